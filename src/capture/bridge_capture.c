@@ -0,0 +1,453 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bridge_capture.h"
+#include "protocol/bridge_checksum.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_S            1000000000ull
+#define RECORD_ALIGNMENT    8
+#define PADDING_FLAG        0x80000000u                         //Committed size of padding at the end of the ring
+
+static const uint8_t m_file_magic[4] = { 'B', 'R', 'C', 'P' };
+
+/**@brief Record in the ring. Committed size is written last, it is 0 until the record is published. */
+typedef struct
+{
+    uint32_t committed_size;
+    uint16_t data_len;
+    uint16_t link_id;
+    uint8_t flags;
+    uint8_t options;
+    uint64_t time_ns;
+} ring_record_t;
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static uint64_t time_ns_get(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    
+    return ((uint64_t)now.tv_sec * NS_PER_S) + (uint64_t)now.tv_nsec;
+}
+
+static void le_put(uint8_t * out,
+                   uint64_t value,
+                   uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t le_get(const uint8_t * in,
+                       uint32_t size)
+{
+    uint64_t value = 0;
+    
+    for (uint32_t i = 0; i < size; i++)
+    {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    
+    return value;
+}
+
+//Reserves room by compare-and-swap, so writers of any number of threads never wait for each other.
+//Record which doesn't fit before the end of the ring starts at its beginning, the rest is padding.
+static void record_put(bridge_capture_t * capture,
+                       const bridge_capture_tap_t * tap,
+                       uint8_t options,
+                       const bridge_write_chunk_t * chunks,
+                       uint8_t chunks_count,
+                       uint16_t data_len)
+{
+    uint64_t time_ns = time_ns_get(CLOCK_MONOTONIC) - capture->start_ns;
+    uint32_t size = (sizeof(ring_record_t) + data_len + (RECORD_ALIGNMENT - 1)) & ~(uint32_t)(RECORD_ALIGNMENT - 1);
+    uint64_t head = __atomic_load_n(&capture->head, __ATOMIC_RELAXED);
+    uint32_t offset;
+    uint32_t padding;
+    
+    do
+    {
+        offset = (uint32_t)(head & (capture->ring_size - 1));
+        padding = ((offset + size) > capture->ring_size) ? (capture->ring_size - offset) : 0;
+        
+        uint64_t tail = __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE);
+        if ((head + padding + size - tail) > capture->ring_size)
+        {
+            __atomic_fetch_add(&capture->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (__atomic_compare_exchange_n(&capture->head, &head, head + padding + size, true,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) == false);
+    
+    if (padding > 0)
+    {
+        __atomic_store_n((uint32_t*)&capture->ring[offset], padding | PADDING_FLAG, __ATOMIC_RELEASE);
+        offset = 0;
+    }
+    
+    ring_record_t * record = (ring_record_t*)&capture->ring[offset];
+    record->data_len = data_len;
+    record->link_id = tap->link_id;
+    record->flags = tap->flags;
+    record->options = options;
+    record->time_ns = time_ns;
+    
+    uint8_t * data = &capture->ring[offset + sizeof(ring_record_t)];
+    for (uint8_t i = 0; i < chunks_count; i++)
+    {
+        memcpy(data, chunks[i].data, chunks[i].data_len);
+        data += chunks[i].data_len;
+    }
+    
+    __atomic_store_n(&record->committed_size, size, __ATOMIC_RELEASE);
+}
+
+static void capture_callback(void * context,
+                             bridge_link_capture_direction_t direction,
+                             uint32_t options,
+                             const bridge_write_chunk_t * chunks,
+                             uint8_t chunks_count)
+{
+    const bridge_capture_tap_t * tap = (const bridge_capture_tap_t*)context;
+    bridge_capture_tap_t received_tap = *tap;
+    
+    if (direction == BRIDGE_LINK_CAPTURE_SENT)
+    {
+        //Message is never longer than a record
+        uint32_t data_len = 0;
+        for (uint8_t i = 0; i < chunks_count; i++)
+        {
+            data_len += chunks[i].data_len;
+        }
+        
+        record_put(tap->capture, tap, (uint8_t)options, chunks, chunks_count, (uint16_t)data_len);
+        return;
+    }
+    
+    received_tap.flags |= BRIDGE_CAPTURE_FLAG_RECEIVED;
+    
+    for (uint8_t i = 0; i < chunks_count; i++)
+    {
+        for (uint32_t offset = 0; offset < chunks[i].data_len; offset += BRIDGE_CAPTURE_MAX_DATA_SIZE)
+        {
+            uint32_t len = chunks[i].data_len - offset;
+            bridge_write_chunk_t piece =
+            {
+                .data = &chunks[i].data[offset],
+                .data_len = (uint16_t)((len < BRIDGE_CAPTURE_MAX_DATA_SIZE) ? len : BRIDGE_CAPTURE_MAX_DATA_SIZE)
+            };
+            
+            record_put(tap->capture, &received_tap, (uint8_t)options, &piece, 1, piece.data_len);
+        }
+    }
+}
+
+//Writes published records to the file in order, stops at the first record not published yet.
+//Released room is zeroed, so committed size of any future record reads 0 until it is published.
+static uint32_t ring_flush(bridge_capture_t * capture)
+{
+    uint32_t flushed = 0;
+    uint64_t tail = capture->tail;
+    uint64_t head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+    
+    while (tail != head)
+    {
+        uint32_t offset = (uint32_t)(tail & (capture->ring_size - 1));
+        ring_record_t * record = (ring_record_t*)&capture->ring[offset];
+        uint32_t committed_size = __atomic_load_n(&record->committed_size, __ATOMIC_ACQUIRE);
+        if (committed_size == 0)
+        {
+            break;
+        }
+        
+        uint32_t size = committed_size & ~PADDING_FLAG;
+        if ((committed_size & PADDING_FLAG) == 0)
+        {
+            uint8_t header[BRIDGE_CAPTURE_RECORD_HEADER_SIZE];
+            le_put(&header[0], record->time_ns, 8);
+            le_put(&header[8], record->link_id, 2);
+            header[10] = record->flags;
+            header[11] = record->options;
+            le_put(&header[12], record->data_len, 2);
+            
+            fwrite(header, 1, sizeof(header), capture->file);
+            fwrite(&capture->ring[offset + sizeof(ring_record_t)], 1, record->data_len, capture->file);
+            flushed++;
+        }
+        
+        memset(record, 0, size);
+        tail += size;
+        __atomic_store_n(&capture->tail, tail, __ATOMIC_RELEASE);
+    }
+    
+    return flushed;
+}
+
+static void * flush_thread(void * arg)
+{
+    bridge_capture_t * capture = (bridge_capture_t*)arg;
+    const struct timespec period = { .tv_sec = 0, .tv_nsec = BRIDGE_CAPTURE_FLUSH_PERIOD_MS * 1000000L };
+    
+    for (;;)
+    {
+        //Stop is checked before the last flush, so records published before stop are never lost
+        bool stop = __atomic_load_n(&capture->stop, __ATOMIC_ACQUIRE);
+        
+        if (ring_flush(capture) == 0)
+        {
+            fflush(capture->file);
+            
+            if (stop)
+            {
+                break;
+            }
+            
+            nanosleep(&period, NULL);
+        }
+    }
+    
+    return NULL;
+}
+
+//Bytes which can't start a message: up to the next sync bytes for synchronized link, otherwise one byte
+static uint16_t stream_skip_size_get(const bridge_capture_stream_t * stream)
+{
+    if ((stream->options & BRIDGE_LINK_OPTION_SYNC) == 0)
+    {
+        return 1;
+    }
+    
+    uint16_t offset = 1;
+    while ((offset < stream->len) &&
+           ((stream->buffer[offset] != BRIDGE_FRAME_SYNC_BYTE_0) ||
+            (((offset + 1) < stream->len) && (stream->buffer[offset + 1] != BRIDGE_FRAME_SYNC_BYTE_1))))
+    {
+        offset++;
+    }
+    
+    return offset;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool bridge_capture_start(bridge_capture_t * capture,
+                          const char * path,
+                          uint32_t ring_size)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->ring_size = (ring_size > 0) ? ring_size : BRIDGE_CAPTURE_DEFAULT_RING_SIZE;
+    
+    if ((capture->ring_size & (capture->ring_size - 1)) != 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    
+    capture->ring = calloc(capture->ring_size, 1);
+    if (capture->ring == NULL)
+    {
+        return false;
+    }
+    
+    capture->file = fopen(path, "wb");
+    if (capture->file == NULL)
+    {
+        free(capture->ring);
+        return false;
+    }
+    
+    uint8_t header[BRIDGE_CAPTURE_FILE_HEADER_SIZE];
+    memcpy(&header[0], m_file_magic, sizeof(m_file_magic));
+    le_put(&header[4], BRIDGE_CAPTURE_FILE_VERSION, 2);
+    le_put(&header[6], 0, 2);
+    le_put(&header[8], time_ns_get(CLOCK_REALTIME), 8);
+    fwrite(header, 1, sizeof(header), capture->file);
+    
+    capture->start_ns = time_ns_get(CLOCK_MONOTONIC);
+    
+    int error = pthread_create(&capture->thread, NULL, flush_thread, capture);
+    if (error != 0)
+    {
+        fclose(capture->file);
+        free(capture->ring);
+        errno = error;
+        return false;
+    }
+    
+    return true;
+}
+
+uint32_t bridge_capture_stop(bridge_capture_t * capture)
+{
+    __atomic_store_n(&capture->stop, true, __ATOMIC_RELEASE);
+    pthread_join(capture->thread, NULL);
+    
+    fclose(capture->file);
+    free(capture->ring);
+    
+    return __atomic_load_n(&capture->dropped, __ATOMIC_RELAXED);
+}
+
+void bridge_capture_link_attach(bridge_capture_t * capture,
+                                bridge_capture_tap_t * tap,
+                                bridge_link_t * link,
+                                uint16_t link_id,
+                                bool server)
+{
+    tap->capture = capture;
+    tap->link_id = link_id;
+    tap->flags = (server) ? BRIDGE_CAPTURE_FLAG_SERVER : 0;
+    
+    link->capture_context = tap;
+    link->capture = (capture != NULL) ? capture_callback : NULL;
+}
+
+bool bridge_capture_reader_open(bridge_capture_reader_t * reader,
+                                const char * path)
+{
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL)
+    {
+        return false;
+    }
+    
+    uint8_t header[BRIDGE_CAPTURE_FILE_HEADER_SIZE];
+    if ((fread(header, 1, sizeof(header), reader->file) != sizeof(header)) ||
+        (memcmp(header, m_file_magic, sizeof(m_file_magic)) != 0) ||
+        (le_get(&header[4], 2) != BRIDGE_CAPTURE_FILE_VERSION))
+    {
+        fclose(reader->file);
+        return false;
+    }
+    
+    reader->start_realtime_ns = le_get(&header[8], 8);
+    
+    return true;
+}
+
+bool bridge_capture_record_read(bridge_capture_reader_t * reader,
+                                bridge_capture_record_t * out_record)
+{
+    uint8_t header[BRIDGE_CAPTURE_RECORD_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header))
+    {
+        return false;
+    }
+    
+    out_record->time_ns = le_get(&header[0], 8);
+    out_record->link_id = (uint16_t)le_get(&header[8], 2);
+    out_record->flags = header[10];
+    out_record->options = header[11];
+    out_record->data_len = (uint16_t)le_get(&header[12], 2);
+    
+    return (out_record->data_len <= sizeof(out_record->data)) &&
+           (fread(out_record->data, 1, out_record->data_len, reader->file) == out_record->data_len);
+}
+
+void bridge_capture_reader_close(bridge_capture_reader_t * reader)
+{
+    fclose(reader->file);
+}
+
+void bridge_capture_stream_init(bridge_capture_stream_t * stream,
+                                uint8_t options)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->options = options;
+}
+
+uint16_t bridge_capture_stream_append(bridge_capture_stream_t * stream,
+                                      const uint8_t * data,
+                                      uint16_t data_len)
+{
+    //Bytes of the message taken out last time are dropped first
+    stream->len -= stream->consumed;
+    memmove(&stream->buffer[0], &stream->buffer[stream->consumed], stream->len);
+    stream->consumed = 0;
+    
+    uint16_t room = (uint16_t)(sizeof(stream->buffer) - stream->len);
+    uint16_t len = (data_len < room) ? data_len : room;
+    
+    memcpy(&stream->buffer[stream->len], data, len);
+    stream->len += len;
+    
+    return len;
+}
+
+bridge_capture_stream_result_t bridge_capture_stream_message_get(bridge_capture_stream_t * stream,
+                                                                 bridge_capture_message_t * out_message)
+{
+    stream->len -= stream->consumed;
+    memmove(&stream->buffer[0], &stream->buffer[stream->consumed], stream->len);
+    stream->consumed = 0;
+    
+    uint16_t sync_size = (stream->options & BRIDGE_LINK_OPTION_SYNC) ? BRIDGE_FRAME_SYNC_SIZE : 0;
+    if (stream->len < sync_size)
+    {
+        return BRIDGE_CAPTURE_STREAM_NEED_MORE;
+    }
+    
+    //Compact header tells its size by its last byte, so all the bytes in the buffer are given
+    uint16_t received = stream->len - sync_size;
+    uint16_t header_size = bridge_frame_header_size_get(stream->options, &stream->buffer[sync_size], received);
+    
+    if (received < header_size)
+    {
+        return BRIDGE_CAPTURE_STREAM_NEED_MORE;
+    }
+    
+    uint32_t type;
+    uint8_t tag;
+    uint16_t size_field;
+    bool header_valid = bridge_frame_header_decode(stream->options, &stream->buffer[sync_size], &type, &tag, &size_field);
+    uint16_t payload_size = size_field & ~BRIDGE_FRAME_COMPRESSED_FLAG;
+    header_valid = header_valid && (payload_size <= BRIDGE_FRAME_MAX_PAYLOAD_SIZE) &&
+                   ((sync_size == 0) ||
+                    ((stream->buffer[0] == BRIDGE_FRAME_SYNC_BYTE_0) && (stream->buffer[1] == BRIDGE_FRAME_SYNC_BYTE_1)));
+    
+    header_size += sync_size;
+    uint16_t size = header_size + payload_size + BRIDGE_FRAME_CHECKSUM_SIZE;
+    if (header_valid && (stream->len < size))
+    {
+        return BRIDGE_CAPTURE_STREAM_NEED_MORE;
+    }
+    
+    if (header_valid)
+    {
+        uint16_t checksum;
+        BRIDGE_SCHEMA_DECODE(uint16_t)(&stream->buffer[header_size + payload_size], &checksum);
+        
+        uint16_t checksum_calculated = bridge_checksum_append(bridge_checksum_init(),
+                                                              &stream->buffer[sync_size],
+                                                              (header_size - sync_size) + payload_size);
+        
+        if (checksum == checksum_calculated)
+        {
+            out_message->data = stream->buffer;
+            out_message->size = size;
+            out_message->type = type;
+            out_message->tag = tag;
+            out_message->compressed = ((size_field & BRIDGE_FRAME_COMPRESSED_FLAG) != 0);
+            out_message->payload = &stream->buffer[header_size];
+            out_message->payload_size = payload_size;
+            
+            stream->consumed = size;
+            return BRIDGE_CAPTURE_STREAM_MESSAGE;
+        }
+    }
+    
+    out_message->data = stream->buffer;
+    out_message->size = stream_skip_size_get(stream);
+    stream->consumed = out_message->size;
+    
+    return BRIDGE_CAPTURE_STREAM_SKIPPED;
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#ifndef _BRIDGE_CAPTURE_H_
+#define _BRIDGE_CAPTURE_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_capture Capture of raw bus traffic (Linux)
+ *
+ * @brief Records every message sent and every byte received by links into a binary file, so corruption
+ * on the wire can be examined without logic analyser. Capture is attached to a link by bridge_capture_link_attach(),
+ * which sets capture callback of the link (see bridge_link_capture_callback_t).
+ *
+ * Callback timestamps data and copies it into a ring buffer shared by all attached links. Ring is lock-free:
+ * every writer reserves room by compare-and-swap and publishes the record by a single release store,
+ * so links of different threads never wait for each other. Background thread flushes published records
+ * to the file. When the ring is full, records are dropped and counted, the link is never slowed down.
+ *
+ * File format, all integers little endian:
+ * - file header: "BRCP" | (uint16_t) version | (uint16_t) reserved | (uint64_t) capture start, ns of CLOCK_REALTIME;
+ * - record: (uint64_t) time, ns since capture start | (uint16_t) link id | (uint8_t) flags (bridge_capture_flag_t) |
+ *   (uint8_t) link options | (uint16_t) data length | (array) data.
+ *
+ * Sent records hold whole messages, received records hold bytes as they were read, bridge_capture_stream_t
+ * splits them into messages again. Files are read by bridge_capture_reader_*() functions, see
+ * bridge_capture_decode and bridge_capture_replay examples.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_frame.h"
+
+#define BRIDGE_CAPTURE_FILE_VERSION         1
+#define BRIDGE_CAPTURE_FILE_HEADER_SIZE     16
+#define BRIDGE_CAPTURE_RECORD_HEADER_SIZE   14
+#define BRIDGE_CAPTURE_MAX_DATA_SIZE        BRIDGE_FRAME_MAX_SIZE   /**< Longer received chunks are split into several records. */
+
+#ifndef BRIDGE_CAPTURE_DEFAULT_RING_SIZE
+#define BRIDGE_CAPTURE_DEFAULT_RING_SIZE    (1UL << 20)             /**< Bytes of ring buffer, power of two. */
+#endif
+
+#ifndef BRIDGE_CAPTURE_FLUSH_PERIOD_MS
+#define BRIDGE_CAPTURE_FLUSH_PERIOD_MS      10                      /**< Background thread checks the ring this often when it is empty. */
+#endif
+
+/**@brief Record flags. */
+typedef enum
+{
+    BRIDGE_CAPTURE_FLAG_RECEIVED = (1 << 0),                    /**< Data is received by the link, otherwise sent. */
+    BRIDGE_CAPTURE_FLAG_SERVER = (1 << 1)                       /**< Link is server side, so it receives requests and sends answers. */
+} bridge_capture_flag_t;
+
+/**@brief Capture instance. Fields are internal, use bridge_capture_*() functions only. */
+typedef struct
+{
+    uint8_t * ring;
+    uint32_t ring_size;
+    uint64_t head;                                              //Bytes reserved by writers, updated by compare-and-swap
+    uint64_t tail;                                              //Bytes released by flush thread
+    uint32_t dropped;                                           //Records lost because the ring was full
+    uint64_t start_ns;                                          //CLOCK_MONOTONIC of capture start
+    FILE * file;
+    pthread_t thread;
+    bool stop;
+} bridge_capture_t;
+
+/**@brief Link attached to capture, capture context of the link. */
+typedef struct
+{
+    //Internal fields
+    bridge_capture_t * capture;
+    uint16_t link_id;
+    uint8_t flags;
+} bridge_capture_tap_t;
+
+/**@brief Capture record read from file. */
+typedef struct
+{
+    uint64_t time_ns;                                           /**< Time since capture start. */
+    uint16_t link_id;                                           /**< Link identifier given to bridge_capture_link_attach(). */
+    uint8_t flags;                                              /**< Combination of bridge_capture_flag_t. */
+    uint8_t options;                                            /**< Options of the link (bridge_link_option_t). */
+    uint16_t data_len;                                          /**< Length of data. */
+    uint8_t data[BRIDGE_CAPTURE_MAX_DATA_SIZE];                 /**< Raw bytes of the bus. */
+} bridge_capture_record_t;
+
+/**@brief Capture file reader. */
+typedef struct
+{
+    FILE * file;
+    uint64_t start_realtime_ns;                                 /**< Wall clock time of capture start. */
+} bridge_capture_reader_t;
+
+/**@brief Message found by bridge_capture_stream_message_get(). Pointers are valid until the next call. */
+typedef struct
+{
+    const uint8_t * data;                                       /**< Whole message as on the bus. */
+    uint16_t size;                                              /**< Size of the whole message. */
+    uint32_t type;                                              /**< Request or answer type. */
+    uint8_t tag;                                                /**< Tag, 0 if link is not tagged. */
+    bool compressed;                                            /**< Payload is compressed. */
+    const uint8_t * payload;                                    /**< Payload as sent. */
+    uint16_t payload_size;                                      /**< Size of payload as sent. */
+} bridge_capture_message_t;
+
+/**@brief Result of bridge_capture_stream_message_get(). */
+typedef enum
+{
+    BRIDGE_CAPTURE_STREAM_MESSAGE,                              /**< Message found. */
+    BRIDGE_CAPTURE_STREAM_SKIPPED,                              /**< Bytes which don't start a valid message skipped. */
+    BRIDGE_CAPTURE_STREAM_NEED_MORE                             /**< More bytes are needed. */
+} bridge_capture_stream_result_t;
+
+/**@brief Splits bytes of one direction of one link into messages. */
+typedef struct
+{
+    //Internal fields
+    uint8_t options;
+    uint16_t len;
+    uint16_t consumed;                                          //Bytes of the last message or skipped bytes, dropped by the next call
+    uint8_t buffer[BRIDGE_FRAME_MAX_SIZE * 2];
+} bridge_capture_stream_t;
+
+/**@brief Start capture: create the file and start background thread.
+ *
+ * @param[out] capture   Capture instance.
+ * @param[in]  path      Path of the file to create.
+ * @param[in]  ring_size Size of ring buffer in bytes, power of two. 0 means BRIDGE_CAPTURE_DEFAULT_RING_SIZE.
+ *
+ * @retval true  Capture started.
+ * @retval false File, ring or thread can't be created, errno holds the reason.
+ */
+bool bridge_capture_start(bridge_capture_t * capture,
+                          const char * path,
+                          uint32_t ring_size);
+
+/**@brief Stop capture: flush all records and close the file. Links should be detached
+ *        (or not used any more) before.
+ *
+ * @param[in] capture Capture instance.
+ *
+ * @return Number of records dropped because the ring was full.
+ */
+uint32_t bridge_capture_stop(bridge_capture_t * capture);
+
+/**@brief Attach link to capture. Capture callback of the link is replaced, NULL detaches the link again.
+ *
+ * @param[in]  capture Capture instance.
+ * @param[out] tap     Tap of the link, should live as long as the link is attached.
+ * @param[in]  link    Link context.
+ * @param[in]  link_id Identifier of the link in the file.
+ * @param[in]  server  Link is server side.
+ */
+void bridge_capture_link_attach(bridge_capture_t * capture,
+                                bridge_capture_tap_t * tap,
+                                bridge_link_t * link,
+                                uint16_t link_id,
+                                bool server);
+
+/**@brief Open capture file.
+ *
+ * @param[out] reader Reader instance.
+ * @param[in]  path   Path of capture file.
+ *
+ * @retval true  File opened.
+ * @retval false File can't be opened or it is not a capture file.
+ */
+bool bridge_capture_reader_open(bridge_capture_reader_t * reader,
+                                const char * path);
+
+/**@brief Read the next record.
+ *
+ * @param[in]  reader     Reader instance.
+ * @param[out] out_record Pointer to store record.
+ *
+ * @retval true  Record read.
+ * @retval false End of file or truncated record.
+ */
+bool bridge_capture_record_read(bridge_capture_reader_t * reader,
+                                bridge_capture_record_t * out_record);
+
+/**@brief Close capture file.
+ *
+ * @param[in] reader Reader instance.
+ */
+void bridge_capture_reader_close(bridge_capture_reader_t * reader);
+
+/**@brief Initialize stream.
+ *
+ * @param[out] stream  Stream instance.
+ * @param[in]  options Options of the link.
+ */
+void bridge_capture_stream_init(bridge_capture_stream_t * stream,
+                                uint8_t options);
+
+/**@brief Append bytes to stream. Messages should be taken out by bridge_capture_stream_message_get()
+ *        until it returns NEED_MORE, otherwise not all bytes may fit.
+ *
+ * @param[in] stream   Stream instance.
+ * @param[in] data     Bytes read from bus.
+ * @param[in] data_len Number of bytes.
+ *
+ * @return Number of bytes appended.
+ */
+uint16_t bridge_capture_stream_append(bridge_capture_stream_t * stream,
+                                      const uint8_t * data,
+                                      uint16_t data_len);
+
+/**@brief Take the next message out of stream. Message is valid if its checksum matches, otherwise
+ *        bytes are skipped up to the next possible start of message (the next sync bytes for synchronized link).
+ *
+ * @param[in]  stream      Stream instance.
+ * @param[out] out_message Pointer to store message, filled for MESSAGE result. Data of SKIPPED bytes is stored too.
+ *
+ * @return Result, see bridge_capture_stream_result_t.
+ */
+bridge_capture_stream_result_t bridge_capture_stream_message_get(bridge_capture_stream_t * stream,
+                                                                 bridge_capture_message_t * out_message);
+
+#endif
+
+/** @} */
\ No newline at end of file
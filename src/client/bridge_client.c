@@ -0,0 +1,766 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bridge_client.h"
+#include "protocol/bridge_frame.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static uint64_t time_ms_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * 1000) + ((uint64_t)now.tv_nsec / 1000000);
+}
+
+//Non-blocking descriptor may be full for a moment, request is still expected to leave in time
+static bool fd_writable_wait(int fd,
+                             uint32_t timeout_ms)
+{
+    struct pollfd poll_fd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+    
+    int result;
+    do
+    {
+        result = poll(&poll_fd, 1, (int)timeout_ms);
+    } while ((result < 0) && (errno == EINTR));
+    
+    return (result > 0) && ((poll_fd.revents & POLLOUT) != 0);
+}
+
+//Answers are never read by blocking calls, parser gets all received data
+static bridge_callback_result_t link_read(void * user,
+                                          uint8_t * data,
+                                          uint16_t max_len,
+                                          uint16_t * out_len,
+                                          uint32_t timeout_ms)
+{
+    (void)user;
+    (void)data;
+    (void)max_len;
+    (void)out_len;
+    (void)timeout_ms;
+    
+    return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+}
+
+static bridge_callback_result_t link_write_vector(void * user,
+                                                  const bridge_write_chunk_t * chunks,
+                                                  uint8_t chunks_count)
+{
+    bridge_client_link_t * link = (bridge_client_link_t*)user;
+    
+    struct iovec iov[4];
+    uint32_t iov_count = 0;
+    for (uint8_t i = 0; (i < chunks_count) && (iov_count < (sizeof(iov) / sizeof(iov[0]))); i++)
+    {
+        iov[iov_count].iov_base = (void*)chunks[i].data;
+        iov[iov_count].iov_len = chunks[i].data_len;
+        iov_count++;
+    }
+    
+    uint32_t first = 0;
+    while (first < iov_count)
+    {
+        ssize_t written = writev(link->fd, &iov[first], (int)(iov_count - first));
+        
+        if (written < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                if (fd_writable_wait(link->fd, link->link.between_bytes_timeout_ms) == false)
+                {
+                    return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+                }
+                continue;
+            }
+            
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+        }
+        
+        //Partial write, skip what is already sent
+        while ((first < iov_count) && ((size_t)written >= iov[first].iov_len))
+        {
+            written -= iov[first].iov_len;
+            first++;
+        }
+        
+        if (first < iov_count)
+        {
+            iov[first].iov_base = (uint8_t*)iov[first].iov_base + written;
+            iov[first].iov_len -= written;
+        }
+    }
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t link_write(void * user,
+                                           const uint8_t * data,
+                                           uint16_t data_len)
+{
+    bridge_write_chunk_t chunk = { .data = data, .data_len = data_len };
+    
+    return link_write_vector(user, &chunk, 1);
+}
+
+//Timer ticks only while somebody needs it, idle client doesn't wake up
+static void timer_arm(bridge_client_t * client,
+                      bool arm)
+{
+    if (client->timer_armed == arm)
+    {
+        return;
+    }
+    
+    struct itimerspec period;
+    memset(&period, 0, sizeof(period));
+    if (arm)
+    {
+        period.it_value.tv_nsec = BRIDGE_CLIENT_IDLE_CHECK_PERIOD_MS * 1000000L;
+        period.it_interval = period.it_value;
+    }
+    
+    timerfd_settime(client->timer_fd, 0, &period, NULL);
+    client->timer_armed = arm;
+}
+
+//Call is not touched after its handler is called, the handler may release it
+static void call_complete(bridge_client_t * client,
+                          bridge_client_call_t * call,
+                          bridge_protocol_result_t result)
+{
+    call->result = result;
+    call->link = NULL;
+    call->next = NULL;
+    client->calls_completed++;
+    
+    if (call->handler != NULL)
+    {
+        call->handler(call, call->context);
+        return;
+    }
+    
+    if (client->completed_tail != NULL)
+    {
+        client->completed_tail->next = call;
+    }
+    else
+    {
+        client->completed_head = call;
+    }
+    client->completed_tail = call;
+}
+
+//Sent call joins calls waiting for answers. BUSY means the window of the link is full
+static bridge_protocol_result_t call_send(bridge_client_link_t * link,
+                                          bridge_client_call_t * call)
+{
+    bridge_protocol_result_t protocol_result = bridge_link_request_send(&link->link, &call->request, &call->tag);
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return protocol_result;
+    }
+    
+    call->next = NULL;
+    if (link->sent_tail != NULL)
+    {
+        link->sent_tail->next = call;
+    }
+    else
+    {
+        link->sent_head = call;
+    }
+    link->sent_tail = call;
+    link->last_data_ms = time_ms_get();
+    
+    //Answer timeout is taken from the link, it follows round trip time if adaptive
+    bridge_parser_timeouts_set(&link->parser,
+                               link->link.between_bytes_timeout_ms,
+                               bridge_link_answer_timeout_get(&link->link),
+                               link->link.recover_timeout_ms);
+    bridge_parser_answer_expect(&link->parser, call->tag, call->request.type);
+    timer_arm(link->client, true);
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
+
+//Queued calls are sent while the window is not full and the link is recovered. Calls which can't be sent are completed at once
+static void link_next_send(bridge_client_link_t * link)
+{
+    //Link may be removed by completion handler
+    while ((link->client != NULL) && (link->recovering == false) && (link->queue_head != NULL))
+    {
+        bridge_client_call_t * call = link->queue_head;
+        link->queue_head = call->next;
+        if (link->queue_head == NULL)
+        {
+            link->queue_tail = NULL;
+        }
+        
+        bridge_protocol_result_t protocol_result = call_send(link, call);
+        if (protocol_result == BRIDGE_PROTOCOL_RESULT_BUSY)
+        {
+            //Call waits at the head of the queue until an answer frees the window
+            call->next = link->queue_head;
+            link->queue_head = call;
+            if (link->queue_tail == NULL)
+            {
+                link->queue_tail = call;
+            }
+            break;
+        }
+        
+        if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            call_complete(link->client, call, protocol_result);
+        }
+    }
+}
+
+//Answered call is the oldest one, or on tagged link the one with the tag of the answer
+static bridge_client_call_t * link_sent_take(bridge_client_link_t * link,
+                                             uint8_t tag)
+{
+    bridge_client_call_t * prev = NULL;
+    bridge_client_call_t * call = link->sent_head;
+    
+    if (link->link.options & BRIDGE_LINK_OPTION_TAGGED)
+    {
+        while ((call != NULL) && (call->tag != tag))
+        {
+            prev = call;
+            call = call->next;
+        }
+    }
+    
+    if (call == NULL)
+    {
+        return NULL;
+    }
+    
+    if (prev != NULL)
+    {
+        prev->next = call->next;
+    }
+    else
+    {
+        link->sent_head = call->next;
+    }
+    
+    if (link->sent_tail == call)
+    {
+        link->sent_tail = prev;
+    }
+    
+    return call;
+}
+
+//Answered call gets the result, the link learns round trip time and agreed features from it
+static void link_answer_complete(bridge_client_link_t * link,
+                                 uint8_t tag,
+                                 bridge_protocol_result_t result,
+                                 const bridge_answer_t * answer)
+{
+    bridge_client_call_t * call = link_sent_take(link, tag);
+    
+    if (call == NULL)
+    {
+        bridge_link_answer_received(&link->link, tag, result, NULL);
+        return;
+    }
+    
+    call->answer = *answer;
+    
+    bridge_link_answer_received(&link->link, tag, result, &call->answer);
+    call_complete(link->client, call, result);
+}
+
+//No valid answer came, so all calls in flight are lost. They are taken off the link first, handlers may submit new calls
+static void link_sent_fail(bridge_client_link_t * link,
+                           bridge_protocol_result_t result)
+{
+    bridge_client_call_t * call = link->sent_head;
+    link->sent_head = NULL;
+    link->sent_tail = NULL;
+    
+    bridge_link_answer_received(&link->link, 0, result, NULL);
+    
+    while (call != NULL)
+    {
+        bridge_client_call_t * next = call->next;
+        call_complete(link->client, call, result);
+        call = next;
+    }
+}
+
+static void parser_event_handler(void * context,
+                                 const bridge_parser_event_t * event)
+{
+    bridge_client_link_t * link = (bridge_client_link_t*)context;
+    
+    //Link may be removed by completion handler while the rest of received data is parsed
+    if (link->client == NULL)
+    {
+        return;
+    }
+    
+    switch (event->type)
+    {
+        case BRIDGE_PARSER_EVENT_ANSWER:
+        {
+            link->link.stats.frames_received++;
+            link_answer_complete(link, event->tag, event->result, event->answer);
+            link_next_send(link);
+            break;
+        }
+        
+        case BRIDGE_PARSER_EVENT_TIMEOUT:
+        {
+            link_sent_fail(link, BRIDGE_PROTOCOL_RESULT_TIMEOUT);
+            link_next_send(link);
+            break;
+        }
+        
+        //Parser waits for silence now, the timer is needed to tell it about
+        case BRIDGE_PARSER_EVENT_CORRUPTED:
+        {
+            link->recovering = true;
+            timer_arm(link->client, true);
+            link_sent_fail(link, BRIDGE_PROTOCOL_RESULT_CORRUPTED);
+            break;
+        }
+        
+        case BRIDGE_PARSER_EVENT_RECOVERED:
+        {
+            link->recovering = false;
+            link_next_send(link);
+            break;
+        }
+        
+        case BRIDGE_PARSER_EVENT_SKIPPED:
+        {
+            bridge_link_data_skipped(&link->link);
+            break;
+        }
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+static void link_close(bridge_client_link_t * link)
+{
+    bridge_client_t * client = link->client;
+    
+    bridge_client_link_remove(link);
+    
+    if (client->closed_handler != NULL)
+    {
+        client->closed_handler(link, client->closed_context);
+    }
+}
+
+//Level triggered epoll reports the descriptor again if more data is left, so links are served fairly
+static void link_data_process(bridge_client_link_t * link,
+                              uint64_t now_ms)
+{
+    uint8_t buffer[BRIDGE_CLIENT_READ_BUFFER_SIZE];
+    
+    ssize_t received = read(link->fd, buffer, sizeof(buffer));
+    
+    if (received > 0)
+    {
+        link->last_data_ms = now_ms;
+        link->link.stats.bytes_received += (uint32_t)received;
+        
+        //Parser reads the bus instead of the link, so the link capture is fed here
+        if (link->link.capture != NULL)
+        {
+            bridge_write_chunk_t chunk = { .data = buffer, .data_len = (uint16_t)received };
+            link->link.capture(link->link.capture_context, BRIDGE_LINK_CAPTURE_RECEIVED, link->link.options, &chunk, 1);
+        }
+        
+        //Message format is negotiated on the link, so its current options go to the parser
+        bridge_parser_options_set(&link->parser, link->link.options);
+        bridge_parser_feed(&link->parser, buffer, (size_t)received);
+        return;
+    }
+    
+    if ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    {
+        return;
+    }
+    
+    if (received < 0)
+    {
+        link->link.stats.io_errors++;
+    }
+    
+    link_close(link);
+}
+
+//Parser knows nothing about time, so every link is told how long it has been silent.
+//The timer is stopped when no link waits for an answer or recovers.
+static void links_idle_process(bridge_client_t * client,
+                               uint64_t now_ms)
+{
+    if ((now_ms - client->idle_checked_ms) < BRIDGE_CLIENT_IDLE_CHECK_PERIOD_MS)
+    {
+        return;
+    }
+    
+    client->idle_checked_ms = now_ms;
+    bool busy = false;
+    
+    bridge_client_link_t * link = client->links;
+    while (link != NULL)
+    {
+        //Link may be removed by completion handler
+        bridge_client_link_t * next = link->next;
+        
+        //Timeouts of the link may be changed at any time, e.g. by bridge_link_baud_set()
+        bridge_parser_timeouts_set(&link->parser,
+                                   link->link.between_bytes_timeout_ms,
+                                   bridge_link_answer_timeout_get(&link->link),
+                                   link->link.recover_timeout_ms);
+        //Requests sent by completion handlers of this process call are younger than now_ms
+        uint32_t idle_ms = (now_ms > link->last_data_ms) ? (uint32_t)(now_ms - link->last_data_ms) : 0;
+        bridge_parser_idle(&link->parser, idle_ms);
+        
+        busy = busy || ((link->client == client) && ((link->sent_head != NULL) || link->recovering));
+        link = next;
+    }
+    
+    timer_arm(client, busy);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool bridge_client_init(bridge_client_t * client,
+                        bridge_client_link_closed_handler_t closed_handler,
+                        void * context)
+{
+    memset(client, 0, sizeof(*client));
+    
+    client->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (client->epoll_fd < 0)
+    {
+        return false;
+    }
+    
+    //Timer events carry no link
+    client->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    
+    if ((client->timer_fd < 0) || (epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, client->timer_fd, &event) < 0))
+    {
+        if (client->timer_fd >= 0)
+        {
+            close(client->timer_fd);
+        }
+        close(client->epoll_fd);
+        return false;
+    }
+    
+    client->closed_handler = closed_handler;
+    client->closed_context = context;
+    client->idle_checked_ms = time_ms_get();
+    
+    return true;
+}
+
+void bridge_client_deinit(bridge_client_t * client)
+{
+    while (client->links != NULL)
+    {
+        bridge_client_link_remove(client->links);
+    }
+    
+    close(client->timer_fd);
+    close(client->epoll_fd);
+    client->timer_fd = -1;
+    client->epoll_fd = -1;
+}
+
+int bridge_client_fd_get(const bridge_client_t * client)
+{
+    return client->epoll_fd;
+}
+
+bool bridge_client_link_add(bridge_client_t * client,
+                            bridge_client_link_t * link,
+                            int fd,
+                            uint32_t options)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        return false;
+    }
+    
+    bridge_link_init(&link->link, link_read, link_write, link);
+    link->link.write_vector = link_write_vector;
+    link->link.options = options;
+    
+    bridge_parser_init(&link->parser, BRIDGE_PARSER_MODE_ANSWER, parser_event_handler, link);
+    link->recovering = true;
+    if (options & BRIDGE_LINK_OPTION_SYNC)
+    {
+        bridge_parser_sync_enable(&link->parser);
+        link->recovering = false;
+    }
+    
+    link->fd = fd;
+    link->sent_head = NULL;
+    link->sent_tail = NULL;
+    link->queue_head = NULL;
+    link->queue_tail = NULL;
+    link->last_data_ms = time_ms_get();
+    
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = link;
+    
+    if (epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        return false;
+    }
+    
+    link->client = client;
+    link->prev = NULL;
+    link->next = client->links;
+    if (client->links != NULL)
+    {
+        client->links->prev = link;
+    }
+    client->links = link;
+    client->links_count++;
+    
+    timer_arm(client, link->recovering || client->timer_armed);
+    
+    return true;
+}
+
+void bridge_client_link_remove(bridge_client_link_t * link)
+{
+    bridge_client_t * client = link->client;
+    
+    if (client == NULL)
+    {
+        return;
+    }
+    
+    epoll_ctl(client->epoll_fd, EPOLL_CTL_DEL, link->fd, NULL);
+    
+    if (link->prev != NULL)
+    {
+        link->prev->next = link->next;
+    }
+    else
+    {
+        client->links = link->next;
+    }
+    
+    if (link->next != NULL)
+    {
+        link->next->prev = link->prev;
+    }
+    
+    client->links_count--;
+    link->client = NULL;
+    link->prev = NULL;
+    link->next = NULL;
+    
+    //Calls are taken off the link first, handlers may submit new calls or remove other links
+    bridge_client_call_t * call = link->sent_head;
+    if (call != NULL)
+    {
+        link->sent_tail->next = link->queue_head;
+    }
+    else
+    {
+        call = link->queue_head;
+    }
+    
+    link->sent_head = NULL;
+    link->sent_tail = NULL;
+    link->queue_head = NULL;
+    link->queue_tail = NULL;
+    link->link.in_flight_count = 0;
+    
+    while (call != NULL)
+    {
+        bridge_client_call_t * next = call->next;
+        call_complete(client, call, BRIDGE_PROTOCOL_RESULT_IO_ERROR);
+        call = next;
+    }
+}
+
+bridge_protocol_result_t bridge_client_call_submit(bridge_client_link_t * link,
+                                                   bridge_client_call_t * call)
+{
+    if ((link->client == NULL) || (call->link != NULL))
+    {
+        return BRIDGE_PROTOCOL_RESULT_BUSY;
+    }
+    
+    if (bridge_frame_request_payload_size_get(&call->request) == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+    }
+    
+    call->next = NULL;
+    
+    //Call which doesn't fit into the window is queued
+    if ((link->recovering == false) && (link->queue_head == NULL))
+    {
+        bridge_protocol_result_t protocol_result = call_send(link, call);
+        if (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            call->link = link;
+        }
+        
+        if (protocol_result != BRIDGE_PROTOCOL_RESULT_BUSY)
+        {
+            return protocol_result;
+        }
+    }
+    
+    call->link = link;
+    if (link->queue_tail != NULL)
+    {
+        link->queue_tail->next = call;
+    }
+    else
+    {
+        link->queue_head = call;
+    }
+    link->queue_tail = call;
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
+
+bool bridge_client_call_cancel(bridge_client_call_t * call)
+{
+    bridge_client_link_t * link = call->link;
+    
+    if (link == NULL)
+    {
+        return false;
+    }
+    
+    bridge_client_call_t * prev = NULL;
+    bridge_client_call_t * item = link->queue_head;
+    while ((item != NULL) && (item != call))
+    {
+        prev = item;
+        item = item->next;
+    }
+    
+    if (item == NULL)
+    {
+        return false;
+    }
+    
+    if (prev != NULL)
+    {
+        prev->next = call->next;
+    }
+    else
+    {
+        link->queue_head = call->next;
+    }
+    
+    if (link->queue_tail == call)
+    {
+        link->queue_tail = prev;
+    }
+    
+    call->link = NULL;
+    call->next = NULL;
+    
+    return true;
+}
+
+bridge_client_call_t * bridge_client_completed_get(bridge_client_t * client)
+{
+    bridge_client_call_t * call = client->completed_head;
+    
+    if (call != NULL)
+    {
+        client->completed_head = call->next;
+        if (client->completed_head == NULL)
+        {
+            client->completed_tail = NULL;
+        }
+        call->next = NULL;
+    }
+    
+    return call;
+}
+
+int32_t bridge_client_process(bridge_client_t * client,
+                              int32_t timeout_ms)
+{
+    struct epoll_event events[BRIDGE_CLIENT_MAX_EVENTS];
+    
+    int events_count = epoll_wait(client->epoll_fd, events, BRIDGE_CLIENT_MAX_EVENTS, timeout_ms);
+    if (events_count < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    
+    client->calls_completed = 0;
+    uint64_t now_ms = time_ms_get();
+    
+    for (int i = 0; i < events_count; i++)
+    {
+        bridge_client_link_t * link = (bridge_client_link_t*)events[i].data.ptr;
+        
+        if (link == NULL)
+        {
+            uint64_t expirations;
+            ssize_t result = read(client->timer_fd, &expirations, sizeof(expirations));
+            (void)result;
+            continue;
+        }
+        
+        //Link may be removed by handler of the previous event
+        if (link->client != client)
+        {
+            continue;
+        }
+        
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            link_data_process(link, now_ms);
+        }
+    }
+    
+    links_idle_process(client, now_ms);
+    
+    return (int32_t)client->calls_completed;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#ifndef _BRIDGE_CLIENT_H_
+#define _BRIDGE_CLIENT_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_client Asynchronous multi-link client runtime (Linux)
+ *
+ * @brief Single threaded client which makes requests on any number of links (ttys, sockets, pipes)
+ * without blocking. Counterpart of bridge_server.h: no thread waits for an answer, so thousands of requests
+ * may be in progress across links at the same time.
+ *
+ * Application fills bridge_client_call_t and submits it by bridge_client_call_submit(), the call itself
+ * is the handle of the request. Every link sends its calls in submit order, up to the window of the link
+ * (link->link.window, limited by MATCH_CAPABILITIES) back-to-back, answers are received by the link's
+ * non-blocking parser (see bridge_parser.h). On tagged links (BRIDGE_LINK_OPTION_TAGGED) answers are matched
+ * to calls by tag, otherwise they come in order of calls. Completed call gets its result and answer
+ * and is passed to its completion handler, or, if the call has none, queued for bridge_client_completed_get().
+ * Handlers may submit new calls, also to the same link.
+ *
+ * Completions happen inside bridge_client_process(). Application either calls it in a loop, or polls
+ * the descriptor returned by bridge_client_fd_get() together with its own ones and calls
+ * bridge_client_process() with zero timeout when it is readable. The descriptor becomes readable
+ * on received data and on timer ticks needed for timeouts, so no call stays uncompleted.
+ *
+ * Timeouts of link->link are applied to its parser, so they may be set per link after bridge_client_link_add().
+ * Adaptive answer timeout (see bridge_link_adaptive_timeout_enable()) works the same as with blocking calls.
+ * Requests are held back while the link recovers after corrupted messages, recovery is done by the parser.
+ * Timeout or corrupted answer fails all calls in flight on the link. Calls are made as submitted only,
+ * so if MATCH_PROTOCOL_VERSION agreed BRIDGE_PROTOCOL_FEATURE_CAPABILITIES, application submits MATCH_CAPABILITIES next.
+ *
+ * Client is not thread safe, all functions should be called from the thread which calls bridge_client_process().
+ * C++20 coroutine wrapper is in bridge_client.hpp.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_parser.h"
+
+#define BRIDGE_CLIENT_MAX_EVENTS            64
+#define BRIDGE_CLIENT_READ_BUFFER_SIZE      512
+#define BRIDGE_CLIENT_IDLE_CHECK_PERIOD_MS  10
+
+typedef struct bridge_client_s bridge_client_t;
+typedef struct bridge_client_link_s bridge_client_link_t;
+typedef struct bridge_client_call_s bridge_client_call_t;
+
+/**@brief Call completion handler.
+ *
+ * @param[in] call    Completed call, it may be submitted again or released by the handler.
+ * @param[in] context Context of the call.
+ */
+typedef void (*bridge_client_completion_handler_t)(bridge_client_call_t * call,
+                                                   void * context);
+
+/**@brief Link closed handler. Called when the peer has closed the link or I/O error occured,
+ *        link is already removed from the client. File descriptor is not closed by the client.
+ *
+ * @param[in] link    Closed link.
+ * @param[in] context Context passed to bridge_client_init().
+ */
+typedef void (*bridge_client_link_closed_handler_t)(bridge_client_link_t * link,
+                                                    void * context);
+
+/**@brief Client call. Allocated by application and submitted by bridge_client_call_submit(),
+ *        should stay valid until completed or cancelled.
+ */
+struct bridge_client_call_s
+{
+    bridge_request_t request;                                   /**< Request, filled by application before submit. */
+    bridge_client_completion_handler_t handler;                 /**< Completion handler. NULL queues completed call
+                                                                     for bridge_client_completed_get(). */
+    void * context;                                             /**< Context passed to handler. */
+    bridge_protocol_result_t result;                            /**< Result of the call, set on completion: as of bridge_link_call(),
+                                                                     or IO_ERROR if the link is removed before the answer. */
+    bridge_answer_t answer;                                     /**< Answer, valid on completion with SUCCESS, REQUEST_REJECTED
+                                                                     or WRONG_REQUEST_ARGUMENTS. */
+    void * user;                                                /**< User data pointer, not used by the client. */
+    
+    //Internal fields
+    bridge_client_link_t * link;                                //Link the call is submitted to, NULL if not in progress
+    uint8_t tag;                                                //Tag of sent request
+    bridge_client_call_t * next;
+};
+
+/**@brief Client link. Allocated by application and registered by bridge_client_link_add(). */
+struct bridge_client_link_s
+{
+    bridge_link_t link;                                         /**< Link context, holds timeouts and statistics. */
+    void * user;                                                /**< User data pointer, not used by the client. */
+    
+    //Internal fields
+    bridge_client_t * client;
+    int fd;
+    bridge_parser_t parser;
+    bool recovering;                                            //Parser waits for silence, requests are held back
+    uint64_t last_data_ms;                                      //Time of the last received data or sent request
+    bridge_client_call_t * sent_head;                           //Calls sent and not answered yet in send order
+    bridge_client_call_t * sent_tail;
+    bridge_client_call_t * queue_head;                          //Calls waiting to be sent in submit order
+    bridge_client_call_t * queue_tail;
+    bridge_client_link_t * prev;
+    bridge_client_link_t * next;
+};
+
+/**@brief Client instance. Fields are internal, use bridge_client_*() functions only. */
+struct bridge_client_s
+{
+    int epoll_fd;
+    int timer_fd;                                               //Ticks while any link waits for answer or recovers
+    bool timer_armed;
+    bridge_client_link_closed_handler_t closed_handler;
+    void * closed_context;
+    uint32_t links_count;
+    bridge_client_link_t * links;                               //List of links for idle checks
+    uint64_t idle_checked_ms;
+    bridge_client_call_t * completed_head;                      //Completed calls without handler in completion order
+    bridge_client_call_t * completed_tail;
+    uint32_t calls_completed;                                   //Calls completed by the current process call
+};
+
+/**@brief Initialize client.
+ *
+ * @param[out] client         Client instance.
+ * @param[in]  closed_handler Link closed handler. May be NULL.
+ * @param[in]  context        Context passed to closed handler.
+ *
+ * @retval true  Client initialized.
+ * @retval false epoll instance or timer can't be created.
+ */
+bool bridge_client_init(bridge_client_t * client,
+                        bridge_client_link_closed_handler_t closed_handler,
+                        void * context);
+
+/**@brief Release client resources. Registered links are removed as by bridge_client_link_remove(),
+ *        their file descriptors are not closed.
+ *
+ * @param[in] client Client instance.
+ */
+void bridge_client_deinit(bridge_client_t * client);
+
+/**@brief Get descriptor which becomes readable when bridge_client_process() has work to do.
+ *
+ * @param[in] client Client instance.
+ *
+ * @return File descriptor, owned by the client.
+ */
+int bridge_client_fd_get(const bridge_client_t * client);
+
+/**@brief Add link to the client. File descriptor is switched to non-blocking mode.
+ *        Link starts in recovery state as protocol requires, calls are sent after it.
+ *
+ * @param[in] client  Client instance.
+ * @param[in] link    Link to add. Should stay valid until removed.
+ * @param[in] fd      File descriptor of the link.
+ * @param[in] options Link options, combination of bridge_link_option_t.
+ *
+ * @retval true  Link added.
+ * @retval false File descriptor can't be registered.
+ */
+bool bridge_client_link_add(bridge_client_t * client,
+                            bridge_client_link_t * link,
+                            int fd,
+                            uint32_t options);
+
+/**@brief Remove link from the client. File descriptor is not closed. Calls submitted to the link are completed
+ *        with IO_ERROR. May be called from completion handlers, also for the link of the call. Link memory should stay
+ *        valid until bridge_client_process() returns.
+ *
+ * @param[in] link Link to remove.
+ */
+void bridge_client_link_remove(bridge_client_link_t * link);
+
+/**@brief Submit call to the link. Request is sent at once if the window of the link is not full and no calls
+ *        wait to be sent, otherwise after the calls submitted before. Handler, context and request of the call should be set before.
+ *
+ * @param[in] link Link to make the call on.
+ * @param[in] call Call to submit. Should stay valid until completed or cancelled.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Call submitted, it will be completed.
+ * @retval BRIDGE_PROTOCOL_RESULT_BUSY                    Call is already in progress or the link is not added.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Request is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                Request can't be sent.
+ */
+bridge_protocol_result_t bridge_client_call_submit(bridge_client_link_t * link,
+                                                   bridge_client_call_t * call);
+
+/**@brief Cancel call which is not sent yet. Cancelled call is not completed.
+ *
+ * @param[in] call Call to cancel.
+ *
+ * @retval true  Call cancelled.
+ * @retval false Call is not in progress or its request is already sent, it will be completed.
+ */
+bool bridge_client_call_cancel(bridge_client_call_t * call);
+
+/**@brief Take the oldest completed call which has no completion handler.
+ *
+ * @param[in] client Client instance.
+ *
+ * @return Completed call or NULL if there is none.
+ */
+bridge_client_call_t * bridge_client_completed_get(bridge_client_t * client);
+
+/**@brief Wait for data on links and process it. Completion handlers are called from this function.
+ *
+ * @param[in] client     Client instance.
+ * @param[in] timeout_ms Maximal time to wait for data, -1 means wait forever.
+ *
+ * @return Number of calls completed or -1 if waiting failed.
+ */
+int32_t bridge_client_process(bridge_client_t * client,
+                              int32_t timeout_ms);
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,209 @@
+#ifndef _BRIDGE_CLIENT_HPP_
+#define _BRIDGE_CLIENT_HPP_
+
+/**
+ * @ingroup bridge_client
+ *
+ * @defgroup bridge_client_coroutine C++20 coroutine wrapper of asynchronous client (Linux)
+ *
+ * @brief Header-only wrapper which lets a coroutine wait for an answer of bridge_client.h call
+ * as for a local function: auto info = co_await link.get_device_info(). Coroutine is suspended while
+ * the request is in progress and resumed from bridge_client_process() by completion of the call,
+ * so any number of coroutines share the thread of the client.
+ *
+ * bridge::link wraps registered bridge_client_link_t. It has a typed call for every entry of
+ * BRIDGE_REQUEST_LIST, which takes request data of the type (if it has any) and gives bridge::result
+ * with answer data of the type (std::monostate if it has none), and generic call() for bridge_request_t.
+ * Call lives in the frame of the awaiting coroutine, nothing is allocated per call.
+ *
+ * bridge::task is a coroutine type for the callers: it starts at once, runs until the first co_await
+ * and destroys itself when finished. Its result is not waited for, e.g. it is passed out through captured state.
+ *
+ * Application runs the client as usual: bridge_client_init(), bridge_client_link_add() and a loop
+ * of bridge_client_process() in the same thread where tasks are started.
+ *
+ * @{
+ */
+
+#include <coroutine>
+#include <exception>
+#include <variant>
+
+extern "C"
+{
+#include "bridge_client.h"
+}
+
+namespace bridge
+{
+
+/**@brief Result of a call with answer data of the request type. */
+template <typename Answer>
+struct result
+{
+    bridge_protocol_result_t status;                            /**< Result of the call as of bridge_link_call(). */
+    bridge_answer_type_t answer_type;                           /**< Type of answer, valid if the answer is received. */
+    Answer answer;                                              /**< Answer data, valid if status is SUCCESS. */
+    
+    /**@brief Call succeeded and answer holds data. */
+    explicit operator bool() const
+    {
+        return status == BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+};
+
+/**@brief Awaitable of one call. Submits the call on suspension of the coroutine and resumes it on completion. */
+template <typename Answer>
+class call_awaiter
+{
+public:
+    using answer_get_t = Answer (*)(const bridge_answer_t & answer);
+    
+    call_awaiter(bridge_client_link_t & link,
+                 const bridge_request_t & request,
+                 answer_get_t answer_get) :
+        m_link(link),
+        m_answer_get(answer_get)
+    {
+        m_call.request = request;
+        m_call.handler = &call_awaiter::completed;
+        m_call.context = this;
+        m_call.link = nullptr;
+        m_call.next = nullptr;
+    }
+    
+    //Submitted call refers to the awaiter, so it never moves
+    call_awaiter(const call_awaiter &) = delete;
+    call_awaiter & operator=(const call_awaiter &) = delete;
+    
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    
+    //Coroutine is not suspended if the call can't be submitted, the result tells why
+    bool await_suspend(std::coroutine_handle<> waiter) noexcept
+    {
+        m_waiter = waiter;
+        m_call.result = bridge_client_call_submit(&m_link, &m_call);
+        
+        return m_call.result == BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+    
+    result<Answer> await_resume() const
+    {
+        result<Answer> call_result{ m_call.result, m_call.answer.type, Answer{} };
+        
+        if (m_call.result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            call_result.answer = m_answer_get(m_call.answer);
+        }
+        
+        return call_result;
+    }
+    
+private:
+    static void completed(bridge_client_call_t * call,
+                          void * context)
+    {
+        (void)call;
+        static_cast<call_awaiter*>(context)->m_waiter.resume();
+    }
+    
+    bridge_client_link_t & m_link;
+    answer_get_t m_answer_get;
+    bridge_client_call_t m_call;
+    std::coroutine_handle<> m_waiter;
+};
+
+//Typed calls, the suffix is the has data flags of BRIDGE_REQUEST_LIST (request, answer)
+#define BRIDGE_CLIENT_ANSWER_TYPE_0(member) std::monostate
+#define BRIDGE_CLIENT_ANSWER_TYPE_1(member) bridge_##member##_answer_t
+#define BRIDGE_CLIENT_ANSWER_GET_0(member)  std::monostate{}
+#define BRIDGE_CLIENT_ANSWER_GET_1(member)  answer.data.member
+#define BRIDGE_CLIENT_REQUEST_PARAM_0(member)
+#define BRIDGE_CLIENT_REQUEST_PARAM_1(member) const bridge_##member##_request_t & data
+#define BRIDGE_CLIENT_REQUEST_SET_0(member)
+#define BRIDGE_CLIENT_REQUEST_SET_1(member) request.data.member = data;
+
+#define BRIDGE_CLIENT_TYPED_CALL(name, member, request_data, answer_data) \
+    call_awaiter<BRIDGE_CLIENT_ANSWER_TYPE_##answer_data(member)> member(BRIDGE_CLIENT_REQUEST_PARAM_##request_data(member)) \
+    { \
+        bridge_request_t request; \
+        request.type = BRIDGE_REQUEST_TYPE_##name; \
+        BRIDGE_CLIENT_REQUEST_SET_##request_data(member) \
+        \
+        return { m_link, request, [](const bridge_answer_t & answer) \
+                 { \
+                     (void)answer; \
+                     return BRIDGE_CLIENT_ANSWER_GET_##answer_data(member); \
+                 } }; \
+    }
+
+/**@brief Link of asynchronous client with awaitable calls. Refers to the link, which should stay registered. */
+class link
+{
+public:
+    explicit link(bridge_client_link_t & client_link) :
+        m_link(client_link)
+    {
+    }
+    
+    /**@brief Call of any type, gives the whole answer. */
+    call_awaiter<bridge_answer_t> call(const bridge_request_t & request)
+    {
+        return { m_link, request, [](const bridge_answer_t & answer) { return answer; } };
+    }
+    
+    /**@brief Typed calls of every request type, generated from BRIDGE_REQUEST_LIST: member([request data]). */
+    BRIDGE_REQUEST_LIST(BRIDGE_CLIENT_TYPED_CALL)
+    
+    /**@brief Wrapped link. */
+    bridge_client_link_t & native()
+    {
+        return m_link;
+    }
+    
+private:
+    bridge_client_link_t & m_link;
+};
+
+#undef BRIDGE_CLIENT_TYPED_CALL
+
+/**@brief Detached coroutine of the client thread. Starts at once and destroys itself when finished. */
+struct task
+{
+    struct promise_type
+    {
+        task get_return_object() noexcept
+        {
+            return {};
+        }
+        
+        std::suspend_never initial_suspend() const noexcept
+        {
+            return {};
+        }
+        
+        std::suspend_never final_suspend() const noexcept
+        {
+            return {};
+        }
+        
+        void return_void() const noexcept
+        {
+        }
+        
+        //Nobody waits for the task, so there is nobody to rethrow to
+        void unhandled_exception() const noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+}
+
+#endif
+
+/** @} */
\ No newline at end of file
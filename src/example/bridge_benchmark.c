@@ -0,0 +1,377 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_benchmark End-to-end throughput and latency benchmark (Linux)
+ *
+ * @brief Measures requests per second, bytes per second and round trip time percentiles of blocking
+ * bridge_link_call() for every request type and several payload sizes.
+ *
+ * Client and server run in separate threads joined by one of the bundled transports: in-process
+ * loopback (bridge_loopback.h) or pty pair (bridge_pty.h), optionally throttled to a baud rate.
+ * Server answers every request the way a device would: MATCH_PROTOCOL_VERSION, GET_DEVICE_INFO,
+ * BATCH of GET_DEVICE_INFO and TRANSFER_CHUNK stored by bridge_transfer.h receiver.
+ *
+ * Usage: bridge_benchmark [loopback|pty [baud [seconds [capture]]]], by default loopback, no throttle, 1 second per case.
+ * Bytes per second count bytes of both directions as written by the links. If capture file is given,
+ * traffic of both links is recorded into it by bridge_capture.h.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_batch.h"
+#include "protocol/bridge_transfer.h"
+#include "transport/bridge_loopback.h"
+#include "transport/bridge_pty.h"
+#include "capture/bridge_capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCHMARK_DEFAULT_SECONDS   1
+#define BENCHMARK_MAX_SAMPLES       (1 << 20)
+
+/**@brief Benchmark case: request type and payload size. */
+typedef struct
+{
+    const char * name;
+    bridge_request_type_t type;
+    uint16_t size;                                              /**< Items of BATCH or bytes of TRANSFER_CHUNK, 0 otherwise. */
+} benchmark_case_t;
+
+/**@brief Server thread state. */
+typedef struct
+{
+    bridge_link_t link;
+    bridge_transfer_receiver_t receiver;
+    uint8_t buffer[BRIDGE_PROTOCOL_CHUNK_MAX_SIZE];             /**< Receiver buffer, every chunk starts a new transfer. */
+} server_t;
+
+static const benchmark_case_t m_cases[] =
+{
+    { "match_protocol_version", BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION, 0 },
+    { "get_device_info",        BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO,        0 },
+    { "batch",                  BRIDGE_REQUEST_TYPE_BATCH,                  1 },
+    { "batch",                  BRIDGE_REQUEST_TYPE_BATCH,                  8 },
+    { "batch",                  BRIDGE_REQUEST_TYPE_BATCH,                  23 },
+    { "transfer_chunk",         BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK,         16 },
+    { "transfer_chunk",         BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK,         64 },
+    { "transfer_chunk",         BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK,         256 },
+};
+
+static uint64_t time_ns_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+static int sample_compare(const void * a,
+                          const void * b)
+{
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    
+    return (left > right) - (left < right);
+}
+
+static double percentile_us_get(const uint64_t * sorted,
+                                uint32_t count,
+                                double percentile)
+{
+    uint32_t index = (uint32_t)((percentile * (double)count) / 100.0);
+    index = (index < count) ? index : (count - 1);
+    
+    return (double)sorted[index] / 1000.0;
+}
+
+static bridge_protocol_result_t server_answer(server_t * server,
+                                              const bridge_request_t * request)
+{
+    device_info_t info =
+    {
+        .firmware_version = 1,
+        .hardware_version = 1
+    };
+    
+    switch (request->type)
+    {
+        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
+        {
+            return bridge_link_match_protocol_version_answer(&server->link);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO:
+        {
+            return bridge_link_get_device_info_answer(&server->link, &info);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_BATCH:
+        {
+            bridge_answer_t answer;
+            bridge_batch_answer_init(&answer);
+            
+            bridge_batch_iterator_t iterator;
+            bridge_request_t item;
+            bridge_batch_request_iterator_init(&iterator, request);
+            while (bridge_batch_request_next(&iterator, &item))
+            {
+                bridge_answer_t item_answer;
+                item_answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+                item_answer.data.get_device_info.info = info;
+                bridge_batch_answer_add(&answer, item.type, &item_answer);
+            }
+            
+            return bridge_link_batch_answer(&server->link, &answer);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK:
+        {
+            bridge_answer_t answer;
+            bridge_transfer_chunk_handle(&server->receiver, request, &answer);
+            
+            return bridge_link_answer_send(&server->link, request->type, &answer);
+        }
+        
+        default:
+        {
+            bridge_answer_t answer = { .type = BRIDGE_ANSWER_TYPE_REQUEST_REJECTED };
+            
+            return bridge_link_answer_send(&server->link, request->type, &answer);
+        }
+    }
+}
+
+//Serves requests until the transport is closed
+static void * server_thread(void * arg)
+{
+    server_t * server = (server_t*)arg;
+    
+    while (true)
+    {
+        bridge_request_t request;
+        bridge_protocol_result_t result = bridge_link_request_read(&server->link, UINT32_MAX, &request);
+        
+        if (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
+        {
+            break;
+        }
+        
+        if (result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            server_answer(server, &request);
+        }
+    }
+    
+    return NULL;
+}
+
+static void case_request_build(const benchmark_case_t * benchmark_case,
+                               uint32_t sequence,
+                               bridge_request_t * out_request)
+{
+    memset(out_request, 0, sizeof(*out_request));
+    out_request->type = benchmark_case->type;
+    
+    switch (benchmark_case->type)
+    {
+        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
+        {
+            out_request->data.match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+            break;
+        }
+        
+        case BRIDGE_REQUEST_TYPE_BATCH:
+        {
+            bridge_request_t item = { .type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO };
+            bridge_batch_request_init(out_request);
+            
+            for (uint16_t i = 0; i < benchmark_case->size; i++)
+            {
+                bridge_batch_request_add(out_request, &item);
+            }
+            break;
+        }
+        
+        case BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK:
+        {
+            //Whole transfer in one chunk, so every request is accepted and completes its transfer
+            bridge_transfer_chunk_request_t * chunk = &out_request->data.transfer_chunk;
+            chunk->total_size = benchmark_case->size;
+            chunk->offset = 0;
+            chunk->transfer_id = (uint16_t)(sequence + 1);
+            chunk->length = benchmark_case->size;
+            memset(chunk->data, (int)sequence, benchmark_case->size);
+            break;
+        }
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+/**@brief Runs one case for a given time and prints its results.
+ *
+ * @param[in] client         Client link.
+ * @param[in] benchmark_case Case to run.
+ * @param[in] seconds        Duration of the case.
+ * @param[in] samples        Buffer for round trip times of BENCHMARK_MAX_SAMPLES entries.
+ *
+ * @retval true  Every call succeeded.
+ * @retval false A call failed.
+ */
+static bool case_run(bridge_link_t * client,
+                     const benchmark_case_t * benchmark_case,
+                     uint32_t seconds,
+                     uint64_t * samples)
+{
+    bridge_link_stats_t stats = client->stats;
+    uint64_t start = time_ns_get();
+    uint64_t end = start + ((uint64_t)seconds * 1000000000ull);
+    uint32_t count = 0;
+    uint64_t now = start;
+    
+    while ((now < end) && (count < BENCHMARK_MAX_SAMPLES))
+    {
+        bridge_request_t request;
+        bridge_answer_t answer;
+        case_request_build(benchmark_case, count, &request);
+        
+        uint64_t sent = time_ns_get();
+        bridge_protocol_result_t result = bridge_link_call(client, &request, &answer);
+        now = time_ns_get();
+        
+        if (result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            printf("%s: call failed with result %d\n", benchmark_case->name, (int)result);
+            return false;
+        }
+        
+        samples[count++] = now - sent;
+    }
+    
+    double wall_s = (double)(now - start) * 1e-9;
+    uint32_t bytes = (client->stats.bytes_sent - stats.bytes_sent) + (client->stats.bytes_received - stats.bytes_received);
+    qsort(samples, count, sizeof(samples[0]), sample_compare);
+    
+    printf("%-22s %5u %10.0f %12.0f %10.2f %10.2f %10.2f\n",
+           benchmark_case->name,
+           benchmark_case->size,
+           (double)count / wall_s,
+           (double)bytes / wall_s,
+           percentile_us_get(samples, count, 50.0),
+           percentile_us_get(samples, count, 99.0),
+           percentile_us_get(samples, count, 99.9));
+    
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    const char * transport = (argc > 1) ? argv[1] : "loopback";
+    uint32_t baud = (argc > 2) ? (uint32_t)atoi(argv[2]) : 0;
+    uint32_t seconds = (argc > 3) ? (uint32_t)atoi(argv[3]) : BENCHMARK_DEFAULT_SECONDS;
+    const char * capture_path = (argc > 4) ? argv[4] : NULL;
+    bool pty_used = (strcmp(transport, "pty") == 0);
+    
+    if ((pty_used == false) && (strcmp(transport, "loopback") != 0))
+    {
+        printf("Usage: %s [loopback|pty [baud [seconds [capture]]]]\n", argv[0]);
+        return 1;
+    }
+    
+    static bridge_loopback_t loopback;
+    static bridge_pty_t pty;
+    static server_t server;
+    static bridge_capture_t capture;
+    bridge_capture_tap_t taps[2];
+    bridge_link_t client;
+    
+    if (pty_used)
+    {
+        if (bridge_pty_init(&pty, baud) == false)
+        {
+            perror("pty");
+            return 1;
+        }
+        
+        bridge_pty_link_init(&pty, 0, &server.link);
+        bridge_pty_link_init(&pty, 1, &client);
+    }
+    else
+    {
+        if (bridge_loopback_init(&loopback) == false)
+        {
+            printf("loopback can't be initialized\n");
+            return 1;
+        }
+        
+        bridge_loopback_link_init(&loopback, 0, &server.link);
+        bridge_loopback_link_init(&loopback, 1, &client);
+    }
+    
+    //Throttled line needs time for the largest message in both directions
+    if (baud > 0)
+    {
+        client.wait_answer_timeout_ms += (uint32_t)((2000ull * 10 * (BRIDGE_PROTOCOL_CHUNK_MAX_SIZE + 32)) / baud);
+    }
+    
+    if (capture_path != NULL)
+    {
+        if (bridge_capture_start(&capture, capture_path, 0) == false)
+        {
+            perror("capture");
+            return 1;
+        }
+        
+        bridge_capture_link_attach(&capture, &taps[0], &server.link, 0, true);
+        bridge_capture_link_attach(&capture, &taps[1], &client, 1, false);
+    }
+    
+    bridge_transfer_receiver_init(&server.receiver, server.buffer, sizeof(server.buffer));
+    
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, &server);
+    
+    uint16_t protocol_version;
+    bool result = (bridge_link_match_protocol_version(&client, &protocol_version) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    
+    printf("transport %s, baud %u (0 - not throttled), %u s per case\n", transport, baud, seconds);
+    printf("%-22s %5s %10s %12s %10s %10s %10s\n", "request", "size", "requests/s", "bytes/s", "p50 us", "p99 us", "p99.9 us");
+    
+    uint64_t * samples = malloc(BENCHMARK_MAX_SAMPLES * sizeof(uint64_t));
+    for (uint32_t i = 0; result && (i < (sizeof(m_cases) / sizeof(m_cases[0]))); i++)
+    {
+        result = case_run(&client, &m_cases[i], seconds, samples);
+    }
+    free(samples);
+    
+    if (pty_used)
+    {
+        bridge_pty_close(&pty);
+        pthread_join(thread, NULL);
+        bridge_pty_deinit(&pty);
+    }
+    else
+    {
+        bridge_loopback_close(&loopback);
+        pthread_join(thread, NULL);
+        bridge_loopback_deinit(&loopback);
+    }
+    
+    if (capture_path != NULL)
+    {
+        printf("capture: %u records dropped\n", bridge_capture_stop(&capture));
+    }
+    
+    return (result) ? 0 : 1;
+}
+
+/** @} */
\ No newline at end of file
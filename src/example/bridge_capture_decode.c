@@ -0,0 +1,401 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_capture_decode Capture file decoder (Linux)
+ *
+ * @brief Prints messages of capture file written by bridge_capture.h, one line per message: time since
+ * capture start, link, side, direction, request or answer type, tag, size and decoded payload fields.
+ * Bytes which don't form a valid message (wrong checksum, impossible size) are reported as corrupted.
+ *
+ * Answer doesn't carry the type of its request, so answers are paired to requests of the same link:
+ * by tag on tagged links, in order otherwise. Payload fields are printed by functions generated from
+ * the schema field lists (bridge_schema.h), so new request types are decoded without changes here.
+ *
+ * Usage: bridge_capture_decode [-x] capture, -x adds hex dump of every message.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "capture/bridge_capture.h"
+#include "protocol/bridge_compress.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define DECODE_MAX_LINKS            16
+#define DECODE_MAX_PENDING          256                         /**< Requests waiting for answer per link, power of two. */
+#define DECODE_ARRAY_PRINT_MAX      8                           /**< Array elements printed, the rest is shown as "...". */
+
+/**@brief Request waiting for its answer. */
+typedef struct
+{
+    uint32_t type;
+    uint64_t time_ns;
+} pending_t;
+
+/**@brief Decoding state of one captured link. */
+typedef struct
+{
+    bool used;
+    uint16_t link_id;
+    bool stream_used[2];
+    bridge_capture_stream_t streams[2];                         /**< Sent and received bytes. */
+    pending_t pending[DECODE_MAX_PENDING];                      /**< Requests in order of sending. */
+    uint32_t pending_head;
+    uint32_t pending_tail;
+    pending_t tagged[256];                                      /**< Requests by tag, type 0 if there is none. */
+} decode_link_t;
+
+static const char * const m_request_names[BRIDGE_REQUEST_TYPE_COUNT] =
+{
+    [BRIDGE_REQUEST_TYPE_UNDEFINED] = "UNDEFINED",
+#define REQUEST_NAME_ENTRY(name, member, request_data, answer_data) [BRIDGE_REQUEST_TYPE_##name] = #name,
+    BRIDGE_REQUEST_LIST(REQUEST_NAME_ENTRY)
+#undef REQUEST_NAME_ENTRY
+};
+
+static const char * const m_answer_names[] =
+{
+    [BRIDGE_ANSWER_TYPE_SUCCESS] = "SUCCESS",
+    [BRIDGE_ANSWER_TYPE_REQUEST_REJECTED] = "REQUEST_REJECTED",
+    [BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS] = "WRONG_REQUEST_ARGUMENTS"
+};
+
+static decode_link_t m_links[DECODE_MAX_LINKS];
+static bool m_hex_dump;
+
+//Printers of integer types, X(type, format, type passed to printf). Inline, so types not used by schema don't warn
+#define DECODE_INTEGER_TYPES_LIST(X) \
+    X(_Bool,    "%u",       unsigned int) \
+    X(uint8_t,  "%u",       unsigned int) \
+    X(int8_t,   "%d",       int) \
+    X(uint16_t, "%u",       unsigned int) \
+    X(int16_t,  "%d",       int) \
+    X(uint32_t, "%" PRIu32, uint32_t) \
+    X(int32_t,  "%" PRId32, int32_t) \
+    X(uint64_t, "%" PRIu64, uint64_t) \
+    X(int64_t,  "%" PRId64, int64_t)
+
+#define PRINT_INTEGER_DEFINE(type, format, printf_type) \
+    static inline void print_##type(const type * value) { printf(format, (printf_type)*value); }
+
+DECODE_INTEGER_TYPES_LIST(PRINT_INTEGER_DEFINE)
+
+//Printers of structures, the extra level expands bool into _Bool before the name is pasted
+#define PRINT_FIELD(type, name)                     PRINT_FIELD_EXPANDED(type, name)
+#define PRINT_FIELD_EXPANDED(type, name) \
+    printf(" %s=", #name); \
+    print_##type(&value->name);
+#define PRINT_ARRAY(type, name, count)              PRINT_ARRAY_EXPANDED(type, name, count)
+#define PRINT_ARRAY_EXPANDED(type, name, count) \
+    printf(" %s=[", #name); \
+    for (uint32_t i = 0; (i < (count)) && (i < DECODE_ARRAY_PRINT_MAX); i++) \
+    { \
+        printf((i > 0) ? " " : ""); \
+        print_##type(&value->name[i]); \
+    } \
+    printf(((count) > DECODE_ARRAY_PRINT_MAX) ? " ...]" : "]");
+
+#define PRINT_STRUCT_DEFINE(type, FIELDS) \
+    static void print_##type(const type * value) \
+    { \
+        printf("{"); \
+        FIELDS(PRINT_FIELD, PRINT_ARRAY) \
+        printf(" }"); \
+    }
+
+BRIDGE_SCHEMA_DATA_TYPES_LIST(PRINT_STRUCT_DEFINE)
+
+//Printers of request and answer data, the suffix is the has data flag of BRIDGE_REQUEST_LIST
+#define PRINT_DATA_DEFINE_0(type, FIELDS)
+#define PRINT_DATA_DEFINE_1(type, FIELDS)           PRINT_STRUCT_DEFINE(type, FIELDS)
+#define PRINT_DATA_ENTRY(name, member, request_data, answer_data) \
+    PRINT_DATA_DEFINE_##request_data(bridge_##member##_request_t, BRIDGE_##name##_REQUEST_FIELDS) \
+    PRINT_DATA_DEFINE_##answer_data(bridge_##member##_answer_t, BRIDGE_##name##_ANSWER_FIELDS)
+
+BRIDGE_REQUEST_LIST(PRINT_DATA_ENTRY)
+
+#define PRINT_DECODE_0(type)
+#define PRINT_DECODE_1(type) \
+    { \
+        type value; \
+        BRIDGE_SCHEMA_DECODE(type)(payload, &value); \
+        printf(" "); \
+        print_##type(&value); \
+    }
+#define PRINT_REQUEST_CASE(name, member, request_data, answer_data) \
+    case BRIDGE_REQUEST_TYPE_##name: \
+    { \
+        PRINT_DECODE_##request_data(bridge_##member##_request_t) \
+        break; \
+    }
+#define PRINT_ANSWER_CASE(name, member, request_data, answer_data) \
+    case BRIDGE_REQUEST_TYPE_##name: \
+    { \
+        PRINT_DECODE_##answer_data(bridge_##member##_answer_t) \
+        break; \
+    }
+
+//Payload is zero padded to the full size of data, variable size payloads are sent shorter
+static void payload_print(uint32_t request_type,
+                          bool answer,
+                          const uint8_t * data,
+                          uint16_t data_len)
+{
+    uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD_SIZE] = { 0 };
+    memcpy(payload, data, data_len);
+    
+    if (answer)
+    {
+        switch (request_type)
+        {
+            BRIDGE_REQUEST_LIST(PRINT_ANSWER_CASE)
+            
+            default:
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        switch (request_type)
+        {
+            BRIDGE_REQUEST_LIST(PRINT_REQUEST_CASE)
+            
+            default:
+            {
+                break;
+            }
+        }
+    }
+}
+
+static void hex_print(const uint8_t * data,
+                      uint16_t data_len)
+{
+    for (uint16_t i = 0; i < data_len; i++)
+    {
+        printf("%s%02x", ((i % 32) == 0) ? "\n    " : " ", data[i]);
+    }
+}
+
+static const char * request_name_get(uint32_t type)
+{
+    return (type < BRIDGE_REQUEST_TYPE_COUNT) ? m_request_names[type] : "unknown";
+}
+
+static const char * answer_name_get(uint32_t type)
+{
+    return (type < (sizeof(m_answer_names) / sizeof(m_answer_names[0]))) ? m_answer_names[type] : "unknown";
+}
+
+static decode_link_t * link_get(uint16_t link_id)
+{
+    for (uint32_t i = 0; i < DECODE_MAX_LINKS; i++)
+    {
+        if (m_links[i].used == false)
+        {
+            m_links[i].used = true;
+            m_links[i].link_id = link_id;
+            return &m_links[i];
+        }
+        
+        if (m_links[i].link_id == link_id)
+        {
+            return &m_links[i];
+        }
+    }
+    
+    return NULL;
+}
+
+static void message_print(decode_link_t * link,
+                          uint8_t flags,
+                          uint8_t options,
+                          uint64_t time_ns,
+                          const bridge_capture_message_t * message)
+{
+    bool received = (flags & BRIDGE_CAPTURE_FLAG_RECEIVED);
+    bool server = (flags & BRIDGE_CAPTURE_FLAG_SERVER);
+    bool tagged = (options & BRIDGE_LINK_OPTION_TAGGED);
+    
+    printf("%12.6f link %u %s %-8s ",
+           (double)time_ns * 1e-9, link->link_id, (server) ? "server" : "client", (received) ? "received" : "sent");
+    
+    //Server receives requests and sends answers, client the other way round
+    if (server == received)
+    {
+        pending_t request = { .type = message->type, .time_ns = time_ns };
+        if (tagged)
+        {
+            link->tagged[message->tag] = request;
+        }
+        else if ((link->pending_tail - link->pending_head) < DECODE_MAX_PENDING)
+        {
+            link->pending[link->pending_tail++ % DECODE_MAX_PENDING] = request;
+        }
+        
+        printf("request %s", request_name_get(message->type));
+        if (tagged)
+        {
+            printf(" tag %u", message->tag);
+        }
+        printf(" size %u", message->size);
+        
+        payload_print(message->type, false, message->payload, message->payload_size);
+    }
+    else
+    {
+        pending_t request = { 0 };
+        if (tagged)
+        {
+            request = link->tagged[message->tag];
+            link->tagged[message->tag].type = BRIDGE_REQUEST_TYPE_UNDEFINED;
+        }
+        else if (link->pending_tail != link->pending_head)
+        {
+            request = link->pending[link->pending_head++ % DECODE_MAX_PENDING];
+        }
+        
+        printf("answer %s to %s", answer_name_get(message->type),
+               (request.type != BRIDGE_REQUEST_TYPE_UNDEFINED) ? request_name_get(request.type) : "request not captured");
+        if (tagged)
+        {
+            printf(" tag %u", message->tag);
+        }
+        printf(" size %u", message->size);
+        if (request.type != BRIDGE_REQUEST_TYPE_UNDEFINED)
+        {
+            printf(" after %.1f us", (double)(time_ns - request.time_ns) * 1e-3);
+        }
+        
+        uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+        uint16_t payload_size = message->payload_size;
+        memcpy(payload, message->payload, payload_size);
+        
+        if (message->compressed)
+        {
+            payload_size = bridge_compress_decode(message->payload, message->payload_size, payload, sizeof(payload));
+            printf(" (compressed %u -> %u)", message->payload_size, payload_size);
+        }
+        
+        if ((message->type == BRIDGE_ANSWER_TYPE_SUCCESS) && (request.type != BRIDGE_REQUEST_TYPE_UNDEFINED))
+        {
+            payload_print(request.type, true, payload, payload_size);
+        }
+    }
+    
+    if (m_hex_dump)
+    {
+        hex_print(message->data, message->size);
+    }
+    printf("\n");
+}
+
+static void corrupted_print(const decode_link_t * link,
+                            const bridge_capture_record_t * record,
+                            uint32_t skipped)
+{
+    printf("%12.6f link %u %s %-8s corrupted %u bytes\n",
+           (double)record->time_ns * 1e-9, link->link_id,
+           (record->flags & BRIDGE_CAPTURE_FLAG_SERVER) ? "server" : "client",
+           (record->flags & BRIDGE_CAPTURE_FLAG_RECEIVED) ? "received" : "sent",
+           skipped);
+}
+
+static void record_decode(const bridge_capture_record_t * record)
+{
+    decode_link_t * link = link_get(record->link_id);
+    if (link == NULL)
+    {
+        return;
+    }
+    
+    uint8_t direction = (record->flags & BRIDGE_CAPTURE_FLAG_RECEIVED) ? 1 : 0;
+    bridge_capture_stream_t * stream = &link->streams[direction];
+    if (link->stream_used[direction] == false)
+    {
+        link->stream_used[direction] = true;
+        bridge_capture_stream_init(stream, record->options);
+    }
+    
+    bridge_capture_stream_append(stream, record->data, record->data_len);
+    
+    bridge_capture_message_t message;
+    bridge_capture_stream_result_t result;
+    uint32_t skipped = 0;
+    
+    while ((result = bridge_capture_stream_message_get(stream, &message)) != BRIDGE_CAPTURE_STREAM_NEED_MORE)
+    {
+        if (result == BRIDGE_CAPTURE_STREAM_SKIPPED)
+        {
+            skipped += message.size;
+            continue;
+        }
+        
+        if (skipped > 0)
+        {
+            corrupted_print(link, record, skipped);
+            skipped = 0;
+        }
+        
+        message_print(link, record->flags, record->options, record->time_ns, &message);
+    }
+    
+    if (skipped > 0)
+    {
+        corrupted_print(link, record, skipped);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    const char * path = NULL;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-x") == 0)
+        {
+            m_hex_dump = true;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    
+    if (path == NULL)
+    {
+        printf("Usage: %s [-x] capture\n", argv[0]);
+        return 1;
+    }
+    
+    static bridge_capture_reader_t reader;
+    static bridge_capture_record_t record;
+    
+    if (bridge_capture_reader_open(&reader, path) == false)
+    {
+        printf("%s is not a capture file\n", path);
+        return 1;
+    }
+    
+    printf("capture started at %" PRIu64 ".%09" PRIu64 " (CLOCK_REALTIME)\n",
+           (uint64_t)(reader.start_realtime_ns / 1000000000ull), (uint64_t)(reader.start_realtime_ns % 1000000000ull));
+    
+    uint32_t records = 0;
+    while (bridge_capture_record_read(&reader, &record))
+    {
+        record_decode(&record);
+        records++;
+    }
+    
+    bridge_capture_reader_close(&reader);
+    printf("%u records\n", records);
+    
+    return 0;
+}
+
+/** @} */
\ No newline at end of file
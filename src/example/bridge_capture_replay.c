@@ -0,0 +1,294 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_capture_replay Replay of captured requests as load generator (Linux)
+ *
+ * @brief Sends requests of one link of capture file (bridge_capture.h) to a device with the original
+ * timing, optionally sped up, and measures answer latency. Requests are taken from client side sent
+ * messages or from server side received bytes, whichever the capture holds.
+ *
+ * Load is open loop: every request is written at its scheduled time whether previous ones are answered
+ * or not, so a slow device builds up a queue instead of slowing the load down, as it happens in the field.
+ * Answers are paired to requests in order and their latency is collected into bridge_histogram.h.
+ *
+ * Usage: bridge_capture_replay capture device [speed [link]], device is a tty (set to raw mode,
+ * its baud rate is kept) or any other file which can be read and written, speed 1 by default,
+ * link is the link id in capture, by default the first link with requests.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "capture/bridge_capture.h"
+#include "protocol/bridge_histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+
+#define REPLAY_ANSWER_WAIT_MS       1000                        /**< Answers are waited for this long after the last request. */
+
+/**@brief Request to replay. */
+typedef struct
+{
+    uint64_t time_ns;                                           /**< Time since capture start. */
+    uint16_t size;
+    uint8_t data[BRIDGE_FRAME_MAX_SIZE];
+} replay_request_t;
+
+/**@brief Replay state shared by threads. */
+typedef struct
+{
+    int fd;
+    uint8_t options;
+    replay_request_t * requests;
+    uint32_t requests_count;
+    uint64_t * sent_ns;                                         /**< Send time of every request. */
+    uint32_t sent;                                              /**< Requests sent, published by release store. */
+    uint32_t answered;
+    uint32_t corrupted_bytes;
+    bridge_histogram_t latency_us;
+} replay_t;
+
+static uint64_t time_ns_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+//Server receives requests, client sends them
+static bool record_is_request(const bridge_capture_record_t * record)
+{
+    return ((record->flags & BRIDGE_CAPTURE_FLAG_SERVER) != 0) == ((record->flags & BRIDGE_CAPTURE_FLAG_RECEIVED) != 0);
+}
+
+static bool requests_load(replay_t * replay,
+                          const char * path,
+                          int32_t link_id)
+{
+    static bridge_capture_reader_t reader;
+    static bridge_capture_record_t record;
+    static bridge_capture_stream_t stream;
+    uint32_t capacity = 0;
+    
+    if (bridge_capture_reader_open(&reader, path) == false)
+    {
+        printf("%s is not a capture file\n", path);
+        return false;
+    }
+    
+    while (bridge_capture_record_read(&reader, &record))
+    {
+        if ((record_is_request(&record) == false) || ((link_id >= 0) && (record.link_id != link_id)))
+        {
+            continue;
+        }
+        
+        if (link_id < 0)
+        {
+            link_id = record.link_id;
+            replay->options = record.options;
+            bridge_capture_stream_init(&stream, record.options);
+        }
+        
+        bridge_capture_stream_append(&stream, record.data, record.data_len);
+        
+        bridge_capture_message_t message;
+        bridge_capture_stream_result_t result;
+        while ((result = bridge_capture_stream_message_get(&stream, &message)) != BRIDGE_CAPTURE_STREAM_NEED_MORE)
+        {
+            if (result != BRIDGE_CAPTURE_STREAM_MESSAGE)
+            {
+                continue;
+            }
+            
+            if (replay->requests_count == capacity)
+            {
+                capacity = (capacity > 0) ? (capacity * 2) : 1024;
+                replay->requests = realloc(replay->requests, capacity * sizeof(replay_request_t));
+            }
+            
+            replay_request_t * request = &replay->requests[replay->requests_count++];
+            request->time_ns = record.time_ns;
+            request->size = message.size;
+            memcpy(request->data, message.data, message.size);
+        }
+    }
+    
+    bridge_capture_reader_close(&reader);
+    
+    if (replay->requests_count == 0)
+    {
+        printf("no requests in %s\n", path);
+        return false;
+    }
+    
+    printf("link %d: %u requests over %.3f s\n", link_id, replay->requests_count,
+           (double)(replay->requests[replay->requests_count - 1].time_ns - replay->requests[0].time_ns) * 1e-9);
+    
+    return true;
+}
+
+//Splits answers out of the bytes read, pairs them to requests in order
+static void * answer_thread(void * arg)
+{
+    replay_t * replay = (replay_t*)arg;
+    static bridge_capture_stream_t stream;
+    uint64_t last_data_ns = 0;
+    
+    bridge_capture_stream_init(&stream, replay->options);
+    
+    while (replay->answered < replay->requests_count)
+    {
+        uint32_t sent = __atomic_load_n(&replay->sent, __ATOMIC_ACQUIRE);
+        uint64_t now = time_ns_get();
+        
+        //Device is given up on when it keeps silent long after the last request
+        if (sent == replay->requests_count)
+        {
+            uint64_t quiet_since = (last_data_ns > replay->sent_ns[sent - 1]) ? last_data_ns : replay->sent_ns[sent - 1];
+            if ((now - quiet_since) > (REPLAY_ANSWER_WAIT_MS * 1000000ull))
+            {
+                break;
+            }
+        }
+        
+        struct pollfd fd = { .fd = replay->fd, .events = POLLIN };
+        if (poll(&fd, 1, 100) <= 0)
+        {
+            continue;
+        }
+        
+        uint8_t buffer[BRIDGE_FRAME_MAX_SIZE];
+        ssize_t received = read(replay->fd, buffer, sizeof(buffer));
+        if (received <= 0)
+        {
+            break;
+        }
+        
+        now = time_ns_get();
+        last_data_ns = now;
+        bridge_capture_stream_append(&stream, buffer, (uint16_t)received);
+        
+        bridge_capture_message_t message;
+        bridge_capture_stream_result_t result;
+        while ((result = bridge_capture_stream_message_get(&stream, &message)) != BRIDGE_CAPTURE_STREAM_NEED_MORE)
+        {
+            if (result == BRIDGE_CAPTURE_STREAM_SKIPPED)
+            {
+                replay->corrupted_bytes += message.size;
+                continue;
+            }
+            
+            if (replay->answered < __atomic_load_n(&replay->sent, __ATOMIC_ACQUIRE))
+            {
+                uint64_t latency_ns = now - replay->sent_ns[replay->answered++];
+                bridge_histogram_record(&replay->latency_us, (uint32_t)(latency_ns / 1000));
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+static bool device_open(replay_t * replay,
+                        const char * path)
+{
+    replay->fd = open(path, O_RDWR | O_NOCTTY);
+    if (replay->fd < 0)
+    {
+        perror(path);
+        return false;
+    }
+    
+    struct termios tio;
+    if (tcgetattr(replay->fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(replay->fd, TCSANOW, &tio);
+    }
+    
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s capture device [speed [link]]\n", argv[0]);
+        return 1;
+    }
+    
+    double speed = (argc > 3) ? atof(argv[3]) : 1.0;
+    int32_t link_id = (argc > 4) ? atoi(argv[4]) : -1;
+    static replay_t replay;
+    
+    if ((speed <= 0.0) || (requests_load(&replay, argv[1], link_id) == false) || (device_open(&replay, argv[2]) == false))
+    {
+        return 1;
+    }
+    
+    replay.sent_ns = calloc(replay.requests_count, sizeof(uint64_t));
+    bridge_histogram_reset(&replay.latency_us);
+    
+    pthread_t thread;
+    pthread_create(&thread, NULL, answer_thread, &replay);
+    
+    uint64_t first_ns = replay.requests[0].time_ns;
+    uint64_t start = time_ns_get();
+    uint32_t late = 0;
+    
+    for (uint32_t i = 0; i < replay.requests_count; i++)
+    {
+        uint64_t due = start + (uint64_t)((double)(replay.requests[i].time_ns - first_ns) / speed);
+        uint64_t now = time_ns_get();
+        
+        if (now < due)
+        {
+            struct timespec until = { .tv_sec = (time_t)(due / 1000000000ull), .tv_nsec = (long)(due % 1000000000ull) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+        }
+        else if ((now - due) > 1000000)
+        {
+            late++;
+        }
+        
+        replay.sent_ns[i] = time_ns_get();
+        __atomic_store_n(&replay.sent, i + 1, __ATOMIC_RELEASE);
+        
+        if (write(replay.fd, replay.requests[i].data, replay.requests[i].size) != replay.requests[i].size)
+        {
+            perror("write");
+            break;
+        }
+    }
+    
+    uint64_t sent_end = time_ns_get();
+    pthread_join(thread, NULL);
+    double wall_s = (double)(time_ns_get() - start) * 1e-9;
+    
+    printf("sent %u (%u later than 1 ms), answered %u, corrupted %u bytes, %.3f s\n",
+           replay.sent, late, replay.answered, replay.corrupted_bytes, (double)(sent_end - start) * 1e-9);
+    printf("answers/s %.0f, latency us p50 %u p99 %u p99.9 %u max %u\n",
+           (double)replay.answered / wall_s,
+           bridge_histogram_percentile_get(&replay.latency_us, 50.0),
+           bridge_histogram_percentile_get(&replay.latency_us, 99.0),
+           bridge_histogram_percentile_get(&replay.latency_us, 99.9),
+           replay.latency_us.max);
+    
+    close(replay.fd);
+    free(replay.sent_ns);
+    free(replay.requests);
+    
+    return (replay.answered == replay.sent) ? 0 : 1;
+}
+
+/** @} */
\ No newline at end of file
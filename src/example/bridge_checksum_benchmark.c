@@ -0,0 +1,150 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_checksum_benchmark Checksum engines benchmark
+ *
+ * @brief Measures throughput of every checksum engine (see bridge_checksum.h) on data of several lengths.
+ *
+ * Engine is selected by BRIDGE_CHECKSUM_SLICES at compile time, so the build compiles bridge_checksum.c
+ * once per engine with its functions renamed to bridge_checksum_append_<slices>() (see CMakeLists.txt).
+ * Every engine is checked against the check value 0x29B1 and against the byte-wise engine on data
+ * of every length up to BENCHMARK_MAX_LEN and several alignments before it is measured.
+ *
+ * Usage: bridge_checksum_benchmark [megabytes], 64 by default.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_DEFAULT_MEGABYTES 64
+#define BENCHMARK_MAX_LEN           4095                        /**< The longest data checksum covers. */
+#define BENCHMARK_CHECK_VALUE       0x29B1
+
+/**@brief Checksum engine. */
+typedef struct
+{
+    const char * name;
+    uint16_t (*init)(void);
+    uint16_t (*append)(uint16_t current_crc, const void * data, uint16_t data_len);
+} checksum_engine_t;
+
+#define CHECKSUM_ENGINE_DECLARE(slices) \
+    uint16_t bridge_checksum_init_##slices(void); \
+    uint16_t bridge_checksum_append_##slices(uint16_t current_crc, const void * data, uint16_t data_len);
+
+CHECKSUM_ENGINE_DECLARE(1)
+CHECKSUM_ENGINE_DECLARE(4)
+CHECKSUM_ENGINE_DECLARE(8)
+
+static const checksum_engine_t m_engines[] =
+{
+    { "byte-wise table", bridge_checksum_init_1, bridge_checksum_append_1 },
+    { "slice-by-4",      bridge_checksum_init_4, bridge_checksum_append_4 },
+    { "slice-by-8",      bridge_checksum_init_8, bridge_checksum_append_8 },
+};
+
+static uint64_t time_ns_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+//Byte-wise engine is the reference, it is the classic table of the protocol
+static bool engine_check(const checksum_engine_t * engine,
+                         const uint8_t * data)
+{
+    static const char check[] = "123456789";
+    
+    if (engine->append(engine->init(), check, (uint16_t)strlen(check)) != BENCHMARK_CHECK_VALUE)
+    {
+        printf("%s: wrong check value\n", engine->name);
+        return false;
+    }
+    
+    for (uint16_t offset = 0; offset < 8; offset++)
+    {
+        for (uint16_t len = 0; len <= (BENCHMARK_MAX_LEN - 8); len++)
+        {
+            uint16_t expected = bridge_checksum_append_1(bridge_checksum_init_1(), &data[offset], len);
+            if (engine->append(engine->init(), &data[offset], len) != expected)
+            {
+                printf("%s: wrong checksum of %u bytes at offset %u\n", engine->name, len, offset);
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+//Checksums of messages are chained, so the result can't be optimized away
+static double engine_measure(const checksum_engine_t * engine,
+                             const uint8_t * data,
+                             uint16_t len,
+                             uint64_t bytes)
+{
+    uint64_t rounds = (bytes + len - 1) / len;
+    uint16_t crc = engine->init();
+    
+    uint64_t start = time_ns_get();
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        crc = engine->append(crc, data, len);
+    }
+    uint64_t wall_ns = time_ns_get() - start;
+    
+    //Result is printed nowhere, it only keeps the loop alive
+    volatile uint16_t sink = crc;
+    (void)sink;
+    
+    return (double)(rounds * len) / (double)wall_ns;
+}
+
+int main(int argc, char ** argv)
+{
+    static const uint16_t lengths[] = { 8, 64, 256, BENCHMARK_MAX_LEN };
+    uint64_t bytes = ((argc > 1) ? (uint64_t)atoi(argv[1]) : BENCHMARK_DEFAULT_MEGABYTES) << 20;
+    
+    static uint8_t data[BENCHMARK_MAX_LEN];
+    srand(1);
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)rand();
+    }
+    
+    printf("%-16s", "GB/s, length");
+    for (size_t i = 0; i < (sizeof(lengths) / sizeof(lengths[0])); i++)
+    {
+        printf(" %10u", lengths[i]);
+    }
+    printf("\n");
+    
+    for (size_t i = 0; i < (sizeof(m_engines) / sizeof(m_engines[0])); i++)
+    {
+        if (engine_check(&m_engines[i], data) == false)
+        {
+            return 1;
+        }
+        
+        printf("%-16s", m_engines[i].name);
+        for (size_t j = 0; j < (sizeof(lengths) / sizeof(lengths[0])); j++)
+        {
+            printf(" %10.2f", engine_measure(&m_engines[i], data, lengths[j], bytes));
+        }
+        printf("\n");
+    }
+    
+    return 0;
+}
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,248 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_client_coroutine_example Coroutine client on many links (Linux, C++20)
+ *
+ * @brief Every link gets a coroutine which matches protocol version and then asks for device info
+ * several times, written as plain sequential code with co_await (see bridge_client.hpp). All coroutines
+ * run in the main thread, server thread serves the other sides of the links by bridge_server.h.
+ *
+ * Every link is a pty pair in raw mode. Usage: bridge_client_coroutine_example [links [calls]],
+ * 1000 links and 10 calls per link by default. Number of links is limited by open files limit,
+ * the example raises it up to the hard limit.
+ *
+ * @{
+ */
+
+#include "client/bridge_client.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/resource.h>
+
+extern "C"
+{
+#include "server/bridge_server.h"
+}
+
+#define EXAMPLE_DEFAULT_LINKS   1000
+#define EXAMPLE_DEFAULT_CALLS   10
+
+/**@brief Example state shared by threads. */
+typedef struct
+{
+    uint32_t links_count;
+    std::vector<int> master_fds;
+    volatile bool stop;
+    uint32_t finished;                                          /**< Coroutines finished. */
+    uint32_t answered;                                          /**< Successful calls. */
+    uint32_t failed;                                            /**< Failed calls. */
+} example_t;
+
+static double time_s_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+}
+
+static void device_info_handler(bridge_server_link_t * link,
+                                const bridge_request_t * request,
+                                void * context)
+{
+    (void)request;
+    (void)context;
+    
+    device_info_t info =
+    {
+        .hardware_version = 1,
+        .firmware_version = 1
+    };
+    
+    bridge_link_get_device_info_answer(&link->link, &info);
+}
+
+static void match_protocol_version_handler(bridge_server_link_t * link,
+                                           const bridge_request_t * request,
+                                           void * context)
+{
+    (void)request;
+    (void)context;
+    
+    bridge_link_match_protocol_version_answer(&link->link);
+}
+
+static void * server_thread(void * arg)
+{
+    example_t * example = (example_t*)arg;
+    
+    bridge_server_t server;
+    if (bridge_server_init(&server, NULL, NULL) == false)
+    {
+        return NULL;
+    }
+    
+    bridge_server_handler_register(&server, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, device_info_handler, NULL);
+    bridge_server_handler_register(&server, BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION, match_protocol_version_handler, NULL);
+    
+    std::vector<bridge_server_link_t> links(example->links_count);
+    for (uint32_t i = 0; i < example->links_count; i++)
+    {
+        //Both sides are fresh, nothing to wait for
+        bridge_server_link_add(&server, &links[i], example->master_fds[i], 0);
+        bridge_parser_idle(&links[i].parser, BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS);
+    }
+    
+    while (example->stop == false)
+    {
+        bridge_server_process(&server, 10);
+    }
+    
+    bridge_server_deinit(&server);
+    
+    return NULL;
+}
+
+//Sequential code, though no thread is blocked by any of the calls
+static bridge::task link_poll(bridge::link link,
+                              example_t * example,
+                              uint32_t calls)
+{
+    bridge_match_protocol_version_request_t version = { BRIDGE_PROTOCOL_VERSION };
+    auto match = co_await link.match_protocol_version(version);
+    
+    if ((!match) || (match.answer.protocol_version != BRIDGE_PROTOCOL_VERSION))
+    {
+        example->failed++;
+        example->finished++;
+        co_return;
+    }
+    
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        auto info = co_await link.get_device_info();
+        
+        if (info)
+        {
+            example->answered++;
+        }
+        else
+        {
+            example->failed++;
+        }
+    }
+    
+    example->finished++;
+}
+
+static int pty_open(int * out_master_fd)
+{
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master_fd < 0) || (grantpt(master_fd) < 0) || (unlockpt(master_fd) < 0))
+    {
+        return -1;
+    }
+    
+    int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+    if (slave_fd < 0)
+    {
+        close(master_fd);
+        return -1;
+    }
+    
+    struct termios tio;
+    tcgetattr(slave_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave_fd, TCSANOW, &tio);
+    
+    *out_master_fd = master_fd;
+    return slave_fd;
+}
+
+int main(int argc, char ** argv)
+{
+    example_t example;
+    example.links_count = (argc > 1) ? (uint32_t)atoi(argv[1]) : EXAMPLE_DEFAULT_LINKS;
+    uint32_t calls = (argc > 2) ? (uint32_t)atoi(argv[2]) : EXAMPLE_DEFAULT_CALLS;
+    example.stop = false;
+    example.finished = 0;
+    example.answered = 0;
+    example.failed = 0;
+    
+    //Two descriptors per link
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    bridge_client_t client;
+    if (bridge_client_init(&client, NULL, NULL) == false)
+    {
+        printf("client can't be created\n");
+        return 1;
+    }
+    
+    std::vector<bridge_client_link_t> links(example.links_count);
+    std::vector<int> slave_fds;
+    for (uint32_t i = 0; i < example.links_count; i++)
+    {
+        int master_fd;
+        int slave_fd = pty_open(&master_fd);
+        if (slave_fd < 0)
+        {
+            printf("only %u pty pairs created (%s)\n", i, strerror(errno));
+            return 1;
+        }
+        
+        example.master_fds.push_back(master_fd);
+        slave_fds.push_back(slave_fd);
+        bridge_client_link_add(&client, &links[i], slave_fd, 0);
+    }
+    
+    pthread_t server;
+    pthread_create(&server, NULL, server_thread, &example);
+    
+    //Calls wait in link queues until links recover, then the first requests leave
+    double start = time_s_get();
+    for (uint32_t i = 0; i < example.links_count; i++)
+    {
+        link_poll(bridge::link(links[i]), &example, calls);
+    }
+    
+    while (example.finished < example.links_count)
+    {
+        if (bridge_client_process(&client, -1) < 0)
+        {
+            break;
+        }
+    }
+    
+    double wall_s = time_s_get() - start;
+    
+    printf("%u links, %u calls answered, %u failed in %.3f s (%.0f answers/s), one client thread\n",
+           example.links_count, example.answered, example.failed, wall_s, (double)example.answered / wall_s);
+    
+    example.stop = true;
+    pthread_join(server, NULL);
+    bridge_client_deinit(&client);
+    
+    for (uint32_t i = 0; i < example.links_count; i++)
+    {
+        close(slave_fds[i]);
+        close(example.master_fds[i]);
+    }
+    
+    return (example.failed == 0) ? 0 : 1;
+}
+
+/** @} */
\ No newline at end of file
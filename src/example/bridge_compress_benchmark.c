@@ -0,0 +1,314 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_compress_benchmark Answer compression benchmark
+ *
+ * @brief Measures compression ratio of answers and effective throughput it gives at several baud rates.
+ *
+ * Client and server links are joined by in-memory lines and served by one thread, so the result
+ * doesn't depend on scheduling. Client sends BATCH of GET_DEVICE_INFO requests, server answers them
+ * with telemetry-like device infos of three kinds: constant (zero padded values), sensor (slowly changing
+ * values) and random. Every kind runs with BRIDGE_PROTOCOL_FEATURE_COMPRESSION offered and not.
+ *
+ * Effective throughput is device info bytes delivered per second when the time of exchange is
+ * the time bytes of both directions take on the line (10 bits per byte) plus CPU time of both sides.
+ * Usage: bridge_compress_benchmark [exchanges], 1000 by default.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_DEFAULT_EXCHANGES 1000
+#define LINE_BUFFER_SIZE            4096
+
+/**@brief One direction of in-memory line. */
+typedef struct
+{
+    uint8_t buffer[LINE_BUFFER_SIZE];
+    uint32_t head;                                              /**< Read position. */
+    uint32_t tail;                                              /**< Write position. */
+    uint64_t bytes;                                             /**< Bytes ever written. */
+} line_t;
+
+/**@brief Ends of both lines seen by one side. */
+typedef struct
+{
+    line_t * rx;
+    line_t * tx;
+} port_t;
+
+/**@brief Kinds of telemetry. */
+typedef enum
+{
+    TELEMETRY_CONSTANT,
+    TELEMETRY_SENSOR,
+    TELEMETRY_RANDOM,
+    TELEMETRY_COUNT
+} telemetry_t;
+
+static const char * const m_telemetry_names[TELEMETRY_COUNT] = { "constant", "sensor", "random" };
+static const uint32_t m_bauds[] = { 9600, 115200, 1000000 };
+
+static double time_s_get(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    
+    return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+}
+
+//Everything written is read by the other side before the next write, so the line is a plain buffer
+static bridge_callback_result_t port_read(void * user,
+                                          uint8_t * data,
+                                          uint16_t max_len,
+                                          uint16_t * out_len,
+                                          uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    line_t * line = ((port_t*)user)->rx;
+    
+    uint32_t available = line->tail - line->head;
+    if (available == 0)
+    {
+        return BRIDGE_CALLBACK_RESULT_READ_TIMEOUT;
+    }
+    
+    *out_len = (available < max_len) ? (uint16_t)available : max_len;
+    memcpy(data, &line->buffer[line->head], *out_len);
+    line->head += *out_len;
+    
+    if (line->head == line->tail)
+    {
+        line->head = 0;
+        line->tail = 0;
+    }
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t port_write(void * user,
+                                           const uint8_t * data,
+                                           uint16_t data_len)
+{
+    line_t * line = ((port_t*)user)->tx;
+    
+    if ((line->tail + data_len) > sizeof(line->buffer))
+    {
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+    }
+    
+    memcpy(&line->buffer[line->tail], data, data_len);
+    line->tail += data_len;
+    line->bytes += data_len;
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static void telemetry_get(telemetry_t telemetry,
+                          uint32_t exchange,
+                          uint32_t item,
+                          device_info_t * out_info)
+{
+    switch (telemetry)
+    {
+        case TELEMETRY_CONSTANT:
+        {
+            out_info->hardware_version = 1;
+            out_info->firmware_version = 2;
+            break;
+        }
+        
+        case TELEMETRY_SENSOR:
+        {
+            out_info->hardware_version = 2000 + ((exchange + (item * 3)) % 16);
+            out_info->firmware_version = 50000 + (item * 7) + (exchange % 4);
+            break;
+        }
+        
+        default:
+        {
+            out_info->hardware_version = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            out_info->firmware_version = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            break;
+        }
+    }
+}
+
+//Server side of one exchange: reads batch and answers every item with telemetry
+static bool server_process(bridge_link_t * server,
+                           telemetry_t telemetry,
+                           uint32_t exchange)
+{
+    bridge_request_t request;
+    if (bridge_link_request_read(server, 0, &request) != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return false;
+    }
+    
+    if (request.type == BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION)
+    {
+        return (bridge_link_match_protocol_version_answer(server) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    }
+    
+    bridge_answer_t answer;
+    bridge_batch_answer_init(&answer);
+    
+    bridge_batch_iterator_t iterator;
+    bridge_request_t item;
+    bridge_batch_request_iterator_init(&iterator, &request);
+    for (uint32_t i = 0; bridge_batch_request_next(&iterator, &item); i++)
+    {
+        bridge_answer_t item_answer;
+        item_answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+        telemetry_get(telemetry, exchange, i, &item_answer.data.get_device_info.info);
+        bridge_batch_answer_add(&answer, item.type, &item_answer);
+    }
+    
+    return (bridge_link_batch_answer(server, &answer) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+}
+
+static bool exchange_run(bridge_link_t * client,
+                         bridge_link_t * server,
+                         const bridge_request_t * request,
+                         telemetry_t telemetry,
+                         uint32_t exchange)
+{
+    bridge_answer_t answer;
+    
+    return (bridge_link_request_send(client, request, NULL) == BRIDGE_PROTOCOL_RESULT_SUCCESS) &&
+           server_process(server, telemetry, exchange) &&
+           (bridge_link_answer_receive(client, NULL, NULL, &answer) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+}
+
+//Fills bytes sent by server, bytes of both directions and CPU time per exchange
+static bool benchmark_run(telemetry_t telemetry,
+                          uint8_t features,
+                          uint32_t exchanges,
+                          uint32_t * out_items,
+                          double * out_answer_bytes,
+                          double * out_line_bytes,
+                          double * out_cpu_s)
+{
+    static line_t requests;
+    static line_t answers;
+    memset(&requests, 0, sizeof(requests));
+    memset(&answers, 0, sizeof(answers));
+    
+    port_t client_port = { .rx = &answers, .tx = &requests };
+    port_t server_port = { .rx = &requests, .tx = &answers };
+    
+    bridge_link_t client;
+    bridge_link_t server;
+    bridge_link_init(&client, port_read, port_write, &client_port);
+    bridge_link_init(&server, port_read, port_write, &server_port);
+    client.features = features;
+    
+    bridge_request_t match;
+    match.type = BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION;
+    match.data.match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+    if (exchange_run(&client, &server, &match, telemetry, 0) == false)
+    {
+        return false;
+    }
+    
+    //As many device infos as batch answer holds
+    bridge_request_t batch;
+    bridge_request_t item;
+    item.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
+    bridge_batch_request_init(&batch);
+    
+    *out_items = 0;
+    while (bridge_batch_request_add(&batch, &item))
+    {
+        (*out_items)++;
+    }
+    
+    uint64_t requests_bytes = requests.bytes;
+    uint64_t answers_bytes = answers.bytes;
+    double cpu_s = time_s_get(CLOCK_PROCESS_CPUTIME_ID);
+    
+    for (uint32_t i = 0; i < exchanges; i++)
+    {
+        if (exchange_run(&client, &server, &batch, telemetry, i) == false)
+        {
+            return false;
+        }
+    }
+    
+    *out_cpu_s = (time_s_get(CLOCK_PROCESS_CPUTIME_ID) - cpu_s) / exchanges;
+    *out_answer_bytes = (double)(answers.bytes - answers_bytes) / exchanges;
+    *out_line_bytes = (double)((requests.bytes - requests_bytes) + (answers.bytes - answers_bytes)) / exchanges;
+    
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t exchanges = (argc > 1) ? (uint32_t)atoi(argv[1]) : BENCHMARK_DEFAULT_EXCHANGES;
+    const uint32_t bauds_count = sizeof(m_bauds) / sizeof(m_bauds[0]);
+    
+    printf("%-9s %-5s %8s %6s %9s", "telemetry", "mode", "answer B", "ratio", "CPU us");
+    for (uint32_t i = 0; i < bauds_count; i++)
+    {
+        printf(" %9u bd", m_bauds[i]);
+    }
+    printf("   (effective kB/s)\n");
+    
+    for (uint32_t telemetry = 0; telemetry < TELEMETRY_COUNT; telemetry++)
+    {
+        double plain_answer_bytes = 0;
+        
+        for (uint32_t compressed = 0; compressed < 2; compressed++)
+        {
+            uint32_t items;
+            double answer_bytes;
+            double line_bytes;
+            double cpu_s;
+            
+            srand(1);
+            if (benchmark_run((telemetry_t)telemetry,
+                              (compressed) ? BRIDGE_PROTOCOL_FEATURE_COMPRESSION : 0,
+                              exchanges,
+                              &items,
+                              &answer_bytes,
+                              &line_bytes,
+                              &cpu_s) == false)
+            {
+                printf("%s: exchange failed\n", m_telemetry_names[telemetry]);
+                return 1;
+            }
+            
+            if (compressed == 0)
+            {
+                plain_answer_bytes = answer_bytes;
+            }
+            
+            printf("%-9s %-5s %8.1f %6.2f %9.2f",
+                   m_telemetry_names[telemetry],
+                   (compressed) ? "lz" : "plain",
+                   answer_bytes,
+                   plain_answer_bytes / answer_bytes,
+                   cpu_s * 1e6);
+            
+            double info_bytes = (double)items * sizeof(device_info_t);
+            for (uint32_t i = 0; i < bauds_count; i++)
+            {
+                double exchange_s = ((line_bytes * 10.0) / m_bauds[i]) + cpu_s;
+                printf(" %12.2f", info_bytes / exchange_s / 1000.0);
+            }
+            printf("\n");
+        }
+    }
+    
+    return 0;
+}
+
+/** @} */
\ No newline at end of file
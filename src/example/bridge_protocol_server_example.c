@@ -1,5 +1,9 @@
 #include "bridge_protocol_server_example.h"
 #include "protocol/bridge_protocol.h"
+#include "protocol/bridge_batch.h"
+#include "protocol/bridge_transfer.h"
+
+#define FIRMWARE_IMAGE_MAX_SIZE 4096
 
 /**@brief Function for writing data to bus.
  *
@@ -48,6 +52,93 @@ static bool bridge_recovery_wait(void)
     return (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR) ? false : true;
 }
 
+/**@brief Request handler, fills the answer to send.
+ *
+ * @param[in]  request    Received request.
+ * @param[out] out_answer Answer to fill, its type is preset to SUCCESS.
+ */
+typedef void (*request_handler_t)(const bridge_request_t * request, bridge_answer_t * out_answer);
+
+static void match_protocol_version_handle(const bridge_request_t * request, bridge_answer_t * out_answer)
+{
+    (void)request;
+    
+    //In theory, if the protocol versions don't match, 
+    //client will not send commands (except, perhaps, command GET_DEVICE_INFO)
+    out_answer->data.match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+}
+
+static void match_capabilities_handle(const bridge_request_t * request, bridge_answer_t * out_answer)
+{
+    (void)request;
+    
+    //Server without link context agrees no features, so clients never follow the match with this request
+    out_answer->type = BRIDGE_ANSWER_TYPE_REQUEST_REJECTED;
+}
+
+static void get_device_info_handle(const bridge_request_t * request, bridge_answer_t * out_answer)
+{
+    (void)request;
+    
+    out_answer->data.get_device_info.info.firmware_version = 1;
+    out_answer->data.get_device_info.info.hardware_version = 1;
+}
+
+static void transfer_chunk_handle(const bridge_request_t * request, bridge_answer_t * out_answer)
+{
+    static uint8_t firmware_image[FIRMWARE_IMAGE_MAX_SIZE];
+    static bridge_transfer_receiver_t receiver;
+    static bool receiver_initialized = false;
+    
+    if (receiver_initialized == false)
+    {
+        bridge_transfer_receiver_init(&receiver, firmware_image, sizeof(firmware_image));
+        receiver_initialized = true;
+    }
+    
+    if (bridge_transfer_chunk_handle(&receiver, request, out_answer))
+    {
+        //Whole image is received, receiver.total_size bytes of firmware_image can be written to flash
+    }
+}
+
+static void batch_handle(const bridge_request_t * request, bridge_answer_t * out_answer);
+
+/**@brief Handlers indexed by request type. Every type of BRIDGE_REQUEST_LIST needs handler named <member>_handle. */
+#define REQUEST_HANDLER_ENTRY(name, member, request_data, answer_data) [BRIDGE_REQUEST_TYPE_##name] = member##_handle,
+
+static const request_handler_t m_handlers[BRIDGE_REQUEST_TYPE_COUNT] =
+{
+    BRIDGE_REQUEST_LIST(REQUEST_HANDLER_ENTRY)
+};
+
+static void batch_handle(const bridge_request_t * request, bridge_answer_t * out_answer)
+{
+    bridge_batch_answer_init(out_answer);
+    
+    bridge_batch_iterator_t iterator;
+    bridge_request_t item;
+    bridge_batch_request_iterator_init(&iterator, request);
+    while (bridge_batch_request_next(&iterator, &item))
+    {
+        bridge_answer_t item_answer;
+        item_answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+        
+        //Iterator never returns nested batches. Unknown requests are rejected, 
+        //so answers stay in the same order as requests
+        if ((item.type < BRIDGE_REQUEST_TYPE_COUNT) && (m_handlers[item.type] != NULL))
+        {
+            m_handlers[item.type](&item, &item_answer);
+        }
+        else
+        {
+            item_answer.type = BRIDGE_ANSWER_TYPE_REQUEST_REJECTED;
+        }
+        
+        bridge_batch_answer_add(out_answer, item.type, &item_answer);
+    }
+}
+
 bool bridge_init(void)
 {
     if (bridge_recovery_wait() == false)
@@ -86,47 +177,25 @@ int32_t bridge_process(void)
         return -1;
     }
     
-    switch (request.type)
+    if ((request.type >= BRIDGE_REQUEST_TYPE_COUNT) || (m_handlers[request.type] == NULL))
     {
-        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
-        {
-            result = bridge_protocol_match_protocol_version_answer(bus_write);
-            if (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
-                return -1;
-            
-            //In theory, if the protocol versions don't match, 
-            //client will not send commands (except, perhaps, command GET_DEVICE_INFO)
-            
-            break;
-        }
-            
-        case BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO:
+        //Unknown request type, should never happen, if happened anyway - probably it's best to recover
+        if (bridge_recovery_wait())
         {
-            device_info_t info =
-            {
-                .firmware_version = 1,
-                .hardware_version = 1
-            };
-            
-            result = bridge_protocol_get_device_info_answer(bus_write, &info);
-            if (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
-            {
-                return -1;
-            }
-            
-            break;
+            return BRIDGE_REQUEST_TYPE_UNDEFINED;
         }
         
-        default:
-        {
-            //Unknown request type, should never happen, if happened anyway - probably it's best to recover
-            if (bridge_recovery_wait())
-            {
-                return BRIDGE_REQUEST_TYPE_UNDEFINED;
-            }
-            
-            return -1;
-        }
+        return -1;
+    }
+    
+    bridge_answer_t answer;
+    answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+    m_handlers[request.type](&request, &answer);
+    
+    result = bridge_protocol_answer_send(bus_write, request.type, &answer);
+    if (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
+    {
+        return -1;
     }
     
     return request.type;
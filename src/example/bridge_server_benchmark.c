@@ -0,0 +1,327 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_server_benchmark Multi-link server benchmark (Linux)
+ *
+ * @brief Measures requests per second and CPU use of bridge_server.h runtime as the number of links grows.
+ *
+ * Every link is a pty pair in raw mode: server serves master sides, client thread keeps one
+ * GET_DEVICE_INFO request in flight on every slave side. Usage: bridge_server_benchmark [seconds [links...]],
+ * by default every step of 1, 10, 100 and 1000 links runs for 2 seconds. Number of links is limited
+ * by open files limit, the benchmark raises it up to the hard limit.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "server/bridge_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define BENCHMARK_DEFAULT_SECONDS 2
+
+/**@brief Client side of one link. */
+typedef struct
+{
+    int fd;                                                     /**< Slave side of pty. */
+    bridge_parser_t parser;                                     /**< Answer parser. */
+    uint64_t answers;                                           /**< Answers received. */
+} client_link_t;
+
+/**@brief Benchmark step state shared by threads. */
+typedef struct
+{
+    uint32_t links_count;
+    int * master_fds;
+    client_link_t * clients;
+    uint8_t request[64];                                        /**< Encoded GET_DEVICE_INFO request. */
+    uint16_t request_len;
+    volatile bool stop;
+    double server_cpu_s;                                        /**< CPU time spent by server thread. */
+} benchmark_t;
+
+static double time_s_get(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    
+    return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+}
+
+/**@brief Write callback used once to encode the request frame. */
+static bridge_callback_result_t request_capture(void * user,
+                                                const uint8_t * data,
+                                                uint16_t data_len)
+{
+    benchmark_t * benchmark = (benchmark_t*)user;
+    
+    if (data_len > sizeof(benchmark->request))
+    {
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+    }
+    
+    memcpy(benchmark->request, data, data_len);
+    benchmark->request_len = data_len;
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t no_read(void * user,
+                                        uint8_t * data,
+                                        uint16_t max_len,
+                                        uint16_t * out_len,
+                                        uint32_t timeout_ms)
+{
+    (void)user;
+    (void)data;
+    (void)max_len;
+    (void)out_len;
+    (void)timeout_ms;
+    
+    return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+}
+
+static void device_info_handler(bridge_server_link_t * link,
+                                const bridge_request_t * request,
+                                void * context)
+{
+    (void)request;
+    (void)context;
+    
+    device_info_t info =
+    {
+        .firmware_version = 1,
+        .hardware_version = 1
+    };
+    
+    bridge_link_get_device_info_answer(&link->link, &info);
+}
+
+static void * server_thread(void * arg)
+{
+    benchmark_t * benchmark = (benchmark_t*)arg;
+    
+    bridge_server_t server;
+    if (bridge_server_init(&server, NULL, NULL) == false)
+    {
+        return NULL;
+    }
+    
+    bridge_server_handler_register(&server, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, device_info_handler, NULL);
+    
+    bridge_server_link_t * links = calloc(benchmark->links_count, sizeof(bridge_server_link_t));
+    for (uint32_t i = 0; i < benchmark->links_count; i++)
+    {
+        //Both sides are fresh, nothing to wait for
+        bridge_server_link_add(&server, &links[i], benchmark->master_fds[i], 0);
+        bridge_parser_idle(&links[i].parser, BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS);
+    }
+    
+    double cpu_start = time_s_get(CLOCK_THREAD_CPUTIME_ID);
+    while (benchmark->stop == false)
+    {
+        bridge_server_process(&server, 10);
+    }
+    benchmark->server_cpu_s = time_s_get(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    
+    bridge_server_deinit(&server);
+    free(links);
+    
+    return NULL;
+}
+
+static void client_event_handler(void * context,
+                                 const bridge_parser_event_t * event)
+{
+    client_link_t * client = (client_link_t*)context;
+    
+    if (event->type == BRIDGE_PARSER_EVENT_ANSWER)
+    {
+        client->answers++;
+    }
+}
+
+static bool client_request_send(const benchmark_t * benchmark,
+                                client_link_t * client)
+{
+    bridge_parser_answer_expect(&client->parser, 0, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO);
+    
+    return write(client->fd, benchmark->request, benchmark->request_len) == benchmark->request_len;
+}
+
+/**@brief Runs one step and prints its results.
+ *
+ * @param[in] links_count Number of links.
+ * @param[in] seconds     Duration of the step.
+ *
+ * @retval true  Step completed.
+ * @retval false Links can't be created.
+ */
+static bool benchmark_step_run(uint32_t links_count,
+                               uint32_t seconds)
+{
+    benchmark_t benchmark;
+    memset(&benchmark, 0, sizeof(benchmark));
+    benchmark.links_count = links_count;
+    benchmark.master_fds = calloc(links_count, sizeof(int));
+    benchmark.clients = calloc(links_count, sizeof(client_link_t));
+    
+    bridge_link_t encoder;
+    bridge_link_init(&encoder, no_read, request_capture, &benchmark);
+    bridge_request_t request;
+    request.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
+    bridge_link_request_send(&encoder, &request, NULL);
+    
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    uint32_t created = 0;
+    for (; created < links_count; created++)
+    {
+        int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master_fd < 0) || (grantpt(master_fd) < 0) || (unlockpt(master_fd) < 0))
+        {
+            break;
+        }
+        
+        int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+        if (slave_fd < 0)
+        {
+            close(master_fd);
+            break;
+        }
+        
+        struct termios tio;
+        tcgetattr(slave_fd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave_fd, TCSANOW, &tio);
+        
+        client_link_t * client = &benchmark.clients[created];
+        client->fd = slave_fd;
+        bridge_parser_init(&client->parser, BRIDGE_PARSER_MODE_ANSWER, client_event_handler, client);
+        bridge_parser_idle(&client->parser, BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS);
+        benchmark.master_fds[created] = master_fd;
+        
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, slave_fd, &event);
+    }
+    
+    bool result = (created == links_count);
+    if (result == false)
+    {
+        printf("%6u links: only %u pty pairs created (%s)\n", links_count, created, strerror(errno));
+    }
+    else
+    {
+        pthread_t server;
+        pthread_create(&server, NULL, server_thread, &benchmark);
+        
+        //Let the server register all links before the first request
+        usleep(100000);
+        
+        for (uint32_t i = 0; i < links_count; i++)
+        {
+            client_request_send(&benchmark, &benchmark.clients[i]);
+        }
+        
+        double wall_start = time_s_get(CLOCK_MONOTONIC);
+        double cpu_start = time_s_get(CLOCK_THREAD_CPUTIME_ID);
+        
+        while ((time_s_get(CLOCK_MONOTONIC) - wall_start) < seconds)
+        {
+            struct epoll_event events[64];
+            int events_count = epoll_wait(epoll_fd, events, 64, 10);
+            
+            for (int i = 0; i < events_count; i++)
+            {
+                client_link_t * client = (client_link_t*)events[i].data.ptr;
+                
+                uint8_t buffer[256];
+                ssize_t received = read(client->fd, buffer, sizeof(buffer));
+                if (received <= 0)
+                {
+                    continue;
+                }
+                
+                uint64_t answers = client->answers;
+                bridge_parser_feed(&client->parser, buffer, (size_t)received);
+                
+                if (client->answers != answers)
+                {
+                    client_request_send(&benchmark, client);
+                }
+            }
+        }
+        
+        double wall_s = time_s_get(CLOCK_MONOTONIC) - wall_start;
+        double client_cpu_s = time_s_get(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+        
+        benchmark.stop = true;
+        pthread_join(server, NULL);
+        
+        uint64_t answers = 0;
+        for (uint32_t i = 0; i < links_count; i++)
+        {
+            answers += benchmark.clients[i].answers;
+        }
+        
+        printf("%6u links: %10.0f requests/s, server CPU %5.1f%%, %6.2f us CPU per request, client CPU %5.1f%%\n",
+               links_count,
+               (double)answers / wall_s,
+               100.0 * benchmark.server_cpu_s / wall_s,
+               (answers > 0) ? (1e6 * benchmark.server_cpu_s / (double)answers) : 0.0,
+               100.0 * client_cpu_s / wall_s);
+    }
+    
+    for (uint32_t i = 0; i < created; i++)
+    {
+        close(benchmark.clients[i].fd);
+        close(benchmark.master_fds[i]);
+    }
+    
+    close(epoll_fd);
+    free(benchmark.master_fds);
+    free(benchmark.clients);
+    
+    return result;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t seconds = (argc > 1) ? (uint32_t)atoi(argv[1]) : BENCHMARK_DEFAULT_SECONDS;
+    
+    //Two descriptors per link
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    if (argc > 2)
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            benchmark_step_run((uint32_t)atoi(argv[i]), seconds);
+        }
+        return 0;
+    }
+    
+    const uint32_t steps[] = { 1, 10, 100, 1000 };
+    for (uint32_t i = 0; i < (sizeof(steps) / sizeof(steps[0])); i++)
+    {
+        benchmark_step_run(steps[i], seconds);
+    }
+    
+    return 0;
+}
+
+/** @} */
\ No newline at end of file
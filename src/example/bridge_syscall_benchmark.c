@@ -0,0 +1,347 @@
+/**
+ * @ingroup bridge_protocol_example
+ *
+ * @defgroup bridge_syscall_benchmark Bus callbacks benchmark (Linux)
+ *
+ * @brief Measures syscalls and time per message of legacy bridge_protocol_*() calls with plain callbacks
+ * and with registered bulk read (bridge_protocol_bulk_read_register()) and vector write
+ * (bridge_protocol_vector_write_register()) callbacks.
+ *
+ * Client and server run in separate threads joined by two pipes, every callback is one syscall the way
+ * a tty adapter does it. Client gets device info and BATCH of device infos, server answers them.
+ * Registrations are made before the server thread starts and removed after it stops, as registrations
+ * are not synchronized with protocol calls.
+ *
+ * Usage: bridge_syscall_benchmark [calls], 10000 by default.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define BENCHMARK_DEFAULT_CALLS     10000
+#define BENCHMARK_BATCH_ITEMS       23
+
+/**@brief One side of the pipes with its syscall counter. Legacy callbacks get no user data,
+ *        so every side has callbacks of its own.
+ */
+typedef struct
+{
+    int read_fd;
+    int write_fd;
+    uint64_t syscalls;
+} side_t;
+
+/**@brief Benchmark case: callbacks registered. */
+typedef struct
+{
+    const char * name;
+    bool bulk_read;
+    bool vector_write;
+} benchmark_case_t;
+
+static const benchmark_case_t m_cases[] =
+{
+    { "byte read, single write", false, false },
+    { "bulk read, single write", true,  false },
+    { "bulk read, vector write", true,  true },
+};
+
+static side_t m_client;
+static side_t m_server;
+
+static uint64_t time_ns_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+//Waits for data only if the first read finds none, so a read of ready data is one syscall
+static bridge_callback_result_t side_read(side_t * side,
+                                          uint8_t * data,
+                                          uint16_t max_len,
+                                          uint16_t * out_len,
+                                          uint32_t timeout_ms)
+{
+    for (;;)
+    {
+        side->syscalls++;
+        ssize_t received = read(side->read_fd, data, max_len);
+        if (received > 0)
+        {
+            *out_len = (uint16_t)received;
+            return BRIDGE_CALLBACK_RESULT_SUCCESS;
+        }
+        
+        if (received == 0)
+        {
+            return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+        }
+        
+        struct pollfd descriptor = { .fd = side->read_fd, .events = POLLIN };
+        side->syscalls++;
+        int ready = poll(&descriptor, 1, (timeout_ms == UINT32_MAX) ? -1 : (int)timeout_ms);
+        if (ready == 0)
+        {
+            return BRIDGE_CALLBACK_RESULT_READ_TIMEOUT;
+        }
+        
+        if (ready < 0)
+        {
+            return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+        }
+    }
+}
+
+static bridge_callback_result_t side_write(side_t * side,
+                                           const uint8_t * data,
+                                           uint16_t data_len)
+{
+    side->syscalls++;
+    
+    return (write(side->write_fd, data, data_len) == (ssize_t)data_len) ?
+           BRIDGE_CALLBACK_RESULT_SUCCESS : BRIDGE_CALLBACK_RESULT_IO_ERROR;
+}
+
+static bridge_callback_result_t side_write_vector(side_t * side,
+                                                  const bridge_write_chunk_t * chunks,
+                                                  uint8_t chunks_count)
+{
+    struct iovec vector[8];
+    ssize_t total = 0;
+    
+    for (uint8_t i = 0; (i < chunks_count) && (i < 8); i++)
+    {
+        vector[i].iov_base = (void*)chunks[i].data;
+        vector[i].iov_len = chunks[i].data_len;
+        total += chunks[i].data_len;
+    }
+    
+    side->syscalls++;
+    
+    return ((chunks_count <= 8) && (writev(side->write_fd, vector, chunks_count) == total)) ?
+           BRIDGE_CALLBACK_RESULT_SUCCESS : BRIDGE_CALLBACK_RESULT_IO_ERROR;
+}
+
+static bridge_callback_result_t client_read(uint8_t * byte, uint32_t timeout_ms)
+{
+    uint16_t received;
+    return side_read(&m_client, byte, 1, &received, timeout_ms);
+}
+
+static bridge_callback_result_t client_read_bulk(uint8_t * data, uint16_t max_len, uint16_t * out_len, uint32_t timeout_ms)
+{
+    return side_read(&m_client, data, max_len, out_len, timeout_ms);
+}
+
+static bridge_callback_result_t client_write(uint8_t * data, uint16_t data_len)
+{
+    return side_write(&m_client, data, data_len);
+}
+
+static bridge_callback_result_t client_write_vector(const bridge_write_chunk_t * chunks, uint8_t chunks_count)
+{
+    return side_write_vector(&m_client, chunks, chunks_count);
+}
+
+static bridge_callback_result_t server_read(uint8_t * byte, uint32_t timeout_ms)
+{
+    uint16_t received;
+    return side_read(&m_server, byte, 1, &received, timeout_ms);
+}
+
+static bridge_callback_result_t server_read_bulk(uint8_t * data, uint16_t max_len, uint16_t * out_len, uint32_t timeout_ms)
+{
+    return side_read(&m_server, data, max_len, out_len, timeout_ms);
+}
+
+static bridge_callback_result_t server_write(uint8_t * data, uint16_t data_len)
+{
+    return side_write(&m_server, data, data_len);
+}
+
+static bridge_callback_result_t server_write_vector(const bridge_write_chunk_t * chunks, uint8_t chunks_count)
+{
+    return side_write_vector(&m_server, chunks, chunks_count);
+}
+
+//Serves requests until the client closes its end
+static void * server_thread(void * arg)
+{
+    (void)arg;
+    
+    device_info_t info =
+    {
+        .hardware_version = 1,
+        .firmware_version = 1
+    };
+    
+    while (true)
+    {
+        bridge_request_t request;
+        bridge_protocol_result_t result = bridge_protocol_request_read(server_read, UINT32_MAX, &request);
+        
+        if (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
+        {
+            break;
+        }
+        
+        if ((result == BRIDGE_PROTOCOL_RESULT_SUCCESS) && (request.type == BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO))
+        {
+            bridge_protocol_get_device_info_answer(server_write, &info);
+        }
+        else if ((result == BRIDGE_PROTOCOL_RESULT_SUCCESS) && (request.type == BRIDGE_REQUEST_TYPE_BATCH))
+        {
+            bridge_answer_t answer;
+            bridge_batch_answer_init(&answer);
+            
+            bridge_batch_iterator_t iterator;
+            bridge_request_t item;
+            bridge_batch_request_iterator_init(&iterator, &request);
+            while (bridge_batch_request_next(&iterator, &item))
+            {
+                bridge_answer_t item_answer;
+                item_answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+                item_answer.data.get_device_info.info = info;
+                bridge_batch_answer_add(&answer, item.type, &item_answer);
+            }
+            
+            bridge_protocol_batch_answer(server_write, &answer);
+        }
+    }
+    
+    return NULL;
+}
+
+static void callbacks_register(const benchmark_case_t * benchmark_case,
+                               bool enable)
+{
+    bridge_protocol_bulk_read_register(client_read, (enable && benchmark_case->bulk_read) ? client_read_bulk : NULL);
+    bridge_protocol_bulk_read_register(server_read, (enable && benchmark_case->bulk_read) ? server_read_bulk : NULL);
+    bridge_protocol_vector_write_register(client_write, (enable && benchmark_case->vector_write) ? client_write_vector : NULL);
+    bridge_protocol_vector_write_register(server_write, (enable && benchmark_case->vector_write) ? server_write_vector : NULL);
+}
+
+/**@brief Runs calls of one kind and prints syscalls and time per call.
+ *
+ * @param[in] name  Name of the kind of calls.
+ * @param[in] batch Make BATCH calls instead of GET_DEVICE_INFO ones.
+ * @param[in] calls Number of calls.
+ *
+ * @retval true  Every call succeeded.
+ * @retval false A call failed.
+ */
+static bool calls_run(const char * name,
+                      bool batch,
+                      uint32_t calls)
+{
+    bridge_request_t request;
+    bridge_request_t item = { .type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO };
+    bridge_batch_request_init(&request);
+    for (uint32_t i = 0; i < BENCHMARK_BATCH_ITEMS; i++)
+    {
+        bridge_batch_request_add(&request, &item);
+    }
+    
+    uint64_t syscalls = m_client.syscalls + m_server.syscalls;
+    uint64_t start = time_ns_get();
+    
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        bridge_protocol_result_t result;
+        
+        if (batch)
+        {
+            bridge_answer_t answer;
+            result = bridge_protocol_batch(client_read, client_write, &request, &answer);
+        }
+        else
+        {
+            device_info_t info;
+            result = bridge_protocol_get_device_info(client_read, client_write, &info);
+        }
+        
+        if (result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            printf("%s: call failed with result %d\n", name, (int)result);
+            return false;
+        }
+    }
+    
+    uint64_t wall_ns = time_ns_get() - start;
+    syscalls = (m_client.syscalls + m_server.syscalls) - syscalls;
+    
+    //Every call is two messages: request and answer
+    printf("  %-16s %12.1f %12.0f\n", name, (double)syscalls / (2.0 * calls), (double)wall_ns / (2.0 * calls));
+    
+    return true;
+}
+
+static bool case_run(const benchmark_case_t * benchmark_case,
+                     uint32_t calls)
+{
+    int requests[2];
+    int answers[2];
+    if ((pipe(requests) != 0) || (pipe(answers) != 0))
+    {
+        printf("pipes can't be created\n");
+        return false;
+    }
+    
+    m_client.read_fd = answers[0];
+    m_client.write_fd = requests[1];
+    m_server.read_fd = requests[0];
+    m_server.write_fd = answers[1];
+    
+    //Registrations are not synchronized, so they are changed while no protocol call runs
+    callbacks_register(benchmark_case, true);
+    
+    pthread_t server;
+    pthread_create(&server, NULL, server_thread, NULL);
+    
+    printf("%s\n", benchmark_case->name);
+    bool success = calls_run("get_device_info", false, calls) && calls_run("batch", true, calls);
+    
+    close(requests[1]);
+    pthread_join(server, NULL);
+    close(requests[0]);
+    close(answers[0]);
+    close(answers[1]);
+    
+    callbacks_register(benchmark_case, false);
+    
+    return success;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t calls = (argc > 1) ? (uint32_t)atoi(argv[1]) : BENCHMARK_DEFAULT_CALLS;
+    
+    printf("%u calls of every kind, both sides counted, per message (request or answer)\n", calls);
+    printf("  %-16s %12s %12s\n", "call", "syscalls", "ns");
+    
+    for (size_t i = 0; i < (sizeof(m_cases) / sizeof(m_cases[0])); i++)
+    {
+        if (case_run(&m_cases[i], calls) == false)
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "bridge_batch.h"
+#include "bridge_frame.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Returns offset of the first free byte or BRIDGE_FRAME_SIZE_INVALID if there is no room for the item
+static uint16_t item_offset_get(const uint8_t * items, 
+                                uint8_t count, 
+                                bool answer_items, 
+                                uint16_t item_size)
+{
+    if (count == UINT8_MAX)
+    {
+        return BRIDGE_FRAME_SIZE_INVALID;
+    }
+    
+    uint16_t offset = bridge_frame_batch_items_size_get(items, count, answer_items);
+    if ((offset == BRIDGE_FRAME_SIZE_INVALID) || ((uint32_t)offset + item_size > BRIDGE_PROTOCOL_BATCH_MAX_SIZE))
+    {
+        return BRIDGE_FRAME_SIZE_INVALID;
+    }
+    
+    return offset;
+}
+
+//Size of the answer to batch request if all requests are answered with SUCCESS
+static uint32_t answer_max_size_get(const bridge_request_t * batch)
+{
+    uint32_t size = 0;
+    
+    bridge_batch_iterator_t iterator;
+    bridge_request_t item;
+    bridge_batch_request_iterator_init(&iterator, batch);
+    while (bridge_batch_request_next(&iterator, &item))
+    {
+        size += BRIDGE_FRAME_BATCH_ANSWER_ITEM_HEADER_SIZE + 
+                bridge_frame_batch_item_payload_size_get(item.type, BRIDGE_ANSWER_TYPE_SUCCESS, true);
+    }
+    
+    return size;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void bridge_batch_request_init(bridge_request_t * batch)
+{
+    batch->type = BRIDGE_REQUEST_TYPE_BATCH;
+    batch->data.batch.count = 0;
+}
+
+bool bridge_batch_request_add(bridge_request_t * batch, 
+                              const bridge_request_t * item)
+{
+    uint16_t payload_size = bridge_frame_batch_item_payload_size_get(item->type, BRIDGE_ANSWER_TYPE_SUCCESS, false);
+    if (payload_size == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return false;
+    }
+    
+    uint16_t offset = item_offset_get(batch->data.batch.items, 
+                                      batch->data.batch.count, 
+                                      false, 
+                                      BRIDGE_FRAME_BATCH_REQUEST_ITEM_HEADER_SIZE + payload_size);
+    
+    if (offset == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return false;
+    }
+    
+    //Server should be able to answer every request of the batch
+    uint32_t answer_size = answer_max_size_get(batch) + BRIDGE_FRAME_BATCH_ANSWER_ITEM_HEADER_SIZE + 
+                           bridge_frame_batch_item_payload_size_get(item->type, BRIDGE_ANSWER_TYPE_SUCCESS, true);
+    
+    if (answer_size > BRIDGE_PROTOCOL_BATCH_MAX_SIZE)
+    {
+        return false;
+    }
+    
+    //Encoder writes the whole data member, only the item payload is packed
+    uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+    bridge_frame_request_data_encode(item, payload);
+    
+    uint16_t request_type = (uint16_t)item->type;
+    BRIDGE_SCHEMA_ENCODE(uint16_t)(&request_type, &batch->data.batch.items[offset]);
+    offset += sizeof(request_type);
+    memcpy(&batch->data.batch.items[offset], payload, payload_size);
+    
+    batch->data.batch.count++;
+    
+    return true;
+}
+
+void bridge_batch_answer_init(bridge_answer_t * batch)
+{
+    batch->type = BRIDGE_ANSWER_TYPE_SUCCESS;
+    batch->data.batch.count = 0;
+}
+
+bool bridge_batch_answer_add(bridge_answer_t * batch, 
+                             bridge_request_type_t request_type, 
+                             const bridge_answer_t * item)
+{
+    uint16_t payload_size = bridge_frame_batch_item_payload_size_get(request_type, item->type, true);
+    if (payload_size == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return false;
+    }
+    
+    uint16_t offset = item_offset_get(batch->data.batch.items, 
+                                      batch->data.batch.count, 
+                                      true, 
+                                      BRIDGE_FRAME_BATCH_ANSWER_ITEM_HEADER_SIZE + payload_size);
+    
+    if (offset == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return false;
+    }
+    
+    uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+    bridge_frame_answer_data_encode(request_type, item->type, &item->data, payload);
+    
+    uint16_t packed_request_type = (uint16_t)request_type;
+    BRIDGE_SCHEMA_ENCODE(uint16_t)(&packed_request_type, &batch->data.batch.items[offset]);
+    offset += sizeof(packed_request_type);
+    batch->data.batch.items[offset] = (uint8_t)item->type;
+    offset += sizeof(uint8_t);
+    memcpy(&batch->data.batch.items[offset], payload, payload_size);
+    
+    batch->data.batch.count++;
+    
+    return true;
+}
+
+void bridge_batch_request_iterator_init(bridge_batch_iterator_t * iterator, 
+                                        const bridge_request_t * batch)
+{
+    iterator->items = batch->data.batch.items;
+    iterator->count = batch->data.batch.count;
+    iterator->index = 0;
+    iterator->offset = 0;
+}
+
+bool bridge_batch_request_next(bridge_batch_iterator_t * iterator, 
+                               bridge_request_t * out_item)
+{
+    if (iterator->index >= iterator->count)
+    {
+        return false;
+    }
+    
+    //Batch is validated on reception, so every item fits the buffer
+    uint16_t request_type;
+    BRIDGE_SCHEMA_DECODE(uint16_t)(&iterator->items[iterator->offset], &request_type);
+    iterator->offset += sizeof(request_type);
+    
+    out_item->type = (bridge_request_type_t)request_type;
+    
+    uint16_t payload_size = bridge_frame_batch_item_payload_size_get(out_item->type, BRIDGE_ANSWER_TYPE_SUCCESS, false);
+    memcpy(&out_item->data, &iterator->items[iterator->offset], payload_size);
+    bridge_frame_request_data_decode((const uint8_t*)&out_item->data, out_item);
+    iterator->offset += payload_size;
+    
+    iterator->index++;
+    
+    return true;
+}
+
+void bridge_batch_answer_iterator_init(bridge_batch_iterator_t * iterator, 
+                                       const bridge_answer_t * batch)
+{
+    iterator->items = batch->data.batch.items;
+    iterator->count = batch->data.batch.count;
+    iterator->index = 0;
+    iterator->offset = 0;
+}
+
+bool bridge_batch_answer_next(bridge_batch_iterator_t * iterator, 
+                              bridge_request_type_t * out_request_type, 
+                              bridge_answer_t * out_item)
+{
+    if (iterator->index >= iterator->count)
+    {
+        return false;
+    }
+    
+    //Batch is validated on reception, so every item fits the buffer
+    uint16_t request_type;
+    BRIDGE_SCHEMA_DECODE(uint16_t)(&iterator->items[iterator->offset], &request_type);
+    iterator->offset += sizeof(request_type);
+    
+    *out_request_type = (bridge_request_type_t)request_type;
+    out_item->type = (bridge_answer_type_t)iterator->items[iterator->offset];
+    iterator->offset += sizeof(uint8_t);
+    
+    uint16_t payload_size = bridge_frame_batch_item_payload_size_get(*out_request_type, out_item->type, true);
+    memcpy(&out_item->data, &iterator->items[iterator->offset], payload_size);
+    bridge_frame_answer_data_decode(*out_request_type, out_item->type, (const uint8_t*)&out_item->data, &out_item->data);
+    iterator->offset += payload_size;
+    
+    iterator->index++;
+    
+    return true;
+}
\ No newline at end of file
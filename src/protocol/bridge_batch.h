@@ -0,0 +1,116 @@
+#ifndef _BRIDGE_BATCH_H_
+#define _BRIDGE_BATCH_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_batch Batch of bridge communication protocol requests
+ *
+ * @brief Helpers to pack several requests into one BRIDGE_REQUEST_TYPE_BATCH request and to walk
+ * the answers, so many small requests cost one round trip instead of one per request.
+ *
+ * Items are packed back-to-back into data.batch.items with no padding, so the helpers below should be
+ * used instead of accessing the buffer directly. Batch can't contain another batch. Items which server
+ * doesn't know should be answered with BRIDGE_ANSWER_TYPE_REQUEST_REJECTED to keep answers in order.
+ *
+ * Client fills the request with bridge_batch_request_add() and sends it by bridge_protocol_batch().
+ * Server walks received request with bridge_batch_request_next(), adds answer for every item
+ * with bridge_batch_answer_add() in the same order and sends it by bridge_protocol_batch_answer().
+ * Client then walks answers with bridge_batch_answer_next().
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bridge_protocol.h"
+
+/**@brief Batch iterator. */
+typedef struct
+{
+    //Internal data
+    const uint8_t * items;
+    uint8_t count;
+    uint8_t index;
+    uint16_t offset;
+} bridge_batch_iterator_t;
+
+/**@brief Initialize empty batch request.
+ *
+ * @param[out] batch Request to initialize.
+ */
+void bridge_batch_request_init(bridge_request_t * batch);
+
+/**@brief Append request to batch request.
+ *
+ * @param[in,out] batch Batch request.
+ * @param[in]     item  Request to append.
+ *
+ * @retval true  Request appended.
+ * @retval false Batch or answer to it would be full or request of this type can't be batched.
+ */
+bool bridge_batch_request_add(bridge_request_t * batch, 
+                              const bridge_request_t * item);
+
+/**@brief Initialize empty batch answer.
+ *
+ * @param[out] batch Answer to initialize.
+ */
+void bridge_batch_answer_init(bridge_answer_t * batch);
+
+/**@brief Append answer to batch answer.
+ *
+ * @param[in,out] batch        Batch answer.
+ * @param[in]     request_type Type of request being answered.
+ * @param[in]     item         Answer to append.
+ *
+ * @retval true  Answer appended.
+ * @retval false Batch is full or request of this type can't be batched.
+ */
+bool bridge_batch_answer_add(bridge_answer_t * batch, 
+                             bridge_request_type_t request_type, 
+                             const bridge_answer_t * item);
+
+/**@brief Initialize iterator over requests of batch request.
+ *
+ * @param[out] iterator Iterator to initialize.
+ * @param[in]  batch    Batch request. It should outlive the iterator.
+ */
+void bridge_batch_request_iterator_init(bridge_batch_iterator_t * iterator, 
+                                        const bridge_request_t * batch);
+
+/**@brief Get next request of batch request.
+ *
+ * @param[in,out] iterator Iterator.
+ * @param[out]    out_item Pointer to store request.
+ *
+ * @retval true  Request stored.
+ * @retval false No more requests.
+ */
+bool bridge_batch_request_next(bridge_batch_iterator_t * iterator, 
+                               bridge_request_t * out_item);
+
+/**@brief Initialize iterator over answers of batch answer.
+ *
+ * @param[out] iterator Iterator to initialize.
+ * @param[in]  batch    Batch answer. It should outlive the iterator.
+ */
+void bridge_batch_answer_iterator_init(bridge_batch_iterator_t * iterator, 
+                                       const bridge_answer_t * batch);
+
+/**@brief Get next answer of batch answer.
+ *
+ * @param[in,out] iterator         Iterator.
+ * @param[out]    out_request_type Pointer to store type of request being answered.
+ * @param[out]    out_item         Pointer to store answer.
+ *
+ * @retval true  Answer stored.
+ * @retval false No more answers.
+ */
+bool bridge_batch_answer_next(bridge_batch_iterator_t * iterator, 
+                              bridge_request_type_t * out_request_type, 
+                              bridge_answer_t * out_item);
+
+#endif
+
+/** @} */
\ No newline at end of file
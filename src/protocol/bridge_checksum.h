@@ -0,0 +1,52 @@
+#ifndef _BRIDGE_CHECKSUM_H_
+#define _BRIDGE_CHECKSUM_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_checksum Message checksum used by bridge communication protocol
+ *
+ * @brief Name  : CRC-16 CCITT
+ *        Poly  : 0x1021    x^16 + x^12 + x^5 + 1
+ *        Init  : 0xFFFF
+ *        Revert: false
+ *        XorOut: 0x0000
+ *        Check : 0x29B1 ("123456789")
+ *        MaxLen: 4095 bytes
+ *
+ * Checksum is calculated with lookup tables. BRIDGE_CHECKSUM_SLICES sets the number of tables and 
+ * the number of bytes processed per iteration:
+ * - 1 - classic byte-wise table, 512 bytes of constant data;
+ * - 4 - slice-by-4, 2 KB of constant data;
+ * - 8 - slice-by-8, 4 KB of constant data, the fastest one for long messages.
+ *
+ * Result doesn't depend on the selected engine.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+
+#ifndef BRIDGE_CHECKSUM_SLICES
+#define BRIDGE_CHECKSUM_SLICES      8
+#endif
+
+/**@brief Get checksum initial value.
+ *
+ * @return Initial value to pass to the first bridge_checksum_append() call.
+ */
+uint16_t bridge_checksum_init(void);
+
+/**@brief Append data to checksum.
+ *
+ * @param[in] current_crc Checksum of the previous data (or initial value).
+ * @param[in] data        Pointer to data.
+ * @param[in] data_len    Length of the data in bytes.
+ *
+ * @return Checksum of the previous data followed by the new one.
+ */
+uint16_t bridge_checksum_append(uint16_t current_crc, const void * data, uint16_t data_len);
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "bridge_compress.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define MATCH_FLAG          0x80
+#define NO_POSITION         UINT16_MAX
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static uint16_t hash_get(const uint8_t * data)
+{
+    uint32_t value = (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16);
+    
+    return (uint16_t)((value * 2654435761u) >> (32 - BRIDGE_COMPRESS_HASH_BITS));
+}
+
+//Writes literal runs for data[start..end), returns false if output doesn't fit
+static bool literals_write(const uint8_t * data,
+                           uint16_t start,
+                           uint16_t end,
+                           uint8_t * out,
+                           uint16_t out_max,
+                           uint16_t * out_len)
+{
+    while (start < end)
+    {
+        uint16_t count = end - start;
+        count = (count < BRIDGE_COMPRESS_MAX_LITERALS) ? count : BRIDGE_COMPRESS_MAX_LITERALS;
+        
+        if ((uint32_t)*out_len + 1 + count > out_max)
+        {
+            return false;
+        }
+        
+        out[(*out_len)++] = (uint8_t)(count - 1);
+        memcpy(&out[*out_len], &data[start], count);
+        *out_len += count;
+        start += count;
+    }
+    
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+uint16_t bridge_compress_encode(const uint8_t * data,
+                                uint16_t data_len,
+                                uint8_t * out,
+                                uint16_t out_max)
+{
+    //Last position of every hash of three bytes, greedy matching against it only
+    uint16_t positions[BRIDGE_COMPRESS_HASH_SIZE];
+    memset(positions, 0xFF, sizeof(positions));
+    
+    uint16_t out_len = 0;
+    uint16_t literals_start = 0;
+    uint16_t i = 0;
+    
+    while ((uint32_t)i + BRIDGE_COMPRESS_MIN_MATCH <= data_len)
+    {
+        uint16_t hash = hash_get(&data[i]);
+        uint16_t candidate = positions[hash];
+        positions[hash] = i;
+        
+        uint16_t match_len = 0;
+        if ((candidate != NO_POSITION) && ((i - candidate) <= BRIDGE_COMPRESS_WINDOW_SIZE))
+        {
+            uint16_t max_len = data_len - i;
+            max_len = (max_len < BRIDGE_COMPRESS_MAX_MATCH) ? max_len : BRIDGE_COMPRESS_MAX_MATCH;
+            
+            while ((match_len < max_len) && (data[candidate + match_len] == data[i + match_len]))
+            {
+                match_len++;
+            }
+        }
+        
+        if (match_len < BRIDGE_COMPRESS_MIN_MATCH)
+        {
+            i++;
+            continue;
+        }
+        
+        if ((literals_write(data, literals_start, i, out, out_max, &out_len) == false) ||
+            ((uint32_t)out_len + 2 > out_max))
+        {
+            return 0;
+        }
+        
+        out[out_len++] = (uint8_t)(MATCH_FLAG | (match_len - BRIDGE_COMPRESS_MIN_MATCH));
+        out[out_len++] = (uint8_t)(i - candidate - 1);
+        
+        //Positions inside the match are remembered too, the next repeat may start there
+        for (uint16_t j = i + 1; (j < i + match_len) && ((uint32_t)j + BRIDGE_COMPRESS_MIN_MATCH <= data_len); j++)
+        {
+            positions[hash_get(&data[j])] = j;
+        }
+        
+        i += match_len;
+        literals_start = i;
+    }
+    
+    if (literals_write(data, literals_start, data_len, out, out_max, &out_len) == false)
+    {
+        return 0;
+    }
+    
+    return out_len;
+}
+
+uint16_t bridge_compress_decode(const uint8_t * data,
+                                uint16_t data_len,
+                                uint8_t * out,
+                                uint16_t out_max)
+{
+    uint16_t in_pos = 0;
+    uint16_t out_len = 0;
+    
+    while (in_pos < data_len)
+    {
+        uint8_t token = data[in_pos++];
+        
+        if ((token & MATCH_FLAG) == 0)
+        {
+            uint16_t count = (uint16_t)token + 1;
+            if ((count > (data_len - in_pos)) || (count > (out_max - out_len)))
+            {
+                return BRIDGE_COMPRESS_SIZE_INVALID;
+            }
+            
+            memcpy(&out[out_len], &data[in_pos], count);
+            in_pos += count;
+            out_len += count;
+            continue;
+        }
+        
+        if (in_pos >= data_len)
+        {
+            return BRIDGE_COMPRESS_SIZE_INVALID;
+        }
+        
+        uint16_t length = (uint16_t)(token & ~MATCH_FLAG) + BRIDGE_COMPRESS_MIN_MATCH;
+        uint16_t offset = (uint16_t)data[in_pos++] + 1;
+        if ((offset > out_len) || (length > (out_max - out_len)))
+        {
+            return BRIDGE_COMPRESS_SIZE_INVALID;
+        }
+        
+        //Byte by byte, match may overlap the bytes it produces
+        for (uint16_t i = 0; i < length; i++, out_len++)
+        {
+            out[out_len] = out[out_len - offset];
+        }
+    }
+    
+    return out_len;
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef _BRIDGE_COMPRESS_H_
+#define _BRIDGE_COMPRESS_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_compress Payload compression of bridge communication protocol
+ *
+ * @brief Small LZ77 codec for message payloads. It needs no heap and no state between calls,
+ * encoder uses BRIDGE_COMPRESS_HASH_SIZE entries of stack, decoder only the output buffer.
+ * It suits repetitive payloads (arrays of close values, zero padded structures), random data
+ * is never sent compressed since encoder gives up when output isn't smaller than input.
+ *
+ * Compressed data is a sequence of tokens:
+ * - 0LLLLLLL: literal run, L + 1 bytes copied as is follow the token;
+ * - 1LLLLLLL OOOOOOOO: match, L + BRIDGE_COMPRESS_MIN_MATCH bytes are copied from O + 1 bytes back in output.
+ *   Match may overlap the bytes it produces, so a run of equal bytes is a literal and one match.
+ *
+ * Compression is negotiated by MATCH_PROTOCOL_VERSION (BRIDGE_PROTOCOL_FEATURE_COMPRESSION), see bridge_protocol.h.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+
+#define BRIDGE_COMPRESS_MIN_MATCH       3                       /**< Shorter repeats are sent as literals. */
+#define BRIDGE_COMPRESS_MAX_MATCH       (BRIDGE_COMPRESS_MIN_MATCH + 0x7F)
+#define BRIDGE_COMPRESS_MAX_LITERALS    0x80                    /**< Literals in one run. */
+#define BRIDGE_COMPRESS_WINDOW_SIZE     0x100                   /**< Matches are searched this far back. */
+#define BRIDGE_COMPRESS_SIZE_INVALID    UINT16_MAX
+
+#ifndef BRIDGE_COMPRESS_HASH_BITS
+#define BRIDGE_COMPRESS_HASH_BITS       8                       /**< Encoder remembers 2^bits recent positions. */
+#endif
+
+#define BRIDGE_COMPRESS_HASH_SIZE       (1 << BRIDGE_COMPRESS_HASH_BITS)
+
+/**@brief Compress data.
+ *
+ * @param[in]  data     Data to compress.
+ * @param[in]  data_len Length of data in bytes.
+ * @param[out] out      Buffer to store compressed data.
+ * @param[in]  out_max  Size of buffer. Data_len - 1 makes encoder give up as soon as compression doesn't pay off.
+ *
+ * @return Length of compressed data or 0 if it doesn't fit the buffer.
+ */
+uint16_t bridge_compress_encode(const uint8_t * data,
+                                uint16_t data_len,
+                                uint8_t * out,
+                                uint16_t out_max);
+
+/**@brief Decompress data.
+ *
+ * @param[in]  data     Compressed data.
+ * @param[in]  data_len Length of compressed data in bytes.
+ * @param[out] out      Buffer to store decompressed data.
+ * @param[in]  out_max  Size of buffer.
+ *
+ * @return Length of decompressed data or BRIDGE_COMPRESS_SIZE_INVALID if data is malformed or doesn't fit the buffer.
+ */
+uint16_t bridge_compress_decode(const uint8_t * data,
+                                uint16_t data_len,
+                                uint8_t * out,
+                                uint16_t out_max);
+
+#endif
+
+/** @} */
\ No newline at end of file
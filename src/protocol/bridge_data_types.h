@@ -6,19 +6,28 @@
  *
  * @defgroup bridge_data_types Structures for data exchange via bridge communication protocol
  *
+ * @brief Structures are described by field lists and declared from BRIDGE_SCHEMA_DATA_TYPES_LIST, see bridge_schema.h.
+ * For example, DEVICE_INFO_FIELDS gives device_info_t with packed size BRIDGE_SCHEMA_SIZE(device_info_t).
+ *
  * @{
  */
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "bridge_schema.h"
+
+/**@brief Device info structure fields, see bridge_schema.h. */
+#define DEVICE_INFO_FIELDS(FIELD, ARRAY) \
+    FIELD(uint32_t, hardware_version)   /* Device hardware version. */ \
+    FIELD(uint32_t, firmware_version)   /* Device firmware version. */
+
+/**@brief Structures used in requests and answers, X(type, fields). Structure used by another one goes first. */
+#define BRIDGE_SCHEMA_DATA_TYPES_LIST(X) \
+    X(device_info_t, DEVICE_INFO_FIELDS) \
+    /* Your structures: */ \
+    /* ... */
 
-/**@brief Device info structure.
-*/
-typedef struct
-{
-    uint32_t hardware_version;          /**< Device hardware version. */
-    uint32_t firmware_version;          /**< Device firmware version. */
-} device_info_t;
+BRIDGE_SCHEMA_DATA_TYPES_LIST(BRIDGE_SCHEMA_DECLARE)
 
 #endif
 
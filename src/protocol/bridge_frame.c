@@ -0,0 +1,387 @@
+#include "bridge_frame.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Size of request or answer data member, 0 if the member doesn't exist (see BRIDGE_REQUEST_LIST)
+#define DATA_SIZE_0(type, member) 0
+#define DATA_SIZE_1(type, member) sizeofmember(type, data.member)
+
+//Sizes are indexed by request type, BATCH payload has variable size, its maximal size is stored
+#define REQUEST_PAYLOAD_SIZE_ENTRY(name, member, request_data, answer_data) \
+    [BRIDGE_REQUEST_TYPE_##name] = DATA_SIZE_##request_data(bridge_request_t, member),
+#define ANSWER_PAYLOAD_SIZE_ENTRY(name, member, request_data, answer_data) \
+    [BRIDGE_REQUEST_TYPE_##name] = DATA_SIZE_##answer_data(bridge_answer_t, member),
+
+//Codec calls of request or answer data member, none if the member doesn't exist (see BRIDGE_REQUEST_LIST)
+#define DATA_ENCODE_CASE_0(name, type, value)
+#define DATA_ENCODE_CASE_1(name, type, value) \
+    case BRIDGE_REQUEST_TYPE_##name: { BRIDGE_SCHEMA_ENCODE(type)(&(value), out_payload); break; }
+#define DATA_DECODE_CASE_0(name, type, value)
+#define DATA_DECODE_CASE_1(name, type, value) \
+    case BRIDGE_REQUEST_TYPE_##name: { BRIDGE_SCHEMA_DECODE(type)(payload, &(value)); break; }
+
+#define REQUEST_DATA_ENCODE_CASE(name, member, request_data, answer_data) \
+    DATA_ENCODE_CASE_##request_data(name, bridge_##member##_request_t, request->data.member)
+#define REQUEST_DATA_DECODE_CASE(name, member, request_data, answer_data) \
+    DATA_DECODE_CASE_##request_data(name, bridge_##member##_request_t, out_request->data.member)
+#define ANSWER_DATA_ENCODE_CASE(name, member, request_data, answer_data) \
+    DATA_ENCODE_CASE_##answer_data(name, bridge_##member##_answer_t, data->member)
+#define ANSWER_DATA_DECODE_CASE(name, member, request_data, answer_data) \
+    DATA_DECODE_CASE_##answer_data(name, bridge_##member##_answer_t, out_data->member)
+
+//Compact header carries request type in one byte and is never longer than the standard one
+typedef char compact_request_type_check[(BRIDGE_REQUEST_TYPE_COUNT <= (UINT8_MAX + 1)) ? 1 : -1];
+typedef char compact_header_size_check[((BRIDGE_FRAME_COMPACT_TYPE_SIZE + BRIDGE_FRAME_VARINT_MAX_SIZE) <= 
+                                        BRIDGE_FRAME_HEADER_SIZE) ? 1 : -1];
+
+static const uint16_t m_request_payload_sizes[BRIDGE_REQUEST_TYPE_COUNT] =
+{
+    BRIDGE_REQUEST_LIST(REQUEST_PAYLOAD_SIZE_ENTRY)
+};
+
+static const uint16_t m_answer_payload_sizes[BRIDGE_REQUEST_TYPE_COUNT] =
+{
+    BRIDGE_REQUEST_LIST(ANSWER_PAYLOAD_SIZE_ENTRY)
+};
+
+//Unknown request types have no payload, so they are still received and may be rejected by server
+static uint16_t fixed_request_payload_size_get(bridge_request_type_t request_type)
+{
+    return (request_type < BRIDGE_REQUEST_TYPE_COUNT) ? m_request_payload_sizes[request_type] : 0;
+}
+
+static uint16_t fixed_answer_payload_size_get(bridge_request_type_t request_type, 
+                                              bridge_answer_type_t answer_type)
+{
+    if ((answer_type != BRIDGE_ANSWER_TYPE_SUCCESS) || (request_type >= BRIDGE_REQUEST_TYPE_COUNT))
+    {
+        return 0;
+    }
+    
+    return m_answer_payload_sizes[request_type];
+}
+
+//Payload size field of compact header, compressed flag is moved to bit 0 to keep small values in one byte
+static uint32_t compact_size_value_get(uint16_t size_field)
+{
+    return ((uint32_t)(size_field & ~BRIDGE_FRAME_COMPRESSED_FLAG) << 1) | 
+           ((size_field & BRIDGE_FRAME_COMPRESSED_FLAG) ? 1 : 0);
+}
+
+static uint16_t varint_encode(uint32_t value, 
+                              uint8_t * out)
+{
+    uint16_t size = 0;
+    
+    while (value >= 0x80)
+    {
+        out[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    
+    out[size++] = (uint8_t)value;
+    
+    return size;
+}
+
+static uint16_t compact_fixed_size_get(uint32_t options)
+{
+    return BRIDGE_FRAME_COMPACT_TYPE_SIZE + ((options & BRIDGE_LINK_OPTION_TAGGED) ? BRIDGE_FRAME_TAG_SIZE : 0);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+uint16_t bridge_frame_size_get(uint32_t options, 
+                               uint16_t payload_size)
+{
+    uint16_t header_size = BRIDGE_FRAME_HEADER_SIZE + ((options & BRIDGE_LINK_OPTION_TAGGED) ? BRIDGE_FRAME_TAG_SIZE : 0);
+    
+    if (options & BRIDGE_LINK_OPTION_COMPACT)
+    {
+        uint8_t varint[BRIDGE_FRAME_VARINT_MAX_SIZE];
+        header_size = compact_fixed_size_get(options) + varint_encode(compact_size_value_get(payload_size), varint);
+    }
+    
+    return ((options & BRIDGE_LINK_OPTION_SYNC) ? BRIDGE_FRAME_SYNC_SIZE : 0) + header_size + 
+           payload_size + BRIDGE_FRAME_CHECKSUM_SIZE;
+}
+
+uint16_t bridge_frame_header_encode(uint32_t options, 
+                                    uint32_t type, 
+                                    uint8_t tag, 
+                                    uint16_t size_field, 
+                                    uint8_t * out)
+{
+    uint16_t size = 0;
+    
+    if ((options & BRIDGE_LINK_OPTION_COMPACT) == 0)
+    {
+        BRIDGE_SCHEMA_ENCODE(uint16_t)(&size_field, &out[0]);
+        BRIDGE_SCHEMA_ENCODE(uint32_t)(&type, &out[sizeof(size_field)]);
+        size = BRIDGE_FRAME_HEADER_SIZE;
+        
+        if (options & BRIDGE_LINK_OPTION_TAGGED)
+        {
+            out[size++] = tag;
+        }
+        
+        return size;
+    }
+    
+    if (type > UINT8_MAX)
+    {
+        return BRIDGE_FRAME_SIZE_INVALID;
+    }
+    
+    out[size++] = (uint8_t)type;
+    
+    if (options & BRIDGE_LINK_OPTION_TAGGED)
+    {
+        out[size++] = tag;
+    }
+    
+    return size + varint_encode(compact_size_value_get(size_field), &out[size]);
+}
+
+uint16_t bridge_frame_header_size_get(uint32_t options, 
+                                      const uint8_t * header, 
+                                      uint16_t header_len)
+{
+    if ((options & BRIDGE_LINK_OPTION_COMPACT) == 0)
+    {
+        return BRIDGE_FRAME_HEADER_SIZE + ((options & BRIDGE_LINK_OPTION_TAGGED) ? BRIDGE_FRAME_TAG_SIZE : 0);
+    }
+    
+    //Every varint byte with bit 7 set is followed by one more, malformed size field is stopped by its maximal size
+    uint16_t size = compact_fixed_size_get(options) + 1;
+    while ((size <= header_len) && (header[size - 1] & 0x80) && 
+           (size < (compact_fixed_size_get(options) + BRIDGE_FRAME_VARINT_MAX_SIZE)))
+    {
+        size++;
+    }
+    
+    return size;
+}
+
+bool bridge_frame_header_decode(uint32_t options, 
+                                const uint8_t * header, 
+                                uint32_t * out_type, 
+                                uint8_t * out_tag, 
+                                uint16_t * out_size_field)
+{
+    if ((options & BRIDGE_LINK_OPTION_COMPACT) == 0)
+    {
+        BRIDGE_SCHEMA_DECODE(uint16_t)(&header[0], out_size_field);
+        BRIDGE_SCHEMA_DECODE(uint32_t)(&header[sizeof(*out_size_field)], out_type);
+        *out_tag = (options & BRIDGE_LINK_OPTION_TAGGED) ? header[BRIDGE_FRAME_HEADER_SIZE] : 0;
+        
+        return true;
+    }
+    
+    uint16_t offset = 0;
+    *out_type = header[offset++];
+    *out_tag = (options & BRIDGE_LINK_OPTION_TAGGED) ? header[offset++] : 0;
+    
+    uint32_t value = 0;
+    for (uint16_t i = 0; i < BRIDGE_FRAME_VARINT_MAX_SIZE; i++)
+    {
+        uint8_t byte = header[offset + i];
+        value |= (uint32_t)(byte & 0x7F) << (7 * i);
+        
+        if ((byte & 0x80) == 0)
+        {
+            if (value > UINT16_MAX)
+            {
+                return false;
+            }
+            
+            *out_size_field = (uint16_t)(value >> 1) | ((value & 1) ? BRIDGE_FRAME_COMPRESSED_FLAG : 0);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+uint16_t bridge_frame_request_payload_max_size_get(bridge_request_type_t request_type)
+{
+    return fixed_request_payload_size_get(request_type);
+}
+
+uint16_t bridge_frame_request_payload_size_get(const bridge_request_t * request)
+{
+    if (request->type == BRIDGE_REQUEST_TYPE_BATCH)
+    {
+        uint16_t items_size = bridge_frame_batch_items_size_get(request->data.batch.items, 
+                                                                request->data.batch.count, 
+                                                                false);
+        
+        return (items_size == BRIDGE_FRAME_SIZE_INVALID) ? 
+               BRIDGE_FRAME_SIZE_INVALID : sizeof(request->data.batch.count) + items_size;
+    }
+    
+    //Only the used part of chunk data is sent
+    if (request->type == BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK)
+    {
+        uint16_t length = request->data.transfer_chunk.length;
+        
+        return (length > BRIDGE_PROTOCOL_CHUNK_MAX_SIZE) ? 
+               BRIDGE_FRAME_SIZE_INVALID : 
+               sizeofmember(bridge_request_t, data.transfer_chunk) - BRIDGE_PROTOCOL_CHUNK_MAX_SIZE + length;
+    }
+    
+    return fixed_request_payload_size_get(request->type);
+}
+
+uint16_t bridge_frame_answer_payload_max_size_get(bridge_request_type_t request_type, 
+                                                  bridge_answer_type_t answer_type)
+{
+    return fixed_answer_payload_size_get(request_type, answer_type);
+}
+
+uint16_t bridge_frame_answer_payload_size_get(bridge_request_type_t request_type, 
+                                              const bridge_answer_t * answer)
+{
+    return bridge_frame_answer_data_size_get(request_type, answer->type, &answer->data);
+}
+
+uint16_t bridge_frame_answer_data_size_get(bridge_request_type_t request_type, 
+                                           bridge_answer_type_t answer_type, 
+                                           const bridge_answer_data_t * data)
+{
+    if ((request_type == BRIDGE_REQUEST_TYPE_BATCH) && (answer_type == BRIDGE_ANSWER_TYPE_SUCCESS))
+    {
+        uint16_t items_size = bridge_frame_batch_items_size_get(data->batch.items, 
+                                                                data->batch.count, 
+                                                                true);
+        
+        return (items_size == BRIDGE_FRAME_SIZE_INVALID) ? 
+               BRIDGE_FRAME_SIZE_INVALID : sizeof(data->batch.count) + items_size;
+    }
+    
+    return fixed_answer_payload_size_get(request_type, answer_type);
+}
+
+void bridge_frame_request_data_encode(const bridge_request_t * request, 
+                                      uint8_t * out_payload)
+{
+    switch (request->type)
+    {
+        BRIDGE_REQUEST_LIST(REQUEST_DATA_ENCODE_CASE)
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+void bridge_frame_request_data_decode(const uint8_t * payload, 
+                                      bridge_request_t * out_request)
+{
+    switch (out_request->type)
+    {
+        BRIDGE_REQUEST_LIST(REQUEST_DATA_DECODE_CASE)
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+void bridge_frame_answer_data_encode(bridge_request_type_t request_type, 
+                                     bridge_answer_type_t answer_type, 
+                                     const bridge_answer_data_t * data, 
+                                     uint8_t * out_payload)
+{
+    if (answer_type != BRIDGE_ANSWER_TYPE_SUCCESS)
+    {
+        return;
+    }
+    
+    switch (request_type)
+    {
+        BRIDGE_REQUEST_LIST(ANSWER_DATA_ENCODE_CASE)
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+void bridge_frame_answer_data_decode(bridge_request_type_t request_type, 
+                                     bridge_answer_type_t answer_type, 
+                                     const uint8_t * payload, 
+                                     bridge_answer_data_t * out_data)
+{
+    if (answer_type != BRIDGE_ANSWER_TYPE_SUCCESS)
+    {
+        return;
+    }
+    
+    switch (request_type)
+    {
+        BRIDGE_REQUEST_LIST(ANSWER_DATA_DECODE_CASE)
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+uint16_t bridge_frame_batch_item_payload_size_get(bridge_request_type_t request_type, 
+                                                  bridge_answer_type_t answer_type, 
+                                                  bool answer_item)
+{
+    if ((request_type == BRIDGE_REQUEST_TYPE_BATCH) || (request_type == BRIDGE_REQUEST_TYPE_UNDEFINED))
+    {
+        return BRIDGE_FRAME_SIZE_INVALID;
+    }
+    
+    return (answer_item) ? 
+           fixed_answer_payload_size_get(request_type, answer_type) : 
+           fixed_request_payload_size_get(request_type);
+}
+
+uint16_t bridge_frame_batch_items_size_get(const uint8_t * items, 
+                                           uint8_t items_count, 
+                                           bool answer_items)
+{
+    const uint16_t max_size = sizeofmember(bridge_request_t, data.batch.items);
+    const uint16_t header_size = (answer_items) ? 
+                                 BRIDGE_FRAME_BATCH_ANSWER_ITEM_HEADER_SIZE : 
+                                 BRIDGE_FRAME_BATCH_REQUEST_ITEM_HEADER_SIZE;
+    
+    uint32_t size = 0;
+    for (uint8_t i = 0; i < items_count; i++)
+    {
+        if ((size + header_size) > max_size)
+        {
+            return BRIDGE_FRAME_SIZE_INVALID;
+        }
+        
+        uint16_t request_type;
+        BRIDGE_SCHEMA_DECODE(uint16_t)(&items[size], &request_type);
+        
+        uint8_t answer_type = (answer_items) ? items[size + sizeof(request_type)] : BRIDGE_ANSWER_TYPE_SUCCESS;
+        
+        uint16_t payload_size = bridge_frame_batch_item_payload_size_get((bridge_request_type_t)request_type, 
+                                                                         (bridge_answer_type_t)answer_type, 
+                                                                         answer_items);
+        
+        if (payload_size == BRIDGE_FRAME_SIZE_INVALID)
+        {
+            return BRIDGE_FRAME_SIZE_INVALID;
+        }
+        
+        size += header_size + payload_size;
+    }
+    
+    return (size > max_size) ? BRIDGE_FRAME_SIZE_INVALID : (uint16_t)size;
+}
\ No newline at end of file
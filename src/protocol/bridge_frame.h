@@ -0,0 +1,237 @@
+#ifndef _BRIDGE_FRAME_H_
+#define _BRIDGE_FRAME_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_frame Message format of bridge communication protocol
+ *
+ * @brief Internal helpers shared by protocol modules, not intended to be used by application.
+ *
+ * Message format:
+ * (uint16_t) payload size | (enum) request or answer type | (array) payload | (uint16_t) checksum of everything prior
+ *
+ * Request and answer types are both forced to 32 bits, so the header size doesn't depend on message direction.
+ *
+ * With BRIDGE_LINK_OPTION_TAGGED the header is followed by (uint8_t) tag, which is covered by checksum as well.
+ *
+ * With BRIDGE_LINK_OPTION_SYNC every message starts with two sync bytes, which are not covered by checksum.
+ * Receiver hunts for them to find the start of the next message right after corruption.
+ *
+ * With BRIDGE_LINK_OPTION_COMPACT the header is for slow buses, where it may be longer than the payload:
+ * (uint8_t) request or answer type | [(uint8_t) tag] | (varint) payload size field, shifted left by one bit
+ * with the compressed flag in bit 0. Varint is 7 bits per byte starting from the least significant ones,
+ * bit 7 is set in every byte but the last. Payload up to 63 bytes costs one byte of size, so the whole message
+ * without payload is 4 bytes instead of 8. Compact header carries request types up to 255 only.
+ *
+ * Header fields and checksum are written byte by byte little endian, payload is in wire layout of bridge_schema.h.
+ *
+ * Bit BRIDGE_FRAME_COMPRESSED_FLAG of payload size is set when the payload is compressed (see bridge_compress.h),
+ * the rest of the field is the size of compressed payload then. Only answers are compressed, and only after
+ * client offered BRIDGE_PROTOCOL_FEATURE_COMPRESSION. Checksum covers payload as sent.
+ *
+ * Payload of BATCH request: (uint8_t) items count | items, every item is (uint16_t) request type | (array) payload.
+ * Payload of BATCH answer:  (uint8_t) items count | items, every item is (uint16_t) request type | 
+ * (uint8_t) answer type | (array) payload. Batch can't contain another batch.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bridge_protocol.h"
+
+#define sizeofmember(type, member) sizeof(((type *)0)->member)
+
+#define BRIDGE_FRAME_SYNC_SIZE          2
+#define BRIDGE_FRAME_SYNC_BYTE_0        0xA5
+#define BRIDGE_FRAME_SYNC_BYTE_1        0x5A
+#define BRIDGE_FRAME_HEADER_SIZE        (sizeof(uint16_t) + sizeof(bridge_request_type_t))
+#define BRIDGE_FRAME_TAG_SIZE           sizeof(uint8_t)
+#define BRIDGE_FRAME_CHECKSUM_SIZE      sizeof(uint16_t)
+#define BRIDGE_FRAME_COMPRESSED_FLAG    0x8000
+#define BRIDGE_FRAME_COMPACT_TYPE_SIZE  sizeof(uint8_t)
+#define BRIDGE_FRAME_VARINT_MAX_SIZE    3
+#define BRIDGE_FRAME_MAX_PAYLOAD_SIZE   ((sizeofmember(bridge_request_t, data) > sizeofmember(bridge_answer_t, data)) ? \
+                                          sizeofmember(bridge_request_t, data) : sizeofmember(bridge_answer_t, data))
+#define BRIDGE_FRAME_MAX_SIZE           (BRIDGE_FRAME_SYNC_SIZE + BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE + \
+                                         BRIDGE_FRAME_MAX_PAYLOAD_SIZE + BRIDGE_FRAME_CHECKSUM_SIZE)
+
+#define BRIDGE_FRAME_BATCH_REQUEST_ITEM_HEADER_SIZE  sizeof(uint16_t)
+#define BRIDGE_FRAME_BATCH_ANSWER_ITEM_HEADER_SIZE   (sizeof(uint16_t) + sizeof(uint8_t))
+#define BRIDGE_FRAME_SIZE_INVALID                    UINT16_MAX
+
+/**@brief Get size of message on the bus.
+ *
+ * @param[in] options      Link options, combination of bridge_link_option_t.
+ * @param[in] payload_size Payload size in bytes as sent.
+ *
+ * @return Message size in bytes with sync bytes and checksum.
+ */
+uint16_t bridge_frame_size_get(uint32_t options, 
+                               uint16_t payload_size);
+
+/**@brief Encode message header, sync bytes are not included.
+ *
+ * @param[in]  options    Link options, combination of bridge_link_option_t.
+ * @param[in]  type       Request or answer type.
+ * @param[in]  tag        Tag of message, written only if link is tagged.
+ * @param[in]  size_field Payload size with BRIDGE_FRAME_COMPRESSED_FLAG set if payload is compressed.
+ * @param[out] out        Buffer of BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE bytes at least.
+ *
+ * @return Header size in bytes or BRIDGE_FRAME_SIZE_INVALID if type doesn't fit compact header.
+ */
+uint16_t bridge_frame_header_encode(uint32_t options, 
+                                    uint32_t type, 
+                                    uint8_t tag, 
+                                    uint16_t size_field, 
+                                    uint8_t * out);
+
+/**@brief Get size of header being received, sync bytes are not included. Size of compact header is known 
+ *        only when its last byte is received, so the size grows while header bytes come. Header is complete
+ *        when all the bytes of the returned size are received.
+ *
+ * @param[in] options    Link options, combination of bridge_link_option_t.
+ * @param[in] header     Received part of header. May be NULL if header_len is 0.
+ * @param[in] header_len Length of received part in bytes.
+ *
+ * @return Header size known so far.
+ */
+uint16_t bridge_frame_header_size_get(uint32_t options, 
+                                      const uint8_t * header, 
+                                      uint16_t header_len);
+
+/**@brief Decode complete header, sync bytes are not included.
+ *
+ * @param[in]  options        Link options, combination of bridge_link_option_t.
+ * @param[in]  header         Header.
+ * @param[out] out_type       Request or answer type.
+ * @param[out] out_tag        Tag of message, 0 if link is not tagged.
+ * @param[out] out_size_field Payload size with BRIDGE_FRAME_COMPRESSED_FLAG set if payload is compressed.
+ *
+ * @retval true  Header decoded.
+ * @retval false Header is malformed.
+ */
+bool bridge_frame_header_decode(uint32_t options, 
+                                const uint8_t * header, 
+                                uint32_t * out_type, 
+                                uint8_t * out_tag, 
+                                uint16_t * out_size_field);
+
+/**@brief Get maximal payload size of request. Used to check received header before payload reception.
+ *
+ * @param[in] request_type Type of request.
+ *
+ * @return Maximal payload size in bytes.
+ */
+uint16_t bridge_frame_request_payload_max_size_get(bridge_request_type_t request_type);
+
+/**@brief Get payload size of request. For requests with variable size (BATCH, TRANSFER_CHUNK) it depends on content.
+ *
+ * @param[in] request Request.
+ *
+ * @return Payload size in bytes or BRIDGE_FRAME_SIZE_INVALID if content is malformed.
+ */
+uint16_t bridge_frame_request_payload_size_get(const bridge_request_t * request);
+
+/**@brief Get maximal payload size of answer. Used to check received header before payload reception.
+ *
+ * @param[in] request_type Type of request being answered.
+ * @param[in] answer_type  Type of answer.
+ *
+ * @return Maximal payload size in bytes.
+ */
+uint16_t bridge_frame_answer_payload_max_size_get(bridge_request_type_t request_type, 
+                                                  bridge_answer_type_t answer_type);
+
+/**@brief Get payload size of answer. For answers with variable size (BATCH) it depends on content.
+ *
+ * @param[in] request_type Type of request being answered.
+ * @param[in] answer       Answer.
+ *
+ * @return Payload size in bytes or BRIDGE_FRAME_SIZE_INVALID if content is malformed.
+ */
+uint16_t bridge_frame_answer_payload_size_get(bridge_request_type_t request_type, 
+                                              const bridge_answer_t * answer);
+
+/**@brief Same as bridge_frame_answer_payload_size_get(), but for answer data outside of answer structure.
+ *
+ * @param[in] request_type Type of request being answered.
+ * @param[in] answer_type  Type of answer.
+ * @param[in] data         Answer data.
+ *
+ * @return Payload size in bytes or BRIDGE_FRAME_SIZE_INVALID if content is malformed.
+ */
+uint16_t bridge_frame_answer_data_size_get(bridge_request_type_t request_type, 
+                                           bridge_answer_type_t answer_type, 
+                                           const bridge_answer_data_t * data);
+
+/**@brief Encode request data to wire layout (see bridge_schema.h). Wire layout has the same field offsets
+ *        as the structure in memory, so payload may be encoded in place over the data.
+ *
+ * @param[in]  request     Request, its type selects the data member.
+ * @param[out] out_payload Buffer as large as request data (BRIDGE_FRAME_MAX_PAYLOAD_SIZE bytes are enough). The whole
+ *                         data member is encoded, variable requests send its first bridge_frame_request_payload_size_get() bytes.
+ */
+void bridge_frame_request_data_encode(const bridge_request_t * request, 
+                                      uint8_t * out_payload);
+
+/**@brief Decode request data from wire layout, may be done in place over the payload.
+ *
+ * @param[in]     payload     Buffer as large as request data with the payload at its start, the rest is ignored.
+ * @param[in,out] out_request Request with type set, its data member is filled.
+ */
+void bridge_frame_request_data_decode(const uint8_t * payload, 
+                                      bridge_request_t * out_request);
+
+/**@brief Encode answer data to wire layout, may be done in place over the data. Only SUCCESS answer carries data.
+ *
+ * @param[in]  request_type Type of request being answered.
+ * @param[in]  answer_type  Type of answer.
+ * @param[in]  data         Answer data.
+ * @param[out] out_payload  Buffer as large as answer data (BRIDGE_FRAME_MAX_PAYLOAD_SIZE bytes are enough).
+ */
+void bridge_frame_answer_data_encode(bridge_request_type_t request_type, 
+                                     bridge_answer_type_t answer_type, 
+                                     const bridge_answer_data_t * data, 
+                                     uint8_t * out_payload);
+
+/**@brief Decode answer data from wire layout, may be done in place over the payload.
+ *
+ * @param[in]  request_type Type of request being answered.
+ * @param[in]  answer_type  Type of answer.
+ * @param[in]  payload      Buffer as large as answer data with the payload at its start, the rest is ignored.
+ * @param[out] out_data     Answer data.
+ */
+void bridge_frame_answer_data_decode(bridge_request_type_t request_type, 
+                                     bridge_answer_type_t answer_type, 
+                                     const uint8_t * payload, 
+                                     bridge_answer_data_t * out_data);
+
+/**@brief Get size of batch items.
+ *
+ * @param[in] items        Packed items.
+ * @param[in] items_count  Number of items.
+ * @param[in] answer_items True if items belong to batch answer, false if to batch request.
+ *
+ * @return Size of items in bytes or BRIDGE_FRAME_SIZE_INVALID if items are malformed.
+ */
+uint16_t bridge_frame_batch_items_size_get(const uint8_t * items, 
+                                           uint8_t items_count, 
+                                           bool answer_items);
+
+/**@brief Get payload size of request or answer item of batch.
+ *
+ * @param[in] request_type Type of request.
+ * @param[in] answer_type  Type of answer (ignored for request item).
+ * @param[in] answer_item  True for answer item, false for request item.
+ *
+ * @return Payload size in bytes or BRIDGE_FRAME_SIZE_INVALID if the request can't be a batch item.
+ */
+uint16_t bridge_frame_batch_item_payload_size_get(bridge_request_type_t request_type, 
+                                                  bridge_answer_type_t answer_type, 
+                                                  bool answer_item);
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "bridge_histogram.h"
+#include <string.h>
+
+#define EXACT_LIMIT     (1UL << (BRIDGE_HISTOGRAM_SUB_BUCKET_BITS + 1))
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Index of the most significant bit set, value is not 0
+static uint32_t msb_get(uint32_t value)
+{
+#if defined(__GNUC__)
+    return 31 - (uint32_t)__builtin_clz(value);
+#else
+    uint32_t msb = 0;
+    while (value >>= 1)
+    {
+        msb++;
+    }
+    
+    return msb;
+#endif
+}
+
+static uint32_t bucket_index_get(uint32_t value)
+{
+    if (value < EXACT_LIMIT)
+    {
+        return value;
+    }
+    
+    if (value >= (1UL << BRIDGE_HISTOGRAM_MAX_BITS))
+    {
+        return BRIDGE_HISTOGRAM_BUCKETS_COUNT - 1;
+    }
+    
+    //Power of two selects the range, the next bits below the leading one select the bucket in it
+    uint32_t shift = msb_get(value) - BRIDGE_HISTOGRAM_SUB_BUCKET_BITS;
+    
+    return (shift << BRIDGE_HISTOGRAM_SUB_BUCKET_BITS) + (value >> shift);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void bridge_histogram_reset(bridge_histogram_t * histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void bridge_histogram_record(bridge_histogram_t * histogram,
+                             uint32_t value)
+{
+    histogram->buckets[bucket_index_get(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+void bridge_histogram_merge(bridge_histogram_t * histogram,
+                            const bridge_histogram_t * other)
+{
+    for (uint32_t i = 0; i < BRIDGE_HISTOGRAM_BUCKETS_COUNT; i++)
+    {
+        histogram->buckets[i] += other->buckets[i];
+    }
+    
+    histogram->count += other->count;
+    histogram->sum += other->sum;
+    
+    if (other->max > histogram->max)
+    {
+        histogram->max = other->max;
+    }
+}
+
+uint32_t bridge_histogram_bucket_value_get(uint32_t index)
+{
+    if (index < EXACT_LIMIT)
+    {
+        return index;
+    }
+    
+    uint32_t shift = (index >> BRIDGE_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    uint32_t mantissa = (index & ((1UL << BRIDGE_HISTOGRAM_SUB_BUCKET_BITS) - 1)) | (1UL << BRIDGE_HISTOGRAM_SUB_BUCKET_BITS);
+    
+    return mantissa << shift;
+}
+
+uint32_t bridge_histogram_percentile_get(const bridge_histogram_t * histogram,
+                                         double percentile)
+{
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    
+    //Rank of the value in sorted order rounded up, from the first value to the last one
+    double rank = (percentile * (double)histogram->count) / 100.0;
+    uint32_t target = (rank < 1.0) ? 1 : ((rank < (double)histogram->count) ? (uint32_t)rank : histogram->count);
+    if (((double)target < rank) && (target < histogram->count))
+    {
+        target++;
+    }
+    
+    uint32_t counted = 0;
+    for (uint32_t i = 0; i < (BRIDGE_HISTOGRAM_BUCKETS_COUNT - 1); i++)
+    {
+        counted += histogram->buckets[i];
+        if (counted >= target)
+        {
+            uint32_t bucket_max = bridge_histogram_bucket_value_get(i + 1) - 1;
+            return (bucket_max < histogram->max) ? bucket_max : histogram->max;
+        }
+    }
+    
+    return histogram->max;
+}
\ No newline at end of file
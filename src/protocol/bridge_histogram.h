@@ -0,0 +1,84 @@
+#ifndef _BRIDGE_HISTOGRAM_H_
+#define _BRIDGE_HISTOGRAM_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_histogram Latency histograms of bridge communication protocol
+ *
+ * @brief Histogram of unsigned values (latencies in microseconds) with bounded relative error, like HDR histogram.
+ * Every power of two range is split into 2^BRIDGE_HISTOGRAM_SUB_BUCKET_BITS buckets of equal width, values below
+ * 2^(BRIDGE_HISTOGRAM_SUB_BUCKET_BITS + 1) have buckets of their own. So a value is known within 1 / 2^BRIDGE_HISTOGRAM_SUB_BUCKET_BITS
+ * of itself whatever its magnitude, and recording is a few arithmetic operations without loops or allocation.
+ *
+ * Values from 2^BRIDGE_HISTOGRAM_MAX_BITS are recorded into the last bucket, max keeps the exact largest value.
+ * Size of histogram is 4 * BRIDGE_HISTOGRAM_BUCKETS_COUNT bytes plus 16, 720 bytes by default.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef BRIDGE_HISTOGRAM_SUB_BUCKET_BITS
+#define BRIDGE_HISTOGRAM_SUB_BUCKET_BITS    3                   /**< Buckets per power of two are 2^bits, relative error is 1 / 2^bits. */
+#endif
+
+#ifndef BRIDGE_HISTOGRAM_MAX_BITS
+#define BRIDGE_HISTOGRAM_MAX_BITS           24                  /**< Values are tracked up to 2^bits, about 16.7 s in microseconds. */
+#endif
+
+#define BRIDGE_HISTOGRAM_BUCKETS_COUNT      ((BRIDGE_HISTOGRAM_MAX_BITS - BRIDGE_HISTOGRAM_SUB_BUCKET_BITS + 1) << BRIDGE_HISTOGRAM_SUB_BUCKET_BITS)
+
+/**@brief Histogram. Should be initialized by bridge_histogram_reset() (zeroed memory is a valid empty histogram). */
+typedef struct
+{
+    uint32_t count;                                             /**< Values recorded. */
+    uint32_t max;                                               /**< Largest value recorded. */
+    uint64_t sum;                                               /**< Sum of values recorded, mean is sum / count. */
+    uint32_t buckets[BRIDGE_HISTOGRAM_BUCKETS_COUNT];           /**< Counts of values, see bridge_histogram_bucket_value_get(). */
+} bridge_histogram_t;
+
+/**@brief Empty histogram.
+ *
+ * @param[out] histogram Histogram.
+ */
+void bridge_histogram_reset(bridge_histogram_t * histogram);
+
+/**@brief Record value.
+ *
+ * @param[in] histogram Histogram.
+ * @param[in] value     Value to record.
+ */
+void bridge_histogram_record(bridge_histogram_t * histogram,
+                             uint32_t value);
+
+/**@brief Add all values recorded by one histogram to another one, e.g. to aggregate histograms of several links.
+ *
+ * @param[in,out] histogram Histogram values are added to.
+ * @param[in]     other     Histogram values are taken from.
+ */
+void bridge_histogram_merge(bridge_histogram_t * histogram,
+                            const bridge_histogram_t * other);
+
+/**@brief Get the smallest value counted by bucket.
+ *
+ * @param[in] index Bucket index, less than BRIDGE_HISTOGRAM_BUCKETS_COUNT.
+ *
+ * @return The smallest value of bucket, the next bucket starts right after the largest one.
+ */
+uint32_t bridge_histogram_bucket_value_get(uint32_t index);
+
+/**@brief Get value at percentile: at least percentile % of values recorded are not larger than it.
+ *
+ * @param[in] histogram  Histogram.
+ * @param[in] percentile Percentile from 0 to 100, e.g. 99.9.
+ *
+ * @return The largest value of bucket holding the percentile (but not above max), 0 if histogram is empty.
+ */
+uint32_t bridge_histogram_percentile_get(const bridge_histogram_t * histogram,
+                                         double percentile);
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,492 @@
+#include "bridge_parser.h"
+#include "bridge_checksum.h"
+#include "bridge_frame.h"
+#include "bridge_compress.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static void event_emit(bridge_parser_t * parser, 
+                       bridge_parser_event_type_t type, 
+                       bridge_request_type_t request_type, 
+                       uint8_t tag, 
+                       bridge_protocol_result_t result)
+{
+    bridge_parser_event_t event = 
+    {
+        .type = type,
+        .request_type = request_type,
+        .tag = tag,
+        .result = result,
+        .request = (type == BRIDGE_PARSER_EVENT_REQUEST) ? &parser->message.request : NULL,
+        .answer = (type == BRIDGE_PARSER_EVENT_ANSWER) ? &parser->message.answer : NULL
+    };
+    
+    parser->handler(parser->context, &event);
+}
+
+//Waiting for the next message starts with sync bytes if link is synchronized
+static void message_wait(bridge_parser_t * parser)
+{
+    parser->state = (parser->sync) ? BRIDGE_PARSER_STATE_SYNC : BRIDGE_PARSER_STATE_HEADER;
+    parser->received = 0;
+    parser->skipped_len = 0;
+}
+
+//Format is taken when the header starts, so switching it never breaks the message being received
+static uint32_t header_options_get(const bridge_parser_t * parser)
+{
+    return ((parser->header_compact) ? BRIDGE_LINK_OPTION_COMPACT : 0) | 
+           ((parser->header_tagged) ? BRIDGE_LINK_OPTION_TAGGED : 0);
+}
+
+//All expected answers are lost, the oldest request is reported
+static void expected_lose(bridge_parser_t * parser, 
+                          bridge_parser_event_type_t type, 
+                          bridge_protocol_result_t result)
+{
+    bridge_parser_expected_t oldest = { .tag = 0, .request_type = BRIDGE_REQUEST_TYPE_UNDEFINED };
+    if (parser->expected_count > 0)
+    {
+        oldest = parser->expected[0];
+    }
+    
+    parser->expected_count = 0;
+    
+    event_emit(parser, type, oldest.request_type, oldest.tag, result);
+}
+
+//Answers come in order of requests, with tagged link they are found by tag
+static bool expected_find(bridge_parser_t * parser)
+{
+    uint8_t index = 0;
+    
+    if (parser->header_tagged)
+    {
+        while ((index < parser->expected_count) && (parser->expected[index].tag != parser->tag))
+        {
+            index++;
+        }
+    }
+    
+    parser->answered = index;
+    
+    return (index < parser->expected_count);
+}
+
+static void recovered_process(bridge_parser_t * parser)
+{
+    message_wait(parser);
+    
+    event_emit(parser, BRIDGE_PARSER_EVENT_RECOVERED, BRIDGE_REQUEST_TYPE_UNDEFINED, 0, BRIDGE_PROTOCOL_RESULT_SUCCESS);
+}
+
+static void corrupted_process(bridge_parser_t * parser)
+{
+    parser->state = BRIDGE_PARSER_STATE_RECOVERING;
+    
+    expected_lose(parser, BRIDGE_PARSER_EVENT_CORRUPTED, BRIDGE_PROTOCOL_RESULT_CORRUPTED);
+    
+    //Synchronized parser doesn't wait for silence, hunting for sync bytes starts at once.
+    //Handler may have already started recovery by itself
+    if (parser->sync && (parser->state == BRIDGE_PARSER_STATE_RECOVERING))
+    {
+        recovered_process(parser);
+    }
+}
+
+//Returns false if header describes a message which can't be received in current mode
+static bool header_process(bridge_parser_t * parser)
+{
+    uint32_t type;
+    if (bridge_frame_header_decode(header_options_get(parser), parser->header, &type, &parser->tag, &parser->payload_size) == false)
+    {
+        return false;
+    }
+    
+    if (parser->mode == BRIDGE_PARSER_MODE_REQUEST)
+    {
+        parser->message.request.type = (bridge_request_type_t)type;
+        
+        return (parser->payload_size <= bridge_frame_request_payload_max_size_get(parser->message.request.type));
+    }
+    
+    parser->message.answer.type = (bridge_answer_type_t)type;
+    
+    //Compressed payload is always smaller than the original one, so the same limit applies
+    parser->compressed = ((parser->payload_size & BRIDGE_FRAME_COMPRESSED_FLAG) != 0);
+    parser->payload_size &= ~BRIDGE_FRAME_COMPRESSED_FLAG;
+    
+    return expected_find(parser) && 
+           (parser->payload_size <= bridge_frame_answer_payload_max_size_get(parser->expected[parser->answered].request_type, 
+                                                                             parser->message.answer.type));
+}
+
+//Data skipped while hunting which starts with a valid standard header is a message of the other side 
+//which dropped negotiated sync bytes, so it is a header failure. Anything else is noise.
+static bool skipped_header_check(bridge_parser_t * parser)
+{
+    parser->header_compact = false;
+    parser->header_tagged = parser->tagged;
+    
+    if (header_process(parser) == false)
+    {
+        return false;
+    }
+    
+    return (parser->mode == BRIDGE_PARSER_MODE_REQUEST) ? 
+           ((parser->message.request.type > BRIDGE_REQUEST_TYPE_UNDEFINED) && 
+            (parser->message.request.type < BRIDGE_REQUEST_TYPE_COUNT)) : 
+           (parser->message.answer.type <= BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS);
+}
+
+static void message_process(bridge_parser_t * parser)
+{
+    bridge_request_type_t request_type = (parser->mode == BRIDGE_PARSER_MODE_ANSWER) ? 
+                                         parser->expected[parser->answered].request_type : BRIDGE_REQUEST_TYPE_UNDEFINED;
+    
+    uint16_t checksum;
+    BRIDGE_SCHEMA_DECODE(uint16_t)(parser->checksum_received, &checksum);
+    
+    if (checksum != parser->checksum)
+    {
+        corrupted_process(parser);
+        return;
+    }
+    
+    if (parser->compressed)
+    {
+        parser->payload_size = bridge_compress_decode(parser->compressed_payload, 
+                                                      parser->payload_size, 
+                                                      (uint8_t*)&parser->message.answer.data, 
+                                                      bridge_frame_answer_payload_max_size_get(request_type, 
+                                                                                               parser->message.answer.type));
+        
+        if (parser->payload_size == BRIDGE_COMPRESS_SIZE_INVALID)
+        {
+            corrupted_process(parser);
+            return;
+        }
+    }
+    
+    if (parser->mode == BRIDGE_PARSER_MODE_REQUEST)
+    {
+        bridge_frame_request_data_decode((const uint8_t*)&parser->message.request.data, &parser->message.request);
+    }
+    else
+    {
+        bridge_frame_answer_data_decode(request_type, parser->message.answer.type, 
+                                        (const uint8_t*)&parser->message.answer.data, &parser->message.answer.data);
+    }
+    
+    //Size of variable messages is known only after their content is received
+    uint16_t payload_size = (parser->mode == BRIDGE_PARSER_MODE_REQUEST) ? 
+                            bridge_frame_request_payload_size_get(&parser->message.request) : 
+                            bridge_frame_answer_payload_size_get(request_type, &parser->message.answer);
+    
+    if (payload_size != parser->payload_size)
+    {
+        corrupted_process(parser);
+        return;
+    }
+    
+    message_wait(parser);
+    
+    if (parser->mode == BRIDGE_PARSER_MODE_REQUEST)
+    {
+        event_emit(parser, BRIDGE_PARSER_EVENT_REQUEST, parser->message.request.type, parser->tag, BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        return;
+    }
+    
+    bridge_protocol_result_t result;
+    switch (parser->message.answer.type)
+    {
+        case BRIDGE_ANSWER_TYPE_REQUEST_REJECTED:
+        {
+            result = BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED;
+            break;
+        }
+        
+        case BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS:
+        {
+            result = BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+            break;
+        }
+        
+        default:
+        {
+            result = BRIDGE_PROTOCOL_RESULT_SUCCESS;
+            break;
+        }
+    }
+    
+    //Expectation is removed before handler call, so handler is able to send the next request
+    parser->expected_count--;
+    memmove(&parser->expected[parser->answered], &parser->expected[parser->answered + 1], 
+            (parser->expected_count - parser->answered) * sizeof(parser->expected[0]));
+    
+    event_emit(parser, BRIDGE_PARSER_EVENT_ANSWER, request_type, parser->tag, result);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void bridge_parser_init(bridge_parser_t * parser, 
+                        bridge_parser_mode_t mode, 
+                        bridge_parser_event_handler_t handler, 
+                        void * context)
+{
+    memset(parser, 0, sizeof(*parser));
+    
+    parser->mode = mode;
+    parser->handler = handler;
+    parser->context = context;
+    parser->state = BRIDGE_PARSER_STATE_RECOVERING;
+    parser->between_bytes_timeout_ms = BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS;
+    parser->wait_answer_timeout_ms = BRIDGE_PROTOCOL_WAIT_ANSWER_TIMEOUT_MS;
+    parser->recover_timeout_ms = BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS;
+}
+
+void bridge_parser_sync_enable(bridge_parser_t * parser)
+{
+    parser->sync = true;
+    
+    if (parser->state == BRIDGE_PARSER_STATE_RECOVERING)
+    {
+        message_wait(parser);
+    }
+}
+
+void bridge_parser_options_set(bridge_parser_t * parser, 
+                               uint32_t options)
+{
+    bool sync = ((options & BRIDGE_LINK_OPTION_SYNC) != 0);
+    bool waiting = (parser->received == 0) && 
+                   ((parser->state == BRIDGE_PARSER_STATE_SYNC) || (parser->state == BRIDGE_PARSER_STATE_HEADER));
+    
+    parser->compact = ((options & BRIDGE_LINK_OPTION_COMPACT) != 0);
+    parser->tagged = ((options & BRIDGE_LINK_OPTION_TAGGED) != 0);
+    
+    //Parser waiting for the next message waits for it in the new format
+    if (sync != parser->sync)
+    {
+        parser->sync = sync;
+        
+        if (waiting)
+        {
+            message_wait(parser);
+        }
+    }
+}
+
+void bridge_parser_timeouts_set(bridge_parser_t * parser, 
+                                uint32_t between_bytes_timeout_ms, 
+                                uint32_t wait_answer_timeout_ms, 
+                                uint32_t recover_timeout_ms)
+{
+    parser->between_bytes_timeout_ms = between_bytes_timeout_ms;
+    parser->wait_answer_timeout_ms = wait_answer_timeout_ms;
+    parser->recover_timeout_ms = recover_timeout_ms;
+}
+
+void bridge_parser_feed(bridge_parser_t * parser, 
+                        const uint8_t * data, 
+                        size_t data_len)
+{
+    size_t i = 0;
+    while (i < data_len)
+    {
+        size_t available = data_len - i;
+        
+        switch (parser->state)
+        {
+            case BRIDGE_PARSER_STATE_SYNC:
+            {
+                uint8_t byte = data[i++];
+                
+                //Start of data is kept in the header buffer, which is free while hunting
+                uint8_t skipped_size = BRIDGE_FRAME_HEADER_SIZE + ((parser->tagged) ? BRIDGE_FRAME_TAG_SIZE : 0);
+                bool header_skipped = false;
+                if (parser->skipped_len < skipped_size)
+                {
+                    parser->header[parser->skipped_len++] = byte;
+                    header_skipped = (parser->skipped_len == skipped_size);
+                }
+                
+                if ((parser->received == 0) && (byte == BRIDGE_FRAME_SYNC_BYTE_0))
+                {
+                    parser->received = 1;
+                }
+                else if ((parser->received == 1) && (byte == BRIDGE_FRAME_SYNC_BYTE_1))
+                {
+                    parser->state = BRIDGE_PARSER_STATE_HEADER;
+                    parser->received = 0;
+                    parser->skipping = false;
+                }
+                else
+                {
+                    //Skipped data is only counted, a real loss of sync shows up as a broken header or checksum
+                    if (parser->skipping == false)
+                    {
+                        parser->skipping = true;
+                        event_emit(parser, BRIDGE_PARSER_EVENT_SKIPPED, BRIDGE_REQUEST_TYPE_UNDEFINED, 0, BRIDGE_PROTOCOL_RESULT_SUCCESS);
+                    }
+                    
+                    //Handler may have started recovery. Sync byte 0 may follow garbage or itself
+                    if (parser->state == BRIDGE_PARSER_STATE_SYNC)
+                    {
+                        parser->received = (byte == BRIDGE_FRAME_SYNC_BYTE_0) ? 1 : 0;
+                    }
+                }
+                
+                //Checked once per wait for message, the rest of the message is skipped after recovery
+                if (header_skipped && parser->skipping && 
+                    (parser->state == BRIDGE_PARSER_STATE_SYNC) && skipped_header_check(parser))
+                {
+                    corrupted_process(parser);
+                }
+                break;
+            }
+            
+            case BRIDGE_PARSER_STATE_HEADER:
+            {
+                if (parser->received == 0)
+                {
+                    parser->header_compact = parser->compact;
+                    parser->header_tagged = parser->tagged;
+                }
+                
+                //Compact header grows while its size field comes
+                uint16_t header_size = bridge_frame_header_size_get(header_options_get(parser), parser->header, parser->received);
+                size_t chunk_len = header_size - parser->received;
+                chunk_len = (chunk_len < available) ? chunk_len : available;
+                
+                memcpy(&parser->header[parser->received], &data[i], chunk_len);
+                parser->received += chunk_len;
+                i += chunk_len;
+                
+                header_size = bridge_frame_header_size_get(header_options_get(parser), parser->header, parser->received);
+                if (parser->received < header_size)
+                {
+                    break;
+                }
+                
+                if (header_process(parser) == false)
+                {
+                    corrupted_process(parser);
+                    break;
+                }
+                
+                parser->checksum = bridge_checksum_append(bridge_checksum_init(), parser->header, header_size);
+                parser->received = 0;
+                parser->state = (parser->payload_size > 0) ? BRIDGE_PARSER_STATE_PAYLOAD : BRIDGE_PARSER_STATE_CHECKSUM;
+                break;
+            }
+            
+            case BRIDGE_PARSER_STATE_PAYLOAD:
+            {
+                size_t chunk_len = parser->payload_size - parser->received;
+                chunk_len = (chunk_len < available) ? chunk_len : available;
+                
+                uint8_t * payload = (parser->mode == BRIDGE_PARSER_MODE_REQUEST) ? (uint8_t*)&parser->message.request.data : 
+                                    (parser->compressed) ? parser->compressed_payload : 
+                                    (uint8_t*)&parser->message.answer.data;
+                
+                memcpy(&payload[parser->received], &data[i], chunk_len);
+                parser->checksum = bridge_checksum_append(parser->checksum, &data[i], chunk_len);
+                parser->received += chunk_len;
+                i += chunk_len;
+                
+                if (parser->received == parser->payload_size)
+                {
+                    parser->received = 0;
+                    parser->state = BRIDGE_PARSER_STATE_CHECKSUM;
+                }
+                break;
+            }
+            
+            case BRIDGE_PARSER_STATE_CHECKSUM:
+            {
+                parser->checksum_received[parser->received++] = data[i++];
+                
+                if (parser->received == sizeof(parser->checksum_received))
+                {
+                    message_process(parser);
+                }
+                break;
+            }
+            
+            default:
+            {
+                //Everything is discarded until the bus becomes silent
+                i = data_len;
+                break;
+            }
+        }
+    }
+}
+
+void bridge_parser_idle(bridge_parser_t * parser, 
+                        uint32_t idle_ms)
+{
+    switch (parser->state)
+    {
+        case BRIDGE_PARSER_STATE_RECOVERING:
+        {
+            if (idle_ms >= parser->recover_timeout_ms)
+            {
+                recovered_process(parser);
+            }
+            break;
+        }
+        
+        case BRIDGE_PARSER_STATE_SYNC:
+        case BRIDGE_PARSER_STATE_HEADER:
+        {
+            if ((parser->received == 0) || (parser->state == BRIDGE_PARSER_STATE_SYNC))
+            {
+                if ((parser->expected_count > 0) && (idle_ms >= parser->wait_answer_timeout_ms))
+                {
+                    expected_lose(parser, BRIDGE_PARSER_EVENT_TIMEOUT, BRIDGE_PROTOCOL_RESULT_TIMEOUT);
+                }
+                break;
+            }
+            
+            //Message is started, timeout between bytes is applied
+        }
+        // fall through
+        
+        default:
+        {
+            if (idle_ms >= parser->between_bytes_timeout_ms)
+            {
+                corrupted_process(parser);
+            }
+            break;
+        }
+    }
+}
+
+void bridge_parser_answer_expect(bridge_parser_t * parser, 
+                                 uint8_t tag, 
+                                 bridge_request_type_t request_type)
+{
+    if (parser->expected_count < BRIDGE_PROTOCOL_MAX_IN_FLIGHT)
+    {
+        parser->expected[parser->expected_count].tag = tag;
+        parser->expected[parser->expected_count].request_type = request_type;
+        parser->expected_count++;
+    }
+}
+
+void bridge_parser_recover(bridge_parser_t * parser)
+{
+    parser->state = BRIDGE_PARSER_STATE_RECOVERING;
+    parser->expected_count = 0;
+    
+    if (parser->sync)
+    {
+        recovered_process(parser);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#ifndef _BRIDGE_PARSER_H_
+#define _BRIDGE_PARSER_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_parser Non-blocking parser of bridge communication protocol messages
+ *
+ * @brief Resumable parser which is fed with any portions of received data and never blocks,
+ * so a single thread (event loop) can serve many links.
+ *
+ * Server side parser (BRIDGE_PARSER_MODE_REQUEST) emits received requests. Client side parser
+ * (BRIDGE_PARSER_MODE_ANSWER) emits answers, type of request being answered should be set by 
+ * bridge_parser_answer_expect() after the request is sent. Up to BRIDGE_PROTOCOL_MAX_IN_FLIGHT answers
+ * may be expected at the same time, they come in order of requests or, with BRIDGE_LINK_OPTION_TAGGED,
+ * are matched to requests by tag. Events carry the tag of the request, so runtimes may keep the window
+ * of requests in flight (see bridge_link_request_send()).
+ *
+ * Parser knows nothing about time. Application should report how long no data has been received
+ * by calling bridge_parser_idle(), parser uses it to detect message timeouts and to complete recovery.
+ * After BRIDGE_PARSER_EVENT_CORRUPTED all received data is discarded until the bus is silent for
+ * BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS, then BRIDGE_PARSER_EVENT_RECOVERED is emitted. Parser starts
+ * in recovery state as protocol requires. Timeouts may be changed per parser by bridge_parser_timeouts_set(),
+ * e.g. to those of the link derived from its baud rate (see bridge_link_baud_set()).
+ *
+ * For links with BRIDGE_LINK_OPTION_SYNC bridge_parser_sync_enable() should be called after initialization.
+ * Then parser hunts for sync bytes instead of waiting for silence, BRIDGE_PARSER_EVENT_RECOVERED is emitted
+ * right after BRIDGE_PARSER_EVENT_CORRUPTED and the rest of received data is parsed at once. Data skipped while hunting
+ * (e.g. noise between messages) is reported by BRIDGE_PARSER_EVENT_SKIPPED once per run. It is no loss of sync by itself,
+ * expected answers are kept and hunting goes on. Only data which starts with a valid header of standard message
+ * (the other side dropped negotiated sync bytes, e.g. on its own recovery) is BRIDGE_PARSER_EVENT_CORRUPTED, so the link
+ * drops them too.
+ *
+ * Client side parser decompresses compressed answers (see bridge_compress.h). Parser takes no part in negotiation
+ * of features, so MATCH_PROTOCOL_VERSION answers are emitted with agreed features in the high byte of version.
+ * Server which receives requests by parser should report them by bridge_link_request_received().
+ *
+ * Tags, compact messages and sync bytes (BRIDGE_LINK_OPTION_TAGGED, BRIDGE_LINK_OPTION_COMPACT, BRIDGE_LINK_OPTION_SYNC)
+ * are switched on and off by bridge_parser_options_set(). Options of the link change with negotiation, so runtimes copy them to the parser
+ * before every portion of data is fed.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "bridge_protocol.h"
+#include "bridge_frame.h"
+
+/**@brief Parser modes. */
+typedef enum
+{
+    BRIDGE_PARSER_MODE_REQUEST,                                 /**< Parse requests (server side). */
+    BRIDGE_PARSER_MODE_ANSWER                                   /**< Parse answers (client side). */
+} bridge_parser_mode_t;
+
+/**@brief Parser event types. */
+typedef enum
+{
+    BRIDGE_PARSER_EVENT_REQUEST,                                /**< Request received. */
+    BRIDGE_PARSER_EVENT_ANSWER,                                 /**< Answer received. */
+    BRIDGE_PARSER_EVENT_TIMEOUT,                                /**< Expected answer not received in time. */
+    BRIDGE_PARSER_EVENT_CORRUPTED,                              /**< Corrupted message detected, recovery started. */
+    BRIDGE_PARSER_EVENT_RECOVERED,                              /**< Recovery completed. */
+    BRIDGE_PARSER_EVENT_SKIPPED                                 /**< Data other than sync bytes skipped while hunting for them,
+                                                                     once per run. Parser state is not changed. */
+} bridge_parser_event_type_t;
+
+/**@brief Parser event. */
+typedef struct
+{
+    bridge_parser_event_type_t type;                            /**< Type of event. */
+    bridge_request_type_t request_type;                         /**< Type of received request or type of request being answered. */
+    uint8_t tag;                                                /**< Tag of received request or of request being answered,
+                                                                     0 without BRIDGE_LINK_OPTION_TAGGED. */
+    bridge_protocol_result_t result;                            /**< Answer result: SUCCESS, REQUEST_REJECTED or WRONG_REQUEST_ARGUMENTS. */
+    const bridge_request_t * request;                           /**< Received request, valid only during handler call. */
+    const bridge_answer_t * answer;                             /**< Received answer, valid only during handler call. */
+} bridge_parser_event_t;
+
+/**@brief Parser event handler.
+ *
+ * @param[in] context Context passed to bridge_parser_init().
+ * @param[in] event   Event.
+ */
+typedef void (*bridge_parser_event_handler_t)(void * context, 
+                                              const bridge_parser_event_t * event);
+
+/**@brief Answer expected by parser. */
+typedef struct
+{
+    uint8_t tag;                                                /**< Tag of sent request. */
+    bridge_request_type_t request_type;                         /**< Type of sent request. */
+} bridge_parser_expected_t;
+
+/**@brief Parser states. */
+typedef enum
+{
+    BRIDGE_PARSER_STATE_SYNC,
+    BRIDGE_PARSER_STATE_HEADER,
+    BRIDGE_PARSER_STATE_PAYLOAD,
+    BRIDGE_PARSER_STATE_CHECKSUM,
+    BRIDGE_PARSER_STATE_RECOVERING
+} bridge_parser_state_t;
+
+/**@brief Parser instance. Fields are internal, use bridge_parser_*() functions only. */
+typedef struct
+{
+    bridge_parser_mode_t mode;
+    bridge_parser_state_t state;
+    bridge_parser_event_handler_t handler;
+    void * context;
+    bridge_parser_expected_t expected[BRIDGE_PROTOCOL_MAX_IN_FLIGHT]; //Answers expected in order of requests
+    uint8_t expected_count;
+    uint8_t answered;                                           //Index of expected answer being received
+    bool sync;                                                  //Messages start with sync bytes
+    bool compact;                                               //Messages have compact header
+    bool tagged;                                                //Messages have tag
+    bool skipping;                                              //Data other than sync bytes is being skipped, reported once
+    uint8_t skipped_len;                                        //Bytes received while hunting, checked for a header without sync bytes
+    uint32_t between_bytes_timeout_ms;
+    uint32_t wait_answer_timeout_ms;
+    uint32_t recover_timeout_ms;
+    uint16_t received;                                          //Bytes of the current field received
+    uint16_t payload_size;
+    bool compressed;                                            //Payload is compressed, it is received to compressed_payload
+    uint16_t checksum;                                          //Checksum calculated over received bytes
+    bool header_compact;                                        //Compact format of the message being received
+    bool header_tagged;                                         //Tag in the message being received
+    uint8_t header[BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE]; //Standard header is the longest one
+    uint8_t tag;                                                //Tag of the message being received
+    uint8_t checksum_received[sizeof(uint16_t)];
+    
+    union
+    {
+        bridge_request_t request;
+        bridge_answer_t answer;
+    } message;
+    
+    uint8_t compressed_payload[sizeofmember(bridge_answer_t, data)];
+} bridge_parser_t;
+
+/**@brief Initialize parser. Parser starts in recovery state.
+ *
+ * @param[out] parser  Parser instance.
+ * @param[in]  mode    Parser mode.
+ * @param[in]  handler Event handler.
+ * @param[in]  context Context passed to handler.
+ */
+void bridge_parser_init(bridge_parser_t * parser, 
+                        bridge_parser_mode_t mode, 
+                        bridge_parser_event_handler_t handler, 
+                        void * context);
+
+/**@brief Expect sync bytes at the start of every message (BRIDGE_LINK_OPTION_SYNC). 
+ *        Recovery state is left at once, parser starts hunting for sync bytes.
+ *
+ * @param[in] parser Parser instance.
+ */
+void bridge_parser_sync_enable(bridge_parser_t * parser);
+
+/**@brief Set message format from link options: tag (BRIDGE_LINK_OPTION_TAGGED), compact header
+ *        (BRIDGE_LINK_OPTION_COMPACT) and sync bytes (BRIDGE_LINK_OPTION_SYNC). Applies to messages which start after the call, the message being received
+ *        is parsed to the end as it started. Unlike bridge_parser_sync_enable() recovery is not left.
+ *
+ * @param[in] parser  Parser instance.
+ * @param[in] options Link options, combination of bridge_link_option_t.
+ */
+void bridge_parser_options_set(bridge_parser_t * parser, 
+                               uint32_t options);
+
+/**@brief Set timeouts of parser, BRIDGE_PROTOCOL_*_TIMEOUT_MS are used by default.
+ *
+ * @param[in] parser                   Parser instance.
+ * @param[in] between_bytes_timeout_ms Silence inside a message which breaks it.
+ * @param[in] wait_answer_timeout_ms   Time the answer is waited for.
+ * @param[in] recover_timeout_ms       Silence which completes recovery.
+ */
+void bridge_parser_timeouts_set(bridge_parser_t * parser, 
+                                uint32_t between_bytes_timeout_ms, 
+                                uint32_t wait_answer_timeout_ms, 
+                                uint32_t recover_timeout_ms);
+
+/**@brief Feed parser with received data. Events are emitted from this call.
+ *
+ * @param[in] parser   Parser instance.
+ * @param[in] data     Received data.
+ * @param[in] data_len Length of the data in bytes.
+ */
+void bridge_parser_feed(bridge_parser_t * parser, 
+                        const uint8_t * data, 
+                        size_t data_len);
+
+/**@brief Report that no data has been received for some time. Should be called periodically
+ *        while the link is silent. Events are emitted from this call.
+ *
+ * @param[in] parser  Parser instance.
+ * @param[in] idle_ms Time passed since the last byte was received or since the answer 
+ *                    was expected (whichever is later).
+ */
+void bridge_parser_idle(bridge_parser_t * parser, 
+                        uint32_t idle_ms);
+
+/**@brief Start waiting for answer to the sent request. Answer mode only. Answers to requests sent before 
+ *        are still expected, up to BRIDGE_PROTOCOL_MAX_IN_FLIGHT in total. On TIMEOUT and CORRUPTED events
+ *        all expected answers are lost.
+ *
+ * @param[in] parser       Parser instance.
+ * @param[in] tag          Tag of sent request, ignored without BRIDGE_LINK_OPTION_TAGGED.
+ * @param[in] request_type Type of sent request.
+ */
+void bridge_parser_answer_expect(bridge_parser_t * parser, 
+                                 uint8_t tag, 
+                                 bridge_request_type_t request_type);
+
+/**@brief Start protocol recovery, e.g. when corruption was detected outside of parser. 
+ *        Synchronized parser completes recovery at once.
+ *
+ * @param[in] parser Parser instance.
+ */
+void bridge_parser_recover(bridge_parser_t * parser);
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -1,92 +1,47 @@
 #include "bridge_protocol.h"
+#include "bridge_checksum.h"
+#include "bridge_frame.h"
+#include "bridge_compress.h"
+#include <string.h>
 
-//Message format:
-//(uint16_t) payload size | (enum) request or answer type | (array) payload | (uint16_t) checksum of everything prior
+#define COMPRESS_MIN_PAYLOAD_SIZE   16                    //Smaller payloads rarely shrink, encoder is not run for them
+#define BITS_PER_CHARACTER          10                    //Start bit, 8 data bits and stop bit
+#define RTT_GRANULARITY_US          1000                  //Timeouts are waited in milliseconds
+#define RTT_MAX_BACKOFF             16
+#define MIN_PAYLOAD_SIZE            sizeof(bridge_transfer_chunk_request_t) //Agreed limit never stops chunked transfer or the next negotiation
 
-#define sizeofmember(type, member) sizeof(((type *)0)->member)
+typedef char min_payload_size_check[(MIN_PAYLOAD_SIZE >= sizeof(bridge_match_capabilities_request_t)) ? 1 : -1];
+typedef char answer_frame_headroom_check[(BRIDGE_ANSWER_FRAME_HEADROOM >= 
+                                          (BRIDGE_FRAME_SYNC_SIZE + BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE)) ? 1 : -1];
 
 typedef struct
 {
-    bridge_answer_type_t type;                            //Type of answer. 
-                                                          //Data field is filled according to request type.
-    union
-    {
-        struct
-        {
-            uint16_t protocol_version;                    //Bridge protocol version
-        } match_protocol_version;
-        
-        struct
-        {
-            device_info_t info;                           //Device info
-        } get_device_info;
-    } data;
-} bridge_answer_t;
+    bridge_read_callback_t read;                          //Single byte read callback
+    bridge_read_bulk_callback_t read_bulk;                //Bulk read callback registered for it
+} bulk_read_registration_t;
+
+typedef struct
+{
+    bridge_write_callback_t write;                        //Write callback
+    bridge_write_vector_callback_t write_vector;          //Vector write callback registered for it
+} vector_write_registration_t;
+
+typedef struct
+{
+    bridge_read_callback_t read;                          //Single byte read callback
+    bridge_read_bulk_callback_t read_bulk;                //Bulk read callback, NULL if not registered
+    bridge_write_callback_t write;                        //Write callback
+    bridge_write_vector_callback_t write_vector;          //Vector write callback, NULL if not registered
+} legacy_bus_t;                                           //Callbacks of protocol calls without link context
+
+//Registrations are changed only while no protocol call runs, see bridge_protocol_bulk_read_register()
+static bulk_read_registration_t m_bulk_readers[BRIDGE_PROTOCOL_BULK_READ_MAX_REGISTERED];
+static vector_write_registration_t m_vector_writers[BRIDGE_PROTOCOL_VECTOR_WRITE_MAX_REGISTERED];
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-static uint16_t checksum_init(void)
-{
-    return 0xFFFF;
-}
-
-/** Name  : CRC-16 CCITT
- *  Poly  : 0x1021    x^16 + x^12 + x^5 + 1
- *  Init  : 0xFFFF
- *  Revert: false
- *  XorOut: 0x0000
- *  Check : 0x29B1 ("123456789")
- *  MaxLen: 4095 bytes
- */
-static uint16_t checksum_append(uint16_t current_crc, const void * data, uint16_t data_len)
-{
-    static const uint16_t crc16_table[256] =
-    {
-        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
-        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
-        0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
-        0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
-        0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
-        0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
-        0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
-        0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
-        0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
-        0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
-        0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
-        0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
-        0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
-        0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
-        0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
-        0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
-        0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
-        0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
-        0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
-        0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
-        0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
-        0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
-        0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
-        0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
-        0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
-        0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
-        0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
-        0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
-        0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
-        0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
-        0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
-        0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
-    };
-    
-    uint16_t result = current_crc;
-    for (uint32_t i = 0; i < data_len; i++)
-    {
-        result = (result << 8) ^ crc16_table[(result >> 8) ^ ((uint8_t*)data)[i]];
-    }
-    
-    return result;
-}
-
-static bridge_protocol_result_t callback_to_protocol_result(bridge_callback_result_t callback_result, 
+static bridge_protocol_result_t callback_to_protocol_result(bridge_callback_result_t callback_result,
                                                             bool corrupted_if_timeout)
 {
     switch (callback_result)
@@ -108,334 +63,492 @@ static bridge_protocol_result_t callback_to_protocol_result(bridge_callback_resu
     }
 }
 
-static uint16_t request_payload_size_get(bridge_request_type_t request_type)
+static bridge_protocol_result_t link_result_account(bridge_link_t * link,
+                                                    bridge_protocol_result_t result)
 {
-    switch (request_type)
+    switch (result)
     {
-        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
+        case BRIDGE_PROTOCOL_RESULT_TIMEOUT:
+        {
+            link->stats.timeouts++;
+            break;
+        }
+        
+        case BRIDGE_PROTOCOL_RESULT_CORRUPTED:
+        {
+            link->stats.corrupted++;
+            break;
+        }
+        
+        case BRIDGE_PROTOCOL_RESULT_IO_ERROR:
         {
-            return sizeofmember(bridge_request_t, data.match_protocol_version);
+            link->stats.io_errors++;
+            break;
         }
         
         default:
         {
-            return 0;
+            break;
         }
     }
+    
+    return result;
 }
 
-static uint16_t answer_payload_size_get(bridge_request_type_t request_type, 
-                                        bridge_answer_type_t answer_type)
+static uint32_t link_time_us_get(const bridge_link_t * link)
 {
-    if (answer_type != BRIDGE_ANSWER_TYPE_SUCCESS)
+    return (link->clock != NULL) ? link->clock(link->user) : 0;
+}
+
+//Sent message is captured before it is written, so it never comes after the answer to it in capture
+static void link_capture(const bridge_link_t * link,
+                         bridge_link_capture_direction_t direction,
+                         const bridge_write_chunk_t * chunks,
+                         uint8_t chunks_count)
+{
+    if (link->capture != NULL)
+    {
+        link->capture(link->capture_context, direction, link->options, chunks, chunks_count);
+    }
+}
+
+//Reads up to max_len bytes (at least one) with a single callback call
+static bridge_callback_result_t link_chunk_read(bridge_link_t * link,
+                                                uint32_t timeout_ms,
+                                                uint8_t * out_data,
+                                                uint32_t max_len,
+                                                uint32_t * out_len)
+{
+    uint16_t chunk_len = 0;
+    bridge_callback_result_t read_result = link->read(link->user,
+                                                      out_data,
+                                                      (max_len > UINT16_MAX) ? UINT16_MAX : max_len,
+                                                      &chunk_len,
+                                                      timeout_ms);
+    
+    if (read_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
     {
-        return 0;
+        return read_result;
     }
     
-    switch (request_type)
+    if ((chunk_len == 0) || (chunk_len > max_len))
     {
-        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
-        {
-            return sizeofmember(bridge_answer_t, data.match_protocol_version);
-        }
-        
-        case BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO:
-        {
-            return sizeofmember(bridge_answer_t, data.get_device_info);
-        }
-        
-        default:
-        {
-            return 0;
-        }
+        //Read callback broke its contract, stream position is unknown
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
     }
+    
+    link->stats.bytes_received += chunk_len;
+    
+    bridge_write_chunk_t chunk = { .data = out_data, .data_len = chunk_len };
+    link_capture(link, BRIDGE_LINK_CAPTURE_RECEIVED, &chunk, 1);
+    
+    *out_len = chunk_len;
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
 }
 
-static bridge_callback_result_t multiple_bytes_read(bridge_read_callback_t read, 
+//Checksum (if not NULL) is updated with every received chunk, so data is not traversed twice
+static bridge_callback_result_t multiple_bytes_read(bridge_link_t * link,
                                                     uint32_t first_byte_timeout_ms,
-                                                    void * out_data, 
-                                                    uint32_t bytes_count, 
+                                                    void * out_data,
+                                                    uint32_t bytes_count,
+                                                    uint16_t * checksum,
                                                     bool * out_timeout_is_on_first_byte)
 {
-    for (uint32_t i = 0; i < bytes_count; i++)
+    uint32_t received = 0;
+    while (received < bytes_count)
     {
-        bridge_callback_result_t read_result = read(&((uint8_t*)out_data)[i], (i == 0) ?
-                                                    first_byte_timeout_ms : 
-                                                    BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS);
+        uint32_t chunk_len;
+        bridge_callback_result_t read_result = link_chunk_read(link, (received == 0) ?
+                                                               first_byte_timeout_ms :
+                                                               link->between_bytes_timeout_ms,
+                                                               &((uint8_t*)out_data)[received],
+                                                               bytes_count - received,
+                                                               &chunk_len);
         
         if (read_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
         {
-            if ((read_result == BRIDGE_CALLBACK_RESULT_READ_TIMEOUT) && 
-                (out_timeout_is_on_first_byte != NULL))
+            //Only the first byte of message may be waited for, any other silence breaks the message
+            bool first_byte = (received == 0) && (out_timeout_is_on_first_byte != NULL);
+            if (read_result == BRIDGE_CALLBACK_RESULT_READ_TIMEOUT)
             {
-                *out_timeout_is_on_first_byte = (i == 0);
+                if (out_timeout_is_on_first_byte != NULL)
+                {
+                    *out_timeout_is_on_first_byte = first_byte;
+                }
+                
+                if (first_byte == false)
+                {
+                    link->stats.between_bytes_timeouts++;
+                }
             }
             
             return read_result;
         }
+        
+        if (checksum != NULL)
+        {
+            *checksum = bridge_checksum_append(*checksum, &((uint8_t*)out_data)[received], chunk_len);
+        }
+        
+        received += chunk_len;
     }
-
+    
     return BRIDGE_CALLBACK_RESULT_SUCCESS;
 }
 
-static bridge_protocol_result_t answer_read(bridge_read_callback_t read, 
-                                            bridge_answer_t * out_answer, 
-                                            bridge_request_type_t request_type)
+static uint16_t frame_sync_size_get(const bridge_link_t * link)
 {
-    bridge_callback_result_t callback_result;
-    
-    uint16_t payload_size;
-    bool timeout_is_on_first_byte;
-    callback_result = multiple_bytes_read(read, 
-                                          BRIDGE_PROTOCOL_WAIT_ANSWER_TIMEOUT_MS, 
-                                          &payload_size, 
-                                          sizeof(payload_size), 
-                                          &timeout_is_on_first_byte);
+    return (link->options & BRIDGE_LINK_OPTION_SYNC) ? BRIDGE_FRAME_SYNC_SIZE : 0;
+}
+
+static uint16_t frame_size_get(const bridge_link_t * link, 
+                               uint16_t payload_size)
+{
+    return bridge_frame_size_get(link->options, payload_size);
+}
+
+//Time bytes spend on the wire, 0 if baud rate is unknown
+static uint32_t wire_time_us_get(const bridge_link_t * link, 
+                                 uint32_t bytes_count)
+{
+    return (link->baud > 0) ? (uint32_t)(((uint64_t)bytes_count * BITS_PER_CHARACTER * 1000000) / link->baud) : 0;
+}
+
+//Smoothing of RFC 6298 with alpha 1/8 and beta 1/4
+static void rtt_sample_add(bridge_link_t * link, 
+                           uint32_t rtt_us)
+{
+    bridge_link_rtt_t * rtt = &link->rtt;
     
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    if (rtt->samples == 0)
     {
-        return callback_to_protocol_result(callback_result, !timeout_is_on_first_byte);
+        rtt->srtt_us = rtt_us;
+        rtt->rttvar_us = rtt_us / 2;
     }
-    
-    callback_result = multiple_bytes_read(read, 
-                                          BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS, 
-                                          &out_answer->type, 
-                                          sizeof(out_answer->type), 
-                                          NULL);
-    
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    else
     {
-        return callback_to_protocol_result(callback_result, true);
+        uint32_t deviation = (rtt->srtt_us > rtt_us) ? (rtt->srtt_us - rtt_us) : (rtt_us - rtt->srtt_us);
+        rtt->rttvar_us = rtt->rttvar_us - (rtt->rttvar_us / 4) + (deviation / 4);
+        rtt->srtt_us = rtt->srtt_us - (rtt->srtt_us / 8) + (rtt_us / 8);
     }
     
-    if (answer_payload_size_get(request_type, out_answer->type) != payload_size)
+    rtt->samples++;
+    rtt->backoff = 0;
+}
+
+//Answer to the oldest request in flight is waited for its round trip time plus the time both messages spend on the wire
+static uint32_t answer_timeout_get(const bridge_link_t * link)
+{
+    if ((link->adaptive_timeout == false) || (link->rtt.samples == 0) || (link->in_flight_count == 0))
     {
-        return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+        return link->wait_answer_timeout_ms;
     }
     
-    if (payload_size > 0)
-    {
-        callback_result = multiple_bytes_read(read, 
-                                              BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS, 
-                                              &out_answer->data, 
-                                              payload_size,
-                                              NULL);
-        
-        if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
-        {
-            return callback_to_protocol_result(callback_result, true);
-        }
-    }
+    const bridge_link_in_flight_t * request = &link->in_flight[0];
+    uint16_t answer_size = frame_size_get(link, bridge_frame_answer_payload_max_size_get(request->request_type, 
+                                                                                         BRIDGE_ANSWER_TYPE_SUCCESS));
     
-    uint16_t checksum;
-    callback_result = multiple_bytes_read(read, 
-                                          BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS, 
-                                          &checksum, 
-                                          sizeof(checksum), 
-                                          NULL);
+    uint32_t variation_us = 4 * link->rtt.rttvar_us;
+    uint64_t timeout_us = (uint64_t)link->rtt.srtt_us + 
+                          ((variation_us > RTT_GRANULARITY_US) ? variation_us : RTT_GRANULARITY_US) + 
+                          wire_time_us_get(link, (uint32_t)request->size + answer_size);
+    uint64_t timeout_ms = ((timeout_us + 999) / 1000) << link->rtt.backoff;
     
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    if (timeout_ms < BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS)
     {
-        return callback_to_protocol_result(callback_result, true);
+        return BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS;
     }
     
-    uint16_t checksum_calculated = checksum_init();
-    checksum_calculated = checksum_append(checksum_calculated, &payload_size, sizeof(payload_size));
-    checksum_calculated = checksum_append(checksum_calculated, &out_answer->type, sizeof(out_answer->type));
-    checksum_calculated = checksum_append(checksum_calculated, &out_answer->data, payload_size);
-    
-    if (checksum != checksum_calculated)
+    return (timeout_ms < link->wait_answer_timeout_ms) ? (uint32_t)timeout_ms : link->wait_answer_timeout_ms;
+}
+
+//Returns offset of the first position in data where sync bytes may start
+static uint16_t frame_sync_find(const uint8_t * data, 
+                                uint16_t data_len)
+{
+    for (uint16_t i = 0; i < data_len; i++)
     {
-        return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+        if ((data[i] == BRIDGE_FRAME_SYNC_BYTE_0) && 
+            (((i + 1) == data_len) || (data[i + 1] == BRIDGE_FRAME_SYNC_BYTE_1)))
+        {
+            return i;
+        }
     }
     
-    if (out_answer->type == BRIDGE_ANSWER_TYPE_REQUEST_REJECTED)
-    {
-        return BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED;
-    }
+    return data_len;
+}
+
+//Discards received bytes until the sync bytes are at the start of the buffer. Buffer is kept full, 
+//so it holds sync bytes followed by the header on success. Never hunts longer than one message.
+static bridge_callback_result_t frame_sync_hunt(bridge_link_t * link, 
+                                                uint8_t * buffer, 
+                                                uint16_t buffer_len)
+{
+    uint32_t discarded = 0;
     
-    if (out_answer->type == BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS)
+    for (;;)
     {
-        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+        uint16_t offset = frame_sync_find(buffer, buffer_len);
+        if (offset == 0)
+        {
+            return BRIDGE_CALLBACK_RESULT_SUCCESS;
+        }
+        
+        if (discarded == 0)
+        {
+            link->stats.skipped++;
+        }
+        
+        discarded += offset;
+        if (discarded > BRIDGE_FRAME_MAX_SIZE)
+        {
+            return BRIDGE_CALLBACK_RESULT_READ_TIMEOUT;
+        }
+        
+        memmove(&buffer[0], &buffer[offset], buffer_len - offset);
+        
+        bridge_callback_result_t read_result = multiple_bytes_read(link,
+                                                                   link->between_bytes_timeout_ms,
+                                                                   &buffer[buffer_len - offset],
+                                                                   offset,
+                                                                   NULL,
+                                                                   NULL);
+        
+        if (read_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+        {
+            return read_result;
+        }
     }
-    
-    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
 }
 
-static bridge_protocol_result_t request_write(bridge_write_callback_t write, 
-                                              const bridge_request_t * request)
+//Sync bytes (if link is synchronized) are part of the header, but not covered by checksum. 
+//Tag is written only if link is tagged. Returns size of the header with sync bytes,
+//BRIDGE_FRAME_SIZE_INVALID if type doesn't fit compact header or payload is larger than agreed.
+static uint16_t frame_header_build(const bridge_link_t * link,
+                                   uint8_t * header,
+                                   uint32_t type,
+                                   uint8_t tag,
+                                   uint16_t size_field)
 {
-    bridge_callback_result_t callback_result;
-    
-    uint16_t payload_size = request_payload_size_get(request->type);
-    
-    callback_result = write((uint8_t*)&payload_size, sizeof(payload_size));
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    if ((size_field & ~BRIDGE_FRAME_COMPRESSED_FLAG) > link->max_payload_size_agreed)
     {
-        return callback_to_protocol_result(callback_result, false);
+        return BRIDGE_FRAME_SIZE_INVALID;
     }
     
-    callback_result = write((uint8_t*)&request->type, sizeof(request->type));
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
-    {
-        return callback_to_protocol_result(callback_result, false);
-    }
+    uint16_t sync_size = frame_sync_size_get(link);
     
-    if (payload_size > 0)
+    if (sync_size > 0)
     {
-        callback_result = write((uint8_t*)&request->data, payload_size);
-        if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
-        {
-            return callback_to_protocol_result(callback_result, false);
-        }
+        header[0] = BRIDGE_FRAME_SYNC_BYTE_0;
+        header[1] = BRIDGE_FRAME_SYNC_BYTE_1;
     }
     
-    uint16_t checksum = checksum_init();
-    checksum = checksum_append(checksum, &payload_size, sizeof(payload_size));
-    checksum = checksum_append(checksum, &request->type, sizeof(request->type));
-    checksum = checksum_append(checksum, &request->data, payload_size);
-    
-    callback_result = write((uint8_t*)&checksum, sizeof(checksum));
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
-    {
-        return callback_to_protocol_result(callback_result, false);
-    }
+    uint16_t header_size = bridge_frame_header_encode(link->options, type, tag, size_field, &header[sync_size]);
     
-    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    return (header_size == BRIDGE_FRAME_SIZE_INVALID) ? BRIDGE_FRAME_SIZE_INVALID : sync_size + header_size;
 }
 
-static bridge_protocol_result_t request_make(bridge_read_callback_t read, 
-                                             bridge_write_callback_t write,
-                                             const bridge_request_t * request, 
-                                             bridge_answer_t * out_answer)
+static bridge_protocol_result_t frame_written_account(bridge_link_t * link,
+                                                      bridge_callback_result_t callback_result,
+                                                      uint16_t frame_size)
 {
-    bridge_protocol_result_t protocol_result;
-    
-    protocol_result = request_write(write, request);
-    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    if (callback_result == BRIDGE_CALLBACK_RESULT_SUCCESS)
     {
-        return protocol_result;
+        link->stats.frames_sent++;
+        link->stats.bytes_sent += frame_size;
     }
     
-    return answer_read(read, out_answer, request->type);
+    return link_result_account(link, callback_to_protocol_result(callback_result, false));
 }
 
-static bridge_protocol_result_t answer_write(bridge_write_callback_t write, 
-                                             const bridge_answer_t * answer, 
-                                             bridge_request_type_t request_type)
+//Sends the whole message with a single callback call. Type is either request or answer type.
+//Tag is sent only if link is tagged.
+static bridge_protocol_result_t frame_write(bridge_link_t * link,
+                                            uint32_t type,
+                                            uint8_t tag,
+                                            const void * payload,
+                                            uint16_t payload_size,
+                                            bool compressed)
 {
     bridge_callback_result_t callback_result;
+    uint16_t size_field = payload_size | ((compressed) ? BRIDGE_FRAME_COMPRESSED_FLAG : 0);
     
-    uint16_t payload_size = answer_payload_size_get(request_type, answer->type);
-    
-    callback_result = write((uint8_t*)&payload_size, sizeof(payload_size));
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    uint8_t header[BRIDGE_FRAME_SYNC_SIZE + BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE];
+    uint16_t sync_size = frame_sync_size_get(link);
+    uint16_t header_size = frame_header_build(link, header, type, tag, size_field);
+    if (header_size == BRIDGE_FRAME_SIZE_INVALID)
     {
-        return callback_to_protocol_result(callback_result, false);
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
     }
     
-    callback_result = write((uint8_t*)&answer->type, sizeof(answer->type));
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
-    {
-        return callback_to_protocol_result(callback_result, false);
-    }
+    uint16_t checksum = bridge_checksum_init();
+    checksum = bridge_checksum_append(checksum, &header[sync_size], header_size - sync_size);
+    checksum = bridge_checksum_append(checksum, payload, payload_size);
     
-    if (payload_size > 0)
+    uint8_t checksum_field[BRIDGE_FRAME_CHECKSUM_SIZE];
+    BRIDGE_SCHEMA_ENCODE(uint16_t)(&checksum, checksum_field);
+    
+    uint16_t frame_size = header_size + payload_size + sizeof(checksum_field);
+    
+    if (link->write_vector != NULL)
     {
-        callback_result = write((uint8_t*)&answer->data, payload_size);
-        if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+        bridge_write_chunk_t chunks[3] =
         {
-            return callback_to_protocol_result(callback_result, false);
+            { .data = header, .data_len = header_size },
+            { .data = (const uint8_t*)payload, .data_len = payload_size },
+            { .data = checksum_field, .data_len = sizeof(checksum_field) }
+        };
+        
+        if (payload_size == 0)
+        {
+            chunks[1] = chunks[2];
         }
+        
+        link_capture(link, BRIDGE_LINK_CAPTURE_SENT, chunks, (payload_size > 0) ? 3 : 2);
+        callback_result = link->write_vector(link->user, chunks, (payload_size > 0) ? 3 : 2);
     }
-    
-    uint16_t checksum = checksum_init();
-    checksum = checksum_append(checksum, &payload_size, sizeof(payload_size));
-    checksum = checksum_append(checksum, &answer->type, sizeof(answer->type));
-    checksum = checksum_append(checksum, &answer->data, payload_size);
-    
-    callback_result = write((uint8_t*)&checksum, sizeof(checksum));
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    else
     {
-        return callback_to_protocol_result(callback_result, false);
+        uint8_t frame[BRIDGE_FRAME_MAX_SIZE];
+        memcpy(&frame[0], header, header_size);
+        memcpy(&frame[header_size], payload, payload_size);
+        memcpy(&frame[header_size + payload_size], checksum_field, sizeof(checksum_field));
+        
+        bridge_write_chunk_t chunk = { .data = frame, .data_len = frame_size };
+        link_capture(link, BRIDGE_LINK_CAPTURE_SENT, &chunk, 1);
+        
+        callback_result = link->write(link->user, frame, frame_size);
     }
     
-    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    return frame_written_account(link, callback_result, frame_size);
 }
 
-bridge_protocol_result_t bridge_protocol_recover(bridge_read_callback_t read, 
-                                                 uint32_t timeout_ms)
+//Answer frame has room for the header before the payload and for the checksum after it,
+//so the message is built around the payload and sent with no copies of the payload.
+//Size of compact header depends on payload size, so the header is built aside and put before the payload.
+static bridge_protocol_result_t frame_in_place_write(bridge_link_t * link,
+                                                     uint32_t type,
+                                                     uint8_t tag,
+                                                     bridge_answer_frame_t * answer_frame,
+                                                     uint16_t payload_size)
 {
-    bridge_callback_result_t read_result;
-    
-    if (timeout_ms < BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS)
+    uint8_t header[BRIDGE_FRAME_SYNC_SIZE + BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE];
+    uint16_t sync_size = frame_sync_size_get(link);
+    uint16_t header_size = frame_header_build(link, header, type, tag, payload_size);
+    if (header_size == BRIDGE_FRAME_SIZE_INVALID)
     {
-        return BRIDGE_PROTOCOL_RESULT_TIMEOUT;
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
     }
     
-    uint32_t waited_ms = 0;    
-    do
-    {
-        uint8_t dummy;
-        read_result = read(&dummy, BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS);
-        
-        waited_ms += BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS;
-        
-        if ((read_result == BRIDGE_CALLBACK_RESULT_SUCCESS) && (waited_ms >= timeout_ms))
-        {
-            return BRIDGE_PROTOCOL_RESULT_TIMEOUT;
-        }
-    } while (read_result == BRIDGE_CALLBACK_RESULT_SUCCESS);
+    uint8_t * payload = (uint8_t*)answer_frame + offsetof(bridge_answer_frame_t, data);
+    uint8_t * frame = payload - header_size;
+    memcpy(frame, header, header_size);
     
-    if (read_result == BRIDGE_CALLBACK_RESULT_READ_TIMEOUT)
+    uint16_t checksum = bridge_checksum_init();
+    checksum = bridge_checksum_append(checksum, &frame[sync_size], header_size - sync_size + payload_size);
+    BRIDGE_SCHEMA_ENCODE(uint16_t)(&checksum, &payload[payload_size]);
+    
+    uint16_t frame_size = header_size + payload_size + BRIDGE_FRAME_CHECKSUM_SIZE;
+    
+    bridge_write_chunk_t chunk = { .data = frame, .data_len = frame_size };
+    link_capture(link, BRIDGE_LINK_CAPTURE_SENT, &chunk, 1);
+    
+    bridge_callback_result_t callback_result;
+    if (link->write_vector != NULL)
     {
-        return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+        callback_result = link->write_vector(link->user, &chunk, 1);
+    }
+    else
+    {
+        callback_result = link->write(link->user, frame, frame_size);
     }
     
-    return callback_to_protocol_result(read_result, false);
+    return frame_written_account(link, callback_result, frame_size);
 }
 
-bridge_protocol_result_t bridge_protocol_request_read(bridge_read_callback_t read, 
-                                                      uint32_t first_byte_timeout_ms, 
-                                                      bridge_request_t * out_request)
+//Reads sync bytes (if link is synchronized), payload size, type and tag (if link is tagged) fields 
+//with a single pass (compact header with long size field takes a read per byte), starts message checksum calculation
+static bridge_protocol_result_t frame_header_read(bridge_link_t * link,
+                                                  uint32_t first_byte_timeout_ms,
+                                                  uint16_t * out_payload_size,
+                                                  uint32_t * out_type,
+                                                  uint8_t * out_tag,
+                                                  uint16_t * out_checksum)
 {
-    bridge_callback_result_t callback_result;
+    uint8_t buffer[BRIDGE_FRAME_SYNC_SIZE + BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_TAG_SIZE];
+    uint16_t sync_size = frame_sync_size_get(link);
+    uint16_t header_size = bridge_frame_header_size_get(link->options, NULL, 0);
+    uint8_t * header = &buffer[sync_size];
+    bool timeout_is_on_first_byte = false;
     
-    uint16_t payload_size;
-    bool timeout_is_on_first_byte;
-    callback_result = multiple_bytes_read(read, 
-                                          first_byte_timeout_ms, 
-                                          &payload_size, 
-                                          sizeof(payload_size), 
-                                          &timeout_is_on_first_byte);
+    bridge_callback_result_t callback_result = multiple_bytes_read(link,
+                                                                   first_byte_timeout_ms,
+                                                                   buffer,
+                                                                   sync_size + header_size,
+                                                                   NULL,
+                                                                   &timeout_is_on_first_byte);
     
     if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
     {
         return callback_to_protocol_result(callback_result, !timeout_is_on_first_byte);
     }
     
-    callback_result = multiple_bytes_read(read, 
-                                          BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS, 
-                                          &out_request->type, 
-                                          sizeof(out_request->type), 
-                                          NULL);
+    if (sync_size > 0)
+    {
+        callback_result = frame_sync_hunt(link, buffer, sync_size + header_size);
+        if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+        {
+            return callback_to_protocol_result(callback_result, true);
+        }
+    }
     
-    if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+    //Compact header is complete when its size field ends
+    uint16_t received = header_size;
+    header_size = bridge_frame_header_size_get(link->options, header, received);
+    while (received < header_size)
     {
-        return callback_to_protocol_result(callback_result, true);
+        callback_result = multiple_bytes_read(link,
+                                              link->between_bytes_timeout_ms,
+                                              &header[received],
+                                              header_size - received,
+                                              NULL,
+                                              NULL);
+        
+        if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
+        {
+            return callback_to_protocol_result(callback_result, true);
+        }
+        
+        received = header_size;
+        header_size = bridge_frame_header_size_get(link->options, header, received);
     }
     
-    if (request_payload_size_get(out_request->type) != payload_size)
+    if (bridge_frame_header_decode(link->options, header, out_type, out_tag, out_payload_size) == false)
     {
+        link->stats.size_mismatches++;
         return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
     }
     
+    *out_checksum = bridge_checksum_append(bridge_checksum_init(), header, header_size);
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
+
+//Reads payload and checksum fields, checksum is updated while payload is being received
+static bridge_protocol_result_t frame_payload_read(bridge_link_t * link,
+                                                   void * out_payload,
+                                                   uint16_t payload_size,
+                                                   uint16_t checksum_calculated)
+{
+    bridge_callback_result_t callback_result;
+    
     if (payload_size > 0)
     {
-        callback_result = multiple_bytes_read(read, 
-                                              BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS, 
-                                              &out_request->data, 
-                                              payload_size, 
+        callback_result = multiple_bytes_read(link,
+                                              link->between_bytes_timeout_ms,
+                                              out_payload,
+                                              payload_size,
+                                              &checksum_calculated,
                                               NULL);
         
         if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
@@ -444,11 +557,12 @@ bridge_protocol_result_t bridge_protocol_request_read(bridge_read_callback_t rea
         }
     }
     
-    uint16_t checksum;
-    callback_result = multiple_bytes_read(read, 
-                                          BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS, 
-                                          &checksum, 
-                                          sizeof(checksum), 
+    uint8_t checksum_field[BRIDGE_FRAME_CHECKSUM_SIZE];
+    callback_result = multiple_bytes_read(link,
+                                          link->between_bytes_timeout_ms,
+                                          checksum_field,
+                                          sizeof(checksum_field),
+                                          NULL,
                                           NULL);
     
     if (callback_result != BRIDGE_CALLBACK_RESULT_SUCCESS)
@@ -456,69 +570,1077 @@ bridge_protocol_result_t bridge_protocol_request_read(bridge_read_callback_t rea
         return callback_to_protocol_result(callback_result, true);
     }
     
-    uint16_t checksum_calculated = checksum_init();
-    checksum_calculated = checksum_append(checksum_calculated, &payload_size, sizeof(payload_size));
-    checksum_calculated = checksum_append(checksum_calculated, &out_request->type, sizeof(out_request->type));
-    checksum_calculated = checksum_append(checksum_calculated, &out_request->data, payload_size);
-    
+    uint16_t checksum;
+    BRIDGE_SCHEMA_DECODE(uint16_t)(checksum_field, &checksum);
     if (checksum != checksum_calculated)
     {
+        link->stats.checksum_failures++;
         return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
     }
     
+    link->stats.frames_received++;
+    
     return BRIDGE_PROTOCOL_RESULT_SUCCESS;
 }
 
-bridge_protocol_result_t bridge_protocol_match_protocol_version_answer(bridge_write_callback_t write)
+//Message format follows the features agreed by the last match, options set by application are left as is
+static void link_options_agree(bridge_link_t * link)
 {
-    bridge_answer_t answer;
-    answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
-    answer.data.match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+    uint32_t options = 0;
     
-    return answer_write(write, &answer, BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION);
+    if (link->features_agreed & BRIDGE_PROTOCOL_FEATURE_COMPACT_FRAME)
+    {
+        options |= BRIDGE_LINK_OPTION_COMPACT;
+    }
+    
+    if (link->features_agreed & BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME)
+    {
+        options |= BRIDGE_LINK_OPTION_SYNC;
+    }
+    
+    link->options &= ~(link->options_agreed & ~options);
+    link->options_agreed = (link->options_agreed & options) | (options & ~link->options);
+    link->options |= options;
 }
 
-bridge_protocol_result_t bridge_protocol_get_device_info_answer(bridge_write_callback_t write,
-                                                                const device_info_t * info)
+//After loss of sync the sides may disagree on message format, so negotiated format is dropped.
+//The other side drops it when it fails to understand standard messages, then both are in the same format.
+static void link_format_drop(bridge_link_t * link)
 {
-    bridge_answer_t answer;
-    answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
-    answer.data.get_device_info.info = *info;
-    
-    return answer_write(write, &answer, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO);
+    link->features_agreed &= (uint8_t)~(BRIDGE_PROTOCOL_FEATURE_COMPACT_FRAME | BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME);
+    link_options_agree(link);
 }
 
-bridge_protocol_result_t bridge_protocol_match_protocol_version(bridge_read_callback_t read, 
-                                                                bridge_write_callback_t write,
-                                                                uint16_t * protocol_version)
+//Limits of the protocol hold until capabilities are agreed
+static void link_limits_reset(bridge_link_t * link)
 {
-    bridge_protocol_result_t protocol_result;
-    
-    bridge_request_t request;
-    request.type = BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION;
-    request.data.match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+    link->window_agreed = BRIDGE_PROTOCOL_MAX_IN_FLIGHT;
+    link->max_payload_size_agreed = BRIDGE_FRAME_MAX_PAYLOAD_SIZE;
+}
+
+static void link_match_agree(bridge_link_t * link,
+                             uint8_t features)
+{
+    link->features_agreed = features;
+    link_options_agree(link);
     
-    bridge_answer_t answer;
-    protocol_result = request_make(read, write, &request, &answer);
-    if (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    //Peer which doesn't agree on capabilities has limits of the protocol, even if the former one had others
+    if ((features & BRIDGE_PROTOCOL_FEATURE_CAPABILITIES) == 0)
     {
-        *protocol_version = answer.data.match_protocol_version.protocol_version;
+        link_limits_reset(link);
     }
+}
+
+//Peer never makes the limits unusable: at least one request is in flight, full transfer chunk and the negotiation payloads fit
+static void link_capabilities_agree(bridge_link_t * link,
+                                    const bridge_match_capabilities_answer_t * agreement)
+{
+    uint8_t window = (agreement->window > BRIDGE_PROTOCOL_MAX_IN_FLIGHT) ? BRIDGE_PROTOCOL_MAX_IN_FLIGHT : agreement->window;
+    uint16_t max_payload_size = (agreement->max_payload_size > BRIDGE_FRAME_MAX_PAYLOAD_SIZE) ? 
+                                BRIDGE_FRAME_MAX_PAYLOAD_SIZE : agreement->max_payload_size;
     
-    return protocol_result;
+    link->window_agreed = (window > 0) ? window : 1;
+    link->max_payload_size_agreed = (max_payload_size > MIN_PAYLOAD_SIZE) ? max_payload_size : MIN_PAYLOAD_SIZE;
 }
 
-bridge_protocol_result_t bridge_protocol_get_device_info(bridge_read_callback_t read,
-                                                         bridge_write_callback_t write,
-                                                         device_info_t * info)
+static bridge_link_answer_cache_t * answer_cache_find(const bridge_link_t * link,
+                                                      bridge_request_type_t request_type)
 {
-    bridge_protocol_result_t protocol_result;
+    bridge_link_answer_cache_t * cache = link->answer_caches;
+    while ((cache != NULL) && (cache->request_type != request_type))
+    {
+        cache = cache->next;
+    }
+    
+    return cache;
+}
+
+static void answer_cache_invalidate(bridge_link_t * link,
+                                    bridge_request_type_t request_type)
+{
+    for (bridge_link_answer_cache_t * cache = link->answer_caches; cache != NULL; cache = cache->next)
+    {
+        if ((request_type == BRIDGE_REQUEST_TYPE_UNDEFINED) || (cache->request_type == request_type))
+        {
+            cache->valid = false;
+        }
+    }
+}
+
+//Cached answer is given to the same request only, i.e. the one which would be written to the bus the same way
+static bool answer_cache_get(bridge_link_t * link,
+                             const bridge_request_t * request,
+                             bridge_answer_t * out_answer)
+{
+    bridge_link_answer_cache_t * cache = answer_cache_find(link, request->type);
+    if ((cache == NULL) || (cache->valid == false))
+    {
+        return false;
+    }
+    
+    if ((cache->ttl_us != 0) && ((link_time_us_get(link) - cache->stored_us) >= cache->ttl_us))
+    {
+        cache->valid = false;
+        return false;
+    }
+    
+    uint16_t payload_size = bridge_frame_request_payload_size_get(request);
+    if ((payload_size == BRIDGE_FRAME_SIZE_INVALID) || 
+        (payload_size != bridge_frame_request_payload_size_get(&cache->request)) || 
+        (memcmp(&request->data, &cache->request.data, payload_size) != 0))
+    {
+        return false;
+    }
+    
+    *out_answer = cache->answer;
+    link->stats.cache_hits++;
+    
+    return true;
+}
+
+static void answer_cache_put(bridge_link_t * link,
+                             const bridge_request_t * request,
+                             const bridge_answer_t * answer)
+{
+    bridge_link_answer_cache_t * cache = answer_cache_find(link, request->type);
+    if (cache == NULL)
+    {
+        return;
+    }
+    
+    cache->request = *request;
+    cache->answer = *answer;
+    cache->stored_us = link_time_us_get(link);
+    cache->valid = true;
+}
+
+//Server loses sync on corrupted request the same way client does on lost answer
+static bridge_protocol_result_t request_lost_account(bridge_link_t * link,
+                                                     bridge_protocol_result_t result)
+{
+    if (result == BRIDGE_PROTOCOL_RESULT_CORRUPTED)
+    {
+        link_format_drop(link);
+    }
+    
+    return link_result_account(link, result);
+}
+
+//Request is removed from in-flight list when its answer is received. 
+//With tagged link it is found by tag, otherwise answers come in order of requests.
+static bool in_flight_remove(bridge_link_t * link, 
+                             uint8_t tag, 
+                             bridge_link_in_flight_t * out_in_flight)
+{
+    uint8_t index = 0;
+    
+    if (link->options & BRIDGE_LINK_OPTION_TAGGED)
+    {
+        while ((index < link->in_flight_count) && (link->in_flight[index].tag != tag))
+        {
+            index++;
+        }
+    }
+    
+    if (index >= link->in_flight_count)
+    {
+        return false;
+    }
+    
+    *out_in_flight = link->in_flight[index];
+    
+    link->in_flight_count--;
+    memmove(&link->in_flight[index], &link->in_flight[index + 1], (link->in_flight_count - index) * sizeof(link->in_flight[0]));
+    
+    return true;
+}
+
+static bool in_flight_add(bridge_link_t * link, 
+                          uint8_t tag, 
+                          bridge_request_type_t request_type, 
+                          uint16_t size)
+{
+    if (link->in_flight_count >= BRIDGE_PROTOCOL_MAX_IN_FLIGHT)
+    {
+        return false;
+    }
+    
+    link->in_flight[link->in_flight_count].tag = tag;
+    link->in_flight[link->in_flight_count].request_type = request_type;
+    link->in_flight[link->in_flight_count].sent_us = link_time_us_get(link);
+    link->in_flight[link->in_flight_count].size = size;
+    link->in_flight_count++;
+    
+    return true;
+}
+
+//Round trip time is measured and features agreed by server are learned from every valid answer
+static void answer_received_account(bridge_link_t * link, 
+                                    const bridge_link_in_flight_t * in_flight, 
+                                    bridge_answer_t * answer, 
+                                    uint16_t answer_size)
+{
+    if (link->clock != NULL)
+    {
+        uint32_t round_trip_us = link_time_us_get(link) - in_flight->sent_us;
+        if (link->histograms != NULL)
+        {
+            bridge_histogram_record(&link->histograms->round_trip_us, round_trip_us);
+        }
+        
+        uint32_t wire_us = wire_time_us_get(link, (uint32_t)in_flight->size + answer_size);
+        rtt_sample_add(link, (round_trip_us > wire_us) ? (round_trip_us - wire_us) : 0);
+    }
+    
+    //Caller gets bare version, features agreed by server are kept by the link
+    if ((in_flight->request_type == BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION) && 
+        (answer->type == BRIDGE_ANSWER_TYPE_SUCCESS))
+    {
+        uint16_t * protocol_version = &answer->data.match_protocol_version.protocol_version;
+        link_match_agree(link, (uint8_t)(*protocol_version >> BRIDGE_PROTOCOL_FEATURES_SHIFT) & link->features);
+        *protocol_version &= BRIDGE_PROTOCOL_VERSION_MASK;
+    }
+    
+    if ((in_flight->request_type == BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES) && 
+        (answer->type == BRIDGE_ANSWER_TYPE_SUCCESS))
+    {
+        link_capabilities_agree(link, &answer->data.match_capabilities);
+    }
+}
+
+//Requests in flight are lost if no valid answer received, answer timeout backs off until the next answer comes
+static void answer_lost_account(bridge_link_t * link, 
+                                bridge_protocol_result_t result)
+{
+    if ((result == BRIDGE_PROTOCOL_RESULT_TIMEOUT) && link->adaptive_timeout && (link->rtt.backoff < RTT_MAX_BACKOFF))
+    {
+        link->rtt.backoff++;
+    }
+    
+    if ((result == BRIDGE_PROTOCOL_RESULT_TIMEOUT) || 
+        (result == BRIDGE_PROTOCOL_RESULT_CORRUPTED) || 
+        (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR))
+    {
+        link->in_flight_count = 0;
+        link_format_drop(link);
+        answer_cache_invalidate(link, BRIDGE_REQUEST_TYPE_UNDEFINED);
+    }
+}
+
+static bridge_protocol_result_t answer_read(bridge_link_t * link,
+                                            bridge_answer_t * out_answer,
+                                            bridge_request_type_t * out_request_type, 
+                                            uint8_t * out_tag)
+{
+    bridge_protocol_result_t protocol_result;
+    
+    uint16_t payload_size;
+    uint32_t answer_type;
+    uint16_t checksum;
+    protocol_result = frame_header_read(link,
+                                        answer_timeout_get(link),
+                                        &payload_size,
+                                        &answer_type,
+                                        out_tag, 
+                                        &checksum);
+    
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return protocol_result;
+    }
+    
+    out_answer->type = (bridge_answer_type_t)answer_type;
+    
+    bridge_link_in_flight_t in_flight;
+    if (in_flight_remove(link, *out_tag, &in_flight) == false)
+    {
+        return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+    }
+    
+    *out_request_type = in_flight.request_type;
+    
+    //Compressed payload is always smaller than the original one, so the same limit applies
+    bool compressed = ((payload_size & BRIDGE_FRAME_COMPRESSED_FLAG) != 0);
+    uint16_t max_size = bridge_frame_answer_payload_max_size_get(*out_request_type, out_answer->type);
+    payload_size &= ~BRIDGE_FRAME_COMPRESSED_FLAG;
+    uint16_t answer_size = frame_size_get(link, payload_size);
+    
+    if (payload_size > max_size)
+    {
+        link->stats.size_mismatches++;
+        return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+    }
+    
+    if (compressed)
+    {
+        uint8_t buffer[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+        protocol_result = frame_payload_read(link, buffer, payload_size, checksum);
+        if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            return protocol_result;
+        }
+        
+        payload_size = bridge_compress_decode(buffer, payload_size, (uint8_t*)&out_answer->data, max_size);
+        if (payload_size == BRIDGE_COMPRESS_SIZE_INVALID)
+        {
+            return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+        }
+    }
+    else
+    {
+        protocol_result = frame_payload_read(link, &out_answer->data, payload_size, checksum);
+        if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            return protocol_result;
+        }
+    }
+    
+    bridge_frame_answer_data_decode(*out_request_type, out_answer->type, (const uint8_t*)&out_answer->data, &out_answer->data);
+    
+    //Size of variable answers is known only after their content is received
+    if (bridge_frame_answer_payload_size_get(*out_request_type, out_answer) != payload_size)
+    {
+        link->stats.size_mismatches++;
+        return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+    }
+    
+    answer_received_account(link, &in_flight, out_answer, answer_size);
+    
+    if (out_answer->type == BRIDGE_ANSWER_TYPE_REQUEST_REJECTED)
+    {
+        return BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED;
+    }
+    
+    if (out_answer->type == BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS)
+    {
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+    }
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
+
+static bridge_protocol_result_t request_write(bridge_link_t * link,
+                                              const bridge_request_t * request, 
+                                              uint8_t * out_tag)
+{
+    uint8_t tag = link->next_tag;
+    
+    //Features of the link are offered with every protocol version match, its capabilities with every capabilities match
+    bridge_request_t offer;
+    if (request->type == BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION)
+    {
+        offer.type = request->type;
+        offer.data.match_protocol_version.protocol_version = 
+            (request->data.match_protocol_version.protocol_version & BRIDGE_PROTOCOL_VERSION_MASK) | 
+            ((uint16_t)link->features << BRIDGE_PROTOCOL_FEATURES_SHIFT);
+        request = &offer;
+    }
+    else if (request->type == BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES)
+    {
+        offer.type = request->type;
+        offer.data.match_capabilities.max_payload_size = link->max_payload_size;
+        offer.data.match_capabilities.window = link->window;
+        offer.data.match_capabilities.checksums = BRIDGE_PROTOCOL_CHECKSUM_CRC16_CCITT;
+        request = &offer;
+    }
+    
+    uint16_t payload_size = bridge_frame_request_payload_size_get(request);
+    if (payload_size == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+    }
+    
+    if (in_flight_add(link, tag, request->type, frame_size_get(link, payload_size)) == false)
+    {
+        return BRIDGE_PROTOCOL_RESULT_BUSY;
+    }
+    
+    uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+    bridge_frame_request_data_encode(request, payload);
+    
+    bridge_protocol_result_t protocol_result = frame_write(link, 
+                                                           request->type, 
+                                                           tag, 
+                                                           payload, 
+                                                           payload_size,
+                                                           false);
+    
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        link->in_flight_count--;
+        return protocol_result;
+    }
+    
+    link->next_tag++;
+    
+    if (out_tag != NULL)
+    {
+        *out_tag = tag;
+    }
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
+
+//Answer is received and the result is accounted
+static bridge_protocol_result_t answer_receive(bridge_link_t * link, 
+                                               uint8_t * out_tag, 
+                                               bridge_request_type_t * out_request_type, 
+                                               bridge_answer_t * out_answer)
+{
+    bridge_protocol_result_t protocol_result = answer_read(link, out_answer, out_request_type, out_tag);
+    
+    answer_lost_account(link, protocol_result);
+    
+    return link_result_account(link, protocol_result);
+}
+
+static bridge_protocol_result_t request_make(bridge_link_t * link,
+                                             const bridge_request_t * request,
+                                             bridge_answer_t * out_answer)
+{
+    bridge_protocol_result_t protocol_result;
+    
+    if (answer_cache_get(link, request, out_answer))
+    {
+        return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+    
+    if (link->in_flight_count > 0)
+    {
+        return BRIDGE_PROTOCOL_RESULT_BUSY;
+    }
+    
+    protocol_result = request_write(link, request, NULL);
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return protocol_result;
+    }
+    
+    uint8_t tag;
+    bridge_request_type_t request_type;
+    protocol_result = answer_receive(link, &tag, &request_type, out_answer);
+    if (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        answer_cache_put(link, request, out_answer);
+    }
+    
+    return protocol_result;
+}
+
+//Answer belongs to the oldest request received, it carries the tag of the request on tagged link.
+//Returns NULL if no request was reported, e.g. answer is sent by a legacy call.
+static const bridge_link_in_flight_t * answer_request_take(bridge_link_t * link, 
+                                                          bridge_link_in_flight_t * out_answered)
+{
+    out_answered->tag = 0;
+    
+    if (in_flight_remove(link, link->in_flight[0].tag, out_answered) == false)
+    {
+        return NULL;
+    }
+    
+    return out_answered;
+}
+
+//Handling time is taken once per request from its own receive time, so any number of requests may wait for answers
+static void answer_written_account(bridge_link_t * link,
+                                   const bridge_link_in_flight_t * answered, 
+                                   bridge_protocol_result_t protocol_result)
+{
+    if ((protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS) && (answered != NULL) && 
+        (link->clock != NULL) && (link->histograms != NULL))
+    {
+        bridge_histogram_record(&link->histograms->handling_us, link_time_us_get(link) - answered->sent_us);
+    }
+}
+
+//Features and capabilities are agreed by successful answers to the matches, so whatever way server answers them,
+//the agreement is put into the answer. Data may be the same as out_data. Returns false for other answers.
+static bool answer_agreement_fill(const bridge_link_t * link,
+                                  bridge_request_type_t request_type,
+                                  bridge_answer_type_t answer_type,
+                                  const bridge_answer_data_t * data,
+                                  bridge_answer_data_t * out_data)
+{
+    if (answer_type != BRIDGE_ANSWER_TYPE_SUCCESS)
+    {
+        return false;
+    }
+    
+    switch (request_type)
+    {
+        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
+        {
+            uint8_t features = link->features_offered & link->features;
+            out_data->match_protocol_version.protocol_version = 
+                (data->match_protocol_version.protocol_version & BRIDGE_PROTOCOL_VERSION_MASK) | 
+                ((uint16_t)features << BRIDGE_PROTOCOL_FEATURES_SHIFT);
+            return true;
+        }
+        
+        //CRC-16 CCITT is the only checksum algorithm, every side supports it
+        case BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES:
+        {
+            const bridge_match_capabilities_request_t * offered = &link->capabilities_offered;
+            uint16_t max_payload_size = (offered->max_payload_size < link->max_payload_size) ? 
+                                        offered->max_payload_size : link->max_payload_size;
+            out_data->match_capabilities.max_payload_size = (max_payload_size > MIN_PAYLOAD_SIZE) ? max_payload_size : MIN_PAYLOAD_SIZE;
+            out_data->match_capabilities.window = (offered->window < link->accept_window) ? offered->window : link->accept_window;
+            out_data->match_capabilities.checksum = BRIDGE_PROTOCOL_CHECKSUM_CRC16_CCITT;
+            return true;
+        }
+        
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+//Answer to a match is sent in the former format and limits, the next messages follow the agreement
+static void answer_agreement_apply(bridge_link_t * link,
+                                   bridge_request_type_t request_type,
+                                   const bridge_answer_data_t * agreement)
+{
+    if (request_type == BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION)
+    {
+        link_match_agree(link, (uint8_t)(agreement->match_protocol_version.protocol_version >> BRIDGE_PROTOCOL_FEATURES_SHIFT));
+    }
+    else
+    {
+        link_capabilities_agree(link, &agreement->match_capabilities);
+    }
+}
+
+//Payload is compressed into buffer only if it gets smaller
+static bool answer_compress(const bridge_link_t * link,
+                            const void * payload,
+                            uint16_t * payload_size,
+                            uint8_t * buffer)
+{
+    if (((link->features_agreed & BRIDGE_PROTOCOL_FEATURE_COMPRESSION) == 0) || 
+        (*payload_size < COMPRESS_MIN_PAYLOAD_SIZE))
+    {
+        return false;
+    }
+    
+    uint16_t compressed_size = bridge_compress_encode((const uint8_t*)payload, *payload_size, buffer, *payload_size - 1);
+    if (compressed_size == 0)
+    {
+        return false;
+    }
+    
+    *payload_size = compressed_size;
+    return true;
+}
+
+static bridge_protocol_result_t answer_write(bridge_link_t * link,
+                                             const bridge_answer_t * answer,
+                                             bridge_request_type_t request_type)
+{
+    uint16_t payload_size = bridge_frame_answer_payload_size_get(request_type, answer);
+    if (payload_size == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+    }
+    
+    const bridge_answer_data_t * data = &answer->data;
+    bridge_answer_data_t agreement;
+    bool agreed = answer_agreement_fill(link, request_type, answer->type, &answer->data, &agreement);
+    if (agreed)
+    {
+        data = &agreement;
+    }
+    
+    uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+    bridge_frame_answer_data_encode(request_type, answer->type, data, payload);
+    
+    uint8_t buffer[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+    bool compressed = answer_compress(link, payload, &payload_size, buffer);
+    
+    bridge_link_in_flight_t request;
+    const bridge_link_in_flight_t * answered = answer_request_take(link, &request);
+    
+    bridge_protocol_result_t protocol_result = frame_write(link, 
+                                                           answer->type, 
+                                                           request.tag, 
+                                                           (compressed) ? buffer : payload, 
+                                                           payload_size,
+                                                           compressed);
+    
+    if (agreed && (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS))
+    {
+        answer_agreement_apply(link, request_type, &agreement);
+    }
+    
+    answer_written_account(link, answered, protocol_result);
+    
+    return protocol_result;
+}
+
+static bridge_protocol_result_t link_recover(bridge_link_t * link,
+                                            uint32_t timeout_ms)
+{
+    bridge_callback_result_t read_result;
+    
+    link->in_flight_count = 0;
+    link_format_drop(link);
+    answer_cache_invalidate(link, BRIDGE_REQUEST_TYPE_UNDEFINED);
+    
+    if (link->options & BRIDGE_LINK_OPTION_SYNC)
+    {
+        //Start of the next message is found by sync bytes, no need to wait for silence
+        return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+    
+    if (timeout_ms < link->recover_timeout_ms)
+    {
+        return BRIDGE_PROTOCOL_RESULT_TIMEOUT;
+    }
+    
+    uint32_t waited_ms = 0;
+    do
+    {
+        uint8_t dummy[32];
+        uint32_t dummy_len;
+        read_result = link_chunk_read(link, link->recover_timeout_ms, dummy, sizeof(dummy), &dummy_len);
+        
+        waited_ms += link->recover_timeout_ms;
+        
+        if ((read_result == BRIDGE_CALLBACK_RESULT_SUCCESS) && (waited_ms >= timeout_ms))
+        {
+            return BRIDGE_PROTOCOL_RESULT_TIMEOUT;
+        }
+    } while (read_result == BRIDGE_CALLBACK_RESULT_SUCCESS);
+    
+    if (read_result == BRIDGE_CALLBACK_RESULT_READ_TIMEOUT)
+    {
+        return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+    
+    return link_result_account(link, callback_to_protocol_result(read_result, false));
+}
+
+static bridge_callback_result_t legacy_read(void * user,
+                                            uint8_t * data,
+                                            uint16_t max_len,
+                                            uint16_t * out_len,
+                                            uint32_t timeout_ms)
+{
+    const legacy_bus_t * bus = (const legacy_bus_t*)user;
+    
+    if (bus->read_bulk != NULL)
+    {
+        return bus->read_bulk(data, max_len, out_len, timeout_ms);
+    }
+    
+    *out_len = 1;
+    return bus->read(data, timeout_ms);
+}
+
+static bridge_callback_result_t legacy_write(void * user,
+                                             const uint8_t * data,
+                                             uint16_t data_len)
+{
+    const legacy_bus_t * bus = (const legacy_bus_t*)user;
+    
+    return bus->write((uint8_t*)data, data_len);
+}
+
+static bridge_callback_result_t legacy_write_vector(void * user,
+                                                    const bridge_write_chunk_t * chunks,
+                                                    uint8_t chunks_count)
+{
+    const legacy_bus_t * bus = (const legacy_bus_t*)user;
+    
+    return bus->write_vector(chunks, chunks_count);
+}
+
+//Wraps callbacks of protocol calls without link context into temporary link.
+//Either of callbacks may be NULL if not used by the call.
+static void legacy_link_init(bridge_link_t * link,
+                             legacy_bus_t * bus,
+                             bridge_read_callback_t read,
+                             bridge_write_callback_t write)
+{
+    memset(bus, 0, sizeof(*bus));
+    bus->read = read;
+    bus->write = write;
+    
+    for (uint32_t i = 0; (read != NULL) && (i < BRIDGE_PROTOCOL_BULK_READ_MAX_REGISTERED); i++)
+    {
+        if (m_bulk_readers[i].read == read)
+        {
+            bus->read_bulk = m_bulk_readers[i].read_bulk;
+            break;
+        }
+    }
+    
+    for (uint32_t i = 0; (write != NULL) && (i < BRIDGE_PROTOCOL_VECTOR_WRITE_MAX_REGISTERED); i++)
+    {
+        if (m_vector_writers[i].write == write)
+        {
+            bus->write_vector = m_vector_writers[i].write_vector;
+            break;
+        }
+    }
+    
+    bridge_link_init(link, legacy_read, legacy_write, bus);
+    link->write_vector = (bus->write_vector != NULL) ? legacy_write_vector : NULL;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void bridge_link_init(bridge_link_t * link,
+                      bridge_link_read_callback_t read,
+                      bridge_link_write_callback_t write,
+                      void * user)
+{
+    memset(link, 0, sizeof(*link));
+    
+    link->read = read;
+    link->write = write;
+    link->write_vector = NULL;
+    link->clock = NULL;
+    link->capture = NULL;
+    link->capture_context = NULL;
+    link->user = user;
+    link->between_bytes_timeout_ms = BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS;
+    link->wait_answer_timeout_ms = BRIDGE_PROTOCOL_WAIT_ANSWER_TIMEOUT_MS;
+    link->recover_timeout_ms = BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS;
+    link->baud = 0;
+    link->adaptive_timeout = false;
+    link->options = BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS;
+    link->window = 1;
+    link->features = BRIDGE_PROTOCOL_DEFAULT_FEATURES;
+    link->accept_window = BRIDGE_PROTOCOL_MAX_IN_FLIGHT;
+    link->max_payload_size = BRIDGE_FRAME_MAX_PAYLOAD_SIZE;
+    link_limits_reset(link);
+}
+
+void bridge_link_stats_snapshot(bridge_link_t * link, 
+                                bridge_link_stats_t * out_stats, 
+                                bridge_link_histograms_t * out_histograms, 
+                                bool reset)
+{
+    memcpy(out_stats, &link->stats, sizeof(*out_stats));
+    
+    if ((out_histograms != NULL) && (link->histograms != NULL))
+    {
+        memcpy(out_histograms, link->histograms, sizeof(*out_histograms));
+    }
+    
+    if (reset)
+    {
+        memset(&link->stats, 0, sizeof(link->stats));
+        
+        if (link->histograms != NULL)
+        {
+            bridge_histogram_reset(&link->histograms->round_trip_us);
+            bridge_histogram_reset(&link->histograms->handling_us);
+        }
+    }
+}
+
+void bridge_link_baud_set(bridge_link_t * link, 
+                          uint32_t baud)
+{
+    link->baud = baud;
+    
+    if (baud == 0)
+    {
+        link->between_bytes_timeout_ms = BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS;
+        link->recover_timeout_ms = BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS;
+        return;
+    }
+    
+    uint32_t timeout_ms = (wire_time_us_get(link, BRIDGE_PROTOCOL_BETWEEN_BYTES_CHARACTERS) + 999) / 1000;
+    link->between_bytes_timeout_ms = (timeout_ms > BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS) ? 
+                                     timeout_ms : BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS;
+    
+    //Silence of recovery should be longer than any pause inside a message
+    link->recover_timeout_ms = 2 * link->between_bytes_timeout_ms;
+}
+
+bool bridge_link_adaptive_timeout_enable(bridge_link_t * link, 
+                                         bool enable)
+{
+    if (enable && (link->clock == NULL))
+    {
+        return false;
+    }
+    
+    link->adaptive_timeout = enable;
+    memset(&link->rtt, 0, sizeof(link->rtt));
+    
+    return true;
+}
+
+uint32_t bridge_link_answer_timeout_get(const bridge_link_t * link)
+{
+    return answer_timeout_get(link);
+}
+
+bool bridge_link_answer_cache_enable(bridge_link_t * link, 
+                                     bridge_link_answer_cache_t * cache, 
+                                     bridge_request_type_t request_type, 
+                                     uint32_t ttl_ms)
+{
+    if ((request_type <= BRIDGE_REQUEST_TYPE_UNDEFINED) || (request_type >= BRIDGE_REQUEST_TYPE_COUNT) || 
+        (answer_cache_find(link, request_type) != NULL))
+    {
+        return false;
+    }
+    
+    //Callers leave data of capabilities request unfilled (the link sends its own offer), so it can't be compared.
+    //Chunks and batches change server state or carry variable data, so their answers are never reused
+    if ((request_type == BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES) || 
+        (request_type == BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK) || 
+        (request_type == BRIDGE_REQUEST_TYPE_BATCH))
+    {
+        return false;
+    }
+    
+    //Age of answer is measured by clock of the link
+    if ((ttl_ms > BRIDGE_LINK_ANSWER_CACHE_MAX_TTL_MS) || ((ttl_ms != 0) && (link->clock == NULL)))
+    {
+        return false;
+    }
+    
+    cache->request_type = request_type;
+    cache->ttl_us = ttl_ms * 1000;
+    cache->valid = false;
+    cache->next = link->answer_caches;
+    link->answer_caches = cache;
+    
+    return true;
+}
+
+void bridge_link_answer_cache_disable(bridge_link_t * link, 
+                                      bridge_request_type_t request_type)
+{
+    bridge_link_answer_cache_t ** cache = &link->answer_caches;
+    while ((*cache != NULL) && ((*cache)->request_type != request_type))
+    {
+        cache = &(*cache)->next;
+    }
+    
+    if (*cache != NULL)
+    {
+        *cache = (*cache)->next;
+    }
+}
+
+void bridge_link_answer_cache_invalidate(bridge_link_t * link, 
+                                         bridge_request_type_t request_type)
+{
+    answer_cache_invalidate(link, request_type);
+}
+
+bridge_protocol_result_t bridge_link_recover(bridge_link_t * link,
+                                             uint32_t timeout_ms)
+{
+    uint32_t start_us = link_time_us_get(link);
+    bridge_protocol_result_t protocol_result = link_recover(link, timeout_ms);
+    
+    link->stats.recovers++;
+    link->stats.recover_time_us += link_time_us_get(link) - start_us;
+    
+    return protocol_result;
+}
+
+bridge_protocol_result_t bridge_link_request_read(bridge_link_t * link,
+                                                  uint32_t first_byte_timeout_ms,
+                                                  bridge_request_t * out_request)
+{
+    bridge_protocol_result_t protocol_result;
+    
+    uint16_t payload_size;
+    uint32_t request_type;
+    uint16_t checksum;
+    uint8_t tag;
+    protocol_result = frame_header_read(link,
+                                        first_byte_timeout_ms,
+                                        &payload_size,
+                                        &request_type,
+                                        &tag, 
+                                        &checksum);
+    
+    if (protocol_result == BRIDGE_PROTOCOL_RESULT_TIMEOUT)
+    {
+        //Timeout on the first byte only means there is no request yet
+        return protocol_result;
+    }
+    
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return request_lost_account(link, protocol_result);
+    }
+    
+    out_request->type = (bridge_request_type_t)request_type;
+    
+    if (payload_size > bridge_frame_request_payload_max_size_get(out_request->type))
+    {
+        link->stats.size_mismatches++;
+        return request_lost_account(link, BRIDGE_PROTOCOL_RESULT_CORRUPTED);
+    }
+    
+    protocol_result = frame_payload_read(link, &out_request->data, payload_size, checksum);
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return request_lost_account(link, protocol_result);
+    }
+    
+    bridge_frame_request_data_decode((const uint8_t*)&out_request->data, out_request);
+    
+    //Size of variable requests is known only after their content is received
+    if (bridge_frame_request_payload_size_get(out_request) != payload_size)
+    {
+        link->stats.size_mismatches++;
+        return request_lost_account(link, BRIDGE_PROTOCOL_RESULT_CORRUPTED);
+    }
+    
+    if (bridge_link_request_received(link, tag, out_request) == false)
+    {
+        return request_lost_account(link, BRIDGE_PROTOCOL_RESULT_CORRUPTED);
+    }
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
+
+bool bridge_link_request_received(bridge_link_t * link, 
+                                  uint8_t tag, 
+                                  const bridge_request_t * request)
+{
+    //Request is kept until it is answered, its tag goes to the answer and its receive time to handling time.
+    //Client never exceeds the window of tagged link, so overflow means lost sync there. 
+    //Otherwise the oldest request is dropped, it is never going to be answered.
+    if (link->in_flight_count >= BRIDGE_PROTOCOL_MAX_IN_FLIGHT)
+    {
+        bridge_link_in_flight_t dropped;
+        if (link->options & BRIDGE_LINK_OPTION_TAGGED)
+        {
+            return false;
+        }
+        
+        in_flight_remove(link, 0, &dropped);
+    }
+    
+    in_flight_add(link, tag, request->type, frame_size_get(link, bridge_frame_request_payload_size_get(request)));
+    
+    if (request->type == BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION)
+    {
+        link->features_offered = (uint8_t)(request->data.match_protocol_version.protocol_version >> BRIDGE_PROTOCOL_FEATURES_SHIFT);
+    }
+    else if (request->type == BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES)
+    {
+        link->capabilities_offered = request->data.match_capabilities;
+    }
+    
+    return true;
+}
+
+void bridge_link_request_unanswered(bridge_link_t * link)
+{
+    bridge_link_in_flight_t request;
+    
+    answer_request_take(link, &request);
+}
+
+void bridge_link_request_corrupted(bridge_link_t * link)
+{
+    request_lost_account(link, BRIDGE_PROTOCOL_RESULT_CORRUPTED);
+}
+
+void bridge_link_data_skipped(bridge_link_t * link)
+{
+    link->stats.skipped++;
+}
+
+void bridge_link_answer_received(bridge_link_t * link, 
+                                 uint8_t tag, 
+                                 bridge_protocol_result_t result, 
+                                 bridge_answer_t * answer)
+{
+    bridge_link_in_flight_t in_flight;
+    
+    //Size of compressed answer on the bus is not known here, the original size is close enough for round trip time
+    if ((answer != NULL) && (in_flight_remove(link, tag, &in_flight)))
+    {
+        uint16_t answer_size = frame_size_get(link, bridge_frame_answer_payload_size_get(in_flight.request_type, answer));
+        answer_received_account(link, &in_flight, answer, answer_size);
+    }
+    
+    answer_lost_account(link, result);
+    link_result_account(link, result);
+}
+
+bridge_protocol_result_t bridge_link_match_protocol_version_answer(bridge_link_t * link)
+{
+    bridge_answer_frame_t frame;
+    bridge_answer_data_t * data = bridge_link_answer_reserve(link, BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION, &frame);
+    data->match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+    
+    return bridge_link_answer_commit(link, &frame, BRIDGE_ANSWER_TYPE_SUCCESS);
+}
+
+bridge_protocol_result_t bridge_link_match_capabilities_answer(bridge_link_t * link)
+{
+    bridge_answer_frame_t frame;
+    bridge_link_answer_reserve(link, BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES, &frame);
+    
+    return bridge_link_answer_commit(link, &frame, BRIDGE_ANSWER_TYPE_SUCCESS);
+}
+
+bridge_protocol_result_t bridge_link_get_device_info_answer(bridge_link_t * link,
+                                                            const device_info_t * info)
+{
+    bridge_answer_frame_t frame;
+    bridge_answer_data_t * data = bridge_link_answer_reserve(link, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, &frame);
+    data->get_device_info.info = *info;
+    
+    return bridge_link_answer_commit(link, &frame, BRIDGE_ANSWER_TYPE_SUCCESS);
+}
+
+bridge_protocol_result_t bridge_link_match_protocol_version(bridge_link_t * link,
+                                                            uint16_t * protocol_version)
+{
+    bridge_protocol_result_t protocol_result;
+    
+    bridge_request_t request;
+    request.type = BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION;
+    request.data.match_protocol_version.protocol_version = BRIDGE_PROTOCOL_VERSION;
+    
+    bridge_answer_t answer;
+    protocol_result = request_make(link, &request, &answer);
+    if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        return protocol_result;
+    }
+    
+    *protocol_version = answer.data.match_protocol_version.protocol_version;
+    
+    //Capabilities are offered by the link itself, so the request has no data to fill
+    if (link->features_agreed & BRIDGE_PROTOCOL_FEATURE_CAPABILITIES)
+    {
+        request.type = BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES;
+        protocol_result = request_make(link, &request, &answer);
+    }
+    
+    return protocol_result;
+}
+
+bridge_protocol_result_t bridge_link_get_device_info(bridge_link_t * link,
+                                                     device_info_t * info)
+{
+    bridge_protocol_result_t protocol_result;
     
     bridge_request_t request;
     request.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
     
     bridge_answer_t answer;
-    protocol_result = request_make(read, write, &request, &answer);
+    protocol_result = request_make(link, &request, &answer);
     if (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
     {
         *info = answer.data.get_device_info.info;
@@ -526,3 +1648,335 @@ bridge_protocol_result_t bridge_protocol_get_device_info(bridge_read_callback_t
     
     return protocol_result;
 }
+
+bridge_protocol_result_t bridge_link_batch_answer(bridge_link_t * link,
+                                                  const bridge_answer_t * answer)
+{
+    return answer_write(link, answer, BRIDGE_REQUEST_TYPE_BATCH);
+}
+
+bridge_protocol_result_t bridge_link_batch(bridge_link_t * link,
+                                           const bridge_request_t * request,
+                                           bridge_answer_t * out_answer)
+{
+    if (request->type != BRIDGE_REQUEST_TYPE_BATCH)
+    {
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+    }
+    
+    return request_make(link, request, out_answer);
+}
+
+bridge_protocol_result_t bridge_link_call(bridge_link_t * link,
+                                          const bridge_request_t * request,
+                                          bridge_answer_t * out_answer)
+{
+    return request_make(link, request, out_answer);
+}
+
+//Typed calls copy data of the type into generic request and out of generic answer
+#define TYPED_REQUEST_SET_0(member)
+#define TYPED_REQUEST_SET_1(member) generic_request.data.member = *request;
+#define TYPED_ANSWER_GET_0(member)
+#define TYPED_ANSWER_GET_1(member) \
+    if (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS) \
+    { \
+        *out_answer = generic_answer.data.member; \
+    }
+#define TYPED_ANSWER_SET_0(member) (void)data;
+#define TYPED_ANSWER_SET_1(member) data->member = *answer;
+
+#define TYPED_DEFINE(name, member, request_data, answer_data) \
+    bridge_protocol_result_t bridge_link_##member##_call(bridge_link_t * link \
+                                                         BRIDGE_LINK_CALL_REQUEST_PARAM_##request_data(member) \
+                                                         BRIDGE_LINK_CALL_ANSWER_PARAM_##answer_data(member)) \
+    { \
+        bridge_request_t generic_request; \
+        generic_request.type = BRIDGE_REQUEST_TYPE_##name; \
+        TYPED_REQUEST_SET_##request_data(member) \
+        \
+        bridge_answer_t generic_answer; \
+        bridge_protocol_result_t protocol_result = request_make(link, &generic_request, &generic_answer); \
+        TYPED_ANSWER_GET_##answer_data(member) \
+        \
+        return protocol_result; \
+    } \
+    \
+    bridge_protocol_result_t bridge_link_##member##_answer_send(bridge_link_t * link \
+                                                                BRIDGE_LINK_ANSWER_SEND_PARAM_##answer_data(member)) \
+    { \
+        bridge_answer_frame_t frame; \
+        bridge_answer_data_t * data = bridge_link_answer_reserve(link, BRIDGE_REQUEST_TYPE_##name, &frame); \
+        TYPED_ANSWER_SET_##answer_data(member) \
+        \
+        return bridge_link_answer_commit(link, &frame, BRIDGE_ANSWER_TYPE_SUCCESS); \
+    }
+
+BRIDGE_REQUEST_LIST(TYPED_DEFINE)
+
+bridge_protocol_result_t bridge_link_request_send(bridge_link_t * link, 
+                                                  const bridge_request_t * request, 
+                                                  uint8_t * out_tag)
+{
+    if ((link->in_flight_count >= link->window) || 
+        (link->in_flight_count >= link->window_agreed) || 
+        (link->in_flight_count >= BRIDGE_PROTOCOL_MAX_IN_FLIGHT))
+    {
+        return BRIDGE_PROTOCOL_RESULT_BUSY;
+    }
+    
+    return request_write(link, request, out_tag);
+}
+
+bridge_protocol_result_t bridge_link_answer_receive(bridge_link_t * link, 
+                                                    uint8_t * out_tag, 
+                                                    bridge_request_type_t * out_request_type, 
+                                                    bridge_answer_t * out_answer)
+{
+    uint8_t tag = 0;
+    bridge_request_type_t request_type = BRIDGE_REQUEST_TYPE_UNDEFINED;
+    
+    if (link->in_flight_count == 0)
+    {
+        return BRIDGE_PROTOCOL_RESULT_BUSY;
+    }
+    
+    bridge_protocol_result_t protocol_result = answer_receive(link, &tag, &request_type, out_answer);
+    
+    if (out_tag != NULL)
+    {
+        *out_tag = tag;
+    }
+    
+    if (out_request_type != NULL)
+    {
+        *out_request_type = request_type;
+    }
+    
+    return protocol_result;
+}
+
+bridge_protocol_result_t bridge_link_answer_send(bridge_link_t * link, 
+                                                 bridge_request_type_t request_type, 
+                                                 const bridge_answer_t * answer)
+{
+    return answer_write(link, answer, request_type);
+}
+
+bridge_answer_data_t * bridge_link_answer_reserve(bridge_link_t * link, 
+                                                  bridge_request_type_t request_type, 
+                                                  bridge_answer_frame_t * frame)
+{
+    (void)link;
+    
+    frame->request_type = request_type;
+    
+    return &frame->data;
+}
+
+bridge_protocol_result_t bridge_link_answer_commit(bridge_link_t * link, 
+                                                   bridge_answer_frame_t * frame, 
+                                                   bridge_answer_type_t answer_type)
+{
+    uint16_t payload_size = bridge_frame_answer_data_size_get(frame->request_type, answer_type, &frame->data);
+    if (payload_size == BRIDGE_FRAME_SIZE_INVALID)
+    {
+        return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+    }
+    
+    bridge_answer_data_t agreement;
+    bool agreed = answer_agreement_fill(link, frame->request_type, answer_type, &frame->data, &agreement);
+    
+    //Data is not valid after commit, so it is encoded in place
+    bridge_frame_answer_data_encode(frame->request_type, answer_type, (agreed) ? &agreement : &frame->data, (uint8_t*)&frame->data);
+    
+    bridge_link_in_flight_t request;
+    const bridge_link_in_flight_t * answered = answer_request_take(link, &request);
+    
+    bridge_protocol_result_t protocol_result;
+    uint8_t buffer[BRIDGE_FRAME_MAX_PAYLOAD_SIZE];
+    if (answer_compress(link, &frame->data, &payload_size, buffer))
+    {
+        protocol_result = frame_write(link, answer_type, request.tag, buffer, payload_size, true);
+    }
+    else
+    {
+        protocol_result = frame_in_place_write(link, answer_type, request.tag, frame, payload_size);
+    }
+    
+    if (agreed && (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS))
+    {
+        answer_agreement_apply(link, frame->request_type, &agreement);
+    }
+    
+    answer_written_account(link, answered, protocol_result);
+    
+    return protocol_result;
+}
+
+bool bridge_protocol_bulk_read_register(bridge_read_callback_t read,
+                                        bridge_read_bulk_callback_t read_bulk)
+{
+    bulk_read_registration_t * free_slot = NULL;
+    
+    for (uint32_t i = 0; i < BRIDGE_PROTOCOL_BULK_READ_MAX_REGISTERED; i++)
+    {
+        if (m_bulk_readers[i].read == read)
+        {
+            free_slot = &m_bulk_readers[i];
+            break;
+        }
+        
+        if ((m_bulk_readers[i].read == NULL) && (free_slot == NULL))
+        {
+            free_slot = &m_bulk_readers[i];
+        }
+    }
+    
+    if (free_slot == NULL)
+    {
+        return (read_bulk == NULL);
+    }
+    
+    free_slot->read = (read_bulk != NULL) ? read : NULL;
+    free_slot->read_bulk = read_bulk;
+    
+    return true;
+}
+
+bool bridge_protocol_vector_write_register(bridge_write_callback_t write,
+                                           bridge_write_vector_callback_t write_vector)
+{
+    vector_write_registration_t * free_slot = NULL;
+    
+    for (uint32_t i = 0; i < BRIDGE_PROTOCOL_VECTOR_WRITE_MAX_REGISTERED; i++)
+    {
+        if (m_vector_writers[i].write == write)
+        {
+            free_slot = &m_vector_writers[i];
+            break;
+        }
+        
+        if ((m_vector_writers[i].write == NULL) && (free_slot == NULL))
+        {
+            free_slot = &m_vector_writers[i];
+        }
+    }
+    
+    if (free_slot == NULL)
+    {
+        return (write_vector == NULL);
+    }
+    
+    free_slot->write = (write_vector != NULL) ? write : NULL;
+    free_slot->write_vector = write_vector;
+    
+    return true;
+}
+
+bridge_protocol_result_t bridge_protocol_recover(bridge_read_callback_t read,
+                                                 uint32_t timeout_ms)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, read, NULL);
+    
+    return bridge_link_recover(&link, timeout_ms);
+}
+
+bridge_protocol_result_t bridge_protocol_request_read(bridge_read_callback_t read,
+                                                      uint32_t first_byte_timeout_ms,
+                                                      bridge_request_t * out_request)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, read, NULL);
+    
+    return bridge_link_request_read(&link, first_byte_timeout_ms, out_request);
+}
+
+bridge_protocol_result_t bridge_protocol_match_protocol_version_answer(bridge_write_callback_t write)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, NULL, write);
+    
+    return bridge_link_match_protocol_version_answer(&link);
+}
+
+bridge_protocol_result_t bridge_protocol_get_device_info_answer(bridge_write_callback_t write,
+                                                                const device_info_t * info)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, NULL, write);
+    
+    return bridge_link_get_device_info_answer(&link, info);
+}
+
+bridge_protocol_result_t bridge_protocol_match_protocol_version(bridge_read_callback_t read,
+                                                                bridge_write_callback_t write,
+                                                                uint16_t * protocol_version)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, read, write);
+    
+    return bridge_link_match_protocol_version(&link, protocol_version);
+}
+
+bridge_protocol_result_t bridge_protocol_get_device_info(bridge_read_callback_t read,
+                                                         bridge_write_callback_t write,
+                                                         device_info_t * info)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, read, write);
+    
+    return bridge_link_get_device_info(&link, info);
+}
+
+bridge_protocol_result_t bridge_protocol_batch_answer(bridge_write_callback_t write,
+                                                      const bridge_answer_t * answer)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, NULL, write);
+    
+    return bridge_link_batch_answer(&link, answer);
+}
+
+bridge_protocol_result_t bridge_protocol_batch(bridge_read_callback_t read,
+                                               bridge_write_callback_t write,
+                                               const bridge_request_t * request,
+                                               bridge_answer_t * out_answer)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, read, write);
+    
+    return bridge_link_batch(&link, request, out_answer);
+}
+
+bridge_protocol_result_t bridge_protocol_call(bridge_read_callback_t read,
+                                              bridge_write_callback_t write,
+                                              const bridge_request_t * request,
+                                              bridge_answer_t * out_answer)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, read, write);
+    
+    return bridge_link_call(&link, request, out_answer);
+}
+
+bridge_protocol_result_t bridge_protocol_answer_send(bridge_write_callback_t write,
+                                                     bridge_request_type_t request_type,
+                                                     const bridge_answer_t * answer)
+{
+    bridge_link_t link;
+    legacy_bus_t bus;
+    legacy_link_init(&link, &bus, NULL, write);
+    
+    return bridge_link_answer_send(&link, request_type, answer);
+}
\ No newline at end of file
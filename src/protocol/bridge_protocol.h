@@ -11,8 +11,13 @@
  * the event should perform protocol reset and recovery procedure by calling bridge_protocol_recover().
  * This procedure should also be performed immediately after the protocol has started.
  *
+ * Recovery waits for bus silence, which may never come under continuous traffic. With BRIDGE_LINK_OPTION_SYNC
+ * every message starts with sync bytes and receiver finds the next message by them, so recovery completes
+ * immediately. Legacy bridge_protocol_*() calls use BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS.
+ *
  * All request types are listed in bridge_request_type_t. Request always contains a request type field and, depending
  * on request type, may contain additional data. Server gets requests by calling bridge_protocol_request_read().
+ * Request types are declared once in BRIDGE_REQUEST_LIST, sizes and dispatch tables are generated from it.
  *
  * After getting a request, server send appropriate answer by calling bridge_protocol_*_answer(), where * is a request type.
  * If request type is not listed in bridge_request_type_t, server should not answer.
@@ -27,8 +32,78 @@
  * BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS milliseconds.
  *
  * Client sends requests and receives answers by calling bridge_protocol_*(), where * is request type.
+ * Requests of any type may also be made by bridge_protocol_call() and answered by bridge_protocol_answer_send().
+ *
+ * Write callback is called once per message with the whole message assembled. Vector write callback
+ * can be registered by bridge_protocol_vector_write_register() to send payload without copying.
+ * Server may also build answer right in the message buffer by bridge_link_answer_reserve() and
+ * bridge_link_answer_commit(), then the message is written as is with no copies at all.
+ *
+ * Read callback delivers one byte per call. If the bus driver is able to return several bytes at once,
+ * bulk read callback should be registered by bridge_protocol_bulk_read_register() to avoid per byte overhead.
+ * Registrations are global and should be made at startup, before protocol calls run in other threads.
+ *
+ * Every bridge_protocol_*() function has bridge_link_*() variant which takes link context (see bridge_link_t)
+ * instead of bare callbacks. Link context holds callbacks with user data pointer, timeouts and statistics,
+ * so any number of links can be served by the same code without global variables.
+ *
+ * Timeouts of the link default to the constants above. bridge_link_baud_set() derives timeouts between bytes
+ * and of recovery from the baud rate of the bus. bridge_link_adaptive_timeout_enable() makes answer timeout
+ * follow round trip time measured by the link, the way TCP sets its retransmission timeout (RFC 6298), 
+ * so a lost message is noticed within milliseconds on a fast link instead of seconds.
+ *
+ * Client calls are stop-and-wait by default. To keep slow links busy, client may send several requests 
+ * back-to-back by bridge_link_request_send() and then collect answers by bridge_link_answer_receive().
+ * With BRIDGE_LINK_OPTION_TAGGED every message carries a tag, so answers are matched to requests by tag.
+ *
+ * Several small requests may be sent as one BATCH request to save round trips, see bridge_batch.h.
+ * Server answers BATCH with one answer holding answers to all packed requests in the same order.
+ * Data larger than one message (e.g. firmware image) is sent in chunks, see bridge_transfer.h.
+ *
+ * MATCH_PROTOCOL_VERSION also negotiates optional features: protocol version is sent in the low byte
+ * (BRIDGE_PROTOCOL_VERSION_MASK), client offers features of the link in the high byte and server answers
+ * with those of them it supports too. Servers of older versions answer with no features, so nothing changes for them.
+ * With BRIDGE_PROTOCOL_FEATURE_COMPRESSION server sends answers compressed whenever it makes them
+ * smaller (see bridge_compress.h). Server negotiates on links which persist between calls only,
+ * requests got not by bridge_link_request_read() (e.g. by parser) are reported by bridge_link_request_received().
+ *
+ * With BRIDGE_PROTOCOL_FEATURE_COMPACT_FRAME both sides switch to compact messages (BRIDGE_LINK_OPTION_COMPACT) right after
+ * the match, which saves half of the header on slow buses. Any message lost or corrupted switches the side which noticed it
+ * back to standard messages, the other side follows as soon as it fails to understand them, so both sides come to standard
+ * messages after a few failed calls whatever happened (e.g. server restarted). Client matches protocol version again
+ * to switch to compact messages again. Compact messages may also be set by application on both sides as a link option.
+ * BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME switches both sides to sync bytes (BRIDGE_LINK_OPTION_SYNC) the same way.
+ *
+ * Limits are negotiated by MATCH_CAPABILITIES, which client sends right after the match if both sides agreed
+ * BRIDGE_PROTOCOL_FEATURE_CAPABILITIES, so servers which don't know the request never get it. Client offers its window
+ * of requests in flight, the largest payload it receives and checksum algorithms it supports. Server answers with
+ * the smaller of the offered and its own window (accept_window) and payload (max_payload_size) and with a checksum
+ * algorithm both support. Both sides then send no payload larger than agreed and client keeps no more requests
+ * in flight than agreed. Payload limit is never agreed below a full TRANSFER_CHUNK request, so chunked transfer
+ * (bridge_transfer.h) works on any link. Match without capabilities resets the limits to those of the protocol.
+ * bridge_link_match_protocol_version() makes both calls, server answers MATCH_CAPABILITIES by
+ * bridge_link_match_capabilities_answer(). Like compact messages, capabilities and sync bytes are not offered by default.
+ *
+ * Answers which rarely change (e.g. GET_DEVICE_INFO asked by every health check) may be cached by the link, see
+ * bridge_link_answer_cache_enable(). Blocking call of a cached request type with the same request data is then answered
+ * from memory without touching the bus until time to live of the answer expires. Cache is dropped on loss of sync
+ * and on recovery, since the server may have restarted with other answers meanwhile.
+ *
+ * Link counts messages, bytes and every kind of failure in its statistics (bridge_link_stats_t). With clock callback
+ * and histograms given by application (bridge_link_histograms_t) it also keeps histograms of round trip time (client side)
+ * and request handling time (server side), see bridge_histogram.h. They are kept out of the link itself, so links
+ * which don't need them (e.g. temporary ones of bridge_protocol_*() calls) stay small. Statistics are updated
+ * without locking, bridge_link_stats_snapshot() copies them for export.
+ * Capture callback of the link sees every message sent and every byte received, see bridge_capture.h.
+ *
+ * Functions above block inside read callback until message is received. Applications driven by event loop
+ * should receive messages with non-blocking parser instead, see bridge_parser.h. Multi-link runtimes built on it
+ * serve requests (bridge_server.h) and make calls which complete by callback or C++20 co_await (bridge_client.h).
  *
  * Structures for data exchange between devices must be defined in the file bridge_data_types.h.
+ * They are described by field lists with fixed little endian wire layout, see bridge_schema.h.
+ * C++17 applications may encode and decode messages of known request type with typed compile-time codec
+ * of bridge_protocol.hpp, in which wire layout of the structures is checked by static_assert.
  *
  * @{
  */
@@ -37,20 +112,148 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "bridge_data_types.h"
+#include "bridge_histogram.h"
 
 #define BRIDGE_PROTOCOL_VERSION                     1
 #define BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS    50
 #define BRIDGE_PROTOCOL_WAIT_ANSWER_TIMEOUT_MS      5000
 #define BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS          100
+#define BRIDGE_PROTOCOL_BULK_READ_MAX_REGISTERED    4
+#define BRIDGE_PROTOCOL_VECTOR_WRITE_MAX_REGISTERED 4
+#define BRIDGE_PROTOCOL_MAX_IN_FLIGHT               8
+#define BRIDGE_PROTOCOL_BATCH_MAX_SIZE              256
+#define BRIDGE_PROTOCOL_CHUNK_MAX_SIZE              256
+#define BRIDGE_PROTOCOL_VERSION_MASK                0x00FF
+#define BRIDGE_PROTOCOL_FEATURES_SHIFT              8
+
+#ifndef BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS
+#define BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS     20              /**< Timeouts derived from baud rate or round trip time are never shorter,
+                                                                         it covers scheduling delays of the hosts. */
+#endif
 
-/**@brief Bridge request types. */
+#ifndef BRIDGE_PROTOCOL_BETWEEN_BYTES_CHARACTERS
+#define BRIDGE_PROTOCOL_BETWEEN_BYTES_CHARACTERS    16              /**< Timeout between bytes in character times when baud rate is set,
+                                                                         UART FIFO may deliver that many bytes at once. */
+#endif
+
+#ifndef BRIDGE_LINK_ANSWER_CACHE_MAX_TTL_MS
+#define BRIDGE_LINK_ANSWER_CACHE_MAX_TTL_MS (UINT32_MAX / 1000)     /**< Age of cached answer is measured by clock of the link,
+                                                                         which wraps around in 71 minutes. Answer not asked for
+                                                                         longer may be taken for a fresh one. */
+#endif
+
+#ifndef BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS
+#define BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS        0               /**< Options of links initialized by bridge_link_init(). */
+#endif
+
+/**@brief Optional protocol features, negotiated by MATCH_PROTOCOL_VERSION. */
+typedef enum
+{
+    BRIDGE_PROTOCOL_FEATURE_COMPRESSION = (1 << 0),             /**< Server compresses answers, see bridge_compress.h. */
+    BRIDGE_PROTOCOL_FEATURE_COMPACT_FRAME = (1 << 1),           /**< Both sides switch to BRIDGE_LINK_OPTION_COMPACT after the match. */
+    BRIDGE_PROTOCOL_FEATURE_CAPABILITIES = (1 << 2),            /**< Client follows the match with MATCH_CAPABILITIES to agree on limits. */
+    BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME = (1 << 3)               /**< Both sides switch to BRIDGE_LINK_OPTION_SYNC after the match. */
+} bridge_protocol_feature_t;
+
+/**@brief Checksum algorithms, negotiated by MATCH_CAPABILITIES. */
+typedef enum
+{
+    BRIDGE_PROTOCOL_CHECKSUM_CRC16_CCITT = (1 << 0)             /**< CRC-16 CCITT of bridge_checksum.h, supported by every side. */
+} bridge_protocol_checksum_t;
+
+#ifndef BRIDGE_PROTOCOL_DEFAULT_FEATURES
+#define BRIDGE_PROTOCOL_DEFAULT_FEATURES            BRIDGE_PROTOCOL_FEATURE_COMPRESSION /**< Features of links initialized by bridge_link_init(). */
+#endif
+
+/**@brief Registry of request types, every entry is X(NAME, member, request has data, answer has data):
+ * - NAME gives BRIDGE_REQUEST_TYPE_NAME, types are numbered in the list order starting from 1;
+ * - member is the name of request and answer data members in bridge_request_t and bridge_answer_t;
+ * - request has data and answer has data are 1 if the corresponding member exists, otherwise 0.
+ *
+ * Request data is described by field list BRIDGE_NAME_REQUEST_FIELDS, answer data by BRIDGE_NAME_ANSWER_FIELDS
+ * (see bridge_schema.h). They give structures bridge_member_request_t and bridge_member_answer_t
+ * and typed calls bridge_link_member_call() and bridge_link_member_answer_send().
+ *
+ * Payload sizes, their validation and generic dispatch tables are generated from this list, 
+ * so adding a request type means adding the entry and its field lists only.
+ * Order of entries should never change, new types are appended to the end.
+ */
+#define BRIDGE_REQUEST_LIST(X) \
+    X(MATCH_PROTOCOL_VERSION,   match_protocol_version, 1, 1)   /* Match bridge protocol version. It should never change! */ \
+    X(GET_DEVICE_INFO,          get_device_info,        0, 1)   /* Get device (aka server) info. It should never change! */ \
+    X(BATCH,                    batch,                  1, 1)   /* Several requests in one message, see bridge_batch.h. It should never change! */ \
+    X(TRANSFER_CHUNK,           transfer_chunk,         1, 1)   /* Part of large data transfer, see bridge_transfer.h. It should never change! */ \
+    X(MATCH_CAPABILITIES,       match_capabilities,     1, 1)   /* Agree on limits after the match. It should never change! */ \
+    /* Your request types: */ \
+    /* ... */
+
+#define BRIDGE_MATCH_PROTOCOL_VERSION_REQUEST_FIELDS(FIELD, ARRAY) \
+    FIELD(uint16_t, protocol_version)                           /* Bridge protocol version, features offered by client in the high byte. */
+
+#define BRIDGE_MATCH_PROTOCOL_VERSION_ANSWER_FIELDS(FIELD, ARRAY) \
+    FIELD(uint16_t, protocol_version)                           /* Bridge protocol version, features agreed by server in the high byte. */
+
+#define BRIDGE_MATCH_CAPABILITIES_REQUEST_FIELDS(FIELD, ARRAY) \
+    FIELD(uint16_t, max_payload_size)                           /* Largest payload client receives. */ \
+    FIELD(uint8_t, window)                                      /* Requests client keeps in flight at most. */ \
+    FIELD(uint8_t, checksums)                                   /* Checksum algorithms client supports, combination of bridge_protocol_checksum_t. */
+
+#define BRIDGE_MATCH_CAPABILITIES_ANSWER_FIELDS(FIELD, ARRAY) \
+    FIELD(uint16_t, max_payload_size)                           /* Largest payload both sides send. */ \
+    FIELD(uint8_t, window)                                      /* Requests client may keep in flight. */ \
+    FIELD(uint8_t, checksum)                                    /* Checksum algorithm agreed, one of bridge_protocol_checksum_t. */
+
+#define BRIDGE_GET_DEVICE_INFO_ANSWER_FIELDS(FIELD, ARRAY) \
+    FIELD(device_info_t, info)                                  /* Device info. */
+
+#define BRIDGE_BATCH_REQUEST_FIELDS(FIELD, ARRAY) \
+    FIELD(uint8_t, count)                                       /* Number of packed requests. */ \
+    ARRAY(uint8_t, items, BRIDGE_PROTOCOL_BATCH_MAX_SIZE)       /* Packed requests, use bridge_batch.h to fill and walk. */
+
+#define BRIDGE_BATCH_ANSWER_FIELDS(FIELD, ARRAY) \
+    FIELD(uint8_t, count)                                       /* Number of packed answers. */ \
+    ARRAY(uint8_t, items, BRIDGE_PROTOCOL_BATCH_MAX_SIZE)       /* Packed answers, use bridge_batch.h to fill and walk. */
+
+#define BRIDGE_TRANSFER_CHUNK_REQUEST_FIELDS(FIELD, ARRAY) \
+    FIELD(uint32_t, total_size)                                 /* Size of the whole data. */ \
+    FIELD(uint32_t, offset)                                     /* Offset of the chunk in data. */ \
+    FIELD(uint16_t, transfer_id)                                /* Identifier of transfer, chunks of other transfers are not mixed. */ \
+    FIELD(uint16_t, length)                                     /* Length of the chunk, only this part of data array is sent. */ \
+    ARRAY(uint8_t, data, BRIDGE_PROTOCOL_CHUNK_MAX_SIZE)        /* Chunk data. */
+
+#define BRIDGE_TRANSFER_CHUNK_ANSWER_FIELDS(FIELD, ARRAY) \
+    FIELD(uint16_t, transfer_id)                                /* Identifier of transfer. */ \
+    FIELD(uint16_t, window)                                     /* Number of chunks after acked_offset receiver accepts. */ \
+    FIELD(uint32_t, acked_offset)                               /* All data before this offset is received. */ \
+    FIELD(uint32_t, received_mask)                              /* Bit i is set if chunk i after acked_offset is received. */
+
+//Your request and answer fields:
+//...
+
+//Generators of request and answer data, the suffix is the has data flag of BRIDGE_REQUEST_LIST
+#define BRIDGE_REQUEST_DATA_DECLARE_0(type, FIELDS)
+#define BRIDGE_REQUEST_DATA_DECLARE_1(type, FIELDS) BRIDGE_SCHEMA_DECLARE(type, FIELDS)
+#define BRIDGE_REQUEST_DATA_MEMBER_0(type, member)
+#define BRIDGE_REQUEST_DATA_MEMBER_1(type, member)  type member;
+
+#define BRIDGE_REQUEST_DATA_ENTRY(name, member, request_data, answer_data) \
+    BRIDGE_REQUEST_DATA_DECLARE_##request_data(bridge_##member##_request_t, BRIDGE_##name##_REQUEST_FIELDS) \
+    BRIDGE_REQUEST_DATA_DECLARE_##answer_data(bridge_##member##_answer_t, BRIDGE_##name##_ANSWER_FIELDS)
+#define BRIDGE_REQUEST_DATA_REQUEST_MEMBER(name, member, request_data, answer_data) \
+    BRIDGE_REQUEST_DATA_MEMBER_##request_data(bridge_##member##_request_t, member)
+#define BRIDGE_REQUEST_DATA_ANSWER_MEMBER(name, member, request_data, answer_data) \
+    BRIDGE_REQUEST_DATA_MEMBER_##answer_data(bridge_##member##_answer_t, member)
+
+BRIDGE_REQUEST_LIST(BRIDGE_REQUEST_DATA_ENTRY)
+
+/**@brief Bridge request types, see BRIDGE_REQUEST_LIST. */
 typedef enum
 {
     BRIDGE_REQUEST_TYPE_UNDEFINED,
-    BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION,                 /**< Match bridge protocol version. It should never change! */
-    BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO,                        /**< Get device (aka server) info. It should never change! */
-    //Your request types:
-    //...
+#define BRIDGE_REQUEST_TYPE_ENTRY(name, member, request_data, answer_data) BRIDGE_REQUEST_TYPE_##name,
+    BRIDGE_REQUEST_LIST(BRIDGE_REQUEST_TYPE_ENTRY)
+#undef BRIDGE_REQUEST_TYPE_ENTRY
+    BRIDGE_REQUEST_TYPE_COUNT,                                  /**< Number of request types including UNDEFINED. */
     BRIDGE_REQUEST_TYPE_FORCE_SIZE_32BITS = UINT32_MAX
 } bridge_request_type_t;
 
@@ -61,12 +264,7 @@ typedef struct
     
     union
     {
-        struct
-        {
-            uint16_t protocol_version;                          /**< Bridge protocol version. */
-        } match_protocol_version;
-        //Your request data:
-        //...
+        BRIDGE_REQUEST_LIST(BRIDGE_REQUEST_DATA_REQUEST_MEMBER) /**< Request data of every type with request data. */
     } data;
 } bridge_request_t;
 
@@ -79,6 +277,19 @@ typedef enum
     BRIDGE_ANSWER_TYPE_FORCE_SIZE_32BITS = UINT32_MAX
 } bridge_answer_type_t;
 
+/**@brief Answer data of every request type with answer data. */
+typedef union
+{
+    BRIDGE_REQUEST_LIST(BRIDGE_REQUEST_DATA_ANSWER_MEMBER)
+} bridge_answer_data_t;
+
+/**@brief Bridge answer structure. Data field is filled according to type of the request being answered. */
+typedef struct
+{
+    bridge_answer_type_t type;                                  /**< Type of answer. */
+    bridge_answer_data_t data;                                  /**< Answer data. */
+} bridge_answer_t;
+
 /**@brief Bridge callback results. */
 typedef enum
 {
@@ -98,6 +309,27 @@ typedef enum
 typedef bridge_callback_result_t (*bridge_write_callback_t)(uint8_t * data, 
                                                             uint16_t data_len);
 
+/**@brief Data chunk for bus vector write callback. */
+typedef struct
+{
+    const uint8_t * data;                                       /**< Pointer to data to write. */
+    uint16_t data_len;                                          /**< Length of the data in bytes. */
+} bridge_write_chunk_t;
+
+/**@brief Bus vector (scatter-gather) write callback. It is optional and used instead of 
+ *        bridge_write_callback_t when registered by bridge_protocol_vector_write_register().
+ *
+ * All chunks belong to one message and should be written to bus in order as a whole (e.g. with writev()).
+ *
+ * @param[in] chunks       Array of chunks to write.
+ * @param[in] chunks_count Number of chunks in array.
+ *
+ * @retval BRIDGE_CALLBACK_RESULT_SUCCESS  Data succesfully written to bus.
+ * @retval BRIDGE_CALLBACK_RESULT_IO_ERROR If I/O error occured.
+ */
+typedef bridge_callback_result_t (*bridge_write_vector_callback_t)(const bridge_write_chunk_t * chunks, 
+                                                                   uint8_t chunks_count);
+
 /**@brief Bus read callback.
  *
  * @param[out] byte       Pointer to store received byte.
@@ -111,6 +343,27 @@ typedef bridge_callback_result_t (*bridge_write_callback_t)(uint8_t * data,
 typedef bridge_callback_result_t (*bridge_read_callback_t)(uint8_t * byte, 
                                                            uint32_t timeout_ms);
 
+/**@brief Bus bulk read callback. It is optional and used instead of bridge_read_callback_t
+ *        when registered by bridge_protocol_bulk_read_register().
+ *
+ * Callback should return as soon as at least one byte is received, it must never store more
+ * than max_len bytes (otherwise the beginning of the next message will be lost).
+ *
+ * @param[out] data       Pointer to buffer to store received bytes.
+ * @param[in]  max_len    Maximal amount of bytes to store.
+ * @param[out] out_len    Pointer to store amount of bytes received. Must be at least 1 on success.
+ * @param[in]  timeout_ms Minimal amount of time to wait for the first byte reception.
+ *                        UINT32_MAX means wait forever.
+ *
+ * @retval BRIDGE_CALLBACK_RESULT_SUCCESS      Data successfully read from bus.
+ * @retval BRIDGE_CALLBACK_RESULT_READ_TIMEOUT No data received during set timeout.
+ * @retval BRIDGE_CALLBACK_RESULT_IO_ERROR     I/O error occured.
+ */
+typedef bridge_callback_result_t (*bridge_read_bulk_callback_t)(uint8_t * data, 
+                                                                uint16_t max_len, 
+                                                                uint16_t * out_len, 
+                                                                uint32_t timeout_ms);
+
 /**@brief Bridge protocol results. */
 typedef enum
 {
@@ -119,9 +372,571 @@ typedef enum
     BRIDGE_PROTOCOL_RESULT_CORRUPTED,                           /**< Received message is corrupted, protocol recovery required. */
     BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED,                    /**< Request rejected because of inappropriate server state or for other similar reason. */
     BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS,             /**< Request contains wrong (probably out of appropriate range) arguments. */
-    BRIDGE_PROTOCOL_RESULT_IO_ERROR                             /**< I/O error occured during protocol operation. */
+    BRIDGE_PROTOCOL_RESULT_IO_ERROR,                            /**< I/O error occured during protocol operation. */
+    BRIDGE_PROTOCOL_RESULT_BUSY                                 /**< Operation can't be started now (e.g. in-flight window is full). */
 } bridge_protocol_result_t;
 
+/**@brief Link read callback. Follows the contract of bridge_read_bulk_callback_t, bus drivers 
+ *        which can't read several bytes at once may always return a single byte.
+ *
+ * @param[in]  user       User data pointer of the link.
+ * @param[out] data       Pointer to buffer to store received bytes.
+ * @param[in]  max_len    Maximal amount of bytes to store.
+ * @param[out] out_len    Pointer to store amount of bytes received. Must be at least 1 on success.
+ * @param[in]  timeout_ms Minimal amount of time to wait for the first byte reception.
+ *                        UINT32_MAX means wait forever.
+ *
+ * @retval BRIDGE_CALLBACK_RESULT_SUCCESS      Data successfully read from bus.
+ * @retval BRIDGE_CALLBACK_RESULT_READ_TIMEOUT No data received during set timeout.
+ * @retval BRIDGE_CALLBACK_RESULT_IO_ERROR     I/O error occured.
+ */
+typedef bridge_callback_result_t (*bridge_link_read_callback_t)(void * user, 
+                                                                uint8_t * data, 
+                                                                uint16_t max_len, 
+                                                                uint16_t * out_len, 
+                                                                uint32_t timeout_ms);
+
+/**@brief Link write callback. Called once per message.
+ *
+ * @param[in] user     User data pointer of the link.
+ * @param[in] data     Pointer to data to write.
+ * @param[in] data_len Length of the data in bytes.
+ *
+ * @retval BRIDGE_CALLBACK_RESULT_SUCCESS  Data succesfully written to bus.
+ * @retval BRIDGE_CALLBACK_RESULT_IO_ERROR If I/O error occured.
+ */
+typedef bridge_callback_result_t (*bridge_link_write_callback_t)(void * user, 
+                                                                 const uint8_t * data, 
+                                                                 uint16_t data_len);
+
+/**@brief Link vector write callback, see bridge_write_vector_callback_t.
+ *
+ * @param[in] user         User data pointer of the link.
+ * @param[in] chunks       Array of chunks to write.
+ * @param[in] chunks_count Number of chunks in array.
+ *
+ * @retval BRIDGE_CALLBACK_RESULT_SUCCESS  Data succesfully written to bus.
+ * @retval BRIDGE_CALLBACK_RESULT_IO_ERROR If I/O error occured.
+ */
+typedef bridge_callback_result_t (*bridge_link_write_vector_callback_t)(void * user, 
+                                                                        const bridge_write_chunk_t * chunks, 
+                                                                        uint8_t chunks_count);
+
+/**@brief Direction of data seen by link capture callback. */
+typedef enum
+{
+    BRIDGE_LINK_CAPTURE_SENT,                                   /**< Whole message about to be written to bus. */
+    BRIDGE_LINK_CAPTURE_RECEIVED                                /**< Bytes read from bus, message may come in several chunks. */
+} bridge_link_capture_direction_t;
+
+/**@brief Link capture callback. Sees raw bytes of the bus, e.g. to record them (see bridge_capture.h).
+ *        It is called on the hot path, so it should return quickly and never block.
+ *
+ * @param[in] context      Capture context of the link.
+ * @param[in] direction    Direction of data.
+ * @param[in] options      Options of the link, needed to split data into messages.
+ * @param[in] chunks       Array of chunks, their data follow each other on the bus.
+ * @param[in] chunks_count Number of chunks in array.
+ */
+typedef void (*bridge_link_capture_callback_t)(void * context, 
+                                               bridge_link_capture_direction_t direction, 
+                                               uint32_t options, 
+                                               const bridge_write_chunk_t * chunks, 
+                                               uint8_t chunks_count);
+
+/**@brief Link clock callback.
+ *
+ * @param[in] user User data pointer of the link.
+ *
+ * @return Monotonic time in microseconds. It may wrap around, only differences are used.
+ */
+typedef uint32_t (*bridge_link_clock_callback_t)(void * user);
+
+/**@brief Link statistics. Counters wrap around on overflow. */
+typedef struct
+{
+    uint32_t frames_sent;                                       /**< Messages successfully sent. */
+    uint32_t frames_received;                                   /**< Messages successfully received. */
+    uint32_t bytes_sent;                                        /**< Bytes written to bus. */
+    uint32_t bytes_received;                                    /**< Bytes read from bus. */
+    uint32_t timeouts;                                          /**< Operations completed with TIMEOUT result, i.e. first byte of answer 
+                                                                     not received in time (waiting for request is not counted). */
+    uint32_t corrupted;                                         /**< Operations completed with CORRUPTED result. */
+    uint32_t io_errors;                                         /**< Operations completed with IO_ERROR result. */
+    uint32_t between_bytes_timeouts;                            /**< Messages broken by silence after their first byte (counted as corrupted too). */
+    uint32_t checksum_failures;                                 /**< Messages with wrong checksum (counted as corrupted too). */
+    uint32_t size_mismatches;                                   /**< Messages with payload size wrong for their type or content (counted as corrupted too). */
+    uint32_t skipped;                                           /**< Runs of data skipped while hunting for sync bytes (BRIDGE_LINK_OPTION_SYNC). */
+    uint32_t recovers;                                          /**< Calls of bridge_link_recover(). */
+    uint64_t recover_time_us;                                   /**< Time spent in bridge_link_recover(), clock callback is required. */
+    uint32_t cache_hits;                                        /**< Calls answered from answer cache without touching the bus. */
+} bridge_link_stats_t;
+
+/**@brief Latency histograms of link. Allocated by application, see bridge_link_t::histograms. */
+typedef struct
+{
+    bridge_histogram_t round_trip_us;                           /**< Time from request written to its answer received (client side). */
+    bridge_histogram_t handling_us;                             /**< Time from request received to its answer written (server side). */
+} bridge_link_histograms_t;
+
+/**@brief Link options. Change message format, so must be the same on both sides. */
+typedef enum
+{
+    BRIDGE_LINK_OPTION_TAGGED = (1 << 0),                       /**< Message header carries a tag, answer carries the tag of its request. */
+    BRIDGE_LINK_OPTION_SYNC = (1 << 1),                         /**< Message starts with sync bytes, receiver resynchronizes without waiting for silence.
+                                                                     Set and cleared by negotiation of BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME too. */
+    BRIDGE_LINK_OPTION_COMPACT = (1 << 2)                       /**< Compact message header: one byte type and varint payload size (see bridge_frame.h).
+                                                                     Set and cleared by negotiation of BRIDGE_PROTOCOL_FEATURE_COMPACT_FRAME. */
+} bridge_link_option_t;
+
+/**@brief Request in flight (sent and not answered yet, or received and not answered yet on server side). */
+typedef struct
+{
+    uint8_t tag;                                                /**< Tag of request. */
+    bridge_request_type_t request_type;                         /**< Type of request. */
+    uint32_t sent_us;                                           /**< Time request was written at (received at on server side), by clock of the link. */
+    uint16_t size;                                              /**< Size of request message on the bus. */
+} bridge_link_in_flight_t;
+
+/**@brief Round trip time estimation of adaptive answer timeout (RFC 6298). Time messages spend on the wire
+ *        is excluded when baud rate is known, so the estimation doesn't depend on message sizes.
+ */
+typedef struct
+{
+    uint32_t samples;                                           /**< Round trip times measured. */
+    uint32_t srtt_us;                                           /**< Smoothed round trip time. */
+    uint32_t rttvar_us;                                         /**< Smoothed deviation of round trip time. */
+    uint8_t backoff;                                            /**< Answer timeout is doubled this many times, 
+                                                                     it grows with every timeout until an answer comes. */
+} bridge_link_rtt_t;
+
+/**@brief Answer cache of one request type, see bridge_link_answer_cache_enable(). Allocated by application,
+ *        it belongs to the link until disabled.
+ */
+typedef struct bridge_link_answer_cache_s
+{
+    //Internal fields
+    struct bridge_link_answer_cache_s * next;                   //Next cache of the link
+    bridge_request_type_t request_type;
+    uint32_t ttl_us;                                            //Time to live of the answer, 0 if it lives until invalidated
+    bool valid;
+    uint32_t stored_us;                                         //Time the answer was stored at, by clock of the link
+    bridge_request_t request;                                   //Request the answer belongs to
+    bridge_answer_t answer;
+} bridge_link_answer_cache_t;
+
+/**@brief Link context. Holds everything related to one bus, so a single application can serve 
+ *        several links with the same code. Should be initialized by bridge_link_init(), 
+ *        after that optional fields may be changed.
+ */
+typedef struct
+{
+    bridge_link_read_callback_t read;                           /**< Read callback. */
+    bridge_link_write_callback_t write;                         /**< Write callback. */
+    bridge_link_write_vector_callback_t write_vector;           /**< Vector write callback. Optional, NULL by default. */
+    void * user;                                                /**< User data pointer passed to callbacks. */
+    uint32_t between_bytes_timeout_ms;                          /**< BRIDGE_PROTOCOL_BETWEEN_BYTES_TIMEOUT_MS by default. */
+    uint32_t wait_answer_timeout_ms;                            /**< BRIDGE_PROTOCOL_WAIT_ANSWER_TIMEOUT_MS by default. */
+    uint32_t recover_timeout_ms;                                /**< BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS by default. */
+    uint32_t baud;                                              /**< Baud rate of the bus, 0 (unknown) by default. Set by bridge_link_baud_set(). */
+    bool adaptive_timeout;                                      /**< Answer timeout follows round trip time, false by default.
+                                                                     Set by bridge_link_adaptive_timeout_enable(). */
+    bridge_link_rtt_t rtt;                                      /**< Round trip time estimation of adaptive answer timeout. Read only. */
+    uint32_t options;                                           /**< Combination of bridge_link_option_t, 
+                                                                     BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS by default. */
+    uint8_t window;                                             /**< Maximal number of requests in flight (client side), 
+                                                                     1 by default, up to BRIDGE_PROTOCOL_MAX_IN_FLIGHT. */
+    uint8_t features;                                           /**< Combination of bridge_protocol_feature_t offered (client side)
+                                                                     or accepted (server side), BRIDGE_PROTOCOL_DEFAULT_FEATURES by default. */
+    uint8_t accept_window;                                      /**< Requests accepted back-to-back (server side), offered by MATCH_CAPABILITIES,
+                                                                     BRIDGE_PROTOCOL_MAX_IN_FLIGHT by default. */
+    uint16_t max_payload_size;                                  /**< Largest payload the link receives, offered by MATCH_CAPABILITIES,
+                                                                     BRIDGE_FRAME_MAX_PAYLOAD_SIZE by default. */
+    bridge_link_clock_callback_t clock;                         /**< Clock callback for time statistics. Optional, NULL by default. */
+    bridge_link_capture_callback_t capture;                     /**< Capture callback. Optional, NULL by default. */
+    void * capture_context;                                     /**< Context passed to capture callback. */
+    bridge_link_stats_t stats;                                  /**< Link statistics. */
+    bridge_link_histograms_t * histograms;                      /**< Latency histograms, kept with clock callback set only.
+                                                                     Optional, NULL by default. */
+    
+    //Internal fields
+    uint8_t next_tag;
+    uint8_t in_flight_count;
+    bridge_link_in_flight_t in_flight[BRIDGE_PROTOCOL_MAX_IN_FLIGHT];
+    uint8_t features_offered;                                   //Features offered by client in the last MATCH_PROTOCOL_VERSION (server side)
+    uint8_t features_agreed;                                    //Features agreed by the last MATCH_PROTOCOL_VERSION
+    uint32_t options_agreed;                                    //Options switched on by negotiation, so they are switched off on loss of sync
+    bridge_match_capabilities_request_t capabilities_offered;   //Capabilities offered by client in the last MATCH_CAPABILITIES (server side)
+    uint8_t window_agreed;                                      //Limits agreed by the last MATCH_CAPABILITIES
+    uint16_t max_payload_size_agreed;
+    bridge_link_answer_cache_t * answer_caches;                 //Answer caches enabled, one per request type (client side)
+} bridge_link_t;
+
+#define BRIDGE_ANSWER_FRAME_HEADROOM 9                          /**< Sync bytes, header and tag, see bridge_frame.h. */
+
+/**@brief Answer built in place, right in the buffer of the message. See bridge_link_answer_reserve(). */
+typedef struct
+{
+    uint8_t headroom[BRIDGE_ANSWER_FRAME_HEADROOM];             //Header is built right before data
+    bridge_answer_data_t data;                                  /**< Answer data, filled by server. */
+    uint8_t tailroom[sizeof(uint16_t)];                         //Checksum follows the payload
+    bridge_request_type_t request_type;                         //Type of request being answered
+} bridge_answer_frame_t;
+
+/**@brief Initialize link context.
+ *
+ * @param[out] link  Link context.
+ * @param[in]  read  Read callback.
+ * @param[in]  write Write callback.
+ * @param[in]  user  User data pointer passed to callbacks.
+ */
+void bridge_link_init(bridge_link_t * link, 
+                      bridge_link_read_callback_t read, 
+                      bridge_link_write_callback_t write, 
+                      void * user);
+
+/**@brief Copy link statistics. Link updates them from the thread using it without any locking, so the snapshot 
+ *        should be taken by that thread too (e.g. between calls or from server handler). The copy can then be 
+ *        exported from any thread. With reset the next snapshot holds what happened after this one only.
+ *
+ * @param[in]  link           Link context.
+ * @param[out] out_stats      Pointer to store statistics.
+ * @param[out] out_histograms Pointer to store histograms, may be NULL. Left untouched if the link has none.
+ * @param[in]  reset          Zero statistics and histograms of the link after copying.
+ */
+void bridge_link_stats_snapshot(bridge_link_t * link, 
+                                bridge_link_stats_t * out_stats, 
+                                bridge_link_histograms_t * out_histograms, 
+                                bool reset);
+
+/**@brief Set baud rate of the bus. Timeout between bytes becomes BRIDGE_PROTOCOL_BETWEEN_BYTES_CHARACTERS 
+ *        character times (10 bits each) and recovery timeout twice as long, both not shorter than 
+ *        BRIDGE_PROTOCOL_MIN_ADAPTIVE_TIMEOUT_MS. Adaptive answer timeout adds time messages spend on the wire.
+ *        USB serial adapters deliver data in bursts (every 16 ms by default for FTDI), timeout between bytes
+ *        should be raised after the call for them.
+ *
+ * @param[in] link Link context.
+ * @param[in] baud Baud rate, 0 restores default timeouts.
+ */
+void bridge_link_baud_set(bridge_link_t * link, 
+                          uint32_t baud);
+
+/**@brief Enable or disable adaptive answer timeout. Round trip time of every answer updates smoothed round trip
+ *        time and its deviation, answer is waited for smoothed time plus four deviations plus time the request 
+ *        and the longest answer to it spend on the wire. Until the first answer and never above it 
+ *        wait_answer_timeout_ms is used. Every timeout doubles answer timeout until the next answer comes.
+ *
+ * @param[in] link   Link context.
+ * @param[in] enable Enable adaptive timeout, estimation starts over.
+ *
+ * @retval true  Adaptive timeout enabled or disabled.
+ * @retval false Clock callback of the link is not set, round trip time can't be measured.
+ */
+bool bridge_link_adaptive_timeout_enable(bridge_link_t * link, 
+                                         bool enable);
+
+/**@brief Get time the answer to the oldest request in flight is waited for. Intended for clients which
+ *        receive answers not by bridge_link_answer_receive(), e.g. by parser (see bridge_parser_timeouts_set()).
+ *
+ * @param[in] link Link context.
+ *
+ * @return Answer timeout in milliseconds, adaptive one if enabled.
+ */
+uint32_t bridge_link_answer_timeout_get(const bridge_link_t * link);
+
+/**@brief Enable answer cache of the request type. Successful answer of blocking call (bridge_link_call(), typed calls 
+ *        and bridge_link_*() calls of the type) is stored, the next blocking call of the type with the same request data 
+ *        gets it back without touching the bus until time to live expires. Answers of bridge_link_answer_receive() 
+ *        and of the client runtime (bridge_client.h) are never cached. Only idempotent requests with fixed data
+ *        may be cached: MATCH_CAPABILITIES (data filled by the link), TRANSFER_CHUNK and BATCH are rejected.
+ *        Request data of MATCH_PROTOCOL_VERSION is filled by the link too, so its cache should be invalidated
+ *        when features of the link change.
+ *
+ * @param[in] link         Link context.
+ * @param[in] cache        Cache to use, it is empty after the call.
+ * @param[in] request_type Type of request to cache answers of.
+ * @param[in] ttl_ms       Time to live of answer, up to BRIDGE_LINK_ANSWER_CACHE_MAX_TTL_MS. 
+ *                         0 keeps answer until invalidated.
+ *
+ * @retval true  Cache enabled.
+ * @retval false Request type is unknown, can't be cached or is already cached, time to live is too long, or it is set 
+ *               while clock callback of the link is not.
+ */
+bool bridge_link_answer_cache_enable(bridge_link_t * link, 
+                                     bridge_link_answer_cache_t * cache, 
+                                     bridge_request_type_t request_type, 
+                                     uint32_t ttl_ms);
+
+/**@brief Disable answer cache of the request type, the cache may be released after that.
+ *
+ * @param[in] link         Link context.
+ * @param[in] request_type Type of request.
+ */
+void bridge_link_answer_cache_disable(bridge_link_t * link, 
+                                      bridge_request_type_t request_type);
+
+/**@brief Drop cached answer, the next call of the type goes to the bus. Link does it itself on loss of sync 
+ *        and on recovery.
+ *
+ * @param[in] link         Link context.
+ * @param[in] request_type Type of request, BRIDGE_REQUEST_TYPE_UNDEFINED drops answers of all types.
+ */
+void bridge_link_answer_cache_invalidate(bridge_link_t * link, 
+                                         bridge_request_type_t request_type);
+
+/**@brief Same as bridge_protocol_recover(), but for the link. 
+ *        Silence timespan is set by recover_timeout_ms of the link. With BRIDGE_LINK_OPTION_SYNC
+ *        there is nothing to wait for, the next read hunts for sync bytes.
+ */
+bridge_protocol_result_t bridge_link_recover(bridge_link_t * link, 
+                                             uint32_t timeout_ms);
+
+/**@brief Same as bridge_protocol_request_read(), but for the link. */
+bridge_protocol_result_t bridge_link_request_read(bridge_link_t * link, 
+                                                  uint32_t first_byte_timeout_ms, 
+                                                  bridge_request_t * out_request);
+
+/**@brief Report request received not by bridge_link_request_read(), e.g. by parser (see bridge_parser.h).
+ *        Link learns features offered by client from it, so it should be called before the request is answered.
+ *        Request is kept until it is answered: answers belong to requests in order they are reported and carry 
+ *        their tags with BRIDGE_LINK_OPTION_TAGGED, handling time is measured from the report. So requests which
+ *        won't be answered should not be reported, or should be reported by bridge_link_request_unanswered().
+ *
+ * @param[in] link    Link context.
+ * @param[in] tag     Tag of received request, ignored without BRIDGE_LINK_OPTION_TAGGED.
+ * @param[in] request Received request.
+ *
+ * @retval true  Request accepted.
+ * @retval false More than BRIDGE_PROTOCOL_MAX_IN_FLIGHT requests are not answered on tagged link, sync is lost.
+ *               Request should be treated as corrupted.
+ */
+bool bridge_link_request_received(bridge_link_t * link, 
+                                  uint8_t tag, 
+                                  const bridge_request_t * request);
+
+/**@brief Report that the oldest request reported by bridge_link_request_received() won't be answered,
+ *        so the answer to the next one gets the right tag (BRIDGE_LINK_OPTION_TAGGED) and handling time.
+ *
+ * @param[in] link Link context.
+ */
+void bridge_link_request_unanswered(bridge_link_t * link);
+
+/**@brief Report corrupted request received not by bridge_link_request_read(), e.g. by parser (see bridge_parser.h).
+ *        Link counts it and switches negotiated compact messages off, as it does for requests it receives itself.
+ *
+ * @param[in] link Link context.
+ */
+void bridge_link_request_corrupted(bridge_link_t * link);
+
+/**@brief Report data skipped while hunting for sync bytes not by the link itself, e.g. by parser (see bridge_parser.h).
+ *        Link only counts it: neither requests in flight nor negotiated format are dropped.
+ *
+ * @param[in] link Link context.
+ */
+void bridge_link_data_skipped(bridge_link_t * link);
+
+/**@brief Report answer received not by bridge_link_answer_receive(), e.g. by parser, or its loss. Answer belongs
+ *        to the oldest request in flight, or with BRIDGE_LINK_OPTION_TAGGED to the request of its tag. Link measures
+ *        round trip time and learns features agreed by server from the answer, as it does for answers it receives itself.
+ *
+ * @param[in]     link   Link context.
+ * @param[in]     tag    Tag of answered request, ignored without BRIDGE_LINK_OPTION_TAGGED.
+ * @param[in]     result SUCCESS, REQUEST_REJECTED or WRONG_REQUEST_ARGUMENTS for received answer.
+ *                       TIMEOUT, CORRUPTED or IO_ERROR if no valid answer received, all requests in flight are lost.
+ * @param[in,out] answer Received answer, NULL if none. Protocol version of MATCH_PROTOCOL_VERSION answer 
+ *                       is left without agreed features.
+ */
+void bridge_link_answer_received(bridge_link_t * link, 
+                                 uint8_t tag, 
+                                 bridge_protocol_result_t result, 
+                                 bridge_answer_t * answer);
+
+/**@brief Same as bridge_protocol_match_protocol_version_answer(), but for the link. 
+ *        Features offered by client and accepted by the link are agreed.
+ */
+bridge_protocol_result_t bridge_link_match_protocol_version_answer(bridge_link_t * link);
+
+/**@brief Answer to MATCH_CAPABILITIES request. Capabilities offered by client and those of the link are agreed,
+ *        the link sends no larger payload since then.
+ *
+ * @param[in] link Link context.
+ *
+ * @return Result of the answer write as of bridge_link_answer_commit().
+ */
+bridge_protocol_result_t bridge_link_match_capabilities_answer(bridge_link_t * link);
+
+/**@brief Same as bridge_protocol_get_device_info_answer(), but for the link. */
+bridge_protocol_result_t bridge_link_get_device_info_answer(bridge_link_t * link,
+                                                            const device_info_t * info);
+
+/**@brief Same as bridge_protocol_match_protocol_version(), but for the link. 
+ *        Features of the link are offered, protocol version is returned without agreed features.
+ *        If BRIDGE_PROTOCOL_FEATURE_CAPABILITIES is agreed, MATCH_CAPABILITIES is made too and its result is returned.
+ */
+bridge_protocol_result_t bridge_link_match_protocol_version(bridge_link_t * link,
+                                                            uint16_t * protocol_version);
+
+/**@brief Same as bridge_protocol_get_device_info(), but for the link. */
+bridge_protocol_result_t bridge_link_get_device_info(bridge_link_t * link,
+                                                     device_info_t * info);
+
+/**@brief Same as bridge_protocol_batch_answer(), but for the link. */
+bridge_protocol_result_t bridge_link_batch_answer(bridge_link_t * link,
+                                                  const bridge_answer_t * answer);
+
+/**@brief Same as bridge_protocol_batch(), but for the link. */
+bridge_protocol_result_t bridge_link_batch(bridge_link_t * link,
+                                           const bridge_request_t * request,
+                                           bridge_answer_t * out_answer);
+
+/**@brief Same as bridge_protocol_call(), but for the link. */
+bridge_protocol_result_t bridge_link_call(bridge_link_t * link,
+                                          const bridge_request_t * request,
+                                          bridge_answer_t * out_answer);
+
+//Parameters of typed calls, the suffix is the has data flag of BRIDGE_REQUEST_LIST
+#define BRIDGE_LINK_CALL_REQUEST_PARAM_0(member)
+#define BRIDGE_LINK_CALL_REQUEST_PARAM_1(member)    , const bridge_##member##_request_t * request
+#define BRIDGE_LINK_CALL_ANSWER_PARAM_0(member)
+#define BRIDGE_LINK_CALL_ANSWER_PARAM_1(member)     , bridge_##member##_answer_t * out_answer
+#define BRIDGE_LINK_ANSWER_SEND_PARAM_0(member)
+#define BRIDGE_LINK_ANSWER_SEND_PARAM_1(member)     , const bridge_##member##_answer_t * answer
+
+/**@brief Typed calls of every request type, generated from BRIDGE_REQUEST_LIST:
+ * - bridge_link_member_call(link, [request], [out_answer]) is bridge_link_call() which takes request data 
+ *   and fills answer data of the type, answer data is filled on SUCCESS only;
+ * - bridge_link_member_answer_send(link, [answer]) sends SUCCESS answer with answer data of the type,
+ *   other answers are sent by bridge_link_answer_send().
+ * Parameters in brackets exist only if the type has request or answer data.
+ */
+#define BRIDGE_LINK_TYPED_DECLARE(name, member, request_data, answer_data) \
+    bridge_protocol_result_t bridge_link_##member##_call(bridge_link_t * link \
+                                                         BRIDGE_LINK_CALL_REQUEST_PARAM_##request_data(member) \
+                                                         BRIDGE_LINK_CALL_ANSWER_PARAM_##answer_data(member)); \
+    bridge_protocol_result_t bridge_link_##member##_answer_send(bridge_link_t * link \
+                                                                BRIDGE_LINK_ANSWER_SEND_PARAM_##answer_data(member));
+
+BRIDGE_REQUEST_LIST(BRIDGE_LINK_TYPED_DECLARE)
+
+/**@brief Send request without waiting for the answer. Up to window requests may be sent back-to-back,
+ *        answers are then received by bridge_link_answer_receive(). Server answers requests in order, 
+ *        with BRIDGE_LINK_OPTION_TAGGED answers are also matched to requests by tag.
+ *
+ * Blocking bridge_link_*() client calls may be used only when no requests are in flight.
+ *
+ * @param[in]  link    Link context.
+ * @param[in]  request Request to send.
+ * @param[out] out_tag Pointer to store tag of request. May be NULL.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Request sent.
+ * @retval BRIDGE_PROTOCOL_RESULT_BUSY                    Window (own or agreed) is full, answer should be received first.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Request is malformed or its payload is larger than agreed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_link_request_send(bridge_link_t * link, 
+                                                  const bridge_request_t * request, 
+                                                  uint8_t * out_tag);
+
+/**@brief Receive answer to one of requests sent by bridge_link_request_send(). 
+ *        On TIMEOUT, CORRUPTED or IO_ERROR all requests in flight are considered lost.
+ *
+ * @param[in]  link             Link context.
+ * @param[out] out_tag          Pointer to store tag of answered request. May be NULL.
+ * @param[out] out_request_type Pointer to store type of answered request. May be NULL.
+ * @param[out] out_answer       Pointer to structure to fill.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Answer received.
+ * @retval BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED        Answer received, request rejected by server.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Answer received, request has wrong arguments.
+ * @retval BRIDGE_PROTOCOL_RESULT_BUSY                    No requests in flight.
+ * @retval BRIDGE_PROTOCOL_RESULT_TIMEOUT                 No answer received.
+ * @retval BRIDGE_PROTOCOL_RESULT_CORRUPTED               Received message is corrupted, protocol recovery required.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_link_answer_receive(bridge_link_t * link, 
+                                                    uint8_t * out_tag, 
+                                                    bridge_request_type_t * out_request_type, 
+                                                    bridge_answer_t * out_answer);
+
+/**@brief Send answer to the received request of any type. Intended for servers which handle requests 
+ *        generically (e.g. dispatch them to handlers), otherwise bridge_link_*_answer() should be used.
+ *
+ * @param[in] link         Link context.
+ * @param[in] request_type Type of request being answered.
+ * @param[in] answer       Answer to send.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Successfully answered.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Answer is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_link_answer_send(bridge_link_t * link, 
+                                                 bridge_request_type_t request_type, 
+                                                 const bridge_answer_t * answer);
+
+/**@brief Start answer to the received request of any type, built in place. Server fills returned data
+ *        and sends the answer by bridge_link_answer_commit(). Header and checksum are added around 
+ *        the data on commit, so the answer is never copied (unless it is compressed).
+ *
+ * @param[in]  link         Link context.
+ * @param[in]  request_type Type of request being answered.
+ * @param[out] frame        Answer frame, may be on stack. Only its data field is used by server.
+ *
+ * @return Answer data to fill, it belongs to frame.
+ */
+bridge_answer_data_t * bridge_link_answer_reserve(bridge_link_t * link, 
+                                                  bridge_request_type_t request_type, 
+                                                  bridge_answer_frame_t * frame);
+
+/**@brief Send answer started by bridge_link_answer_reserve().
+ *
+ * @param[in]     link        Link context.
+ * @param[in,out] frame       Answer frame with data filled. Data is not valid after commit.
+ * @param[in]     answer_type Type of answer, data is sent with SUCCESS answer only.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Successfully answered.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Answer is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_link_answer_commit(bridge_link_t * link, 
+                                                   bridge_answer_frame_t * frame, 
+                                                   bridge_answer_type_t answer_type);
+
+/**@brief Register bulk read callback for the read callback. After that every protocol call which
+ *        gets the read callback pulls data through the bulk one, so a message is received 
+ *        with a few callback calls instead of one call per byte.
+ *
+ * Registrations are global and not synchronized: they should be made before the read callback is passed 
+ * to any protocol call (e.g. at startup) and not changed while protocol calls run in other threads. Lookup 
+ * doesn't change them, so registered callbacks may be used by any number of threads after that.
+ * Registration belongs to the read callback, all buses read by it share the registration. Links (bridge_link_t)
+ * hold callbacks of their own with user data and need no registration.
+ * Up to BRIDGE_PROTOCOL_BULK_READ_MAX_REGISTERED callbacks can be registered at the same time.
+ *
+ * @param[in] read      Read callback.
+ * @param[in] read_bulk Bulk read callback. NULL removes previous registration.
+ *
+ * @retval true  Registration updated.
+ * @retval false No free registration slots.
+ */
+bool bridge_protocol_bulk_read_register(bridge_read_callback_t read, 
+                                        bridge_read_bulk_callback_t read_bulk);
+
+/**@brief Register vector write callback for the write callback. After that every protocol call which
+ *        gets the write callback sends messages through the vector one without copying the payload.
+ *        Otherwise the whole message is assembled on stack and sent with a single write callback call.
+ *
+ * Registrations are global and not synchronized the same way as of bridge_protocol_bulk_read_register().
+ * Up to BRIDGE_PROTOCOL_VECTOR_WRITE_MAX_REGISTERED callbacks can be registered at the same time.
+ *
+ * @param[in] write        Write callback.
+ * @param[in] write_vector Vector write callback. NULL removes previous registration.
+ *
+ * @retval true  Registration updated.
+ * @retval false No free registration slots.
+ */
+bool bridge_protocol_vector_write_register(bridge_write_callback_t write, 
+                                           bridge_write_vector_callback_t write_vector);
+
 /**@brief Recover after receiving corrupted message. Blocks until no new data received 
  *        for BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS timespan or specified timeout reached.
  *
@@ -204,6 +1019,74 @@ bridge_protocol_result_t bridge_protocol_get_device_info(bridge_read_callback_t
                                                          bridge_write_callback_t write,
                                                          device_info_t * info);
 
+/**@brief Answer to BATCH request. Answer should contain answers to all packed requests in the same order,
+ *        it is filled by bridge_batch_answer_init() and bridge_batch_answer_add().
+ *
+ * @param[in] write  Write callback.
+ * @param[in] answer Pointer to batch answer to send.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Successfully answered.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Batch answer is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_protocol_batch_answer(bridge_write_callback_t write,
+                                                      const bridge_answer_t * answer);
+
+/**@brief Send several requests as one BATCH request and receive answers to all of them in one message.
+ *        Request is filled by bridge_batch_request_init() and bridge_batch_request_add(),
+ *        answers are walked by bridge_batch_answer_next().
+ *
+ * @param[in]  read       Read callback.
+ * @param[in]  write      Write callback.
+ * @param[in]  request    Pointer to batch request.
+ * @param[out] out_answer Pointer to structure to store batch answer.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Completed successfully.
+ * @retval BRIDGE_PROTOCOL_RESULT_TIMEOUT                 No answer received.
+ * @retval BRIDGE_PROTOCOL_RESULT_CORRUPTED               Received message is corrupted, protocol recovery required.
+ * @retval BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED        Server rejected the whole batch.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Batch request is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_protocol_batch(bridge_read_callback_t read,
+                                               bridge_write_callback_t write,
+                                               const bridge_request_t * request,
+                                               bridge_answer_t * out_answer);
+
+/**@brief Send request of any type and receive the answer. Typed calls like bridge_protocol_get_device_info()
+ *        are shortcuts for this call.
+ *
+ * @param[in]  read       Read callback.
+ * @param[in]  write      Write callback.
+ * @param[in]  request    Pointer to request, payload is taken from the data member of its type.
+ * @param[out] out_answer Pointer to structure to store answer.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Completed successfully.
+ * @retval BRIDGE_PROTOCOL_RESULT_TIMEOUT                 No answer received.
+ * @retval BRIDGE_PROTOCOL_RESULT_CORRUPTED               Received message is corrupted, protocol recovery required.
+ * @retval BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED        Request rejected by server.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Request has wrong arguments or is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_protocol_call(bridge_read_callback_t read,
+                                              bridge_write_callback_t write,
+                                              const bridge_request_t * request,
+                                              bridge_answer_t * out_answer);
+
+/**@brief Send answer to the received request of any type, see bridge_link_answer_send().
+ *
+ * @param[in] write        Write callback.
+ * @param[in] request_type Type of request being answered.
+ * @param[in] answer       Answer to send.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Successfully answered.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Answer is malformed.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_protocol_answer_send(bridge_write_callback_t write,
+                                                     bridge_request_type_t request_type,
+                                                     const bridge_answer_t * answer);
+
 #endif
 
 /** @} */
\ No newline at end of file
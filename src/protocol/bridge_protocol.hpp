@@ -0,0 +1,608 @@
+#ifndef _BRIDGE_PROTOCOL_HPP_
+#define _BRIDGE_PROTOCOL_HPP_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_protocol_cpp Typed C++17 codec of bridge communication protocol messages
+ *
+ * @brief Header-only wrapper in which every request type is a specialisation of bridge::request_traits
+ * carrying its request and answer data types, generated from BRIDGE_REQUEST_LIST. Messages of the type are
+ * encoded and decoded by bridge::frame with data of exactly those types, so nothing is copied through
+ * bridge_request_t or bridge_answer_t unions and no request type is looked up at run time.
+ *
+ * Wire layout of every structure is generated from its field list (see bridge_schema.h) as constexpr
+ * bridge::schema specialisation. Packed sizes are checked against the C declarations and field offsets
+ * against the packed layout by static_assert, so a mismatch fails the build instead of corrupting messages.
+ * Frame sizes are compile-time constants, encoders are constexpr and work on std::array of the exact size,
+ * the compiler inlines and unrolls the whole codec. Even checksum is constexpr, so a constant request frame
+ * may be built at compile time:
+ *
+ *     constexpr auto request = bridge::frame<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO>::request_encode();
+ *
+ * Link options are the second template parameter of bridge::frame, BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS by default.
+ * Frame with BRIDGE_LINK_OPTION_COMPACT is the compact one of bridge_frame.h, its varint size is counted at compile time too.
+ * Types with payload size depending on content (BATCH, TRANSFER_CHUNK) have traits but no frame,
+ * they are sent by the C API. Codec is the wire format only: features are negotiated and answers are compressed
+ * by the link (compressed answers are still decoded), MATCH_PROTOCOL_VERSION carries features in the high byte.
+ *
+ * @{
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+extern "C"
+{
+#include "bridge_protocol.h"
+#include "bridge_frame.h"
+#include "bridge_compress.h"
+}
+
+namespace bridge
+{
+
+/**@brief Data of request or answer which has none. */
+struct empty
+{
+};
+
+/**@brief Wire layout of type: size, encode() and decode(). Specialised for integers, for every structure
+ *        of BRIDGE_SCHEMA_DATA_TYPES_LIST and for request and answer data of every request type.
+ */
+template <typename T, typename Enable = void>
+struct schema;
+
+/**@brief Integers are sent little endian whatever the host byte order is. */
+template <typename T>
+struct schema<T, std::enable_if_t<std::is_integral_v<T>>>
+{
+    static constexpr size_t size = sizeof(T);
+    
+    static constexpr uint8_t * encode(const T & value, uint8_t * out)
+    {
+        using bits_t = std::make_unsigned_t<T>;
+        bits_t bits = static_cast<bits_t>(value);
+        
+        for (size_t i = 0; i < size; i++)
+        {
+            out[i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+        
+        return out + size;
+    }
+    
+    static constexpr const uint8_t * decode(const uint8_t * in, T & out_value)
+    {
+        using bits_t = std::make_unsigned_t<T>;
+        bits_t bits = 0;
+        
+        for (size_t i = 0; i < size; i++)
+        {
+            bits = static_cast<bits_t>(bits | (static_cast<bits_t>(in[i]) << (8 * i)));
+        }
+        
+        out_value = static_cast<T>(bits);
+        
+        return in + size;
+    }
+};
+
+template <>
+struct schema<bool>
+{
+    static constexpr size_t size = 1;
+    
+    static constexpr uint8_t * encode(const bool & value, uint8_t * out)
+    {
+        *out = value ? 1 : 0;
+        return out + size;
+    }
+    
+    static constexpr const uint8_t * decode(const uint8_t * in, bool & out_value)
+    {
+        out_value = (*in != 0);
+        return in + size;
+    }
+};
+
+template <>
+struct schema<empty>
+{
+    static constexpr size_t size = 0;
+    
+    static constexpr uint8_t * encode(const empty &, uint8_t * out)
+    {
+        return out;
+    }
+    
+    static constexpr const uint8_t * decode(const uint8_t * in, empty &)
+    {
+        return in;
+    }
+};
+
+//Generators of structure layouts from field lists
+#define BRIDGE_SCHEMA_CPP_FIELD_SIZE(type, name)            + schema<type>::size
+#define BRIDGE_SCHEMA_CPP_ARRAY_SIZE(type, name, count)     + (schema<type>::size * (count))
+#define BRIDGE_SCHEMA_CPP_FIELD_ENCODE(type, name) \
+    out = schema<type>::encode(value.name, out);
+#define BRIDGE_SCHEMA_CPP_ARRAY_ENCODE(type, name, count) \
+    for (size_t i = 0; i < (count); i++) { out = schema<type>::encode(value.name[i], out); }
+#define BRIDGE_SCHEMA_CPP_FIELD_DECODE(type, name) \
+    in = schema<type>::decode(in, out_value.name);
+#define BRIDGE_SCHEMA_CPP_ARRAY_DECODE(type, name, count) \
+    for (size_t i = 0; i < (count); i++) { in = schema<type>::decode(in, out_value.name[i]); }
+#define BRIDGE_SCHEMA_CPP_FIELD_LAYOUT(type, name) \
+    matches = matches && (offsetof(value_type, name) == offset); \
+    offset += schema<type>::size;
+#define BRIDGE_SCHEMA_CPP_ARRAY_LAYOUT(type, name, count) \
+    matches = matches && (offsetof(value_type, name) == offset); \
+    offset += schema<type>::size * (count);
+
+#define BRIDGE_SCHEMA_CPP_DEFINE(type, FIELDS) \
+    template <> \
+    struct schema<type> \
+    { \
+        using value_type = type; \
+        static constexpr size_t size = 0 FIELDS(BRIDGE_SCHEMA_CPP_FIELD_SIZE, BRIDGE_SCHEMA_CPP_ARRAY_SIZE); \
+        \
+        static constexpr uint8_t * encode(const type & value, uint8_t * out) \
+        { \
+            FIELDS(BRIDGE_SCHEMA_CPP_FIELD_ENCODE, BRIDGE_SCHEMA_CPP_ARRAY_ENCODE) \
+            return out; \
+        } \
+        \
+        static constexpr const uint8_t * decode(const uint8_t * in, type & out_value) \
+        { \
+            FIELDS(BRIDGE_SCHEMA_CPP_FIELD_DECODE, BRIDGE_SCHEMA_CPP_ARRAY_DECODE) \
+            return in; \
+        } \
+        \
+        /* Memory layout is the wire one, fields in list order with no padding */ \
+        static constexpr bool layout_matches() \
+        { \
+            size_t offset = 0; \
+            bool matches = true; \
+            FIELDS(BRIDGE_SCHEMA_CPP_FIELD_LAYOUT, BRIDGE_SCHEMA_CPP_ARRAY_LAYOUT) \
+            return matches && (offset == sizeof(value_type)); \
+        } \
+    }; \
+    static_assert(schema<type>::size == BRIDGE_SCHEMA_SIZE(type), "Packed size of " #type " differs from C declaration"); \
+    static_assert(schema<type>::layout_matches(), "Memory layout of " #type " differs from wire layout");
+
+BRIDGE_SCHEMA_DATA_TYPES_LIST(BRIDGE_SCHEMA_CPP_DEFINE)
+
+//Request and answer data exist only for types with data flag set in BRIDGE_REQUEST_LIST
+#define BRIDGE_SCHEMA_CPP_DATA_DEFINE_0(type, FIELDS)
+#define BRIDGE_SCHEMA_CPP_DATA_DEFINE_1(type, FIELDS) BRIDGE_SCHEMA_CPP_DEFINE(type, FIELDS)
+
+#define BRIDGE_SCHEMA_CPP_ENTRY_DEFINE(name, member, request_data, answer_data) \
+    BRIDGE_SCHEMA_CPP_DATA_DEFINE_##request_data(bridge_##member##_request_t, BRIDGE_##name##_REQUEST_FIELDS) \
+    BRIDGE_SCHEMA_CPP_DATA_DEFINE_##answer_data(bridge_##member##_answer_t, BRIDGE_##name##_ANSWER_FIELDS)
+
+BRIDGE_REQUEST_LIST(BRIDGE_SCHEMA_CPP_ENTRY_DEFINE)
+
+/**@brief Request type: type value, request data type request_t and answer data type answer_t (bridge::empty if none). */
+template <bridge_request_type_t Type>
+struct request_traits;
+
+/**@brief Payload size of the request type depends on content, see bridge_frame.h. */
+template <bridge_request_type_t Type>
+struct is_variable_size : std::false_type
+{
+};
+
+template <>
+struct is_variable_size<BRIDGE_REQUEST_TYPE_BATCH> : std::true_type
+{
+};
+
+template <>
+struct is_variable_size<BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK> : std::true_type
+{
+};
+
+//Traits of every request type, the suffix is the has data flag of BRIDGE_REQUEST_LIST
+#define BRIDGE_TRAITS_CPP_DATA_TYPE_0(member, direction)    empty
+#define BRIDGE_TRAITS_CPP_DATA_TYPE_1(member, direction)    bridge_##member##_##direction##_t
+#define BRIDGE_TRAITS_CPP_DATA_CHECK_0(message, member, direction)
+#define BRIDGE_TRAITS_CPP_DATA_CHECK_1(message, member, direction) \
+    static_assert(schema<bridge_##member##_##direction##_t>::size == sizeofmember(message, data.member), \
+                  "Payload of " #member " " #direction " differs from its data in " #message);
+
+#define BRIDGE_TRAITS_CPP_DEFINE(name, member, request_data, answer_data) \
+    template <> \
+    struct request_traits<BRIDGE_REQUEST_TYPE_##name> \
+    { \
+        static constexpr bridge_request_type_t type = BRIDGE_REQUEST_TYPE_##name; \
+        using request_t = BRIDGE_TRAITS_CPP_DATA_TYPE_##request_data(member, request); \
+        using answer_t = BRIDGE_TRAITS_CPP_DATA_TYPE_##answer_data(member, answer); \
+    }; \
+    BRIDGE_TRAITS_CPP_DATA_CHECK_##request_data(bridge_request_t, member, request) \
+    BRIDGE_TRAITS_CPP_DATA_CHECK_##answer_data(bridge_answer_t, member, answer)
+
+BRIDGE_REQUEST_LIST(BRIDGE_TRAITS_CPP_DEFINE)
+
+//Table of CRC-16 CCITT (polynomial 0x1021) for byte-wise computation, built at compile time
+constexpr std::array<uint16_t, 256> checksum_table_make()
+{
+    std::array<uint16_t, 256> table{};
+    
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        uint16_t crc = static_cast<uint16_t>(i << 8);
+        for (size_t bit = 0; bit < 8; bit++)
+        {
+            crc = static_cast<uint16_t>((crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1));
+        }
+        table[i] = crc;
+    }
+    
+    return table;
+}
+
+inline constexpr std::array<uint16_t, 256> checksum_table = checksum_table_make();
+
+/**@brief CRC-16 CCITT of bridge_checksum.h as constexpr functions. */
+class checksum
+{
+public:
+    static constexpr uint16_t init()
+    {
+        return 0xFFFF;
+    }
+    
+    static constexpr uint16_t append(uint16_t current_crc,
+                                     const uint8_t * data,
+                                     size_t data_len)
+    {
+        for (size_t i = 0; i < data_len; i++)
+        {
+            current_crc = static_cast<uint16_t>((current_crc << 8) ^ checksum_table[((current_crc >> 8) ^ data[i]) & 0xFF]);
+        }
+        
+        return current_crc;
+    }
+};
+
+/**@brief Get size of message on a link with given options, as bridge_frame_size_get().
+ *
+ * @param[in] options      Link options, combination of bridge_link_option_t.
+ * @param[in] payload_size Payload size in bytes as sent.
+ *
+ * @return Message size in bytes with sync bytes and checksum.
+ */
+constexpr size_t frame_size_get(uint32_t options,
+                                size_t payload_size)
+{
+    size_t size = ((options & BRIDGE_LINK_OPTION_SYNC) ? BRIDGE_FRAME_SYNC_SIZE : 0) +
+                  ((options & BRIDGE_LINK_OPTION_TAGGED) ? BRIDGE_FRAME_TAG_SIZE : 0) +
+                  payload_size + BRIDGE_FRAME_CHECKSUM_SIZE;
+    
+    if ((options & BRIDGE_LINK_OPTION_COMPACT) == 0)
+    {
+        return size + BRIDGE_FRAME_HEADER_SIZE;
+    }
+    
+    //Size field of compact header is shifted to free bit 0 for the compressed flag
+    size += BRIDGE_FRAME_COMPACT_TYPE_SIZE + 1;
+    for (size_t value = (payload_size << 1); value > 0x7F; value >>= 7)
+    {
+        size++;
+    }
+    
+    return size;
+}
+
+/**@brief Messages of the request type on a link with given options. Sizes are compile-time constants,
+ *        encoders give std::array of the exact frame size, decoders check the whole frame.
+ */
+template <bridge_request_type_t Type, uint32_t Options = BRIDGE_PROTOCOL_DEFAULT_LINK_OPTIONS>
+class frame
+{
+    static_assert(!is_variable_size<Type>::value, "Payload size of the request type depends on content, use C API");
+
+public:
+    using traits = request_traits<Type>;
+    using request_t = typename traits::request_t;
+    using answer_t = typename traits::answer_t;
+    
+    static constexpr bool sync = ((Options & BRIDGE_LINK_OPTION_SYNC) != 0);
+    static constexpr bool tagged = ((Options & BRIDGE_LINK_OPTION_TAGGED) != 0);
+    static constexpr bool compact = ((Options & BRIDGE_LINK_OPTION_COMPACT) != 0);
+    static constexpr size_t sync_size = sync ? BRIDGE_FRAME_SYNC_SIZE : 0;
+    static constexpr size_t request_size = frame_size_get(Options, schema<request_t>::size);   /**< Request frame size. */
+    static constexpr size_t answer_size = frame_size_get(Options, schema<answer_t>::size);     /**< SUCCESS answer frame size. */
+    static constexpr size_t empty_answer_size = frame_size_get(Options, 0);                    /**< Answer without data frame size. */
+    
+    static_assert(!compact || (static_cast<uint32_t>(Type) <= UINT8_MAX), "Request type doesn't fit into compact header");
+    static_assert(request_size <= BRIDGE_FRAME_MAX_SIZE, "Request doesn't fit into message");
+    static_assert(answer_size <= BRIDGE_FRAME_MAX_SIZE, "Answer doesn't fit into message");
+    
+    /**@brief Encode request.
+     *
+     * @param[in] data Request data.
+     * @param[in] tag  Tag of request (tagged links only).
+     *
+     * @return Request frame.
+     */
+    static constexpr std::array<uint8_t, request_size> request_encode(const request_t & data = request_t{},
+                                                                      uint8_t tag = 0)
+    {
+        return message_encode<request_size>(static_cast<uint32_t>(Type), tag, data);
+    }
+    
+    /**@brief Encode SUCCESS answer.
+     *
+     * @param[in] data Answer data.
+     * @param[in] tag  Tag of request being answered (tagged links only).
+     *
+     * @return Answer frame.
+     */
+    static constexpr std::array<uint8_t, answer_size> answer_encode(const answer_t & data = answer_t{},
+                                                                    uint8_t tag = 0)
+    {
+        return message_encode<answer_size>(static_cast<uint32_t>(BRIDGE_ANSWER_TYPE_SUCCESS), tag, data);
+    }
+    
+    /**@brief Encode answer without data, i.e. REQUEST_REJECTED or WRONG_REQUEST_ARGUMENTS.
+     *
+     * @param[in] answer_type Type of answer.
+     * @param[in] tag         Tag of request being answered (tagged links only).
+     *
+     * @return Answer frame.
+     */
+    static constexpr std::array<uint8_t, empty_answer_size> answer_encode(bridge_answer_type_t answer_type,
+                                                                          uint8_t tag = 0)
+    {
+        return message_encode<empty_answer_size>(static_cast<uint32_t>(answer_type), tag, empty{});
+    }
+    
+    /**@brief Decode request of the type.
+     *
+     * @param[in]  data     Received frame.
+     * @param[in]  data_len Length of the frame in bytes.
+     * @param[out] out_data Request data.
+     * @param[out] out_tag  Tag of request (tagged links only). May be NULL.
+     *
+     * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS   Request decoded.
+     * @retval BRIDGE_PROTOCOL_RESULT_CORRUPTED Frame is not a valid request of the type.
+     */
+    static constexpr bridge_protocol_result_t request_decode(const uint8_t * data,
+                                                             size_t data_len,
+                                                             request_t & out_data,
+                                                             uint8_t * out_tag = nullptr)
+    {
+        uint16_t payload_size = 0;
+        uint32_t type = 0;
+        const uint8_t * payload = header_decode(data, data_len, payload_size, type, out_tag);
+        
+        if ((payload == nullptr) || (type != static_cast<uint32_t>(Type)) || (data_len != request_size))
+        {
+            return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+        }
+        
+        schema<request_t>::decode(payload, out_data);
+        
+        return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+    
+    /**@brief Decode answer to request of the type.
+     *
+     * @param[in]  data     Received frame.
+     * @param[in]  data_len Length of the frame in bytes.
+     * @param[out] out_data Answer data, filled on SUCCESS only.
+     * @param[out] out_tag  Tag of request being answered (tagged links only). May be NULL.
+     *
+     * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 Answer decoded.
+     * @retval BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED        Answer decoded, request rejected by server.
+     * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Answer decoded, request has wrong arguments.
+     * @retval BRIDGE_PROTOCOL_RESULT_CORRUPTED               Frame is not a valid answer to request of the type.
+     */
+    static constexpr bridge_protocol_result_t answer_decode(const uint8_t * data,
+                                                            size_t data_len,
+                                                            answer_t & out_data,
+                                                            uint8_t * out_tag = nullptr)
+    {
+        uint16_t payload_size = 0;
+        uint32_t answer_type = 0;
+        const uint8_t * payload = header_decode(data, data_len, payload_size, answer_type, out_tag);
+        
+        if (payload == nullptr)
+        {
+            return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+        }
+        
+        switch (answer_type)
+        {
+            case BRIDGE_ANSWER_TYPE_SUCCESS:
+            {
+                break;
+            }
+            
+            case BRIDGE_ANSWER_TYPE_REQUEST_REJECTED:
+            {
+                return (payload_size == 0) ? BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED : BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+            }
+            
+            case BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS:
+            {
+                return (payload_size == 0) ? BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS : BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+            }
+            
+            default:
+            {
+                return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+            }
+        }
+        
+        if ((payload_size & BRIDGE_FRAME_COMPRESSED_FLAG) == 0)
+        {
+            if (payload_size != schema<answer_t>::size)
+            {
+                return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+            }
+            
+            schema<answer_t>::decode(payload, out_data);
+            return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+        }
+        
+        //Compressed answer is expanded to the original size first
+        uint8_t buffer[schema<answer_t>::size + 1] = {};
+        uint16_t compressed_size = static_cast<uint16_t>(payload_size & ~BRIDGE_FRAME_COMPRESSED_FLAG);
+        if (bridge_compress_decode(payload, compressed_size, buffer, static_cast<uint16_t>(sizeof(buffer))) != schema<answer_t>::size)
+        {
+            return BRIDGE_PROTOCOL_RESULT_CORRUPTED;
+        }
+        
+        schema<answer_t>::decode(buffer, out_data);
+        return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+    }
+    
+private:
+    template <size_t Size, typename Data>
+    static constexpr std::array<uint8_t, Size> message_encode(uint32_t type,
+                                                              uint8_t tag,
+                                                              const Data & data)
+    {
+        std::array<uint8_t, Size> message{};
+        uint8_t * out = message.data();
+        
+        if constexpr (sync)
+        {
+            *out++ = BRIDGE_FRAME_SYNC_BYTE_0;
+            *out++ = BRIDGE_FRAME_SYNC_BYTE_1;
+        }
+        
+        if constexpr (compact)
+        {
+            *out++ = static_cast<uint8_t>(type);
+            
+            if constexpr (tagged)
+            {
+                *out++ = tag;
+            }
+            
+            uint32_t size_value = static_cast<uint32_t>(schema<Data>::size << 1);
+            while (size_value > 0x7F)
+            {
+                *out++ = static_cast<uint8_t>((size_value & 0x7F) | 0x80);
+                size_value >>= 7;
+            }
+            *out++ = static_cast<uint8_t>(size_value);
+        }
+        else
+        {
+            out = schema<uint16_t>::encode(static_cast<uint16_t>(schema<Data>::size), out);
+            out = schema<uint32_t>::encode(type, out);
+            
+            if constexpr (tagged)
+            {
+                *out++ = tag;
+            }
+        }
+        
+        out = schema<Data>::encode(data, out);
+        
+        //Sync bytes are not covered by checksum
+        uint16_t crc = checksum::append(checksum::init(), message.data() + sync_size, Size - sync_size - BRIDGE_FRAME_CHECKSUM_SIZE);
+        schema<uint16_t>::encode(crc, out);
+        
+        return message;
+    }
+    
+    //Returns payload of valid frame, nullptr if the frame is malformed. Payload size is checked by the caller
+    static constexpr const uint8_t * header_decode(const uint8_t * data,
+                                                   size_t data_len,
+                                                   uint16_t & out_payload_size,
+                                                   uint32_t & out_type,
+                                                   uint8_t * out_tag)
+    {
+        if (data_len < empty_answer_size)
+        {
+            return nullptr;
+        }
+        
+        if constexpr (sync)
+        {
+            if ((data[0] != BRIDGE_FRAME_SYNC_BYTE_0) || (data[1] != BRIDGE_FRAME_SYNC_BYTE_1))
+            {
+                return nullptr;
+            }
+        }
+        
+        const uint8_t * in = data + sync_size;
+        
+        if constexpr (!compact)
+        {
+            in = schema<uint16_t>::decode(in, out_payload_size);
+            in = schema<uint32_t>::decode(in, out_type);
+        }
+        else
+        {
+            out_type = *in++;
+        }
+        
+        if constexpr (tagged)
+        {
+            if (out_tag != nullptr)
+            {
+                *out_tag = *in;
+            }
+            in++;
+        }
+        
+        if constexpr (compact)
+        {
+            //Varint is bounded by the frame, which is at least as long as the shortest one
+            uint32_t size_value = 0;
+            size_t shift = 0;
+            const uint8_t * end = data + data_len - BRIDGE_FRAME_CHECKSUM_SIZE;
+            do
+            {
+                if ((in == end) || (shift >= (7 * BRIDGE_FRAME_VARINT_MAX_SIZE)))
+                {
+                    return nullptr;
+                }
+                
+                size_value |= static_cast<uint32_t>(*in & 0x7F) << shift;
+                shift += 7;
+            } while ((*in++ & 0x80) != 0);
+            
+            if (size_value > UINT16_MAX)
+            {
+                return nullptr;
+            }
+            
+            out_payload_size = static_cast<uint16_t>((size_value >> 1) | ((size_value & 1) ? BRIDGE_FRAME_COMPRESSED_FLAG : 0));
+        }
+        
+        size_t wire_payload_size = out_payload_size & ~BRIDGE_FRAME_COMPRESSED_FLAG;
+        if (data_len != frame_size_get(Options, wire_payload_size))
+        {
+            return nullptr;
+        }
+        
+        uint16_t crc = 0;
+        schema<uint16_t>::decode(in + wire_payload_size, crc);
+        if (crc != checksum::append(checksum::init(), data + sync_size, static_cast<size_t>(in - data) - sync_size + wire_payload_size))
+        {
+            return nullptr;
+        }
+        
+        return in;
+    }
+};
+
+}
+
+#undef BRIDGE_SCHEMA_CPP_DEFINE
+#undef BRIDGE_SCHEMA_CPP_ENTRY_DEFINE
+#undef BRIDGE_TRAITS_CPP_DEFINE
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "bridge_schema.h"
+#include "bridge_protocol.h"
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Integers are sent little endian whatever the host byte order is
+#define INTEGER_CODEC_DEFINE(type, unsigned_type) \
+    uint8_t * BRIDGE_SCHEMA_ENCODE(type)(const type * value, uint8_t * out) \
+    { \
+        unsigned_type bits = (unsigned_type)*value; \
+        \
+        for (uint32_t i = 0; i < BRIDGE_SCHEMA_SIZE(type); i++) \
+        { \
+            out[i] = (uint8_t)(bits >> (8 * i)); \
+        } \
+        \
+        return out + BRIDGE_SCHEMA_SIZE(type); \
+    } \
+    \
+    const uint8_t * BRIDGE_SCHEMA_DECODE(type)(const uint8_t * in, type * out_value) \
+    { \
+        unsigned_type bits = 0; \
+        \
+        for (uint32_t i = 0; i < BRIDGE_SCHEMA_SIZE(type); i++) \
+        { \
+            bits |= (unsigned_type)((unsigned_type)in[i] << (8 * i)); \
+        } \
+        \
+        *out_value = (type)bits; \
+        \
+        return in + BRIDGE_SCHEMA_SIZE(type); \
+    }
+
+//Request and answer data exist only for types with data flag set in BRIDGE_REQUEST_LIST
+#define REQUEST_DATA_DEFINE_0(type, FIELDS)
+#define REQUEST_DATA_DEFINE_1(type, FIELDS) BRIDGE_SCHEMA_DEFINE(type, FIELDS)
+
+#define REQUEST_DATA_ENTRY_DEFINE(name, member, request_data, answer_data) \
+    REQUEST_DATA_DEFINE_##request_data(bridge_##member##_request_t, BRIDGE_##name##_REQUEST_FIELDS) \
+    REQUEST_DATA_DEFINE_##answer_data(bridge_##member##_answer_t, BRIDGE_##name##_ANSWER_FIELDS)
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+BRIDGE_SCHEMA_INTEGER_TYPES_LIST(INTEGER_CODEC_DEFINE)
+
+BRIDGE_SCHEMA_DATA_TYPES_LIST(BRIDGE_SCHEMA_DEFINE)
+
+BRIDGE_REQUEST_LIST(REQUEST_DATA_ENTRY_DEFINE)
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef _BRIDGE_SCHEMA_H_
+#define _BRIDGE_SCHEMA_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_schema Schema of data exchanged via bridge communication protocol
+ *
+ * @brief Message structures are described once by field lists, the preprocessor generates the structures,
+ * their packed sizes and encode/decode functions from them. Nothing is generated by external tools,
+ * so any change of the schema is picked up by the next build of files which include it.
+ *
+ * Field list is a macro which takes two macros and calls them for every field in order:
+ * FIELD(type, name) for single value and ARRAY(type, name, count) for fixed size array, e.g.
+ *
+ *     #define POINT_FIELDS(FIELD, ARRAY) \
+ *         FIELD(int16_t, x) \
+ *         FIELD(int16_t, y) \
+ *         ARRAY(uint8_t, label, 4)
+ *
+ * Field type is either integer type (uint8_t ... int64_t, bool) or another structure described by schema.
+ *
+ * Wire layout of structure is its fields packed back-to-back in list order, little endian, no padding.
+ * Protocol encodes every payload it sends and decodes every payload it receives by the generated functions,
+ * so it works on hosts of any byte order. Structure with padding fails to compile (reorder its fields),
+ * so fields have the same offsets on the wire and in memory and payloads are encoded and decoded in place.
+ *
+ * Structures used in requests and answers are listed in BRIDGE_SCHEMA_DATA_TYPES_LIST (bridge_data_types.h),
+ * request and answer data are described by BRIDGE_<NAME>_REQUEST_FIELDS and BRIDGE_<NAME>_ANSWER_FIELDS
+ * (bridge_protocol.h).
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**@brief Packed size of structure or integer type described by schema, in bytes. */
+#define BRIDGE_SCHEMA_SIZE(type)                    bridge_schema_size_##type
+
+/**@brief Name of generated encode function of type:
+ *        uint8_t * BRIDGE_SCHEMA_ENCODE(type)(const type * value, uint8_t * out).
+ *        Writes BRIDGE_SCHEMA_SIZE(type) bytes and returns pointer past them.
+ */
+#define BRIDGE_SCHEMA_ENCODE(type)                  bridge_schema_encode_##type
+
+/**@brief Name of generated decode function of type:
+ *        const uint8_t * BRIDGE_SCHEMA_DECODE(type)(const uint8_t * in, type * out_value).
+ *        Reads BRIDGE_SCHEMA_SIZE(type) bytes and returns pointer past them.
+ */
+#define BRIDGE_SCHEMA_DECODE(type)                  bridge_schema_decode_##type
+
+//Generators, used through BRIDGE_SCHEMA_DECLARE() and BRIDGE_SCHEMA_DEFINE()
+#define BRIDGE_SCHEMA_MEMBER(type, name)            type name;
+#define BRIDGE_SCHEMA_ARRAY_MEMBER(type, name, count) type name[count];
+#define BRIDGE_SCHEMA_FIELD_SIZE(type, name)        + BRIDGE_SCHEMA_SIZE(type)
+#define BRIDGE_SCHEMA_ARRAY_SIZE(type, name, count) + (BRIDGE_SCHEMA_SIZE(type) * (count))
+
+#define BRIDGE_SCHEMA_FIELD_ENCODE(type, name) \
+    out = BRIDGE_SCHEMA_ENCODE(type)(&value->name, out);
+#define BRIDGE_SCHEMA_ARRAY_ENCODE(type, name, count) \
+    for (uint32_t i = 0; i < (count); i++) { out = BRIDGE_SCHEMA_ENCODE(type)(&value->name[i], out); }
+#define BRIDGE_SCHEMA_FIELD_DECODE(type, name) \
+    in = BRIDGE_SCHEMA_DECODE(type)(in, &out_value->name);
+#define BRIDGE_SCHEMA_ARRAY_DECODE(type, name, count) \
+    for (uint32_t i = 0; i < (count); i++) { in = BRIDGE_SCHEMA_DECODE(type)(in, &out_value->name[i]); }
+
+/**@brief Declare structure described by field list, its packed size and encode/decode functions. For headers.
+ *
+ * @param[in] type   Name of structure type to declare.
+ * @param[in] FIELDS Field list.
+ */
+#define BRIDGE_SCHEMA_DECLARE(type, FIELDS) \
+    typedef struct \
+    { \
+        FIELDS(BRIDGE_SCHEMA_MEMBER, BRIDGE_SCHEMA_ARRAY_MEMBER) \
+    } type; \
+    enum { BRIDGE_SCHEMA_SIZE(type) = 0 FIELDS(BRIDGE_SCHEMA_FIELD_SIZE, BRIDGE_SCHEMA_ARRAY_SIZE) }; \
+    typedef char bridge_schema_unpadded_##type[(sizeof(type) == BRIDGE_SCHEMA_SIZE(type)) ? 1 : -1]; \
+    uint8_t * BRIDGE_SCHEMA_ENCODE(type)(const type * value, uint8_t * out); \
+    const uint8_t * BRIDGE_SCHEMA_DECODE(type)(const uint8_t * in, type * out_value);
+
+/**@brief Define encode/decode functions of structure declared by BRIDGE_SCHEMA_DECLARE(). For bridge_schema.c only.
+ *
+ * @param[in] type   Name of structure type.
+ * @param[in] FIELDS Field list.
+ */
+#define BRIDGE_SCHEMA_DEFINE(type, FIELDS) \
+    uint8_t * BRIDGE_SCHEMA_ENCODE(type)(const type * value, uint8_t * out) \
+    { \
+        FIELDS(BRIDGE_SCHEMA_FIELD_ENCODE, BRIDGE_SCHEMA_ARRAY_ENCODE) \
+        return out; \
+    } \
+    const uint8_t * BRIDGE_SCHEMA_DECODE(type)(const uint8_t * in, type * out_value) \
+    { \
+        FIELDS(BRIDGE_SCHEMA_FIELD_DECODE, BRIDGE_SCHEMA_ARRAY_DECODE) \
+        return in; \
+    }
+
+/**@brief Packed sizes of integer types. */
+enum
+{
+    BRIDGE_SCHEMA_SIZE(bool)     = 1,
+    BRIDGE_SCHEMA_SIZE(_Bool)    = 1,
+    BRIDGE_SCHEMA_SIZE(uint8_t)  = 1,
+    BRIDGE_SCHEMA_SIZE(int8_t)   = 1,
+    BRIDGE_SCHEMA_SIZE(uint16_t) = 2,
+    BRIDGE_SCHEMA_SIZE(int16_t)  = 2,
+    BRIDGE_SCHEMA_SIZE(uint32_t) = 4,
+    BRIDGE_SCHEMA_SIZE(int32_t)  = 4,
+    BRIDGE_SCHEMA_SIZE(uint64_t) = 8,
+    BRIDGE_SCHEMA_SIZE(int64_t)  = 8
+};
+
+/**@brief Integer types, X(type, unsigned type of the same size). bool is spelled as _Bool, 
+ *        nested macros expand it before names are pasted. 
+ */
+#define BRIDGE_SCHEMA_INTEGER_TYPES_LIST(X) \
+    X(_Bool,    uint8_t) \
+    X(uint8_t,  uint8_t) \
+    X(int8_t,   uint8_t) \
+    X(uint16_t, uint16_t) \
+    X(int16_t,  uint16_t) \
+    X(uint32_t, uint32_t) \
+    X(int32_t,  uint32_t) \
+    X(uint64_t, uint64_t) \
+    X(int64_t,  uint64_t)
+
+#define BRIDGE_SCHEMA_INTEGER_DECLARE(type, unsigned_type) \
+    uint8_t * BRIDGE_SCHEMA_ENCODE(type)(const type * value, uint8_t * out); \
+    const uint8_t * BRIDGE_SCHEMA_DECODE(type)(const uint8_t * in, type * out_value);
+
+BRIDGE_SCHEMA_INTEGER_TYPES_LIST(BRIDGE_SCHEMA_INTEGER_DECLARE)
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include "bridge_transfer.h"
+#include <string.h>
+
+#define CHUNK_SIZE BRIDGE_PROTOCOL_CHUNK_MAX_SIZE
+
+//Chunk sent and not answered yet
+typedef struct
+{
+    uint32_t index;
+    uint8_t tag;
+} chunk_in_flight_t;
+
+//Client side state of transfer
+typedef struct
+{
+    bridge_link_t * link;
+    uint16_t transfer_id;
+    const uint8_t * data;
+    uint32_t size;
+    uint32_t chunks_count;
+    uint32_t acked_chunks;                                      //Chunks before this index are received
+    uint32_t received_mask;                                     //Bit i is set if chunk acked_chunks + i is received
+    uint32_t window;                                            //Chunks server accepts after acked_chunks
+    uint8_t in_flight_count;
+    chunk_in_flight_t in_flight[BRIDGE_PROTOCOL_MAX_IN_FLIGHT];
+} sender_t;
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static uint32_t chunk_length_get(uint32_t total_size,
+                                 uint32_t offset)
+{
+    uint32_t left = total_size - offset;
+    
+    return (left < CHUNK_SIZE) ? left : CHUNK_SIZE;
+}
+
+static bool chunk_is_valid(const bridge_transfer_receiver_t * receiver,
+                           uint32_t offset,
+                           uint16_t length)
+{
+    //Empty transfer consists of one empty chunk
+    if (receiver->total_size == 0)
+    {
+        return (offset == 0) && (length == 0);
+    }
+    
+    return ((offset % CHUNK_SIZE) == 0) &&
+           (offset < receiver->total_size) &&
+           (length == chunk_length_get(receiver->total_size, offset));
+}
+
+static bool sender_chunk_in_flight(const sender_t * sender,
+                                   uint32_t index)
+{
+    for (uint8_t i = 0; i < sender->in_flight_count; i++)
+    {
+        if (sender->in_flight[i].index == index)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+//Oldest chunk which is neither received nor in flight, chunks_count if there is none in the window
+static uint32_t sender_chunk_next(const sender_t * sender)
+{
+    uint32_t window = (sender->window < BRIDGE_TRANSFER_WINDOW_CHUNKS) ? sender->window : BRIDGE_TRANSFER_WINDOW_CHUNKS;
+    
+    for (uint32_t i = 0; (i < window) && ((sender->acked_chunks + i) < sender->chunks_count); i++)
+    {
+        uint32_t index = sender->acked_chunks + i;
+        
+        if (((sender->received_mask & (1UL << i)) == 0) && (sender_chunk_in_flight(sender, index) == false))
+        {
+            return index;
+        }
+    }
+    
+    return sender->chunks_count;
+}
+
+static bridge_protocol_result_t sender_chunk_send(sender_t * sender,
+                                                  uint32_t index)
+{
+    uint32_t offset = index * CHUNK_SIZE;
+    uint16_t length = (uint16_t)chunk_length_get(sender->size, offset);
+    
+    bridge_request_t request;
+    request.type = BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK;
+    request.data.transfer_chunk.total_size = sender->size;
+    request.data.transfer_chunk.offset = offset;
+    request.data.transfer_chunk.transfer_id = sender->transfer_id;
+    request.data.transfer_chunk.length = length;
+    memcpy(request.data.transfer_chunk.data, &sender->data[offset], length);
+    
+    uint8_t tag;
+    bridge_protocol_result_t protocol_result = bridge_link_request_send(sender->link, &request, &tag);
+    if (protocol_result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+    {
+        sender->in_flight[sender->in_flight_count].index = index;
+        sender->in_flight[sender->in_flight_count].tag = tag;
+        sender->in_flight_count++;
+    }
+    
+    return protocol_result;
+}
+
+//Answered chunk is no longer in flight. If it is not acknowledged, it is sent again
+static void sender_in_flight_remove(sender_t * sender,
+                                    uint8_t tag)
+{
+    uint8_t index = 0;
+    
+    //Untagged answers come in request order, so unknown tag means the oldest chunk
+    while ((index < sender->in_flight_count) && (sender->in_flight[index].tag != tag))
+    {
+        index++;
+    }
+    
+    if (index >= sender->in_flight_count)
+    {
+        index = 0;
+    }
+    
+    sender->in_flight_count--;
+    memmove(&sender->in_flight[index], &sender->in_flight[index + 1], (sender->in_flight_count - index) * sizeof(sender->in_flight[0]));
+}
+
+//Returns true if acknowledgement moves the transfer forward
+static bool sender_ack_process(sender_t * sender,
+                               const bridge_answer_t * answer)
+{
+    const bridge_transfer_chunk_answer_t * ack = &answer->data.transfer_chunk;
+    
+    if ((ack->transfer_id != sender->transfer_id) || (ack->acked_offset > sender->size))
+    {
+        return false;
+    }
+    
+    uint32_t acked_chunks = (ack->acked_offset == sender->size) ?
+                            sender->chunks_count :
+                            ack->acked_offset / CHUNK_SIZE;
+    
+    //Answers may come out of order on tagged links, older acknowledgement tells nothing new
+    if (acked_chunks < sender->acked_chunks)
+    {
+        return false;
+    }
+    
+    bool progress = (acked_chunks > sender->acked_chunks);
+    uint32_t shift = acked_chunks - sender->acked_chunks;
+    
+    sender->received_mask = (shift >= BRIDGE_TRANSFER_WINDOW_CHUNKS) ? 0 : (sender->received_mask >> shift);
+    sender->received_mask |= ack->received_mask;
+    sender->acked_chunks = acked_chunks;
+    sender->window = (ack->window > 0) ? ack->window : 1;
+    
+    return progress;
+}
+
+//Answers to chunks still in flight are received and dropped, so they are not taken for answers to next requests
+static void sender_drain(sender_t * sender)
+{
+    while (sender->link->in_flight_count > 0)
+    {
+        bridge_answer_t answer;
+        bridge_protocol_result_t protocol_result = bridge_link_answer_receive(sender->link, NULL, NULL, &answer);
+        
+        if ((protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS) &&
+            (protocol_result != BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED) &&
+            (protocol_result != BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS))
+        {
+            break;
+        }
+    }
+    
+    sender->in_flight_count = 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void bridge_transfer_receiver_init(bridge_transfer_receiver_t * receiver,
+                                   uint8_t * buffer,
+                                   uint32_t buffer_size)
+{
+    memset(receiver, 0, sizeof(*receiver));
+    
+    receiver->buffer = buffer;
+    receiver->buffer_size = buffer_size;
+}
+
+bool bridge_transfer_chunk_handle(bridge_transfer_receiver_t * receiver,
+                                  const bridge_request_t * request,
+                                  bridge_answer_t * out_answer)
+{
+    const bridge_transfer_chunk_request_t * chunk = &request->data.transfer_chunk;
+    bool completed_before = true;
+    
+    out_answer->type = BRIDGE_ANSWER_TYPE_SUCCESS;
+    
+    if ((receiver->started == false) || (chunk->transfer_id != receiver->transfer_id))
+    {
+        if (chunk->total_size > receiver->buffer_size)
+        {
+            out_answer->type = BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS;
+            return false;
+        }
+        
+        receiver->started = true;
+        receiver->transfer_id = chunk->transfer_id;
+        receiver->total_size = chunk->total_size;
+        receiver->acked_offset = 0;
+        receiver->received_mask = 0;
+        completed_before = false;
+    }
+    else
+    {
+        completed_before = (receiver->acked_offset == receiver->total_size);
+    }
+    
+    if ((chunk->total_size != receiver->total_size) || (chunk_is_valid(receiver, chunk->offset, chunk->length) == false))
+    {
+        out_answer->type = BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS;
+        return false;
+    }
+    
+    //Chunks before acknowledged offset are repeated ones, chunks beyond the window are dropped
+    if ((chunk->offset >= receiver->acked_offset) && (chunk->offset < receiver->total_size))
+    {
+        uint32_t index = (chunk->offset - receiver->acked_offset) / CHUNK_SIZE;
+        
+        if ((index < BRIDGE_TRANSFER_WINDOW_CHUNKS) && ((receiver->received_mask & (1UL << index)) == 0))
+        {
+            memcpy(&receiver->buffer[chunk->offset], chunk->data, chunk->length);
+            receiver->received_mask |= (1UL << index);
+        }
+    }
+    
+    while (receiver->received_mask & 1)
+    {
+        receiver->received_mask >>= 1;
+        receiver->acked_offset += chunk_length_get(receiver->total_size, receiver->acked_offset);
+    }
+    
+    out_answer->data.transfer_chunk.transfer_id = receiver->transfer_id;
+    out_answer->data.transfer_chunk.window = BRIDGE_TRANSFER_WINDOW_CHUNKS;
+    out_answer->data.transfer_chunk.acked_offset = receiver->acked_offset;
+    out_answer->data.transfer_chunk.received_mask = receiver->received_mask;
+    
+    return (completed_before == false) && (receiver->acked_offset == receiver->total_size);
+}
+
+bridge_protocol_result_t bridge_transfer_send(bridge_link_t * link,
+                                              uint16_t transfer_id,
+                                              const uint8_t * data,
+                                              uint32_t size)
+{
+    if (link->in_flight_count > 0)
+    {
+        return BRIDGE_PROTOCOL_RESULT_BUSY;
+    }
+    
+    sender_t sender;
+    memset(&sender, 0, sizeof(sender));
+    sender.link = link;
+    sender.transfer_id = transfer_id;
+    sender.data = data;
+    sender.size = size;
+    sender.chunks_count = (size == 0) ? 1 : ((size - 1) / CHUNK_SIZE) + 1;
+    sender.window = BRIDGE_TRANSFER_WINDOW_CHUNKS;
+    
+    //Link refuses requests beyond the window agreed by MATCH_CAPABILITIES as well as beyond its own one
+    uint8_t window = (link->window < link->window_agreed) ? link->window : link->window_agreed;
+    if (window > BRIDGE_PROTOCOL_MAX_IN_FLIGHT)
+    {
+        window = BRIDGE_PROTOCOL_MAX_IN_FLIGHT;
+    }
+    
+    if (window == 0)
+    {
+        window = 1;
+    }
+    
+    uint32_t retries = 0;
+    
+    while (sender.acked_chunks < sender.chunks_count)
+    {
+        //Keep the window full
+        while (sender.in_flight_count < window)
+        {
+            uint32_t index = sender_chunk_next(&sender);
+            if (index >= sender.chunks_count)
+            {
+                break;
+            }
+            
+            bridge_protocol_result_t protocol_result = sender_chunk_send(&sender, index);
+            if (protocol_result != BRIDGE_PROTOCOL_RESULT_SUCCESS)
+            {
+                sender_drain(&sender);
+                return protocol_result;
+            }
+        }
+        
+        uint8_t tag = 0;
+        bridge_answer_t answer;
+        bridge_protocol_result_t protocol_result = bridge_link_answer_receive(link, &tag, NULL, &answer);
+        
+        switch (protocol_result)
+        {
+            case BRIDGE_PROTOCOL_RESULT_SUCCESS:
+            {
+                sender_in_flight_remove(&sender, tag);
+                
+                if (sender_ack_process(&sender, &answer))
+                {
+                    retries = 0;
+                }
+                break;
+            }
+            
+            case BRIDGE_PROTOCOL_RESULT_TIMEOUT:
+            case BRIDGE_PROTOCOL_RESULT_CORRUPTED:
+            {
+                //Link considers all requests in flight lost, unacknowledged chunks are sent again
+                sender.in_flight_count = 0;
+                
+                if (++retries > BRIDGE_TRANSFER_MAX_RETRIES)
+                {
+                    return protocol_result;
+                }
+                
+                if (protocol_result == BRIDGE_PROTOCOL_RESULT_CORRUPTED)
+                {
+                    bridge_protocol_result_t recover_result = bridge_link_recover(link, link->wait_answer_timeout_ms);
+                    if (recover_result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
+                    {
+                        return recover_result;
+                    }
+                }
+                break;
+            }
+            
+            case BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED:
+            case BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS:
+            {
+                sender_drain(&sender);
+                return protocol_result;
+            }
+            
+            default:
+            {
+                return protocol_result;
+            }
+        }
+    }
+    
+    //Chunks sent again may still be answered
+    sender_drain(&sender);
+    
+    return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+}
\ No newline at end of file
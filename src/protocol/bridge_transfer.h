@@ -0,0 +1,97 @@
+#ifndef _BRIDGE_TRANSFER_H_
+#define _BRIDGE_TRANSFER_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_transfer Chunked transfer of large data
+ *
+ * @brief Sends data of any size up to 4 GB (firmware image, log dump) from client to server
+ * as a stream of TRANSFER_CHUNK requests, keeping the link busy instead of waiting a round trip per chunk.
+ *
+ * Client splits data into chunks of BRIDGE_PROTOCOL_CHUNK_MAX_SIZE bytes and keeps up to link window
+ * (see bridge_link_t), or the smaller window agreed by MATCH_CAPABILITIES, chunks in flight. Server stores every chunk at its offset and answers with
+ * acknowledgement: offset before which all data is received and mask of chunks received after it.
+ * Client retransmits only chunks which are not acknowledged, so a corrupted message costs one chunk.
+ *
+ * Server accepts chunks up to BRIDGE_TRANSFER_WINDOW_CHUNKS ahead of the acknowledged offset,
+ * window of the link should not be larger to keep all chunks in flight useful. With window 1 transfer
+ * works as stop-and-wait. Chunks of a new transfer (another transfer_id) restart the reception.
+ *
+ * Client sends data by bridge_transfer_send(). Server initializes receiver by bridge_transfer_receiver_init(),
+ * handles every TRANSFER_CHUNK request by bridge_transfer_chunk_handle() and sends the answer it fills.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bridge_protocol.h"
+
+#define BRIDGE_TRANSFER_WINDOW_CHUNKS   32                      /**< Chunks receiver accepts ahead, bits of received_mask. */
+
+#ifndef BRIDGE_TRANSFER_MAX_RETRIES
+#define BRIDGE_TRANSFER_MAX_RETRIES     3                       /**< Failed attempts in a row after which client gives up. */
+#endif
+
+/**@brief Transfer receiver. */
+typedef struct
+{
+    uint8_t * buffer;                                           /**< Buffer data is stored to. */
+    uint32_t buffer_size;                                       /**< Size of buffer. */
+    uint32_t total_size;                                        /**< Size of data being received. */
+    uint32_t acked_offset;                                      /**< All data before this offset is received. */
+    
+    //Internal data
+    uint16_t transfer_id;
+    bool started;
+    uint32_t received_mask;
+} bridge_transfer_receiver_t;
+
+/**@brief Initialize transfer receiver.
+ *
+ * @param[out] receiver    Receiver to initialize.
+ * @param[in]  buffer      Buffer to store received data. It should outlive the receiver.
+ * @param[in]  buffer_size Size of buffer, larger transfers are answered with WRONG_REQUEST_ARGUMENTS.
+ */
+void bridge_transfer_receiver_init(bridge_transfer_receiver_t * receiver,
+                                   uint8_t * buffer,
+                                   uint32_t buffer_size);
+
+/**@brief Handle TRANSFER_CHUNK request: store chunk and fill acknowledgement.
+ *
+ * @param[in,out] receiver   Receiver.
+ * @param[in]     request    Received TRANSFER_CHUNK request.
+ * @param[out]    out_answer Answer to send to client.
+ *
+ * @retval true  All data of the transfer is received, total_size bytes are in the buffer.
+ * @retval false Transfer is not completed yet or chunk is rejected.
+ */
+bool bridge_transfer_chunk_handle(bridge_transfer_receiver_t * receiver,
+                                  const bridge_request_t * request,
+                                  bridge_answer_t * out_answer);
+
+/**@brief Send data to server and wait until all of it is acknowledged. No other requests should be
+ *        in flight on the link.
+ *
+ * @param[in] link        Link context. Number of chunks in flight is set by its window and the window agreed.
+ * @param[in] transfer_id Identifier of transfer, should differ from the previous transfer on the link.
+ * @param[in] data        Data to send.
+ * @param[in] size        Size of data.
+ *
+ * @retval BRIDGE_PROTOCOL_RESULT_SUCCESS                 All data received by server.
+ * @retval BRIDGE_PROTOCOL_RESULT_BUSY                    Other requests are in flight.
+ * @retval BRIDGE_PROTOCOL_RESULT_TIMEOUT                 No progress after BRIDGE_TRANSFER_MAX_RETRIES attempts.
+ * @retval BRIDGE_PROTOCOL_RESULT_CORRUPTED               No progress after BRIDGE_TRANSFER_MAX_RETRIES attempts, last one corrupted.
+ * @retval BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED        Server rejected transfer.
+ * @retval BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS Server can't receive data of this size.
+ * @retval BRIDGE_PROTOCOL_RESULT_IO_ERROR                I/O error occured.
+ */
+bridge_protocol_result_t bridge_transfer_send(bridge_link_t * link,
+                                              uint16_t transfer_id,
+                                              const uint8_t * data,
+                                              uint32_t size);
+
+#endif
+
+/** @} */
\ No newline at end of file
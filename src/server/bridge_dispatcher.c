@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bridge_dispatcher.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Links share a small set of locks, the lock is held only while answers are sent or the link state is changed
+static pthread_mutex_t * link_lock_get(bridge_dispatcher_t * dispatcher,
+                                       const bridge_server_link_t * link)
+{
+    uintptr_t hash = (uintptr_t)link / sizeof(bridge_server_link_t);
+    
+    return &dispatcher->link_locks[hash % BRIDGE_DISPATCHER_LOCK_STRIPES];
+}
+
+//Server takes the same lock while it reports received requests and reads options of the link
+static pthread_mutex_t * server_link_lock_get(void * context,
+                                              const bridge_server_link_t * link)
+{
+    return link_lock_get((bridge_dispatcher_t*)context, link);
+}
+
+//Server thread is blocked while all jobs are busy, so a flood of requests can't exhaust memory
+static bridge_dispatcher_job_t * job_alloc(bridge_dispatcher_t * dispatcher)
+{
+    pthread_mutex_lock(&dispatcher->lock);
+    
+    while (dispatcher->free_jobs == NULL)
+    {
+        pthread_cond_wait(&dispatcher->job_freed, &dispatcher->lock);
+    }
+    
+    bridge_dispatcher_job_t * job = dispatcher->free_jobs;
+    dispatcher->free_jobs = job->next;
+    dispatcher->busy++;
+    
+    pthread_mutex_unlock(&dispatcher->lock);
+    
+    return job;
+}
+
+static void job_free(bridge_dispatcher_t * dispatcher,
+                     bridge_dispatcher_job_t * job)
+{
+    pthread_mutex_lock(&dispatcher->lock);
+    
+    job->next = dispatcher->free_jobs;
+    dispatcher->free_jobs = job;
+    dispatcher->busy--;
+    
+    pthread_cond_broadcast(&dispatcher->job_freed);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+static void job_run(bridge_dispatcher_job_t * job)
+{
+    const bridge_dispatcher_registration_t * registration = job->registration;
+    
+    memset(&job->answer, 0, sizeof(job->answer));
+    job->answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+    job->answer_needed = registration->handler(job->link, &job->request, &job->answer, registration->context);
+}
+
+//Answers are sent from the head of the link's list as long as they are ready, so the order is kept
+static void job_complete(bridge_dispatcher_t * dispatcher,
+                         bridge_dispatcher_job_t * job)
+{
+    bridge_server_link_t * link = job->link;
+    pthread_mutex_t * link_lock = link_lock_get(dispatcher, link);
+    
+    pthread_mutex_lock(link_lock);
+    
+    job->answer_ready = true;
+    
+    while ((link->pending_head != NULL) && link->pending_head->answer_ready)
+    {
+        bridge_dispatcher_job_t * answered = link->pending_head;
+        
+        link->pending_head = answered->next;
+        if (link->pending_head == NULL)
+        {
+            link->pending_tail = NULL;
+        }
+        
+        if (answered->answer_needed)
+        {
+            bridge_link_answer_send(&link->link, answered->request.type, &answered->answer);
+        }
+        else
+        {
+            bridge_link_request_unanswered(&link->link);
+        }
+        
+        job_free(dispatcher, answered);
+    }
+    
+    pthread_mutex_unlock(link_lock);
+}
+
+static void queue_push(bridge_dispatcher_queue_t * queue,
+                       bridge_dispatcher_job_t * job)
+{
+    pthread_mutex_lock(&queue->lock);
+    
+    //Queue can hold every job of the pool, so it never overflows
+    queue->jobs[(queue->head + queue->count) % BRIDGE_DISPATCHER_MAX_JOBS] = job;
+    queue->count++;
+    
+    pthread_mutex_unlock(&queue->lock);
+}
+
+//Owner takes the oldest job, thief takes the newest one, so they rarely compete for the same end
+static bridge_dispatcher_job_t * queue_pop(bridge_dispatcher_queue_t * queue,
+                                           bool oldest)
+{
+    bridge_dispatcher_job_t * job = NULL;
+    
+    pthread_mutex_lock(&queue->lock);
+    
+    if (queue->count > 0)
+    {
+        if (oldest)
+        {
+            job = queue->jobs[queue->head];
+            queue->head = (queue->head + 1) % BRIDGE_DISPATCHER_MAX_JOBS;
+        }
+        else
+        {
+            job = queue->jobs[(queue->head + queue->count - 1) % BRIDGE_DISPATCHER_MAX_JOBS];
+        }
+        
+        queue->count--;
+    }
+    
+    pthread_mutex_unlock(&queue->lock);
+    
+    return job;
+}
+
+static bridge_dispatcher_job_t * worker_job_get(bridge_dispatcher_t * dispatcher,
+                                                uint32_t worker_index)
+{
+    bridge_dispatcher_job_t * job = queue_pop(&dispatcher->queues[worker_index], true);
+    
+    for (uint32_t i = 1; (job == NULL) && (i < dispatcher->workers_count); i++)
+    {
+        job = queue_pop(&dispatcher->queues[(worker_index + i) % dispatcher->workers_count], false);
+    }
+    
+    if (job != NULL)
+    {
+        pthread_mutex_lock(&dispatcher->lock);
+        dispatcher->queued--;
+        pthread_mutex_unlock(&dispatcher->lock);
+    }
+    
+    return job;
+}
+
+static void * worker_run(void * arg)
+{
+    bridge_dispatcher_t * dispatcher = ((bridge_dispatcher_queue_t*)arg)->dispatcher;
+    uint32_t index = ((bridge_dispatcher_queue_t*)arg)->worker_index;
+    
+    for (;;)
+    {
+        bridge_dispatcher_job_t * job = worker_job_get(dispatcher, index);
+        
+        if (job != NULL)
+        {
+            job_run(job);
+            job_complete(dispatcher, job);
+            continue;
+        }
+        
+        pthread_mutex_lock(&dispatcher->lock);
+        
+        while ((dispatcher->queued <= 0) && (dispatcher->stop == false))
+        {
+            pthread_cond_wait(&dispatcher->job_queued, &dispatcher->lock);
+        }
+        
+        bool stop = dispatcher->stop && (dispatcher->queued <= 0);
+        
+        pthread_mutex_unlock(&dispatcher->lock);
+        
+        if (stop)
+        {
+            return NULL;
+        }
+    }
+}
+
+static void workers_stop(bridge_dispatcher_t * dispatcher,
+                         uint32_t started_count)
+{
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->stop = true;
+    pthread_cond_broadcast(&dispatcher->job_queued);
+    pthread_mutex_unlock(&dispatcher->lock);
+    
+    for (uint32_t i = 0; i < started_count; i++)
+    {
+        pthread_join(dispatcher->workers[i], NULL);
+    }
+}
+
+//Called by the server for every request of registered type
+static void server_handler(bridge_server_link_t * link,
+                           const bridge_request_t * request,
+                           void * context)
+{
+    const bridge_dispatcher_registration_t * registration = (const bridge_dispatcher_registration_t*)context;
+    bridge_dispatcher_t * dispatcher = registration->dispatcher;
+    
+    bridge_dispatcher_job_t * job = job_alloc(dispatcher);
+    job->link = link;
+    job->registration = registration;
+    job->request = *request;
+    job->answer_ready = false;
+    job->answer_needed = false;
+    job->next = NULL;
+    
+    pthread_mutex_t * link_lock = link_lock_get(dispatcher, link);
+    pthread_mutex_lock(link_lock);
+    
+    if (link->pending_tail != NULL)
+    {
+        link->pending_tail->next = job;
+    }
+    else
+    {
+        link->pending_head = job;
+    }
+    link->pending_tail = job;
+    
+    pthread_mutex_unlock(link_lock);
+    
+    if (registration->pooled == false)
+    {
+        job_run(job);
+        job_complete(dispatcher, job);
+        return;
+    }
+    
+    queue_push(&dispatcher->queues[dispatcher->next_queue], job);
+    dispatcher->next_queue = (dispatcher->next_queue + 1) % dispatcher->workers_count;
+    
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->queued++;
+    pthread_cond_signal(&dispatcher->job_queued);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool bridge_dispatcher_init(bridge_dispatcher_t * dispatcher,
+                            bridge_server_t * server,
+                            uint32_t workers_count)
+{
+    if ((workers_count == 0) || (workers_count > BRIDGE_DISPATCHER_MAX_WORKERS))
+    {
+        return false;
+    }
+    
+    memset(dispatcher, 0, sizeof(*dispatcher));
+    
+    dispatcher->server = server;
+    
+    pthread_mutex_init(&dispatcher->lock, NULL);
+    pthread_cond_init(&dispatcher->job_queued, NULL);
+    pthread_cond_init(&dispatcher->job_freed, NULL);
+    
+    for (uint32_t i = 0; i < BRIDGE_DISPATCHER_LOCK_STRIPES; i++)
+    {
+        pthread_mutex_init(&dispatcher->link_locks[i], NULL);
+    }
+    
+    for (uint32_t i = 0; i < BRIDGE_DISPATCHER_MAX_JOBS; i++)
+    {
+        dispatcher->jobs[i].next = dispatcher->free_jobs;
+        dispatcher->free_jobs = &dispatcher->jobs[i];
+    }
+    
+    for (uint32_t i = 0; i < workers_count; i++)
+    {
+        dispatcher->queues[i].dispatcher = dispatcher;
+        dispatcher->queues[i].worker_index = i;
+        pthread_mutex_init(&dispatcher->queues[i].lock, NULL);
+    }
+    
+    //Workers steal from every queue, so the count is set before any of them starts
+    dispatcher->workers_count = workers_count;
+    server->link_lock_get = server_link_lock_get;
+    server->link_lock_context = dispatcher;
+    
+    for (uint32_t i = 0; i < workers_count; i++)
+    {
+        if (pthread_create(&dispatcher->workers[i], NULL, worker_run, &dispatcher->queues[i]) != 0)
+        {
+            workers_stop(dispatcher, i);
+            server->link_lock_get = NULL;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void bridge_dispatcher_deinit(bridge_dispatcher_t * dispatcher)
+{
+    bridge_dispatcher_wait(dispatcher);
+    
+    workers_stop(dispatcher, dispatcher->workers_count);
+    dispatcher->server->link_lock_get = NULL;
+}
+
+bool bridge_dispatcher_handler_register(bridge_dispatcher_t * dispatcher,
+                                        bridge_request_type_t request_type,
+                                        bridge_dispatcher_handler_t handler,
+                                        void * context,
+                                        bool pooled)
+{
+    if ((request_type == BRIDGE_REQUEST_TYPE_UNDEFINED) || (request_type >= BRIDGE_REQUEST_TYPE_COUNT))
+    {
+        return false;
+    }
+    
+    bridge_dispatcher_registration_t * registration = &dispatcher->registrations[request_type];
+    registration->dispatcher = dispatcher;
+    registration->request_type = request_type;
+    registration->handler = handler;
+    registration->context = context;
+    registration->pooled = pooled;
+    
+    return bridge_server_handler_register(dispatcher->server, request_type, server_handler, registration);
+}
+
+void bridge_dispatcher_wait(bridge_dispatcher_t * dispatcher)
+{
+    pthread_mutex_lock(&dispatcher->lock);
+    
+    while (dispatcher->busy > 0)
+    {
+        pthread_cond_wait(&dispatcher->job_freed, &dispatcher->lock);
+    }
+    
+    pthread_mutex_unlock(&dispatcher->lock);
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef _BRIDGE_DISPATCHER_H_
+#define _BRIDGE_DISPATCHER_H_
+
+/**
+ * @ingroup bridge_server
+ *
+ * @defgroup bridge_dispatcher Worker pool request dispatcher (Linux)
+ *
+ * @brief Runs slow request handlers of bridge_server.h runtime on a pool of worker threads,
+ * so a handler which takes milliseconds (e.g. flash read) blocks neither its link nor other links.
+ *
+ * Handlers registered by bridge_dispatcher_handler_register() fill the answer instead of sending it.
+ * Pooled handlers run on workers, every worker has its own queue and steals requests from the queues
+ * of other workers when idle. Other handlers run on the server thread right away.
+ *
+ * Answers of every link are sent in request order, whatever order handlers complete in: an answer
+ * waits until all earlier requests of the link are answered. All handlers of a link should be
+ * registered through the dispatcher, answers sent directly may overtake queued ones.
+ *
+ * Answers are sent under the lock of the link, the server takes the same lock while it changes the link state
+ * (requests received, negotiated options), so workers and the server thread never touch the link at the same time.
+ * Handlers may run concurrently, also for the same link, so they should protect shared data themselves.
+ * Link should not be freed and its descriptor should not be closed while its requests are queued,
+ * bridge_dispatcher_wait() waits until all queued requests are answered.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "bridge_server.h"
+
+#define BRIDGE_DISPATCHER_MAX_WORKERS       16
+#define BRIDGE_DISPATCHER_MAX_JOBS          256
+#define BRIDGE_DISPATCHER_LOCK_STRIPES      64
+
+typedef struct bridge_dispatcher_s bridge_dispatcher_t;
+
+/**@brief Dispatched request handler.
+ *
+ * @param[in]  link       Link the request is received from.
+ * @param[in]  request    Received request.
+ * @param[out] out_answer Answer to fill.
+ * @param[in]  context    Context passed to bridge_dispatcher_handler_register().
+ *
+ * @retval true  Answer should be sent.
+ * @retval false Request should not be answered.
+ */
+typedef bool (*bridge_dispatcher_handler_t)(bridge_server_link_t * link,
+                                            const bridge_request_t * request,
+                                            bridge_answer_t * out_answer,
+                                            void * context);
+
+/**@brief Request being handled. Internal, allocated from the pool of dispatcher. */
+typedef struct bridge_dispatcher_job_s
+{
+    bridge_server_link_t * link;
+    const struct bridge_dispatcher_registration_s * registration;
+    bridge_request_t request;
+    bridge_answer_t answer;
+    bool answer_ready;                                          //Handler completed
+    bool answer_needed;                                         //Handler asked to send the answer
+    struct bridge_dispatcher_job_s * next;                      //Next request of the same link or next free job
+} bridge_dispatcher_job_t;
+
+/**@brief Handler registration. Internal. */
+typedef struct bridge_dispatcher_registration_s
+{
+    bridge_dispatcher_t * dispatcher;
+    bridge_request_type_t request_type;
+    bridge_dispatcher_handler_t handler;
+    void * context;
+    bool pooled;
+} bridge_dispatcher_registration_t;
+
+/**@brief Queue of worker. Internal. */
+typedef struct
+{
+    bridge_dispatcher_t * dispatcher;
+    uint32_t worker_index;
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t count;
+    bridge_dispatcher_job_t * jobs[BRIDGE_DISPATCHER_MAX_JOBS];
+} bridge_dispatcher_queue_t;
+
+/**@brief Dispatcher instance. Fields are internal, use bridge_dispatcher_*() functions only. */
+struct bridge_dispatcher_s
+{
+    bridge_server_t * server;
+    uint32_t workers_count;
+    pthread_t workers[BRIDGE_DISPATCHER_MAX_WORKERS];
+    bridge_dispatcher_queue_t queues[BRIDGE_DISPATCHER_MAX_WORKERS];
+    uint32_t next_queue;                                        //Queue for the next pooled request, round robin
+    
+    pthread_mutex_t lock;                                       //Protects fields below
+    pthread_cond_t job_queued;
+    pthread_cond_t job_freed;
+    int32_t queued;                                             //Pooled requests waiting for worker, 
+                                                                //may drop below zero for a moment
+    uint32_t busy;                                              //Requests not answered yet
+    bool stop;
+    bridge_dispatcher_job_t * free_jobs;
+    bridge_dispatcher_job_t jobs[BRIDGE_DISPATCHER_MAX_JOBS];
+    
+    pthread_mutex_t link_locks[BRIDGE_DISPATCHER_LOCK_STRIPES]; //Protect pending answers of links
+    bridge_dispatcher_registration_t registrations[BRIDGE_REQUEST_TYPE_COUNT]; //Indexed by request type
+};
+
+/**@brief Initialize dispatcher and start workers.
+ *
+ * @param[out] dispatcher    Dispatcher instance.
+ * @param[in]  server        Server which requests are dispatched.
+ * @param[in]  workers_count Number of worker threads, up to BRIDGE_DISPATCHER_MAX_WORKERS.
+ *
+ * @retval true  Dispatcher started.
+ * @retval false Wrong number of workers or threads can't be started.
+ */
+bool bridge_dispatcher_init(bridge_dispatcher_t * dispatcher,
+                            bridge_server_t * server,
+                            uint32_t workers_count);
+
+/**@brief Wait until all queued requests are answered and stop workers.
+ *
+ * @param[in] dispatcher Dispatcher instance.
+ */
+void bridge_dispatcher_deinit(bridge_dispatcher_t * dispatcher);
+
+/**@brief Register handler for requests of given type in the server.
+ *
+ * @param[in] dispatcher   Dispatcher instance.
+ * @param[in] request_type Type of request.
+ * @param[in] handler      Handler.
+ * @param[in] context      Context passed to handler.
+ * @param[in] pooled       True if handler should run on workers, false if on the server thread.
+ *
+ * @retval true  Handler registered.
+ * @retval false Request type is not listed in BRIDGE_REQUEST_LIST.
+ */
+bool bridge_dispatcher_handler_register(bridge_dispatcher_t * dispatcher,
+                                        bridge_request_type_t request_type,
+                                        bridge_dispatcher_handler_t handler,
+                                        void * context,
+                                        bool pooled);
+
+/**@brief Wait until all queued requests are answered. Should not be called from handlers.
+ *
+ * @param[in] dispatcher Dispatcher instance.
+ */
+void bridge_dispatcher_wait(bridge_dispatcher_t * dispatcher);
+
+#endif
+
+/** @} */
\ No newline at end of file
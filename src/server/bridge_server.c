@@ -0,0 +1,469 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bridge_server.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static uint64_t time_ms_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * 1000) + ((uint64_t)now.tv_nsec / 1000000);
+}
+
+//Non-blocking descriptor may be full for a moment, answer is still expected to leave in time
+static bool fd_writable_wait(int fd,
+                             uint32_t timeout_ms)
+{
+    struct pollfd poll_fd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+    
+    int result;
+    do
+    {
+        result = poll(&poll_fd, 1, (int)timeout_ms);
+    } while ((result < 0) && (errno == EINTR));
+    
+    return (result > 0) && ((poll_fd.revents & POLLOUT) != 0);
+}
+
+//Requests are never read by blocking calls, parser gets all received data
+static bridge_callback_result_t link_read(void * user,
+                                          uint8_t * data,
+                                          uint16_t max_len,
+                                          uint16_t * out_len,
+                                          uint32_t timeout_ms)
+{
+    (void)user;
+    (void)data;
+    (void)max_len;
+    (void)out_len;
+    (void)timeout_ms;
+    
+    return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+}
+
+static bridge_callback_result_t link_write_vector(void * user,
+                                                  const bridge_write_chunk_t * chunks,
+                                                  uint8_t chunks_count)
+{
+    bridge_server_link_t * link = (bridge_server_link_t*)user;
+    
+    struct iovec iov[4];
+    uint32_t iov_count = 0;
+    for (uint8_t i = 0; (i < chunks_count) && (iov_count < (sizeof(iov) / sizeof(iov[0]))); i++)
+    {
+        iov[iov_count].iov_base = (void*)chunks[i].data;
+        iov[iov_count].iov_len = chunks[i].data_len;
+        iov_count++;
+    }
+    
+    uint32_t first = 0;
+    while (first < iov_count)
+    {
+        ssize_t written = writev(link->fd, &iov[first], (int)(iov_count - first));
+        
+        if (written < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                if (fd_writable_wait(link->fd, link->link.between_bytes_timeout_ms) == false)
+                {
+                    return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+                }
+                continue;
+            }
+            
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+        }
+        
+        //Partial write, skip what is already sent
+        while ((first < iov_count) && ((size_t)written >= iov[first].iov_len))
+        {
+            written -= iov[first].iov_len;
+            first++;
+        }
+        
+        if (first < iov_count)
+        {
+            iov[first].iov_base = (uint8_t*)iov[first].iov_base + written;
+            iov[first].iov_len -= written;
+        }
+    }
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t link_write(void * user,
+                                           const uint8_t * data,
+                                           uint16_t data_len)
+{
+    bridge_write_chunk_t chunk = { .data = data, .data_len = data_len };
+    
+    return link_write_vector(user, &chunk, 1);
+}
+
+//Answers may be sent by other threads (see bridge_dispatcher.h), so the state of the link is changed under its lock.
+//Handlers are called without the lock, they take it themselves to send answers.
+static void link_state_lock(bridge_server_link_t * link,
+                            bool lock)
+{
+    bridge_server_t * server = link->server;
+    
+    if (server->link_lock_get == NULL)
+    {
+        return;
+    }
+    
+    pthread_mutex_t * link_lock = server->link_lock_get(server->link_lock_context, link);
+    if (lock)
+    {
+        pthread_mutex_lock(link_lock);
+    }
+    else
+    {
+        pthread_mutex_unlock(link_lock);
+    }
+}
+
+static bridge_server_request_handler_t handler_find(const bridge_server_t * server,
+                                                    bridge_request_type_t request_type,
+                                                    void ** out_context)
+{
+    if (request_type >= BRIDGE_REQUEST_TYPE_COUNT)
+    {
+        return NULL;
+    }
+    
+    *out_context = server->handlers[request_type].context;
+    return server->handlers[request_type].handler;
+}
+
+static void parser_event_handler(void * context,
+                                 const bridge_parser_event_t * event)
+{
+    bridge_server_link_t * link = (bridge_server_link_t*)context;
+    
+    switch (event->type)
+    {
+        case BRIDGE_PARSER_EVENT_REQUEST:
+        {
+            //Requests without handler are not answered, so they are not reported to the link:
+            //tagged link would give their tags to answers of later requests
+            void * handler_context;
+            bridge_server_request_handler_t handler = handler_find(link->server, event->request_type, &handler_context);
+            
+            //Client keeps no more requests in flight than allowed, so more of them means lost sync
+            link_state_lock(link, true);
+            link->link.stats.frames_received++;
+            bool accepted = (handler == NULL) || bridge_link_request_received(&link->link, event->tag, event->request);
+            if (accepted == false)
+            {
+                bridge_link_request_corrupted(&link->link);
+            }
+            link_state_lock(link, false);
+            
+            if (accepted == false)
+            {
+                bridge_parser_recover(&link->parser);
+            }
+            
+            if ((handler == NULL) || (accepted == false))
+            {
+                break;
+            }
+            
+            link->server->requests_dispatched++;
+            handler(link, event->request, handler_context);
+            break;
+        }
+        
+        case BRIDGE_PARSER_EVENT_CORRUPTED:
+        {
+            link_state_lock(link, true);
+            bridge_link_request_corrupted(&link->link);
+            link_state_lock(link, false);
+            break;
+        }
+        
+        case BRIDGE_PARSER_EVENT_SKIPPED:
+        {
+            link_state_lock(link, true);
+            bridge_link_data_skipped(&link->link);
+            link_state_lock(link, false);
+            break;
+        }
+        
+        default:
+        {
+            break;
+        }
+    }
+}
+
+static void link_close(bridge_server_link_t * link)
+{
+    bridge_server_t * server = link->server;
+    
+    bridge_server_link_remove(link);
+    
+    if (server->closed_handler != NULL)
+    {
+        server->closed_handler(link, server->closed_context);
+    }
+}
+
+//Level triggered epoll reports the descriptor again if more data is left, so links are served fairly
+static void link_data_process(bridge_server_link_t * link,
+                              uint64_t now_ms)
+{
+    uint8_t buffer[BRIDGE_SERVER_READ_BUFFER_SIZE];
+    
+    ssize_t received = read(link->fd, buffer, sizeof(buffer));
+    
+    if (received > 0)
+    {
+        link->last_data_ms = now_ms;
+        
+        link_state_lock(link, true);
+        link->link.stats.bytes_received += (uint32_t)received;
+        
+        //Parser reads the bus instead of the link, so the link capture is fed here
+        if (link->link.capture != NULL)
+        {
+            bridge_write_chunk_t chunk = { .data = buffer, .data_len = (uint16_t)received };
+            link->link.capture(link->link.capture_context, BRIDGE_LINK_CAPTURE_RECEIVED, link->link.options, &chunk, 1);
+        }
+        
+        //Message format is negotiated on the link, so its current options go to the parser
+        bridge_parser_options_set(&link->parser, link->link.options);
+        link_state_lock(link, false);
+        
+        bridge_parser_feed(&link->parser, buffer, (size_t)received);
+        return;
+    }
+    
+    if ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    {
+        return;
+    }
+    
+    if (received < 0)
+    {
+        link->link.stats.io_errors++;
+    }
+    
+    link_close(link);
+}
+
+//Parser knows nothing about time, so every link is told how long it has been silent
+static void links_idle_process(bridge_server_t * server,
+                               uint64_t now_ms)
+{
+    if ((now_ms - server->idle_checked_ms) < BRIDGE_SERVER_IDLE_CHECK_PERIOD_MS)
+    {
+        return;
+    }
+    
+    server->idle_checked_ms = now_ms;
+    
+    bridge_server_link_t * link = server->links;
+    while (link != NULL)
+    {
+        //Link may be removed by event handler
+        bridge_server_link_t * next = link->next;
+        
+        //Timeouts of the link may be changed at any time, e.g. by bridge_link_baud_set()
+        bridge_parser_timeouts_set(&link->parser, 
+                                   link->link.between_bytes_timeout_ms, 
+                                   link->link.wait_answer_timeout_ms, 
+                                   link->link.recover_timeout_ms);
+        bridge_parser_idle(&link->parser, (uint32_t)(now_ms - link->last_data_ms));
+        
+        link = next;
+    }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool bridge_server_init(bridge_server_t * server,
+                        bridge_server_link_closed_handler_t closed_handler,
+                        void * context)
+{
+    memset(server, 0, sizeof(*server));
+    
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0)
+    {
+        return false;
+    }
+    
+    server->closed_handler = closed_handler;
+    server->closed_context = context;
+    server->idle_checked_ms = time_ms_get();
+    
+    return true;
+}
+
+void bridge_server_deinit(bridge_server_t * server)
+{
+    while (server->links != NULL)
+    {
+        bridge_server_link_remove(server->links);
+    }
+    
+    close(server->epoll_fd);
+    server->epoll_fd = -1;
+}
+
+bool bridge_server_handler_register(bridge_server_t * server,
+                                    bridge_request_type_t request_type,
+                                    bridge_server_request_handler_t handler,
+                                    void * context)
+{
+    if ((request_type == BRIDGE_REQUEST_TYPE_UNDEFINED) || (request_type >= BRIDGE_REQUEST_TYPE_COUNT))
+    {
+        return false;
+    }
+    
+    server->handlers[request_type].handler = handler;
+    server->handlers[request_type].context = context;
+    
+    return true;
+}
+
+bool bridge_server_link_add(bridge_server_t * server,
+                            bridge_server_link_t * link,
+                            int fd,
+                            uint32_t options)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        return false;
+    }
+    
+    bridge_link_init(&link->link, link_read, link_write, link);
+    link->link.write_vector = link_write_vector;
+    link->link.options = options;
+    
+    bridge_parser_init(&link->parser, BRIDGE_PARSER_MODE_REQUEST, parser_event_handler, link);
+    if (options & BRIDGE_LINK_OPTION_SYNC)
+    {
+        bridge_parser_sync_enable(&link->parser);
+    }
+    
+    link->server = server;
+    link->fd = fd;
+    link->pending_head = NULL;
+    link->pending_tail = NULL;
+    link->last_data_ms = time_ms_get();
+    
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = link;
+    
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        return false;
+    }
+    
+    link->prev = NULL;
+    link->next = server->links;
+    if (server->links != NULL)
+    {
+        server->links->prev = link;
+    }
+    server->links = link;
+    server->links_count++;
+    
+    return true;
+}
+
+void bridge_server_link_remove(bridge_server_link_t * link)
+{
+    bridge_server_t * server = link->server;
+    
+    if (server == NULL)
+    {
+        return;
+    }
+    
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, link->fd, NULL);
+    
+    if (link->prev != NULL)
+    {
+        link->prev->next = link->next;
+    }
+    else
+    {
+        server->links = link->next;
+    }
+    
+    if (link->next != NULL)
+    {
+        link->next->prev = link->prev;
+    }
+    
+    server->links_count--;
+    link->server = NULL;
+    link->prev = NULL;
+    link->next = NULL;
+}
+
+int32_t bridge_server_process(bridge_server_t * server,
+                              int32_t timeout_ms)
+{
+    struct epoll_event events[BRIDGE_SERVER_MAX_EVENTS];
+    
+    //Idle checks need regular wakeups while any link is registered
+    if ((server->links != NULL) && ((timeout_ms < 0) || (timeout_ms > BRIDGE_SERVER_IDLE_CHECK_PERIOD_MS)))
+    {
+        timeout_ms = BRIDGE_SERVER_IDLE_CHECK_PERIOD_MS;
+    }
+    
+    int events_count = epoll_wait(server->epoll_fd, events, BRIDGE_SERVER_MAX_EVENTS, timeout_ms);
+    if (events_count < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    
+    server->requests_dispatched = 0;
+    uint64_t now_ms = time_ms_get();
+    
+    for (int i = 0; i < events_count; i++)
+    {
+        bridge_server_link_t * link = (bridge_server_link_t*)events[i].data.ptr;
+        
+        //Link may be removed by handler of the previous event
+        if (link->server != server)
+        {
+            continue;
+        }
+        
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            link_data_process(link, now_ms);
+        }
+    }
+    
+    links_idle_process(server, now_ms);
+    
+    return (int32_t)server->requests_dispatched;
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#ifndef _BRIDGE_SERVER_H_
+#define _BRIDGE_SERVER_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_server Multi-link server runtime (Linux)
+ *
+ * @brief Single threaded server which serves any number of links (ttys, sockets, pipes) with epoll.
+ *
+ * Every link is a file descriptor registered by bridge_server_link_add(). Received data is fed to
+ * the link's non-blocking parser (see bridge_parser.h), complete requests are dispatched to handlers
+ * registered by bridge_server_handler_register(). Handler answers through the link context, e.g.
+ * bridge_link_get_device_info_answer(&link->link, ...). Requests without registered handler are not answered,
+ * handler which leaves the request unanswered reports it by bridge_link_request_unanswered().
+ * Handlers are indexed by request type, so dispatch takes the same time for any number of request types.
+ *
+ * Recovery after corrupted messages is done by the parser, so one noisy link never blocks others.
+ * Timeouts of link->link are applied to its parser, so they may be set per link after bridge_server_link_add(),
+ * e.g. by bridge_link_baud_set(). Idle links are checked every BRIDGE_SERVER_IDLE_CHECK_PERIOD_MS.
+ * On tagged links (BRIDGE_LINK_OPTION_TAGGED) answers carry tags of their requests, requests are answered in order.
+ *
+ * Application calls bridge_server_process() in a loop.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_parser.h"
+
+#define BRIDGE_SERVER_MAX_EVENTS            64
+#define BRIDGE_SERVER_READ_BUFFER_SIZE      512
+#define BRIDGE_SERVER_IDLE_CHECK_PERIOD_MS  10
+
+typedef struct bridge_server_s bridge_server_t;
+typedef struct bridge_server_link_s bridge_server_link_t;
+struct bridge_dispatcher_job_s;
+
+/**@brief Request handler.
+ *
+ * @param[in] link    Link the request is received from.
+ * @param[in] request Received request, valid only during handler call.
+ * @param[in] context Context passed to bridge_server_handler_register().
+ */
+typedef void (*bridge_server_request_handler_t)(bridge_server_link_t * link,
+                                                const bridge_request_t * request,
+                                                void * context);
+
+/**@brief Get lock of link state shared with other threads. Internal, see bridge_dispatcher.h.
+ *
+ * @param[in] context Context of the lock owner.
+ * @param[in] link    Link.
+ *
+ * @return Lock of the link.
+ */
+typedef pthread_mutex_t * (*bridge_server_link_lock_get_t)(void * context,
+                                                           const bridge_server_link_t * link);
+
+/**@brief Link closed handler. Called when the peer has closed the link or I/O error occured,
+ *        link is already removed from the server. File descriptor is not closed by the server.
+ *
+ * @param[in] link    Closed link.
+ * @param[in] context Context passed to bridge_server_init().
+ */
+typedef void (*bridge_server_link_closed_handler_t)(bridge_server_link_t * link,
+                                                    void * context);
+
+/**@brief Server link. Allocated by application and registered by bridge_server_link_add(). */
+struct bridge_server_link_s
+{
+    bridge_link_t link;                                         /**< Link context, answers are sent through it. */
+    void * user;                                                /**< User data pointer, not used by the server. */
+    
+    //Internal fields
+    bridge_server_t * server;
+    int fd;
+    bridge_parser_t parser;
+    uint64_t last_data_ms;                                      //Time of the last received data
+    bridge_server_link_t * prev;
+    bridge_server_link_t * next;
+    struct bridge_dispatcher_job_s * pending_head;             //Requests not answered yet in receive order (see bridge_dispatcher.h)
+    struct bridge_dispatcher_job_s * pending_tail;
+};
+
+/**@brief Request handler registration. */
+typedef struct
+{
+    bridge_server_request_handler_t handler;                    /**< Handler. */
+    void * context;                                             /**< Context passed to handler. */
+} bridge_server_handler_t;
+
+/**@brief Server instance. Fields are internal, use bridge_server_*() functions only. */
+struct bridge_server_s
+{
+    int epoll_fd;
+    bridge_server_link_closed_handler_t closed_handler;
+    void * closed_context;
+    bridge_server_handler_t handlers[BRIDGE_REQUEST_TYPE_COUNT]; //Indexed by request type
+    uint32_t links_count;
+    bridge_server_link_t * links;                               //List of links for idle checks
+    uint64_t idle_checked_ms;
+    uint32_t requests_dispatched;                               //Requests dispatched by the current process call
+    bridge_server_link_lock_get_t link_lock_get;                //Links are answered by other threads too, NULL if not
+    void * link_lock_context;
+};
+
+/**@brief Initialize server.
+ *
+ * @param[out] server         Server instance.
+ * @param[in]  closed_handler Link closed handler. May be NULL.
+ * @param[in]  context        Context passed to closed handler.
+ *
+ * @retval true  Server initialized.
+ * @retval false epoll instance can't be created.
+ */
+bool bridge_server_init(bridge_server_t * server,
+                        bridge_server_link_closed_handler_t closed_handler,
+                        void * context);
+
+/**@brief Release server resources. Registered links are removed, their file descriptors are not closed.
+ *
+ * @param[in] server Server instance.
+ */
+void bridge_server_deinit(bridge_server_t * server);
+
+/**@brief Register handler for requests of given type. Handler registered for the same type is replaced.
+ *
+ * @param[in] server       Server instance.
+ * @param[in] request_type Type of request.
+ * @param[in] handler      Handler.
+ * @param[in] context      Context passed to handler.
+ *
+ * @retval true  Handler registered.
+ * @retval false Request type is not listed in BRIDGE_REQUEST_LIST.
+ */
+bool bridge_server_handler_register(bridge_server_t * server,
+                                    bridge_request_type_t request_type,
+                                    bridge_server_request_handler_t handler,
+                                    void * context);
+
+/**@brief Add link to the server. File descriptor is switched to non-blocking mode.
+ *        Link starts in recovery state as protocol requires.
+ *
+ * @param[in] server  Server instance.
+ * @param[in] link    Link to add. Should stay valid until removed.
+ * @param[in] fd      File descriptor of the link.
+ * @param[in] options Link options, combination of bridge_link_option_t.
+ *
+ * @retval true  Link added.
+ * @retval false File descriptor can't be registered.
+ */
+bool bridge_server_link_add(bridge_server_t * server,
+                            bridge_server_link_t * link,
+                            int fd,
+                            uint32_t options);
+
+/**@brief Remove link from the server. File descriptor is not closed.
+ *        May be called from handlers, also for the link being served. Link memory should stay
+ *        valid until bridge_server_process() returns.
+ *
+ * @param[in] link Link to remove.
+ */
+void bridge_server_link_remove(bridge_server_link_t * link);
+
+/**@brief Wait for data on links and process it. Handlers are called from this function.
+ *
+ * @param[in] server     Server instance.
+ * @param[in] timeout_ms Maximal time to wait for data, -1 means wait forever.
+ *
+ * @return Number of requests dispatched to handlers or -1 if waiting failed.
+ */
+int32_t bridge_server_process(bridge_server_t * server,
+                              int32_t timeout_ms);
+
+#endif
+
+/** @} */
\ No newline at end of file
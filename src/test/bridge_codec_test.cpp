@@ -0,0 +1,356 @@
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_codec_test C++ codec against C links (Linux)
+ *
+ * @brief Messages of bridge::frame (bridge_protocol.hpp) are compared byte for byte with those written by
+ * C links over in-process loopback (bridge_loopback.h), for every combination of link options. Every message
+ * is also decoded by the other side: frames written by C links by bridge::frame, frames encoded by bridge::frame
+ * by C links. The header is compiled by this test only, so the test keeps it building with C++17.
+ *
+ * Usage: bridge_codec_test [test], by default all test cases are run.
+ *
+ * @{
+ */
+
+#include "protocol/bridge_protocol.hpp"
+
+extern "C"
+{
+#include "transport/bridge_loopback.h"
+}
+
+#include <cstdio>
+#include <cstring>
+
+#define TEST_HARDWARE_VERSION   3
+#define TEST_FIRMWARE_VERSION   0x00010204
+#define TEST_ALL_OPTIONS        (BRIDGE_LINK_OPTION_COMPACT | BRIDGE_LINK_OPTION_SYNC | BRIDGE_LINK_OPTION_TAGGED)
+
+//Failed check is printed and fails the test case, the rest of the case still runs
+#define TEST_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("    %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            m_failed_checks++; \
+        } \
+    } while (0)
+
+/**@brief Test case. */
+typedef struct
+{
+    const char * name;
+    void (*run)(void);
+} test_case_t;
+
+/**@brief Client link on end 1 of loopback, server link on end 0. Both run in the thread of the test,
+ *        messages written by one link are read raw from the other end or decoded by the other link.
+ */
+typedef struct
+{
+    bridge_loopback_t loopback;
+    bridge_link_t server;
+    bridge_link_t client;
+} test_links_t;
+
+static const device_info_t m_info = { TEST_HARDWARE_VERSION, TEST_FIRMWARE_VERSION };
+
+static uint32_t m_failed_checks;
+
+//Checksum is the last two bytes of the frame, little endian
+template <size_t Size>
+static constexpr uint16_t frame_checksum_get(const std::array<uint8_t, Size> & frame)
+{
+    return static_cast<uint16_t>(frame[Size - 2] | (frame[Size - 1] << 8));
+}
+
+//Reference checksums of GET_DEVICE_INFO request, so the C++ codec is checked at compile time too
+static_assert(frame_checksum_get(bridge::frame<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO>::request_encode()) == 0xE378,
+              "Checksum of standard GET_DEVICE_INFO request differs from reference");
+static_assert(frame_checksum_get(bridge::frame<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, TEST_ALL_OPTIONS>::request_encode({}, 7)) == 0x3B6B,
+              "Checksum of compact synchronized GET_DEVICE_INFO request with tag 7 differs from reference");
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Features are not offered, so nothing is negotiated and no answer is compressed
+static bool links_init(test_links_t & links,
+                       uint32_t options)
+{
+    if (!bridge_loopback_init(&links.loopback))
+    {
+        return false;
+    }
+    
+    bridge_loopback_link_init(&links.loopback, 0, &links.server);
+    bridge_loopback_link_init(&links.loopback, 1, &links.client);
+    links.server.options = options;
+    links.client.options = options;
+    links.client.features = 0;
+    
+    return true;
+}
+
+//Everything written to the other end so far, no thread writes concurrently
+static size_t raw_read(bridge_link_t & link,
+                       uint8_t * data,
+                       size_t max_len)
+{
+    size_t len = 0;
+    uint16_t read_len = 0;
+    
+    while ((len < max_len) &&
+           (link.read(link.user, &data[len], static_cast<uint16_t>(max_len - len), &read_len, 0) == BRIDGE_CALLBACK_RESULT_SUCCESS))
+    {
+        len += read_len;
+    }
+    
+    return len;
+}
+
+template <size_t Size>
+static bool raw_equal(const uint8_t * data,
+                      size_t data_len,
+                      const std::array<uint8_t, Size> & expected)
+{
+    return (data_len == Size) && (memcmp(data, expected.data(), Size) == 0);
+}
+
+//Wire layout of C++ data, compared instead of structures so padding doesn't matter
+template <typename T>
+static std::array<uint8_t, bridge::schema<T>::size + 1> wire_get(const T & data)
+{
+    std::array<uint8_t, bridge::schema<T>::size + 1> wire{};
+    bridge::schema<T>::encode(data, wire.data());
+    
+    return wire;
+}
+
+static bridge_protocol_result_t answer_result_get(bridge_answer_type_t answer_type)
+{
+    switch (answer_type)
+    {
+        case BRIDGE_ANSWER_TYPE_SUCCESS:
+        {
+            return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+        }
+        
+        case BRIDGE_ANSWER_TYPE_REQUEST_REJECTED:
+        {
+            return BRIDGE_PROTOCOL_RESULT_REQUEST_REJECTED;
+        }
+        
+        default:
+        {
+            return BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS;
+        }
+    }
+}
+
+//Request goes client to server and answer back twice: written by C link and decoded by C++, encoded by C++ and decoded by C link
+template <bridge_request_type_t Type, uint32_t Options>
+static void exchange_check(test_links_t & links,
+                           const typename bridge::request_traits<Type>::request_t & request_data,
+                           bridge_answer_type_t answer_type,
+                           const typename bridge::request_traits<Type>::answer_t & answer_data)
+{
+    using frame = bridge::frame<Type, Options>;
+    using request_t = typename frame::request_t;
+    using answer_t = typename frame::answer_t;
+    
+    uint8_t data[BRIDGE_FRAME_MAX_SIZE];
+    auto request_wire = wire_get(request_data);
+    auto answer_wire = wire_get(answer_data);
+    bridge_protocol_result_t answer_result = answer_result_get(answer_type);
+    
+    bridge_request_t request = {};
+    request.type = Type;
+    bridge_frame_request_data_decode(request_wire.data(), &request);
+    
+    uint8_t tag = 0;
+    TEST_CHECK(bridge_link_request_send(&links.client, &request, &tag) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    
+    auto request_frame = frame::request_encode(request_data, tag);
+    size_t data_len = raw_read(links.server, data, sizeof(data));
+    TEST_CHECK(raw_equal(data, data_len, request_frame));
+    
+    request_t decoded_request{};
+    uint8_t decoded_tag = 0;
+    TEST_CHECK(frame::request_decode(data, data_len, decoded_request, &decoded_tag) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(wire_get(decoded_request) == request_wire);
+    TEST_CHECK(!frame::tagged || (decoded_tag == tag));
+    
+    TEST_CHECK(links.client.write(links.client.user, request_frame.data(), request_frame.size()) == BRIDGE_CALLBACK_RESULT_SUCCESS);
+    
+    bridge_request_t received = {};
+    TEST_CHECK(bridge_link_request_read(&links.server, 0, &received) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(received.type == Type);
+    
+    decltype(request_wire) received_wire{};
+    bridge_frame_request_data_encode(&received, received_wire.data());
+    TEST_CHECK(received_wire == request_wire);
+    
+    bridge_answer_t answer = {};
+    answer.type = answer_type;
+    bridge_frame_answer_data_decode(Type, answer_type, answer_wire.data(), &answer.data);
+    TEST_CHECK(bridge_link_answer_send(&links.server, Type, &answer) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    
+    data_len = raw_read(links.client, data, sizeof(data));
+    
+    answer_t decoded_answer{};
+    decoded_tag = 0;
+    TEST_CHECK(frame::answer_decode(data, data_len, decoded_answer, &decoded_tag) == answer_result);
+    TEST_CHECK(!frame::tagged || (decoded_tag == tag));
+    
+    if (answer_type == BRIDGE_ANSWER_TYPE_SUCCESS)
+    {
+        auto answer_frame = frame::answer_encode(answer_data, tag);
+        TEST_CHECK(raw_equal(data, data_len, answer_frame));
+        TEST_CHECK(wire_get(decoded_answer) == answer_wire);
+        TEST_CHECK(links.server.write(links.server.user, answer_frame.data(), answer_frame.size()) == BRIDGE_CALLBACK_RESULT_SUCCESS);
+    }
+    else
+    {
+        auto answer_frame = frame::answer_encode(answer_type, tag);
+        TEST_CHECK(raw_equal(data, data_len, answer_frame));
+        TEST_CHECK(links.server.write(links.server.user, answer_frame.data(), answer_frame.size()) == BRIDGE_CALLBACK_RESULT_SUCCESS);
+    }
+    
+    bridge_answer_t received_answer = {};
+    bridge_request_type_t received_type = BRIDGE_REQUEST_TYPE_FORCE_SIZE_32BITS;
+    uint8_t received_tag = 0;
+    TEST_CHECK(bridge_link_answer_receive(&links.client, &received_tag, &received_type, &received_answer) == answer_result);
+    TEST_CHECK(received_type == Type);
+    TEST_CHECK(!frame::tagged || (received_tag == tag));
+    
+    if (answer_type == BRIDGE_ANSWER_TYPE_SUCCESS)
+    {
+        decltype(answer_wire) received_answer_wire{};
+        bridge_frame_answer_data_encode(Type, answer_type, &received_answer.data, received_answer_wire.data());
+        TEST_CHECK(received_answer_wire == answer_wire);
+    }
+}
+
+//Links agree no features, so the version is answered without them
+template <uint32_t Options>
+static void exchanges_check(void)
+{
+    test_links_t links;
+    TEST_CHECK(links_init(links, Options));
+    
+    bridge_match_protocol_version_request_t version_request = { BRIDGE_PROTOCOL_VERSION };
+    bridge_match_protocol_version_answer_t version_answer = { BRIDGE_PROTOCOL_VERSION };
+    exchange_check<BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION, Options>(links, version_request, BRIDGE_ANSWER_TYPE_SUCCESS, version_answer);
+    
+    bridge_get_device_info_answer_t info_answer = { m_info };
+    exchange_check<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, Options>(links, bridge::empty{}, BRIDGE_ANSWER_TYPE_SUCCESS, info_answer);
+    exchange_check<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, Options>(links, bridge::empty{}, BRIDGE_ANSWER_TYPE_REQUEST_REJECTED, info_answer);
+    exchange_check<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, Options>(links, bridge::empty{}, BRIDGE_ANSWER_TYPE_WRONG_REQUEST_ARGUMENTS, info_answer);
+    
+    bridge_loopback_deinit(&links.loopback);
+}
+
+//Checksums are checked on frames of C links here, bridge::frame ones are checked by static_assert
+template <uint32_t Options>
+static void request_checksum_check(uint8_t tag,
+                                   uint16_t expected_crc)
+{
+    using frame = bridge::frame<BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, Options>;
+    
+    test_links_t links;
+    TEST_CHECK(links_init(links, Options));
+    
+    bridge_request_t request = {};
+    request.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
+    
+    //Tag of the reference request is reached by exchanges of the links themselves
+    for (uint8_t i = 0; i < tag; i++)
+    {
+        bridge_request_t received = {};
+        bridge_answer_t answer = {};
+        TEST_CHECK(bridge_link_request_send(&links.client, &request, NULL) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(bridge_link_request_read(&links.server, 0, &received) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(bridge_link_get_device_info_answer(&links.server, &m_info) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(bridge_link_answer_receive(&links.client, NULL, NULL, &answer) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    }
+    
+    uint8_t sent_tag = 0;
+    TEST_CHECK(bridge_link_request_send(&links.client, &request, &sent_tag) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(sent_tag == tag);
+    
+    uint8_t data[BRIDGE_FRAME_MAX_SIZE];
+    size_t data_len = raw_read(links.server, data, sizeof(data));
+    TEST_CHECK(data_len == frame::request_size);
+    TEST_CHECK((data_len >= 2) && (static_cast<uint16_t>(data[data_len - 2] | (data[data_len - 1] << 8)) == expected_crc));
+    
+    bridge_loopback_deinit(&links.loopback);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static void checksum_reference_test(void)
+{
+    request_checksum_check<0>(0, 0xE378);
+    request_checksum_check<TEST_ALL_OPTIONS>(7, 0x3B6B);
+}
+
+static void standard_test(void)
+{
+    exchanges_check<0>();
+}
+
+static void compact_test(void)
+{
+    exchanges_check<BRIDGE_LINK_OPTION_COMPACT>();
+}
+
+static void sync_test(void)
+{
+    exchanges_check<BRIDGE_LINK_OPTION_SYNC>();
+}
+
+static void tagged_test(void)
+{
+    exchanges_check<BRIDGE_LINK_OPTION_TAGGED>();
+}
+
+static void all_options_test(void)
+{
+    exchanges_check<TEST_ALL_OPTIONS>();
+}
+
+static const test_case_t m_tests[] =
+{
+    { "checksum_reference",     checksum_reference_test },
+    { "standard",               standard_test },
+    { "compact",                compact_test },
+    { "sync",                   sync_test },
+    { "tagged",                 tagged_test },
+    { "all_options",            all_options_test },
+};
+
+int main(int argc, char ** argv)
+{
+    uint32_t failed = 0;
+    
+    for (size_t i = 0; i < (sizeof(m_tests) / sizeof(m_tests[0])); i++)
+    {
+        if ((argc > 1) && (strcmp(argv[1], m_tests[i].name) != 0))
+        {
+            continue;
+        }
+        
+        m_failed_checks = 0;
+        m_tests[i].run();
+        
+        printf("%-24s %s\n", m_tests[i].name, (m_failed_checks == 0) ? "passed" : "FAILED");
+        failed += (m_failed_checks == 0) ? 0 : 1;
+    }
+    
+    return static_cast<int>(failed);
+}
+
+/** @} */
\ No newline at end of file
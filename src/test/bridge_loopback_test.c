@@ -0,0 +1,915 @@
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_loopback_test Protocol tests over in-process loopback (Linux)
+ *
+ * @brief Client and server links joined by bridge_loopback.h, so the protocol is tested end to end
+ * without hardware. Runtimes (bridge_server.h, bridge_client.h) take descriptors, they are joined by
+ * a socket pair instead. Every test case is a function in m_tests, it creates its own loopback and server
+ * thread if it needs them. Exit status is the number of failed test cases.
+ *
+ * Usage: bridge_loopback_test [test], by default all test cases are run.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+
+#include "protocol/bridge_protocol.h"
+#include "protocol/bridge_batch.h"
+#include "protocol/bridge_checksum.h"
+#include "protocol/bridge_transfer.h"
+#include "protocol/bridge_parser.h"
+#include "transport/bridge_loopback.h"
+#include "server/bridge_server.h"
+#include "server/bridge_dispatcher.h"
+#include "client/bridge_client.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#define TEST_HARDWARE_VERSION   3
+#define TEST_FIRMWARE_VERSION   0x00010204
+#define TEST_WINDOW             4
+#define TEST_WORKERS            2
+#define TEST_WAITS              50                              /**< Waits of 100 ms for calls to complete. */
+#define TEST_TRANSFER_CHUNKS    (TEST_WINDOW * 2)
+#define TEST_TRANSFER_SIZE      (((TEST_TRANSFER_CHUNKS - 1) * BRIDGE_PROTOCOL_CHUNK_MAX_SIZE) + 100)  /**< Last chunk is shorter than the others. */
+
+//Noise between messages of synchronized link, no sync byte 0 in it
+static const uint8_t m_noise[] = { 0x00, 0x11, 0x22, 0x33, 0x5A };
+
+//Failed check is printed and fails the test case, the rest of the case still runs
+#define TEST_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("    %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            m_failed_checks++; \
+        } \
+    } while (0)
+
+/**@brief Test case. */
+typedef struct
+{
+    const char * name;
+    void (*run)(void);
+} test_case_t;
+
+/**@brief Loopback with a server thread on its end 0, client link on end 1. */
+typedef struct
+{
+    bridge_loopback_t loopback;
+    bridge_link_t server;
+    bridge_link_t client;
+    pthread_t thread;
+} test_fixture_t;
+
+/**@brief Server and client runtimes joined by a socket pair. Server runs in its own thread
+ *        until the client closes the link.
+ */
+typedef struct
+{
+    int fds[2];
+    bridge_server_t server;
+    bridge_server_link_t server_link;
+    pthread_t thread;
+    bool stop;                                                  //Set by the server thread only
+    bridge_client_t client;
+    bridge_client_link_t client_link;
+} test_runtime_t;
+
+/**@brief Server of tagged link joined to client by a socket pair. It collects a window of TRANSFER_CHUNK requests
+ *        and answers them in reverse order, so client gets answers out of order. Runs in its own thread
+ *        until the client closes the link.
+ */
+typedef struct
+{
+    int fds[2];
+    bridge_link_t link;                                         //Requests are reported to it right before their answers
+    bridge_parser_t parser;
+    pthread_t thread;
+    bridge_request_t requests[TEST_WINDOW];
+    uint8_t tags[TEST_WINDOW];
+    uint8_t requests_count;
+    bridge_link_t client;
+} test_reversing_server_t;
+
+static uint32_t m_failed_checks;
+
+//Transfers are received by the server thread of the fixture, test case initializes the receiver before start
+static bridge_transfer_receiver_t m_receiver;
+static uint8_t m_received[TEST_TRANSFER_SIZE];
+static uint32_t m_chunk_dropped_offset = UINT32_MAX;            //Server drops chunk at this offset once
+
+//Client write callback of the fixture, wrapped to corrupt a message
+static bridge_link_write_callback_t m_client_write;
+static uint32_t m_corrupted_frame;                              //Number of message to corrupt from 1, 0 for none
+
+static bridge_protocol_result_t server_answer(bridge_link_t * link,
+                                              const bridge_request_t * request)
+{
+    device_info_t info =
+    {
+        .hardware_version = TEST_HARDWARE_VERSION,
+        .firmware_version = TEST_FIRMWARE_VERSION
+    };
+    
+    switch (request->type)
+    {
+        case BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION:
+        {
+            return bridge_link_match_protocol_version_answer(link);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES:
+        {
+            return bridge_link_match_capabilities_answer(link);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO:
+        {
+            return bridge_link_get_device_info_answer(link, &info);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_BATCH:
+        {
+            bridge_answer_t answer;
+            bridge_batch_answer_init(&answer);
+            
+            bridge_batch_iterator_t iterator;
+            bridge_request_t item;
+            bridge_batch_request_iterator_init(&iterator, request);
+            while (bridge_batch_request_next(&iterator, &item))
+            {
+                bridge_answer_t item_answer;
+                item_answer.type = BRIDGE_ANSWER_TYPE_SUCCESS;
+                item_answer.data.get_device_info.info = info;
+                bridge_batch_answer_add(&answer, item.type, &item_answer);
+            }
+            
+            return bridge_link_batch_answer(link, &answer);
+        }
+        
+        case BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK:
+        {
+            //Dropped chunk is not answered, as if it was lost on the bus
+            if (request->data.transfer_chunk.offset == m_chunk_dropped_offset)
+            {
+                m_chunk_dropped_offset = UINT32_MAX;
+                bridge_link_request_unanswered(link);
+                return BRIDGE_PROTOCOL_RESULT_SUCCESS;
+            }
+            
+            bridge_answer_t answer;
+            bridge_transfer_chunk_handle(&m_receiver, request, &answer);
+            
+            return bridge_link_answer_send(link, request->type, &answer);
+        }
+        
+        default:
+        {
+            bridge_answer_t answer = { .type = BRIDGE_ANSWER_TYPE_REQUEST_REJECTED };
+            
+            return bridge_link_answer_send(link, request->type, &answer);
+        }
+    }
+}
+
+//Serves requests until the loopback is closed
+static void * server_thread(void * arg)
+{
+    bridge_link_t * link = (bridge_link_t*)arg;
+    
+    while (true)
+    {
+        bridge_request_t request;
+        bridge_protocol_result_t result = bridge_link_request_read(link, UINT32_MAX, &request);
+        
+        if (result == BRIDGE_PROTOCOL_RESULT_IO_ERROR)
+        {
+            break;
+        }
+        
+        if (result == BRIDGE_PROTOCOL_RESULT_SUCCESS)
+        {
+            server_answer(link, &request);
+        }
+    }
+    
+    return NULL;
+}
+
+//Links may be configured between setup and start, both sides are fresh so no recovery is needed
+static bool fixture_setup(test_fixture_t * fixture)
+{
+    if (bridge_loopback_init(&fixture->loopback) == false)
+    {
+        return false;
+    }
+    
+    bridge_loopback_link_init(&fixture->loopback, 0, &fixture->server);
+    bridge_loopback_link_init(&fixture->loopback, 1, &fixture->client);
+    
+    return true;
+}
+
+static void fixture_start(test_fixture_t * fixture)
+{
+    pthread_create(&fixture->thread, NULL, server_thread, &fixture->server);
+}
+
+static void fixture_teardown(test_fixture_t * fixture)
+{
+    bridge_loopback_close(&fixture->loopback);
+    pthread_join(fixture->thread, NULL);
+    bridge_loopback_deinit(&fixture->loopback);
+}
+
+static uint32_t clock_us_get(void * user)
+{
+    (void)user;
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return (uint32_t)(((uint64_t)now.tv_sec * 1000000u) + ((uint64_t)now.tv_nsec / 1000u));
+}
+
+static void runtime_info_handler(bridge_server_link_t * link,
+                                 const bridge_request_t * request,
+                                 void * context)
+{
+    (void)context;
+    
+    server_answer(&link->link, request);
+}
+
+//Answer is preceded by noise, which client skips while hunting for sync bytes
+static void noisy_info_handler(bridge_server_link_t * link,
+                               const bridge_request_t * request,
+                               void * context)
+{
+    (void)context;
+    
+    TEST_CHECK(write(link->fd, m_noise, sizeof(m_noise)) == (ssize_t)sizeof(m_noise));
+    server_answer(&link->link, request);
+}
+
+static bool dispatched_info_handler(bridge_server_link_t * link,
+                                    const bridge_request_t * request,
+                                    bridge_answer_t * out_answer,
+                                    void * context)
+{
+    (void)link;
+    (void)request;
+    (void)context;
+    
+    out_answer->data.get_device_info.info.hardware_version = TEST_HARDWARE_VERSION;
+    out_answer->data.get_device_info.info.firmware_version = TEST_FIRMWARE_VERSION;
+    
+    return true;
+}
+
+static void runtime_link_closed(bridge_server_link_t * link,
+                                void * context)
+{
+    (void)link;
+    
+    ((test_runtime_t*)context)->stop = true;
+}
+
+static void * runtime_server_thread(void * arg)
+{
+    test_runtime_t * runtime = (test_runtime_t*)arg;
+    
+    while (runtime->stop == false)
+    {
+        bridge_server_process(&runtime->server, 10);
+    }
+    
+    return NULL;
+}
+
+//Blocking link on a descriptor, user data is the descriptor
+static bridge_callback_result_t fd_read(void * user,
+                                        uint8_t * data,
+                                        uint16_t max_len,
+                                        uint16_t * out_len,
+                                        uint32_t timeout_ms)
+{
+    struct pollfd descriptor = { .fd = *(int*)user, .events = POLLIN };
+    int ready = poll(&descriptor, 1, (timeout_ms == UINT32_MAX) ? -1 : (int)timeout_ms);
+    if (ready == 0)
+    {
+        return BRIDGE_CALLBACK_RESULT_READ_TIMEOUT;
+    }
+    
+    ssize_t received = (ready > 0) ? read(descriptor.fd, data, max_len) : -1;
+    if (received <= 0)
+    {
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+    }
+    
+    *out_len = (uint16_t)received;
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t fd_write(void * user,
+                                         const uint8_t * data,
+                                         uint16_t data_len)
+{
+    return (write(*(int*)user, data, data_len) == (ssize_t)data_len) ? 
+           BRIDGE_CALLBACK_RESULT_SUCCESS : BRIDGE_CALLBACK_RESULT_IO_ERROR;
+}
+
+//Handlers may be registered between setup and start
+static bool runtime_setup(test_runtime_t * runtime,
+                          uint32_t options)
+{
+    memset(runtime, 0, sizeof(*runtime));
+    
+    return (socketpair(AF_UNIX, SOCK_STREAM, 0, runtime->fds) == 0) && 
+           bridge_server_init(&runtime->server, runtime_link_closed, runtime) && 
+           bridge_server_link_add(&runtime->server, &runtime->server_link, runtime->fds[0], options) && 
+           bridge_client_init(&runtime->client, NULL, NULL) && 
+           bridge_client_link_add(&runtime->client, &runtime->client_link, runtime->fds[1], options);
+}
+
+static void runtime_start(test_runtime_t * runtime)
+{
+    pthread_create(&runtime->thread, NULL, runtime_server_thread, runtime);
+}
+
+//Data may wake the client without completing any call, so it waits a bounded number of times
+static uint32_t runtime_calls_wait(test_runtime_t * runtime,
+                                   uint32_t calls_count)
+{
+    uint32_t completed = 0;
+    for (uint32_t waits = 0; (completed < calls_count) && (waits < TEST_WAITS); waits++)
+    {
+        if (bridge_client_process(&runtime->client, 100) < 0)
+        {
+            break;
+        }
+        
+        while (bridge_client_completed_get(&runtime->client) != NULL)
+        {
+            completed++;
+        }
+    }
+    
+    return completed;
+}
+
+//Calls are submitted at once, returns the number of them completed
+static uint32_t runtime_calls_make(test_runtime_t * runtime,
+                                   bridge_client_call_t * calls,
+                                   uint32_t calls_count)
+{
+    for (uint32_t i = 0; i < calls_count; i++)
+    {
+        TEST_CHECK(bridge_client_call_submit(&runtime->client_link, &calls[i]) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    }
+    
+    return runtime_calls_wait(runtime, calls_count);
+}
+
+static void runtime_teardown(test_runtime_t * runtime)
+{
+    bridge_client_deinit(&runtime->client);
+    shutdown(runtime->fds[1], SHUT_RDWR);
+    pthread_join(runtime->thread, NULL);
+    bridge_server_deinit(&runtime->server);
+    close(runtime->fds[0]);
+    close(runtime->fds[1]);
+}
+
+//Message is corrupted in its last payload byte, so the header stays valid and the checksum fails
+static bridge_callback_result_t corrupting_write(void * user,
+                                                 const uint8_t * data,
+                                                 uint16_t data_len)
+{
+    if ((m_corrupted_frame == 0) || (--m_corrupted_frame > 0))
+    {
+        return m_client_write(user, data, data_len);
+    }
+    
+    uint8_t frame[BRIDGE_FRAME_MAX_SIZE];
+    memcpy(frame, data, data_len);
+    frame[data_len - BRIDGE_FRAME_CHECKSUM_SIZE - 1] ^= 0xFF;
+    
+    return m_client_write(user, frame, data_len);
+}
+
+static void transfer_data_fill(uint8_t * data,
+                               uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        data[i] = (uint8_t)((i * 7) + (i >> 8));
+    }
+}
+
+static void reversing_server_event_handle(void * context,
+                                          const bridge_parser_event_t * event)
+{
+    test_reversing_server_t * server = (test_reversing_server_t*)context;
+    
+    if (event->type != BRIDGE_PARSER_EVENT_REQUEST)
+    {
+        return;
+    }
+    
+    server->requests[server->requests_count] = *event->request;
+    server->tags[server->requests_count] = event->tag;
+    if (++server->requests_count < TEST_WINDOW)
+    {
+        return;
+    }
+    
+    while (server->requests_count > 0)
+    {
+        server->requests_count--;
+        
+        bridge_answer_t answer;
+        const bridge_request_t * request = &server->requests[server->requests_count];
+        TEST_CHECK(bridge_link_request_received(&server->link, server->tags[server->requests_count], request));
+        bridge_transfer_chunk_handle(&m_receiver, request, &answer);
+        bridge_link_answer_send(&server->link, request->type, &answer);
+    }
+}
+
+static void * reversing_server_thread(void * arg)
+{
+    test_reversing_server_t * server = (test_reversing_server_t*)arg;
+    
+    while (true)
+    {
+        uint8_t data[BRIDGE_FRAME_MAX_SIZE];
+        ssize_t received = read(server->fds[0], data, sizeof(data));
+        if (received <= 0)
+        {
+            break;
+        }
+        
+        bridge_parser_feed(&server->parser, data, (size_t)received);
+    }
+    
+    return NULL;
+}
+
+static bool reversing_server_start(test_reversing_server_t * server)
+{
+    memset(server, 0, sizeof(*server));
+    
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, server->fds) != 0)
+    {
+        return false;
+    }
+    
+    bridge_link_init(&server->link, fd_read, fd_write, &server->fds[0]);
+    server->link.options = BRIDGE_LINK_OPTION_TAGGED;
+    bridge_parser_init(&server->parser, BRIDGE_PARSER_MODE_REQUEST, reversing_server_event_handle, server);
+    bridge_parser_options_set(&server->parser, BRIDGE_LINK_OPTION_TAGGED);
+    bridge_parser_idle(&server->parser, BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS);
+    
+    bridge_link_init(&server->client, fd_read, fd_write, &server->fds[1]);
+    server->client.options = BRIDGE_LINK_OPTION_TAGGED;
+    server->client.window = TEST_WINDOW;
+    
+    pthread_create(&server->thread, NULL, reversing_server_thread, server);
+    
+    return true;
+}
+
+static void reversing_server_stop(test_reversing_server_t * server)
+{
+    shutdown(server->fds[1], SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fds[0]);
+    close(server->fds[1]);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static void checksum_check_value_test(void)
+{
+    static const char check[] = "123456789";
+    
+    TEST_CHECK(bridge_checksum_append(bridge_checksum_init(), check, (uint16_t)strlen(check)) == 0x29B1);
+    
+    //Split input gives the same checksum
+    uint16_t crc = bridge_checksum_append(bridge_checksum_init(), check, 4);
+    TEST_CHECK(bridge_checksum_append(crc, &check[4], 5) == 0x29B1);
+}
+
+static void blocking_calls_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    fixture_start(&fixture);
+    
+    uint16_t protocol_version = 0;
+    TEST_CHECK(bridge_link_match_protocol_version(&fixture.client, &protocol_version) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(protocol_version == BRIDGE_PROTOCOL_VERSION);
+    
+    device_info_t info;
+    memset(&info, 0, sizeof(info));
+    TEST_CHECK(bridge_link_get_device_info(&fixture.client, &info) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(info.hardware_version == TEST_HARDWARE_VERSION);
+    TEST_CHECK(info.firmware_version == TEST_FIRMWARE_VERSION);
+    
+    bridge_request_t request;
+    bridge_request_t item = { .type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO };
+    bridge_batch_request_init(&request);
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        TEST_CHECK(bridge_batch_request_add(&request, &item));
+    }
+    
+    bridge_answer_t answer;
+    TEST_CHECK(bridge_link_batch(&fixture.client, &request, &answer) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    
+    uint8_t answered = 0;
+    bridge_batch_iterator_t iterator;
+    bridge_request_type_t item_type;
+    bridge_answer_t item_answer;
+    bridge_batch_answer_iterator_init(&iterator, &answer);
+    while (bridge_batch_answer_next(&iterator, &item_type, &item_answer))
+    {
+        TEST_CHECK(item_answer.data.get_device_info.info.firmware_version == TEST_FIRMWARE_VERSION);
+        answered++;
+    }
+    TEST_CHECK(answered == 3);
+    
+    TEST_CHECK(fixture.client.stats.frames_sent == 3);
+    TEST_CHECK(fixture.client.stats.corrupted == 0);
+    
+    fixture_teardown(&fixture);
+}
+
+//Repeated call is answered from cache, requests with data filled by the link or changing server state are never cached
+static void answer_cache_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    fixture_start(&fixture);
+    
+    static bridge_link_answer_cache_t cache;
+    TEST_CHECK(bridge_link_answer_cache_enable(&fixture.client, &cache, BRIDGE_REQUEST_TYPE_MATCH_CAPABILITIES, 0) == false);
+    TEST_CHECK(bridge_link_answer_cache_enable(&fixture.client, &cache, BRIDGE_REQUEST_TYPE_TRANSFER_CHUNK, 0) == false);
+    TEST_CHECK(bridge_link_answer_cache_enable(&fixture.client, &cache, BRIDGE_REQUEST_TYPE_BATCH, 0) == false);
+    TEST_CHECK(bridge_link_answer_cache_enable(&fixture.client, &cache, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, 0));
+    
+    device_info_t info;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        memset(&info, 0, sizeof(info));
+        TEST_CHECK(bridge_link_get_device_info(&fixture.client, &info) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(info.firmware_version == TEST_FIRMWARE_VERSION);
+    }
+    
+    TEST_CHECK(fixture.client.stats.frames_sent == 1);
+    TEST_CHECK(fixture.client.stats.cache_hits == 2);
+    
+    fixture_teardown(&fixture);
+}
+
+//Every feature is offered and accepted, calls go on in negotiated format
+static void negotiation_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    
+    uint8_t features = BRIDGE_PROTOCOL_FEATURE_COMPRESSION | BRIDGE_PROTOCOL_FEATURE_COMPACT_FRAME |
+                       BRIDGE_PROTOCOL_FEATURE_CAPABILITIES | BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME;
+    fixture.server.features = features;
+    fixture.client.features = features;
+    fixture_start(&fixture);
+    
+    uint16_t protocol_version = 0;
+    TEST_CHECK(bridge_link_match_protocol_version(&fixture.client, &protocol_version) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(protocol_version == BRIDGE_PROTOCOL_VERSION);
+    TEST_CHECK(fixture.client.options == (BRIDGE_LINK_OPTION_COMPACT | BRIDGE_LINK_OPTION_SYNC));
+    
+    device_info_t info;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        memset(&info, 0, sizeof(info));
+        TEST_CHECK(bridge_link_get_device_info(&fixture.client, &info) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(info.firmware_version == TEST_FIRMWARE_VERSION);
+    }
+    
+    fixture_teardown(&fixture);
+}
+
+//Transfer keeps within limits agreed with the server: fewer chunks in flight than client window, payload smaller than chunk
+static void transfer_agreed_limits_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    fixture.server.features = BRIDGE_PROTOCOL_FEATURE_CAPABILITIES;
+    fixture.server.accept_window = 2;
+    fixture.server.max_payload_size = BRIDGE_PROTOCOL_CHUNK_MAX_SIZE / 2;
+    fixture.client.features = BRIDGE_PROTOCOL_FEATURE_CAPABILITIES;
+    fixture.client.window = TEST_WINDOW;
+    bridge_transfer_receiver_init(&m_receiver, m_received, sizeof(m_received));
+    fixture_start(&fixture);
+    
+    uint16_t protocol_version = 0;
+    TEST_CHECK(bridge_link_match_protocol_version(&fixture.client, &protocol_version) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(fixture.client.window_agreed == 2);
+    
+    uint8_t data[TEST_TRANSFER_SIZE];
+    transfer_data_fill(data, sizeof(data));
+    
+    memset(m_received, 0, sizeof(m_received));
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 1, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(memcmp(m_received, data, sizeof(data)) == 0);
+    
+    fixture_teardown(&fixture);
+}
+
+//Window of chunks is kept in flight, every chunk is sent once and the last shorter one ends the transfer
+static void transfer_chunks_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    fixture.client.window = TEST_WINDOW;
+    bridge_transfer_receiver_init(&m_receiver, m_received, sizeof(m_received));
+    fixture_start(&fixture);
+    
+    uint8_t data[TEST_TRANSFER_SIZE];
+    transfer_data_fill(data, sizeof(data));
+    
+    memset(m_received, 0, sizeof(m_received));
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 1, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(memcmp(m_received, data, sizeof(data)) == 0);
+    TEST_CHECK(m_receiver.acked_offset == sizeof(data));
+    TEST_CHECK(fixture.client.stats.frames_sent == TEST_TRANSFER_CHUNKS);
+    TEST_CHECK(fixture.client.in_flight_count == 0);
+    
+    //Next transfer restarts reception, the one larger than receiver buffer is refused
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 2, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    m_receiver.buffer_size = sizeof(data) - 1;
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 3, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_WRONG_REQUEST_ARGUMENTS);
+    TEST_CHECK(fixture.client.in_flight_count == 0);
+    
+    fixture_teardown(&fixture);
+}
+
+//Empty transfer is a single empty chunk
+static void transfer_empty_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    fixture.client.window = TEST_WINDOW;
+    bridge_transfer_receiver_init(&m_receiver, m_received, sizeof(m_received));
+    fixture_start(&fixture);
+    
+    uint8_t data[1] = { 0 };
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 1, data, 0) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(m_receiver.started);
+    TEST_CHECK(m_receiver.total_size == 0);
+    TEST_CHECK(m_receiver.acked_offset == 0);
+    TEST_CHECK(fixture.client.stats.frames_sent == 1);
+    
+    fixture_teardown(&fixture);
+}
+
+//Answers of tagged link come in reverse order of chunks, older acknowledgements don't stop the transfer
+static void transfer_out_of_order_test(void)
+{
+    static test_reversing_server_t server;
+    bridge_transfer_receiver_init(&m_receiver, m_received, sizeof(m_received));
+    TEST_CHECK(reversing_server_start(&server));
+    
+    uint8_t data[TEST_TRANSFER_SIZE];
+    transfer_data_fill(data, sizeof(data));
+    
+    memset(m_received, 0, sizeof(m_received));
+    TEST_CHECK(bridge_transfer_send(&server.client, 1, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(memcmp(m_received, data, sizeof(data)) == 0);
+    TEST_CHECK(server.client.stats.frames_sent == TEST_TRANSFER_CHUNKS);
+    TEST_CHECK(server.client.stats.timeouts == 0);
+    TEST_CHECK(server.client.stats.corrupted == 0);
+    
+    reversing_server_stop(&server);
+}
+
+//Chunk lost on the way to server or corrupted is sent again after the answer timeout, the rest are not
+static void transfer_retransmission_test(void)
+{
+    test_fixture_t fixture;
+    TEST_CHECK(fixture_setup(&fixture));
+    fixture.server.options = BRIDGE_LINK_OPTION_TAGGED;
+    fixture.client.options = BRIDGE_LINK_OPTION_TAGGED;
+    fixture.client.window = TEST_WINDOW;
+    fixture.client.wait_answer_timeout_ms = BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS;
+    bridge_transfer_receiver_init(&m_receiver, m_received, sizeof(m_received));
+    
+    m_client_write = fixture.client.write;
+    fixture.client.write = corrupting_write;
+    fixture.client.write_vector = NULL;
+    fixture_start(&fixture);
+    
+    uint8_t data[TEST_TRANSFER_SIZE];
+    transfer_data_fill(data, sizeof(data));
+    
+    memset(m_received, 0, sizeof(m_received));
+    m_chunk_dropped_offset = 2 * BRIDGE_PROTOCOL_CHUNK_MAX_SIZE;
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 1, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(memcmp(m_received, data, sizeof(data)) == 0);
+    TEST_CHECK(m_chunk_dropped_offset == UINT32_MAX);
+    TEST_CHECK(fixture.client.stats.timeouts == 1);
+    TEST_CHECK(fixture.client.stats.frames_sent == (TEST_TRANSFER_CHUNKS + 1));
+    
+    memset(m_received, 0, sizeof(m_received));
+    m_corrupted_frame = 3;
+    TEST_CHECK(bridge_transfer_send(&fixture.client, 2, data, sizeof(data)) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(memcmp(m_received, data, sizeof(data)) == 0);
+    TEST_CHECK(fixture.client.stats.timeouts == 2);
+    TEST_CHECK(fixture.client.stats.frames_sent == ((TEST_TRANSFER_CHUNKS + 1) * 2));
+    
+    fixture_teardown(&fixture);
+    
+    TEST_CHECK(fixture.server.stats.checksum_failures == 1);
+}
+
+//Calls fill the window of tagged link at once, answers are matched to them by tag
+static void runtime_tagged_window_test(void)
+{
+    static test_runtime_t runtime;
+    TEST_CHECK(runtime_setup(&runtime, BRIDGE_LINK_OPTION_TAGGED | BRIDGE_LINK_OPTION_SYNC));
+    TEST_CHECK(bridge_server_handler_register(&runtime.server, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, runtime_info_handler, NULL));
+    runtime.client_link.link.window = TEST_WINDOW;
+    runtime_start(&runtime);
+    
+    bridge_client_call_t calls[TEST_WINDOW + 1];
+    memset(calls, 0, sizeof(calls));
+    for (uint8_t i = 0; i < (TEST_WINDOW + 1); i++)
+    {
+        calls[i].request.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
+        TEST_CHECK(bridge_client_call_submit(&runtime.client_link, &calls[i]) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    }
+    
+    //The last call waits for the window
+    TEST_CHECK(runtime.client_link.link.in_flight_count == TEST_WINDOW);
+    
+    TEST_CHECK(runtime_calls_wait(&runtime, TEST_WINDOW + 1) == (TEST_WINDOW + 1));
+    
+    for (uint8_t i = 0; i < (TEST_WINDOW + 1); i++)
+    {
+        TEST_CHECK(calls[i].result == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(calls[i].answer.data.get_device_info.info.firmware_version == TEST_FIRMWARE_VERSION);
+    }
+    TEST_CHECK(runtime.client_link.link.stats.corrupted == 0);
+    
+    runtime_teardown(&runtime);
+}
+
+//Noise before request and answer is skipped, the call waiting for the answer goes on
+static void sync_skipped_data_test(void)
+{
+    static test_runtime_t runtime;
+    TEST_CHECK(runtime_setup(&runtime, BRIDGE_LINK_OPTION_SYNC));
+    TEST_CHECK(bridge_server_handler_register(&runtime.server, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, noisy_info_handler, NULL));
+    runtime_start(&runtime);
+    
+    TEST_CHECK(write(runtime.fds[1], m_noise, sizeof(m_noise)) == (ssize_t)sizeof(m_noise));
+    
+    bridge_client_call_t call;
+    memset(&call, 0, sizeof(call));
+    call.request.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
+    TEST_CHECK(runtime_calls_make(&runtime, &call, 1) == 1);
+    TEST_CHECK(call.result == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(call.answer.data.get_device_info.info.firmware_version == TEST_FIRMWARE_VERSION);
+    TEST_CHECK(runtime.client_link.link.stats.skipped == 1);
+    TEST_CHECK(runtime.client_link.link.stats.corrupted == 0);
+    
+    runtime_teardown(&runtime);
+    
+    TEST_CHECK(runtime.server_link.link.stats.skipped == 1);
+    TEST_CHECK(runtime.server_link.link.stats.corrupted == 0);
+}
+
+//Client drops negotiated sync bytes on its own recovery, server follows on its first standard request
+static void sync_peer_recovery_test(void)
+{
+    static test_runtime_t runtime;
+    TEST_CHECK(runtime_setup(&runtime, 0));
+    TEST_CHECK(bridge_server_handler_register(&runtime.server, BRIDGE_REQUEST_TYPE_MATCH_PROTOCOL_VERSION, runtime_info_handler, NULL));
+    TEST_CHECK(bridge_server_handler_register(&runtime.server, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, runtime_info_handler, NULL));
+    runtime.server_link.link.features = BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME;
+    
+    //Bus is silent before the first request, the server needn't wait for it
+    bridge_parser_idle(&runtime.server_link.parser, BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS);
+    runtime_start(&runtime);
+    
+    //Client runtime of the fixture stays idle, blocking link takes its descriptor
+    bridge_link_t link;
+    bridge_link_init(&link, fd_read, fd_write, &runtime.fds[1]);
+    link.features = BRIDGE_PROTOCOL_FEATURE_SYNC_FRAME;
+    link.wait_answer_timeout_ms = BRIDGE_PROTOCOL_RECOVER_TIMEOUT_MS;
+    
+    uint16_t protocol_version;
+    TEST_CHECK(bridge_link_match_protocol_version(&link, &protocol_version) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(link.options == BRIDGE_LINK_OPTION_SYNC);
+    
+    device_info_t info;
+    TEST_CHECK(bridge_link_get_device_info(&link, &info) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    
+    TEST_CHECK(bridge_link_recover(&link, link.recover_timeout_ms) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(link.options == 0);
+    
+    //Request which makes server drop sync bytes is lost
+    TEST_CHECK(bridge_link_get_device_info(&link, &info) != BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(bridge_link_get_device_info(&link, &info) == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+    TEST_CHECK(info.firmware_version == TEST_FIRMWARE_VERSION);
+    
+    runtime_teardown(&runtime);
+    
+    TEST_CHECK(runtime.server_link.link.options == 0);
+    TEST_CHECK(runtime.server_link.link.stats.corrupted == 1);
+}
+
+//Requests of one link wait for workers together, every one of them gets its own handling time
+static void dispatcher_handling_time_test(void)
+{
+    static test_runtime_t runtime;
+    static bridge_dispatcher_t dispatcher;
+    static bridge_link_histograms_t histograms;
+    TEST_CHECK(runtime_setup(&runtime, BRIDGE_LINK_OPTION_SYNC));
+    TEST_CHECK(bridge_dispatcher_init(&dispatcher, &runtime.server, TEST_WORKERS));
+    TEST_CHECK(bridge_dispatcher_handler_register(&dispatcher, BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO, dispatched_info_handler, NULL, true));
+    runtime.server_link.link.clock = clock_us_get;
+    runtime.server_link.link.histograms = &histograms;
+    runtime.client_link.link.window = TEST_WINDOW;
+    runtime_start(&runtime);
+    
+    bridge_client_call_t calls[TEST_WINDOW * 2];
+    memset(calls, 0, sizeof(calls));
+    for (uint8_t i = 0; i < (TEST_WINDOW * 2); i++)
+    {
+        calls[i].request.type = BRIDGE_REQUEST_TYPE_GET_DEVICE_INFO;
+    }
+    
+    TEST_CHECK(runtime_calls_make(&runtime, calls, TEST_WINDOW * 2) == (TEST_WINDOW * 2));
+    for (uint8_t i = 0; i < (TEST_WINDOW * 2); i++)
+    {
+        TEST_CHECK(calls[i].result == BRIDGE_PROTOCOL_RESULT_SUCCESS);
+        TEST_CHECK(calls[i].answer.data.get_device_info.info.firmware_version == TEST_FIRMWARE_VERSION);
+    }
+    
+    runtime_teardown(&runtime);
+    bridge_dispatcher_deinit(&dispatcher);
+    
+    TEST_CHECK(histograms.handling_us.count == (TEST_WINDOW * 2));
+}
+
+static const test_case_t m_tests[] =
+{
+    { "checksum_check_value",     checksum_check_value_test },
+    { "blocking_calls",           blocking_calls_test },
+    { "negotiation",              negotiation_test },
+    { "answer_cache",             answer_cache_test },
+    { "transfer_chunks",          transfer_chunks_test },
+    { "transfer_empty",           transfer_empty_test },
+    { "transfer_out_of_order",    transfer_out_of_order_test },
+    { "transfer_retransmission",  transfer_retransmission_test },
+    { "transfer_agreed_limits",   transfer_agreed_limits_test },
+    { "runtime_tagged_window",    runtime_tagged_window_test },
+    { "sync_skipped_data",        sync_skipped_data_test },
+    { "sync_peer_recovery",       sync_peer_recovery_test },
+    { "dispatcher_handling_time", dispatcher_handling_time_test },
+};
+
+int main(int argc, char ** argv)
+{
+    uint32_t failed = 0;
+    
+    for (size_t i = 0; i < (sizeof(m_tests) / sizeof(m_tests[0])); i++)
+    {
+        if ((argc > 1) && (strcmp(argv[1], m_tests[i].name) != 0))
+        {
+            continue;
+        }
+        
+        m_failed_checks = 0;
+        m_tests[i].run();
+        
+        printf("%-24s %s\n", m_tests[i].name, (m_failed_checks == 0) ? "passed" : "FAILED");
+        failed += (m_failed_checks == 0) ? 0 : 1;
+    }
+    
+    return (int)failed;
+}
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bridge_loopback.h"
+#include <string.h>
+#include <time.h>
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Waits for ring change until deadline, NULL deadline waits forever. Mutex is held by caller
+static bool ring_changed_wait(bridge_loopback_t * loopback,
+                              bridge_loopback_ring_t * ring,
+                              const struct timespec * deadline)
+{
+    if (deadline == NULL)
+    {
+        pthread_cond_wait(&ring->changed, &loopback->mutex);
+        return true;
+    }
+    
+    return (pthread_cond_timedwait(&ring->changed, &loopback->mutex, deadline) == 0);
+}
+
+static bridge_callback_result_t loopback_read(void * user,
+                                              uint8_t * data,
+                                              uint16_t max_len,
+                                              uint16_t * out_len,
+                                              uint32_t timeout_ms)
+{
+    bridge_loopback_end_t * end = (bridge_loopback_end_t*)user;
+    bridge_loopback_t * loopback = end->loopback;
+    bridge_loopback_ring_t * ring = end->rx;
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    
+    pthread_mutex_lock(&loopback->mutex);
+    
+    while ((ring->count == 0) && (loopback->closed == false))
+    {
+        if (ring_changed_wait(loopback, ring, (timeout_ms == UINT32_MAX) ? NULL : &deadline) == false)
+        {
+            //Data may have arrived together with the timeout
+            if (ring->count == 0)
+            {
+                pthread_mutex_unlock(&loopback->mutex);
+                return BRIDGE_CALLBACK_RESULT_READ_TIMEOUT;
+            }
+        }
+    }
+    
+    if (loopback->closed)
+    {
+        pthread_mutex_unlock(&loopback->mutex);
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+    }
+    
+    //Ring is copied in up to two parts, the second one starts at the beginning of the buffer
+    uint32_t len = (ring->count < max_len) ? ring->count : max_len;
+    uint32_t first_len = BRIDGE_LOOPBACK_RING_SIZE - ring->head;
+    first_len = (first_len < len) ? first_len : len;
+    
+    memcpy(data, &ring->buffer[ring->head], first_len);
+    memcpy(&data[first_len], &ring->buffer[0], len - first_len);
+    
+    ring->head = (ring->head + len) % BRIDGE_LOOPBACK_RING_SIZE;
+    ring->count -= len;
+    
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&loopback->mutex);
+    
+    *out_len = (uint16_t)len;
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+//Chunks are written as a whole, writer waits for room in the ring as long as needed
+static bridge_callback_result_t loopback_write_vector(void * user,
+                                                      const bridge_write_chunk_t * chunks,
+                                                      uint8_t chunks_count)
+{
+    bridge_loopback_end_t * end = (bridge_loopback_end_t*)user;
+    bridge_loopback_t * loopback = end->loopback;
+    bridge_loopback_ring_t * ring = end->tx;
+    
+    pthread_mutex_lock(&loopback->mutex);
+    
+    for (uint8_t i = 0; i < chunks_count; i++)
+    {
+        uint32_t written = 0;
+        while (written < chunks[i].data_len)
+        {
+            while ((ring->count == BRIDGE_LOOPBACK_RING_SIZE) && (loopback->closed == false))
+            {
+                ring_changed_wait(loopback, ring, NULL);
+            }
+            
+            if (loopback->closed)
+            {
+                pthread_mutex_unlock(&loopback->mutex);
+                return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+            }
+            
+            uint32_t tail = (ring->head + ring->count) % BRIDGE_LOOPBACK_RING_SIZE;
+            uint32_t len = chunks[i].data_len - written;
+            uint32_t room = BRIDGE_LOOPBACK_RING_SIZE - ring->count;
+            uint32_t contiguous = BRIDGE_LOOPBACK_RING_SIZE - tail;
+            len = (len < room) ? len : room;
+            len = (len < contiguous) ? len : contiguous;
+            
+            memcpy(&ring->buffer[tail], &chunks[i].data[written], len);
+            ring->count += len;
+            written += len;
+            
+            pthread_cond_broadcast(&ring->changed);
+        }
+    }
+    
+    pthread_mutex_unlock(&loopback->mutex);
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t loopback_write(void * user,
+                                               const uint8_t * data,
+                                               uint16_t data_len)
+{
+    bridge_write_chunk_t chunk = { .data = data, .data_len = data_len };
+    
+    return loopback_write_vector(user, &chunk, 1);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool bridge_loopback_init(bridge_loopback_t * loopback)
+{
+    memset(loopback, 0, sizeof(*loopback));
+    
+    if (pthread_mutex_init(&loopback->mutex, NULL) != 0)
+    {
+        return false;
+    }
+    
+    //Read timeouts are measured by monotonic clock, so they don't jump with the wall clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        if (pthread_cond_init(&loopback->rings[i].changed, &attr) != 0)
+        {
+            if (i > 0)
+            {
+                pthread_cond_destroy(&loopback->rings[0].changed);
+            }
+            
+            pthread_condattr_destroy(&attr);
+            pthread_mutex_destroy(&loopback->mutex);
+            return false;
+        }
+        
+        loopback->ends[i].loopback = loopback;
+        loopback->ends[i].rx = &loopback->rings[i];
+        loopback->ends[i].tx = &loopback->rings[1 - i];
+    }
+    
+    pthread_condattr_destroy(&attr);
+    
+    return true;
+}
+
+void bridge_loopback_deinit(bridge_loopback_t * loopback)
+{
+    pthread_cond_destroy(&loopback->rings[0].changed);
+    pthread_cond_destroy(&loopback->rings[1].changed);
+    pthread_mutex_destroy(&loopback->mutex);
+}
+
+void bridge_loopback_link_init(bridge_loopback_t * loopback,
+                               uint8_t end,
+                               bridge_link_t * link)
+{
+    bridge_link_init(link, loopback_read, loopback_write, &loopback->ends[end & 1]);
+    link->write_vector = loopback_write_vector;
+}
+
+void bridge_loopback_close(bridge_loopback_t * loopback)
+{
+    pthread_mutex_lock(&loopback->mutex);
+    
+    loopback->closed = true;
+    pthread_cond_broadcast(&loopback->rings[0].changed);
+    pthread_cond_broadcast(&loopback->rings[1].changed);
+    
+    pthread_mutex_unlock(&loopback->mutex);
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef _BRIDGE_LOOPBACK_H_
+#define _BRIDGE_LOOPBACK_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_loopback In-process loopback transport (POSIX threads)
+ *
+ * @brief Two links of one process joined by ring buffers, one per direction. Client and server run
+ * in different threads, everything written by one side is read by the other one. There is no bus,
+ * so the cost of the protocol itself is measured and tests need no hardware.
+ *
+ * Write blocks while the ring is full, read blocks until data arrives or timeout expires.
+ * bridge_loopback_close() wakes both sides up, all their calls fail with IO_ERROR after that.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "protocol/bridge_protocol.h"
+
+#ifndef BRIDGE_LOOPBACK_RING_SIZE
+#define BRIDGE_LOOPBACK_RING_SIZE   4096                        /**< Bytes buffered in one direction. */
+#endif
+
+/**@brief One direction of loopback. */
+typedef struct
+{
+    //Internal fields
+    uint8_t buffer[BRIDGE_LOOPBACK_RING_SIZE];
+    uint32_t head;                                              //Read position
+    uint32_t count;                                             //Bytes buffered
+    pthread_cond_t changed;                                     //Data written or read
+} bridge_loopback_ring_t;
+
+/**@brief End of loopback, user data pointer of its link. */
+typedef struct bridge_loopback_end_s
+{
+    //Internal fields
+    struct bridge_loopback_s * loopback;
+    bridge_loopback_ring_t * rx;
+    bridge_loopback_ring_t * tx;
+} bridge_loopback_end_t;
+
+/**@brief Loopback instance. Fields are internal, use bridge_loopback_*() functions only. */
+typedef struct bridge_loopback_s
+{
+    pthread_mutex_t mutex;
+    bridge_loopback_ring_t rings[2];
+    bridge_loopback_end_t ends[2];
+    bool closed;
+} bridge_loopback_t;
+
+/**@brief Initialize loopback.
+ *
+ * @param[out] loopback Loopback instance.
+ *
+ * @retval true  Loopback initialized.
+ * @retval false Synchronization primitives can't be created.
+ */
+bool bridge_loopback_init(bridge_loopback_t * loopback);
+
+/**@brief Release loopback resources. Links of both ends should not be used any more.
+ *
+ * @param[in] loopback Loopback instance.
+ */
+void bridge_loopback_deinit(bridge_loopback_t * loopback);
+
+/**@brief Initialize link of one end of loopback.
+ *
+ * @param[in]  loopback Loopback instance.
+ * @param[in]  end      End of loopback, 0 or 1. Data written to one end is read from the other one.
+ * @param[out] link     Link context, initialized by bridge_link_init() with loopback callbacks.
+ */
+void bridge_loopback_link_init(bridge_loopback_t * loopback,
+                               uint8_t end,
+                               bridge_link_t * link);
+
+/**@brief Close loopback. Blocked calls of both ends return IO_ERROR, so threads serving them may stop.
+ *
+ * @param[in] loopback Loopback instance.
+ */
+void bridge_loopback_close(bridge_loopback_t * loopback);
+
+#endif
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+
+#include "bridge_pty.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NS_PER_S        1000000000ull
+#define BITS_PER_BYTE   10                                      //Start bit, 8 data bits, stop bit
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static uint64_t time_ns_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return ((uint64_t)now.tv_sec * NS_PER_S) + (uint64_t)now.tv_nsec;
+}
+
+//Waits until bytes written before and data_len new ones would have left the line
+static void throttle(bridge_pty_end_t * end,
+                     uint32_t data_len)
+{
+    uint64_t now = time_ns_get();
+    uint64_t start = (end->busy_until_ns > now) ? end->busy_until_ns : now;
+    end->busy_until_ns = start + (((uint64_t)data_len * BITS_PER_BYTE * NS_PER_S) / end->baud);
+    
+    struct timespec until =
+    {
+        .tv_sec = (time_t)(end->busy_until_ns / NS_PER_S),
+        .tv_nsec = (long)(end->busy_until_ns % NS_PER_S)
+    };
+    
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+    {
+    }
+}
+
+static bridge_callback_result_t pty_read(void * user,
+                                         uint8_t * data,
+                                         uint16_t max_len,
+                                         uint16_t * out_len,
+                                         uint32_t timeout_ms)
+{
+    bridge_pty_end_t * end = (bridge_pty_end_t*)user;
+    
+    struct pollfd fds[2] =
+    {
+        { .fd = end->fd, .events = POLLIN },
+        { .fd = end->wake_fd, .events = POLLIN }
+    };
+    
+    int timeout = (timeout_ms > INT32_MAX) ? -1 : (int)timeout_ms;
+    int ready;
+    do
+    {
+        ready = poll(fds, 2, timeout);
+    } while ((ready < 0) && (errno == EINTR));
+    
+    if ((ready < 0) || (fds[1].revents != 0))
+    {
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+    }
+    
+    if (ready == 0)
+    {
+        return BRIDGE_CALLBACK_RESULT_READ_TIMEOUT;
+    }
+    
+    ssize_t received = read(end->fd, data, max_len);
+    if (received <= 0)
+    {
+        return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+    }
+    
+    *out_len = (uint16_t)received;
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t pty_write_vector(void * user,
+                                                 const bridge_write_chunk_t * chunks,
+                                                 uint8_t chunks_count)
+{
+    bridge_pty_end_t * end = (bridge_pty_end_t*)user;
+    
+    if (end->baud > 0)
+    {
+        uint32_t data_len = 0;
+        for (uint8_t i = 0; i < chunks_count; i++)
+        {
+            data_len += chunks[i].data_len;
+        }
+        
+        throttle(end, data_len);
+    }
+    
+    for (uint8_t i = 0; i < chunks_count; i++)
+    {
+        uint16_t written = 0;
+        while (written < chunks[i].data_len)
+        {
+            ssize_t result = write(end->fd, &chunks[i].data[written], chunks[i].data_len - written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                
+                return BRIDGE_CALLBACK_RESULT_IO_ERROR;
+            }
+            
+            written += (uint16_t)result;
+        }
+    }
+    
+    return BRIDGE_CALLBACK_RESULT_SUCCESS;
+}
+
+static bridge_callback_result_t pty_write(void * user,
+                                          const uint8_t * data,
+                                          uint16_t data_len)
+{
+    bridge_write_chunk_t chunk = { .data = data, .data_len = data_len };
+    
+    return pty_write_vector(user, &chunk, 1);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool bridge_pty_init(bridge_pty_t * pty,
+                     uint32_t baud)
+{
+    memset(pty, 0, sizeof(*pty));
+    
+    if (pipe2(pty->wake_fds, O_CLOEXEC) < 0)
+    {
+        return false;
+    }
+    
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if ((master_fd < 0) || (grantpt(master_fd) < 0) || (unlockpt(master_fd) < 0))
+    {
+        int error = errno;
+        if (master_fd >= 0)
+        {
+            close(master_fd);
+        }
+        close(pty->wake_fds[0]);
+        close(pty->wake_fds[1]);
+        errno = error;
+        return false;
+    }
+    
+    int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave_fd < 0)
+    {
+        int error = errno;
+        close(master_fd);
+        close(pty->wake_fds[0]);
+        close(pty->wake_fds[1]);
+        errno = error;
+        return false;
+    }
+    
+    //No echo, no line editing, no translation of bytes
+    struct termios tio;
+    tcgetattr(slave_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave_fd, TCSANOW, &tio);
+    
+    pty->ends[0].fd = master_fd;
+    pty->ends[1].fd = slave_fd;
+    
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        pty->ends[i].wake_fd = pty->wake_fds[0];
+        pty->ends[i].baud = baud;
+    }
+    
+    return true;
+}
+
+void bridge_pty_deinit(bridge_pty_t * pty)
+{
+    close(pty->ends[1].fd);
+    close(pty->ends[0].fd);
+    close(pty->wake_fds[0]);
+    close(pty->wake_fds[1]);
+}
+
+void bridge_pty_link_init(bridge_pty_t * pty,
+                          uint8_t end,
+                          bridge_link_t * link)
+{
+    bridge_link_init(link, pty_read, pty_write, &pty->ends[end & 1]);
+    link->write_vector = pty_write_vector;
+}
+
+void bridge_pty_close(bridge_pty_t * pty)
+{
+    //Pipe is never read, so it stays readable for every poll of both ends
+    const uint8_t byte = 0;
+    while ((write(pty->wake_fds[1], &byte, 1) < 0) && (errno == EINTR))
+    {
+    }
+}
\ No newline at end of file
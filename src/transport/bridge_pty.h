@@ -0,0 +1,77 @@
+#ifndef _BRIDGE_PTY_H_
+#define _BRIDGE_PTY_H_
+
+/**
+ * @ingroup bridge_protocol
+ *
+ * @defgroup bridge_pty Pseudo terminal transport (Linux)
+ *
+ * @brief Two links joined by a pty pair in raw mode. Bytes pass the kernel tty layer like on a real
+ * serial port, so system calls and scheduling are measured too. Master side is end 0, slave side is end 1.
+ *
+ * pty has no baud rate of its own, optional throttle makes writer wait as long as the bytes take
+ * on a UART with the given baud rate (10 bits per byte), so timeouts and throughput of slow buses
+ * can be tried without hardware.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "protocol/bridge_protocol.h"
+
+/**@brief End of pty pair, user data pointer of its link. */
+typedef struct
+{
+    //Internal fields
+    int fd;
+    int wake_fd;                                                //Readable when pty pair is closed
+    uint32_t baud;                                              //0 if not throttled
+    uint64_t busy_until_ns;                                     //When the last written byte leaves the line
+} bridge_pty_end_t;
+
+/**@brief pty pair. Use bridge_pty_*() functions only. */
+typedef struct
+{
+    //Internal fields
+    bridge_pty_end_t ends[2];
+    int wake_fds[2];                                            //Pipe written by bridge_pty_close()
+} bridge_pty_t;
+
+/**@brief Open pty pair.
+ *
+ * @param[out] pty  pty pair.
+ * @param[in]  baud Baud rate both ends are throttled to, 0 disables throttle.
+ *
+ * @retval true  pty pair opened.
+ * @retval false pty pair can't be opened, errno holds the reason.
+ */
+bool bridge_pty_init(bridge_pty_t * pty,
+                     uint32_t baud);
+
+/**@brief Close descriptors of pty pair. Links of both ends should not be used any more.
+ *
+ * @param[in] pty pty pair.
+ */
+void bridge_pty_deinit(bridge_pty_t * pty);
+
+/**@brief Initialize link of one end of pty pair.
+ *
+ * @param[in]  pty  pty pair.
+ * @param[in]  end  End of pty pair, 0 (master) or 1 (slave).
+ * @param[out] link Link context, initialized by bridge_link_init() with pty callbacks.
+ */
+void bridge_pty_link_init(bridge_pty_t * pty,
+                          uint8_t end,
+                          bridge_link_t * link);
+
+/**@brief Close pty pair. Blocked reads of both ends return IO_ERROR, so threads serving them may stop.
+ *        Descriptors stay open until bridge_pty_deinit().
+ *
+ * @param[in] pty pty pair.
+ */
+void bridge_pty_close(bridge_pty_t * pty);
+
+#endif
+
+/** @} */
\ No newline at end of file